@@ -9,6 +9,7 @@ JitterBufferMeter::JitterBufferMeter()
 {
     jitterColor = Colour::fromHSV(0.9f, 0.15f, 0.3f, 1.0f); //Colour::fromHSV(0.9f, 0.3f, 0.4f, 1.0f);
     barColor = jitterColor.withAlpha(0.7f);
+    markerColor = Colour::fromHSV(0.12f, 0.6f, 0.8f, 0.8f);
     //fixedColor = Colour::fromFloatRGBA(0.6f, 0.2f, 0.6f, 1.0f);
     setInterceptsMouseClicks(false, false);
 }
@@ -34,6 +35,14 @@ void JitterBufferMeter::setFillRatio (float ratio, float stdev)
     }
 }
 
+void JitterBufferMeter::setJitterRatio (float ratio)
+{
+    if (fabsf(ratio - _jitterRatio) > 0.005f) {
+        _jitterRatio = ratio;
+        repaint();
+    }
+}
+
 
 void JitterBufferMeter::paint (Graphics& g)
 {
@@ -73,7 +82,13 @@ void JitterBufferMeter::paint (Graphics& g)
     g.setColour(jitterColor);
     g.fillRoundedRectangle(edgebox, radius);
     //g.fillRect(edgebox);
-    
+
+    if (_jitterRatio >= 0.0f) {
+        // marker where the buffer would just cover the measured jitter
+        float xpos = jlimit(1.0f, width - 2.0f, width * _jitterRatio);
+        g.setColour(markerColor);
+        g.fillRect(xpos, 1.0f, 1.5f, height - 2.0f);
+    }
 }
 
 void JitterBufferMeter::resized()
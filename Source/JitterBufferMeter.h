@@ -17,15 +17,19 @@ public:
 
     void setRecvMode(bool recvmode);
     void setFillRatio (float ratio, float stdev);
+    // position of the measured 99th percentile of the arrival jitter, relative to the buffer size, negative hides it
+    void setJitterRatio (float ratio);
     
 private:
 
     bool  _recvmode = true;
     float _ratio = 0.0f;
     float _stdev = 0.0f;
+    float _jitterRatio = -1.0f;
     
     Colour  jitterColor;
     Colour  barColor;
+    Colour  markerColor;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (JitterBufferMeter)
 };
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2020 Jesse Chappell
+
+
+#pragma once
+
+#include "aoo/aoo.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+// how long an idle latency/echo pair is kept around after its test ended
+#define TEST_ENDPOINT_RELEASE_DELAY_MS 2000.0
+
+// Bookkeeping for the latency and echo AOO sink/source pairs of a peer, which
+// only exist while a latency test needs them: the latency pair for our own test,
+// the echo pair for the remote's. Peer is anything with the latencysink/source,
+// echosink/source, latencyReleaseTimeMs/echoReleaseTimeMs and activeLatencyTest
+// members of SonobusAudioProcessor::RemotePeer. The caller does the locking, as
+// noted for each function, and creates/destroys the AOO objects outside of it.
+namespace LatencyTestEndpoints {
+
+template <typename Peer>
+aoo::isink::pointer & sinkOf(Peer & peer, bool echo) { return echo ? peer.echosink : peer.latencysink; }
+
+template <typename Peer>
+aoo::isource::pointer & sourceOf(Peer & peer, bool echo) { return echo ? peer.echosource : peer.latencysource; }
+
+template <typename Peer>
+std::atomic<double> & releaseTimeOf(Peer & peer, bool echo) { return echo ? peer.echoReleaseTimeMs : peer.latencyReleaseTimeMs; }
+
+// true if the source message past the address pattern 'onset' is an /invite,
+// i.e. a sink wants one of our sources to start sending to it
+inline bool isInvite(const char * buf, int32_t nbytes, int32_t onset)
+{
+    return onset > 0 && nbytes - onset >= AOO_MSG_INVITE_LEN
+        && !std::memcmp(buf + onset, AOO_MSG_INVITE, AOO_MSG_INVITE_LEN);
+}
+
+// read lock: the pair is needed (again), cancels a pending release.
+// returns true if it is there already.
+template <typename Peer>
+bool retain(Peer & peer, bool echo)
+{
+    releaseTimeOf(peer, echo) = 0.0;
+    return sinkOf(peer, echo) != nullptr;
+}
+
+// write lock: hands a new pair to the peer, unless somebody else was first,
+// then it is left in 'sink' and 'source' to be destroyed after unlocking
+template <typename Peer>
+bool install(Peer & peer, bool echo, aoo::isink::pointer & sink, aoo::isource::pointer & source)
+{
+    auto & peersink = sinkOf(peer, echo);
+    if (peersink) return false;
+
+    peersink = std::move(sink);
+    sourceOf(peer, echo) = std::move(source);
+    return true;
+}
+
+// read lock: the test is over, the pair goes after a while so the uninvite can still go out
+template <typename Peer>
+void scheduleRelease(Peer & peer, bool echo, double nowms)
+{
+    releaseTimeOf(peer, echo) = nowms + TEST_ENDPOINT_RELEASE_DELAY_MS;
+}
+
+template <typename Peer>
+bool isReleaseDue(Peer & peer, bool echo, double nowms)
+{
+    if (!sinkOf(peer, echo) || (!echo && peer.activeLatencyTest)) return false;
+    const double when = releaseTimeOf(peer, echo).load();
+    return when > 0.0 && nowms > when;
+}
+
+// read lock
+template <typename Peer>
+bool anyReleaseDue(Peer & peer, double nowms)
+{
+    return isReleaseDue(peer, false, nowms) || isReleaseDue(peer, true, nowms);
+}
+
+// write lock: moves the pairs whose time has come out of the peer, to be
+// destroyed after unlocking. returns the number of pairs.
+template <typename Peer>
+int takeDue(Peer & peer, double nowms, std::vector<aoo::isink::pointer> & sinks, std::vector<aoo::isource::pointer> & sources)
+{
+    int count = 0;
+    for (bool echo : { false, true }) {
+        if (isReleaseDue(peer, echo, nowms)) {
+            sinks.push_back(std::move(sinkOf(peer, echo)));
+            sources.push_back(std::move(sourceOf(peer, echo)));
+            releaseTimeOf(peer, echo) = 0.0;
+            ++count;
+        }
+    }
+    return count;
+}
+
+}
@@ -168,6 +168,31 @@ OptionsView::OptionsView(SonobusAudioProcessor& proc, std::function<AudioDeviceM
     configLabel(mOptionsLanguageLabel.get(), false);
     mOptionsLanguageLabel->setJustificationType(Justification::centredRight);
 
+    mOptionsResampleQualityChoice = std::make_unique<SonoChoiceButton>();
+    mOptionsResampleQualityChoice->setTitle(TRANS("Resampling Quality"));
+    mOptionsResampleQualityChoice->addChoiceListener(this);
+    mOptionsResampleQualityChoice->addItem(TRANS("Linear (lowest CPU)"), AOO_RESAMPLE_LINEAR);
+    mOptionsResampleQualityChoice->addItem(TRANS("Cubic"), AOO_RESAMPLE_CUBIC);
+    mOptionsResampleQualityChoice->addItem(TRANS("Short Sinc"), AOO_RESAMPLE_SINC_SHORT);
+    mOptionsResampleQualityChoice->addItem(TRANS("Long Sinc (best)"), AOO_RESAMPLE_SINC_LONG);
+
+    mOptionsResampleQualityLabel = std::make_unique<Label>("", TRANS("Resampling Quality:"));
+    configLabel(mOptionsResampleQualityLabel.get(), false);
+    mOptionsResampleQualityLabel->setJustificationType(Justification::centredRight);
+
+    // ids are in tenths of a percent
+    mOptionsAdaptiveStretchChoice = std::make_unique<SonoChoiceButton>();
+    mOptionsAdaptiveStretchChoice->setTitle(TRANS("Max Playback Speed Change"));
+    mOptionsAdaptiveStretchChoice->addChoiceListener(this);
+    mOptionsAdaptiveStretchChoice->addItem(TRANS("0.5% (slowest)"), 5);
+    mOptionsAdaptiveStretchChoice->addItem(TRANS("1%"), 10);
+    mOptionsAdaptiveStretchChoice->addItem(TRANS("2%"), 20);
+    mOptionsAdaptiveStretchChoice->addItem(TRANS("5% (fastest, audible)"), 50);
+
+    mOptionsAdaptiveStretchLabel = std::make_unique<Label>("", TRANS("Max Speed Change:"));
+    configLabel(mOptionsAdaptiveStretchLabel.get(), false);
+    mOptionsAdaptiveStretchLabel->setJustificationType(Justification::centredRight);
+
 
     //mOptionsHearLatencyButton = std::make_unique<ToggleButton>(TRANS("Make Latency Test Audible"));
     //mOptionsHearLatencyButton->addListener(this);
@@ -254,6 +279,12 @@ OptionsView::OptionsView(SonobusAudioProcessor& proc, std::function<AudioDeviceM
     mOptionsDisableShortcutButton = std::make_unique<ToggleButton>(TRANS("Disable keyboard shortcuts"));
     mOptionsDisableShortcutButton->addListener(this);
 
+    mOptionsParallelPeerProcButton = std::make_unique<ToggleButton>(TRANS("Process users on multiple cores"));
+    mOptionsParallelPeerProcButton->addListener(this);
+
+    mOptionsAdaptiveNetBufButton = std::make_unique<ToggleButton>(TRANS("Continuously adapt jitter buffer latency"));
+    mOptionsAdaptiveNetBufButton->addListener(this);
+
 #if JUCE_IOS
     if (JUCEApplicationBase::isStandaloneApp()) {
         mOptionsAllowBluetoothInput = std::make_unique<ToggleButton>(TRANS("Allow Bluetooth Input"));
@@ -360,6 +391,10 @@ OptionsView::OptionsView(SonobusAudioProcessor& proc, std::function<AudioDeviceM
     mOptionsComponent->addAndMakeVisible(mVersionLabel.get());
     mOptionsComponent->addAndMakeVisible(mOptionsLanguageChoice.get());
     mOptionsComponent->addAndMakeVisible(mOptionsLanguageLabel.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsResampleQualityChoice.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsResampleQualityLabel.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsAdaptiveStretchChoice.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsAdaptiveStretchLabel.get());
     mOptionsComponent->addAndMakeVisible(mOptionsAutoDropThreshSlider.get());
     mOptionsComponent->addAndMakeVisible(mOptionsAutoDropThreshLabel.get());
 
@@ -379,6 +414,8 @@ OptionsView::OptionsView(SonobusAudioProcessor& proc, std::function<AudioDeviceM
     }
     mOptionsComponent->addAndMakeVisible(mOptionsSliderSnapToMouseButton.get());
     mOptionsComponent->addAndMakeVisible(mOptionsDisableShortcutButton.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsParallelPeerProcButton.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsAdaptiveNetBufButton.get());
 
 
 
@@ -620,6 +657,11 @@ void OptionsView::updateState(bool ignorecheck)
 
     mOptionsSliderSnapToMouseButton->setToggleState(processor.getSlidersSnapToMousePosition(), dontSendNotification);
     mOptionsDisableShortcutButton->setToggleState(processor.getDisableKeyboardShortcuts(), dontSendNotification);
+    mOptionsParallelPeerProcButton->setToggleState(processor.getParallelPeerProcessing(), dontSendNotification);
+    mOptionsResampleQualityChoice->setSelectedId(processor.getResampleQuality(), dontSendNotification);
+    mOptionsAdaptiveNetBufButton->setToggleState(processor.getAdaptiveNetBuffer(), dontSendNotification);
+    mOptionsAdaptiveStretchChoice->setSelectedId(roundToInt(processor.getAdaptiveNetBufferMaxStretch() * 1000.0f), dontSendNotification);
+    mOptionsAdaptiveStretchChoice->setEnabled(processor.getAdaptiveNetBuffer());
 
     uint32 recmask = processor.getDefaultRecordingOptions();
 
@@ -775,6 +817,26 @@ void OptionsView::updateLayout()
     optionsDisableShortcutsBox.items.add(FlexItem(180, minpassheight, *mOptionsDisableShortcutButton).withMargin(0).withFlex(1));
 
 
+    optionsResampleQualityBox.items.clear();
+    optionsResampleQualityBox.flexDirection = FlexBox::Direction::row;
+    optionsResampleQualityBox.items.add(FlexItem(minButtonWidth, minitemheight, *mOptionsResampleQualityLabel).withMargin(0).withFlex(1));
+    optionsResampleQualityBox.items.add(FlexItem(minButtonWidth, minitemheight, *mOptionsResampleQualityChoice).withMargin(0).withFlex(1));
+
+    optionsAdaptiveNetbufBox.items.clear();
+    optionsAdaptiveNetbufBox.flexDirection = FlexBox::Direction::row;
+    optionsAdaptiveNetbufBox.items.add(FlexItem(10, 12).withFlex(0));
+    optionsAdaptiveNetbufBox.items.add(FlexItem(180, minpassheight, *mOptionsAdaptiveNetBufButton).withMargin(0).withFlex(1));
+
+    optionsAdaptiveStretchBox.items.clear();
+    optionsAdaptiveStretchBox.flexDirection = FlexBox::Direction::row;
+    optionsAdaptiveStretchBox.items.add(FlexItem(minButtonWidth, minitemheight, *mOptionsAdaptiveStretchLabel).withMargin(0).withFlex(1));
+    optionsAdaptiveStretchBox.items.add(FlexItem(minButtonWidth, minitemheight, *mOptionsAdaptiveStretchChoice).withMargin(0).withFlex(1));
+
+    optionsParallelPeerProcBox.items.clear();
+    optionsParallelPeerProcBox.flexDirection = FlexBox::Direction::row;
+    optionsParallelPeerProcBox.items.add(FlexItem(10, 12).withFlex(0));
+    optionsParallelPeerProcBox.items.add(FlexItem(180, minpassheight, *mOptionsParallelPeerProcButton).withMargin(0).withFlex(1));
+
     optionsAllowBluetoothBox.items.clear();
     optionsAllowBluetoothBox.flexDirection = FlexBox::Direction::row;
     if (mOptionsAllowBluetoothInput) {
@@ -803,6 +865,8 @@ void OptionsView::updateLayout()
     optionsBox.items.add(FlexItem(100, minitemheight, optionsNetbufBox).withMargin(2).withFlex(0));
     optionsBox.items.add(FlexItem(4, 3));
     optionsBox.items.add(FlexItem(100, minitemheight, optionsAutoDropThreshBox).withMargin(2).withFlex(0));
+    optionsBox.items.add(FlexItem(100, minpassheight, optionsAdaptiveNetbufBox).withMargin(2).withFlex(0));
+    optionsBox.items.add(FlexItem(100, minitemheight, optionsAdaptiveStretchBox).withMargin(2).withFlex(0));
     optionsBox.items.add(FlexItem(4, 10));
     optionsBox.items.add(FlexItem(100, minitemheight, optionsDefaultLevelBox).withMargin(2).withFlex(0));
     optionsBox.items.add(FlexItem(4, 6));
@@ -819,7 +883,9 @@ void OptionsView::updateLayout()
         optionsBox.items.add(FlexItem(100, minpassheight, optionsCheckForUpdateBox).withMargin(2).withFlex(0));
     }
     optionsBox.items.add(FlexItem(100, minpassheight, optionsDisableShortcutsBox).withMargin(2).withFlex(0));
+    optionsBox.items.add(FlexItem(100, minpassheight, optionsParallelPeerProcBox).withMargin(2).withFlex(0));
     optionsBox.items.add(FlexItem(100, minpassheight, optionsDynResampleBox).withMargin(2).withFlex(0));
+    optionsBox.items.add(FlexItem(100, minitemheight, optionsResampleQualityBox).withMargin(2).withFlex(0));
 
     if ( ! JUCEApplicationBase::isStandaloneApp()) {
         optionsBox.items.add(FlexItem(100, minitemheight, optionsPluginDefaultBox).withMargin(2).withFlex(0));
@@ -1130,6 +1196,13 @@ void OptionsView::buttonClicked (Button* buttonThatWasClicked)
             //}
         }
     }
+    else if (buttonThatWasClicked == mOptionsParallelPeerProcButton.get()) {
+        processor.setParallelPeerProcessing(mOptionsParallelPeerProcButton->getToggleState());
+    }
+    else if (buttonThatWasClicked == mOptionsAdaptiveNetBufButton.get()) {
+        processor.setAdaptiveNetBuffer(mOptionsAdaptiveNetBufButton->getToggleState());
+        mOptionsAdaptiveStretchChoice->setEnabled(mOptionsAdaptiveNetBufButton->getToggleState());
+    }
     else if (buttonThatWasClicked == mOptionsSliderSnapToMouseButton.get()) {
         bool newval = mOptionsSliderSnapToMouseButton->getToggleState();
         processor.setSlidersSnapToMousePosition(newval);
@@ -1171,6 +1244,12 @@ void OptionsView::choiceButtonSelected(SonoChoiceButton *comp, int index, int id
     else if (comp == mRecBitsChoice.get()) {
         processor.setDefaultRecordingBitsPerSample(ident);
     }
+    else if (comp == mOptionsResampleQualityChoice.get()) {
+        processor.setResampleQuality(ident);
+    }
+    else if (comp == mOptionsAdaptiveStretchChoice.get()) {
+        processor.setAdaptiveNetBufferMaxStretch(ident * 0.001f);
+    }
     else if (comp == mOptionsLanguageChoice.get()) {
         String code = codes[ident];
         //app->mainConfig.languageOverrideCode =  codes[comp->getRowId()].toStdString();
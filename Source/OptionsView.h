@@ -136,6 +136,8 @@ protected:
     std::unique_ptr<ToggleButton> mOptionsSliderSnapToMouseButton;
     std::unique_ptr<ToggleButton> mOptionsAllowBluetoothInput;
     std::unique_ptr<ToggleButton> mOptionsDisableShortcutButton;
+    std::unique_ptr<ToggleButton> mOptionsParallelPeerProcButton;
+    std::unique_ptr<ToggleButton> mOptionsAdaptiveNetBufButton;
     std::unique_ptr<TextButton> mOptionsSavePluginDefaultButton;
     std::unique_ptr<TextButton> mOptionsResetPluginDefaultButton;
 
@@ -147,7 +149,11 @@ protected:
     std::unique_ptr<Slider> mOptionsAutoDropThreshSlider;
 
     std::unique_ptr<SonoChoiceButton> mOptionsLanguageChoice;
+    std::unique_ptr<SonoChoiceButton> mOptionsResampleQualityChoice;
     std::unique_ptr<Label> mOptionsLanguageLabel;
+    std::unique_ptr<Label> mOptionsResampleQualityLabel;
+    std::unique_ptr<SonoChoiceButton> mOptionsAdaptiveStretchChoice;
+    std::unique_ptr<Label> mOptionsAdaptiveStretchLabel;
 
 
     std::unique_ptr<Label> mOptionsRecFilesStaticLabel;
@@ -180,6 +186,10 @@ protected:
     FlexBox optionsAutoReconnectBox;
     FlexBox optionsSnapToMouseBox;
     FlexBox optionsDisableShortcutsBox;
+    FlexBox optionsParallelPeerProcBox;
+    FlexBox optionsResampleQualityBox;
+    FlexBox optionsAdaptiveNetbufBox;
+    FlexBox optionsAdaptiveStretchBox;
     FlexBox optionsDefaultLevelBox;
     FlexBox optionsLanguageBox;
     FlexBox optionsAllowBluetoothBox;
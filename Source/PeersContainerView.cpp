@@ -578,6 +578,28 @@ PeerViewInfo * PeersContainerView::createPeerViewInfo()
     pvf->changeAllRecvFormatButton->addListener(this);
     pvf->changeAllRecvFormatButton->setLookAndFeel(&pvf->smallLnf);
 
+    pvf->lossConcealmentChoiceButton = std::make_unique<SonoChoiceButton>();
+    pvf->lossConcealmentChoiceButton->addChoiceListener(this);
+    pvf->lossConcealmentChoiceButton->setTitle(TRANS("Loss Concealment"));
+    pvf->lossConcealmentChoiceButton->addItem(TRANS("Silence"), AOO_LOSS_CONCEAL_NONE);
+    pvf->lossConcealmentChoiceButton->addItem(TRANS("Codec PLC"), AOO_LOSS_CONCEAL_PLC);
+    pvf->lossConcealmentChoiceButton->addItem(TRANS("In-band FEC + PLC"), AOO_LOSS_CONCEAL_FEC);
+    pvf->lossConcealmentChoiceButton->setTooltip(TRANS("How lost audio packets from this user are filled in. In-band FEC only helps if they send with FEC enabled."));
+
+    pvf->staticLossConcealmentLabel = std::make_unique<Label>("lossconcst", TRANS("Loss Concealment"));
+    configLabel(pvf->staticLossConcealmentLabel.get(), LabelTypeRegular);
+    pvf->staticLossConcealmentLabel->setAccessible(false);
+
+    pvf->sendInbandFecButton = std::make_unique<ToggleButton>(TRANS("Send In-band FEC (Opus)"));
+    pvf->sendInbandFecButton->addListener(this);
+    pvf->sendInbandFecButton->setLookAndFeel(&pvf->smallLnf);
+    pvf->sendInbandFecButton->setTooltip(TRANS("Adds forward error correction data to the Opus stream sent to this user, so they can recover lost packets. Uses a bit more bandwidth and latency."));
+
+    pvf->sendParityButton = std::make_unique<ToggleButton>(TRANS("Send Parity FEC"));
+    pvf->sendParityButton->addListener(this);
+    pvf->sendParityButton->setLookAndFeel(&pvf->smallLnf);
+    pvf->sendParityButton->setTooltip(TRANS("Sends a parity packet after every few packets to this user, so they can rebuild one lost packet of each group without waiting for a resend. Works with any format, uses 25% more bandwidth."));
+
 
     pvf->staticLatencyLabel = std::make_unique<Label>("latst", TRANS("Latency (ms)"));
     configLabel(pvf->staticLatencyLabel.get(), LabelTypeSmallDim);
@@ -890,10 +912,14 @@ void PeersContainerView::rebuildPeerViews()
         pvf->recvOptionsContainer->addAndMakeVisible(pvf->remoteSendFormatChoiceButton.get());
         pvf->recvOptionsContainer->addAndMakeVisible(pvf->staticRemoteSendFormatChoiceLabel.get());
         pvf->recvOptionsContainer->addAndMakeVisible(pvf->changeAllRecvFormatButton.get());
+        pvf->recvOptionsContainer->addAndMakeVisible(pvf->lossConcealmentChoiceButton.get());
+        pvf->recvOptionsContainer->addAndMakeVisible(pvf->staticLossConcealmentLabel.get());
 
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->formatChoiceButton.get());
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->changeAllFormatButton.get());
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->staticFormatChoiceLabel.get());
+        pvf->sendOptionsContainer->addAndMakeVisible(pvf->sendInbandFecButton.get());
+        pvf->sendOptionsContainer->addAndMakeVisible(pvf->sendParityButton.get());
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->sendMutedButton.get());
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->optionsRemoveButton.get());
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->optionsBlockButton.get());
@@ -1185,6 +1211,11 @@ void PeersContainerView::updateLayout()
         pvf->optionsRemoteQualityBox.items.add(FlexItem(minButtonWidth, minitemheight, *pvf->remoteSendFormatChoiceButton).withMargin(0).withFlex(2));
         pvf->optionsRemoteQualityBox.items.add(FlexItem(68, minitemheight, *pvf->changeAllRecvFormatButton).withMargin(0).withFlex(0));
 
+        pvf->optionsLossConcealmentBox.items.clear();
+        pvf->optionsLossConcealmentBox.flexDirection = FlexBox::Direction::row;
+        pvf->optionsLossConcealmentBox.items.add(FlexItem(80, minitemheight, *pvf->staticLossConcealmentLabel).withMargin(0).withFlex(0));
+        pvf->optionsLossConcealmentBox.items.add(FlexItem(minButtonWidth, minitemheight, *pvf->lossConcealmentChoiceButton).withMargin(0).withFlex(2));
+
         
         pvf->optionsSendMutedBox.items.clear();
         pvf->optionsSendMutedBox.flexDirection = FlexBox::Direction::row;
@@ -1201,6 +1232,16 @@ void PeersContainerView::updateLayout()
         pvf->optionsChangeAllQualBox.items.add(FlexItem(10, minitemheight-10).withMargin(0).withFlex(1));
         pvf->optionsChangeAllQualBox.items.add(FlexItem(150, minitemheight-10, *pvf->changeAllFormatButton).withMargin(0).withFlex(0));
 
+        pvf->optionsSendFecBox.items.clear();
+        pvf->optionsSendFecBox.flexDirection = FlexBox::Direction::row;
+        pvf->optionsSendFecBox.items.add(FlexItem(10, minitemheight-10).withMargin(0).withFlex(1));
+        pvf->optionsSendFecBox.items.add(FlexItem(180, minitemheight-10, *pvf->sendInbandFecButton).withMargin(0).withFlex(0));
+
+        pvf->optionsSendParityBox.items.clear();
+        pvf->optionsSendParityBox.flexDirection = FlexBox::Direction::row;
+        pvf->optionsSendParityBox.items.add(FlexItem(10, minitemheight-10).withMargin(0).withFlex(1));
+        pvf->optionsSendParityBox.items.add(FlexItem(180, minitemheight-10, *pvf->sendParityButton).withMargin(0).withFlex(0));
+
         
         pvf->optionsbuttbox.items.clear();
         pvf->optionsbuttbox.flexDirection = FlexBox::Direction::row;
@@ -1223,6 +1264,8 @@ void PeersContainerView::updateLayout()
         pvf->recvOptionsBox.items.add(FlexItem(100, minitemheight,  pvf->optionsNetbufBox).withMargin(2).withFlex(0));
         pvf->recvOptionsBox.items.add(FlexItem(4, 2));
         pvf->recvOptionsBox.items.add(FlexItem(100, minitemheight,  pvf->optionsRemoteQualityBox).withMargin(2).withFlex(0));
+        pvf->recvOptionsBox.items.add(FlexItem(4, 2));
+        pvf->recvOptionsBox.items.add(FlexItem(100, minitemheight,  pvf->optionsLossConcealmentBox).withMargin(2).withFlex(0));
         pvf->recvOptionsBox.items.add(FlexItem(4, 8));
         pvf->recvOptionsBox.items.add(FlexItem(100, minitemheight,  pvf->optionsbuttbox).withMargin(2).withFlex(0));
 
@@ -1232,6 +1275,8 @@ void PeersContainerView::updateLayout()
         pvf->sendOptionsBox.items.add(FlexItem(4, 4));
         pvf->sendOptionsBox.items.add(FlexItem(100, minitemheight,  pvf->optionsSendQualBox).withMargin(2).withFlex(0));
         pvf->sendOptionsBox.items.add(FlexItem(100, minitemheight-10,  pvf->optionsChangeAllQualBox).withMargin(2).withFlex(0));
+        pvf->sendOptionsBox.items.add(FlexItem(100, minitemheight-10,  pvf->optionsSendFecBox).withMargin(2).withFlex(0));
+        pvf->sendOptionsBox.items.add(FlexItem(100, minitemheight-10,  pvf->optionsSendParityBox).withMargin(2).withFlex(0));
         pvf->sendOptionsBox.items.add(FlexItem(4, 4));
         pvf->sendOptionsBox.items.add(FlexItem(100, minitemheight, pvf->optionsSendMutedBox).withMargin(0).withFlex(0));
 
@@ -1644,15 +1689,31 @@ void PeersContainerView::updatePeerViews(int specific)
 
         pvf->channelGroups->setPeerMode(true, i);
 
-        bool connected = processor.getRemotePeerConnected(i);
         auto fullmode = pvf->fullMode;
 
-        String hostname;
-        int port = 0;
-        processor.getRemotePeerAddressInfo(i, hostname, port);
+        // there is no snapshot before the first publish, while the index belongs
+        // to a removed peer or if the writer was busy, just keep the last one then
+        SonobusAudioProcessor::PeerTelemetry telem;
+        if (processor.getRemotePeerTelemetry(i, telem)) {
+            if (telem.peerId == pvf->telemetry.peerId && pvf->telemetryTimestampMs > 0 && nowstampms > pvf->telemetryTimestampMs) {
+                double timedelta = (nowstampms - pvf->telemetryTimestampMs) * 1e-3;
+                pvf->sendRate = (telem.bytesSent - pvf->telemetry.bytesSent) / timedelta;
+                pvf->recvRate = (telem.bytesReceived - pvf->telemetry.bytesReceived) / timedelta;
+            }
+            else if (telem.peerId != pvf->telemetry.peerId) {
+                pvf->sendRate = pvf->recvRate = 0.0;
+            }
+            pvf->telemetry = telem;
+            pvf->telemetryTimestampMs = nowstampms;
+        }
+        else {
+            telem = pvf->telemetry;
+        }
+
+        bool connected = telem.connected;
 
         String addrname;
-        addrname << hostname << " : " << port;
+        addrname << String::fromUTF8(telem.hostname) << " : " << telem.port;
 
         if (pvf->addrClicked) {
             pvf->addrLabel->setText(addrname, dontSendNotification);
@@ -1661,31 +1722,19 @@ void PeersContainerView::updatePeerViews(int specific)
         }
 
         String sendtext;
-        bool sendactive = processor.getRemotePeerSendActive(i);
-        bool sendallow = processor.getRemotePeerSendAllow(i);
+        bool sendactive = telem.sendActive;
+        bool sendallow = telem.sendAllow;
 
-        bool recvactive = processor.getRemotePeerRecvActive(i);
-        bool recvallow = processor.getRemotePeerRecvAllow(i);
-        bool latactive = processor.isRemotePeerLatencyTestActive(i);
-        bool safetymuted = processor.getRemotePeerSafetyMuted(i);
-        bool blocked = processor.getRemotePeerBlockedUs(i);
+        bool recvactive = telem.recvActive;
+        bool recvallow = telem.recvAllow;
+        bool latactive = telem.latencyTestActive;
+        bool safetymuted = telem.safetyMuted;
+        bool blocked = telem.blockedUs;
 
-        const int chcnt = processor.getRemotePeerRecvChannelCount(i);
+        const int chcnt = telem.recvChannels;
 
-        double sendrate = 0.0;
-        double recvrate = 0.0;
-        
-        if (lastUpdateTimestampMs > 0) {
-            double timedelta = (nowstampms - lastUpdateTimestampMs) * 1e-3;
-            int64_t nbs = processor.getRemotePeerBytesSent(i);
-            int64_t nbr = processor.getRemotePeerBytesReceived(i);
-            
-            sendrate = (nbs - pvf->lastBytesSent) / timedelta;
-            recvrate = (nbr - pvf->lastBytesRecv) / timedelta;
-            
-            pvf->lastBytesRecv = nbr;
-            pvf->lastBytesSent = nbs;
-        }
+        const double sendrate = pvf->sendRate;
+        const double recvrate = pvf->recvRate;
 
         if (blocked) {
             sendtext += TRANS("Other end BLOCKED us");
@@ -1707,16 +1756,13 @@ void PeersContainerView::updatePeerViews(int specific)
         }
         
         String recvtext;
-        SonobusAudioProcessor::AudioCodecFormatInfo recvfinfo;
-        processor.getRemotePeerReceiveAudioCodecFormat(i, recvfinfo);
-
         if (recvactive) {
             //recvtext << String(juce::CharPointer_UTF8 ("\xe2\x86\x93 ")) // down arrow
             recvtext << chcnt << "ch "
-            << recvfinfo.name
+            << String::fromUTF8(telem.recvFormatName)
             << String::formatted(" | %d kb/s", lrintf(recvrate * 8 * 1e-3));
 
-            int64_t dropped = processor.getRemotePeerPacketsDropped(i);
+            int64_t dropped = telem.packetsDropped;
             if (dropped > 0) {
                 recvtext += String::formatted(" | %d drop", dropped);
             }
@@ -1726,7 +1772,7 @@ void PeersContainerView::updatePeerViews(int specific)
                 pvf->lastDroppedChangedTimestampMs = nowstampms;
             }
 
-            int64_t resent = processor.getRemotePeerPacketsResent(i);
+            int64_t resent = telem.packetsResent;
             if (resent > 0) {
                 recvtext += String::formatted(" | %d resent", resent);
             }
@@ -1784,9 +1830,9 @@ void PeersContainerView::updatePeerViews(int specific)
         pvf->latActiveButton->setToggleState(latactive, dontSendNotification);
 
 
-        bool initCompleted = false;
-        int autobufmode = (int)processor.getRemotePeerAutoresizeBufferMode(i, initCompleted);
-        float buftimeMs = processor.getRemotePeerBufferTime(i);
+        bool initCompleted = telem.autoNetbufInitCompleted;
+        int autobufmode = (int)telem.autosizeBufferMode;
+        float buftimeMs = telem.bufferTimeMs;
         
         pvf->autosizeButton->setSelectedId(autobufmode, dontSendNotification);
         String buflab = (autobufmode == SonobusAudioProcessor::AutoNetBufferModeOff ? "" :
@@ -1795,6 +1841,18 @@ void PeersContainerView::updatePeerViews(int specific)
                          " (Auto)");
         pvf->bufferLabel->setText(String::formatted("%d ms", (int) lrintf(buftimeMs)) + buflab, dontSendNotification);
 
+        if (telem.hasJitterStats && telem.jitterStats.count > 0) {
+            const aoo_jitter_stats & jstats = telem.jitterStats;
+            String jitterstr = TRANS("Arrival Jitter (50/95/99%):") + String::formatted(" %.1f / %.1f / %.1f ms", jstats.p50, jstats.p95, jstats.p99);
+            jitterstr += "\n" + TRANS("Max. Jitter:") + String::formatted(" %.1f ms", jstats.max);
+            jitterstr += "\n" + TRANS("Max. Burst:") + String::formatted(" %d", jstats.max_burst);
+            jitterstr += "\n" + TRANS("Max. Reorder Depth:") + String::formatted(" %d", jstats.max_reorder);
+            jitterstr += "\n" + TRANS("Max. Loss Run:") + String::formatted(" %d", jstats.max_lossrun);
+            pvf->bufferLabel->setTooltip(jitterstr);
+        } else {
+            pvf->bufferLabel->setTooltip("");
+        }
+
         pvf->bufferMinButton->setEnabled(autobufmode != SonobusAudioProcessor::AutoNetBufferModeOff);
         pvf->bufferMinFrontButton->setEnabled(autobufmode != SonobusAudioProcessor::AutoNetBufferModeOff);
 
@@ -1803,13 +1861,16 @@ void PeersContainerView::updatePeerViews(int specific)
             pvf->bufferTimeSlider->setValue(buftimeMs, dontSendNotification);
         }
 
-        pvf->remoteSendFormatChoiceButton->setSelectedId(processor.getRequestRemotePeerSendAudioCodecFormat(i), dontSendNotification);
+        pvf->remoteSendFormatChoiceButton->setSelectedId(telem.reqRemoteSendFormatIndex, dontSendNotification);
+        pvf->lossConcealmentChoiceButton->setSelectedId(telem.lossConcealment, dontSendNotification);
+        pvf->sendInbandFecButton->setToggleState(telem.sendInbandFec, dontSendNotification);
+        pvf->sendParityButton->setToggleState(telem.sendParity, dontSendNotification);
         
         
-        int formatindex = processor.getRemotePeerAudioCodecFormat(i);
+        int formatindex = telem.formatIndex;
         pvf->formatChoiceButton->setSelectedItemIndex(formatindex >= 0 ? formatindex : processor.getDefaultAudioCodecFormat(), dontSendNotification);
         String sendqual;
-        sendqual << processor.getRemotePeerActualSendChannelCount(i) << "ch " << processor.getAudioCodeFormatName(formatindex);
+        sendqual << telem.sendChannels << "ch " << processor.getAudioCodeFormatName(formatindex);
         pvf->sendQualityLabel->setText(sendqual, dontSendNotification);
         
         // pvf->recvMeter->setMeterSource (processor.getRemotePeerRecvMeterSource(i));
@@ -1876,8 +1937,6 @@ void PeersContainerView::updatePeerViews(int specific)
         updateLayout();
         listeners.call (&PeersContainerView::Listener::internalSizesChanged, this);
     }
-    
-    lastUpdateTimestampMs = nowstampms;
 }
 
 void PeersContainerView::startLatencyTest(int di)
@@ -1943,9 +2002,18 @@ void PeersContainerView::timerCallback(int timerId)
             PeerViewInfo * pvf = mPeerViews.getUnchecked(di);
             int i = mPeerUpdateOrdering[di];
 
-            float ratio, stdev;
-            if (processor.getRemotePeerReceiveBufferFillRatio(i, ratio, stdev)) {
-                pvf->jitterBufferMeter->setFillRatio(ratio, stdev);
+            // lock-free, this runs often and must never hold up the audio thread
+            SonobusAudioProcessor::PeerTelemetry telem;
+            if (!processor.getRemotePeerTelemetry(i, telem)) {
+                continue;
+            }
+
+            pvf->jitterBufferMeter->setFillRatio(telem.fillRatio, telem.fillRatioStdDev);
+
+            if (telem.hasJitterStats && telem.jitterStats.count > 0 && telem.bufferTimeMs > 0.0f) {
+                pvf->jitterBufferMeter->setJitterRatio(telem.jitterStats.p99 / telem.bufferTimeMs);
+            } else {
+                pvf->jitterBufferMeter->setJitterRatio(-1.0f);
             }
         }
     }
@@ -1987,6 +2055,10 @@ void PeersContainerView::choiceButtonSelected(SonoChoiceButton *comp, int index,
             processor.setRemotePeerAutoresizeBufferMode(i, (SonobusAudioProcessor::AutoNetBufferMode) ident);
             break;
         }        
+        else if (pvf->lossConcealmentChoiceButton.get() == comp) {
+            processor.setRemotePeerLossConcealment(i, ident);
+            break;
+        }
     }
 }
 
@@ -2115,6 +2187,14 @@ void PeersContainerView::buttonClicked (Button* buttonThatWasClicked)
             processor.setChangingDefaultRecvAudioCodecSetsExisting(buttonThatWasClicked->getToggleState());
             return;
         }
+        else if (pvf->sendInbandFecButton.get() == buttonThatWasClicked) {
+            processor.setRemotePeerSendInbandFec(i, buttonThatWasClicked->getToggleState());
+            return;
+        }
+        else if (pvf->sendParityButton.get() == buttonThatWasClicked) {
+            processor.setRemotePeerSendParity(i, buttonThatWasClicked->getToggleState());
+            return;
+        }
         else if (pvf->optionsRemoveButton.get() == buttonThatWasClicked) {
             processor.removeRemotePeer(i);
             showSendOptions(di, false);
@@ -2208,9 +2288,9 @@ void PeersContainerView::showRecvOptions(int dindex, bool flag, Component * from
         
         const int defWidth = 300;
 #if JUCE_IOS || JUCE_ANDROID
-        const int defHeight = 180;
+        const int defHeight = 230;
 #else
-        const int defHeight = 152;
+        const int defHeight = 194;
 #endif
 
         wrap->setSize(jmin(defWidth, dw->getWidth() - 20), jmin(defHeight, dw->getHeight() - 24));
@@ -2269,9 +2349,9 @@ void PeersContainerView::showSendOptions(int dindex, bool flag, Component * from
         
         const int defWidth = 245;
 #if JUCE_IOS || JUCE_ANDROID
-        const int defHeight = 144;
+        const int defHeight = 212;
 #else
-        const int defHeight = 116;
+        const int defHeight = 176;
 #endif
         
         
@@ -56,6 +56,9 @@ public:
     std::unique_ptr<TextButton> optionsBlockButton;
     std::unique_ptr<SonoChoiceButton> remoteSendFormatChoiceButton;
     std::unique_ptr<ToggleButton> changeAllRecvFormatButton;
+    std::unique_ptr<SonoChoiceButton> lossConcealmentChoiceButton;
+    std::unique_ptr<ToggleButton> sendInbandFecButton;
+    std::unique_ptr<ToggleButton> sendParityButton;
     std::unique_ptr<SonoDrawableButton> bufferMinButton;
     std::unique_ptr<SonoDrawableButton> bufferMinFrontButton;
     std::unique_ptr<Drawable> recvButtonImage;
@@ -80,6 +83,7 @@ public:
     
     std::unique_ptr<Label>  staticFormatChoiceLabel;
     std::unique_ptr<Label>  staticRemoteSendFormatChoiceLabel;
+    std::unique_ptr<Label>  staticLossConcealmentLabel;
 
     std::unique_ptr<Label>  sendActualBitrateLabel;
     std::unique_ptr<Label>  recvActualBitrateLabel;
@@ -127,11 +131,14 @@ public:
     FlexBox optionsbuttbox;
     FlexBox optionsaddrbox;
     FlexBox optionsRemoteQualityBox;
+    FlexBox optionsLossConcealmentBox;
 
     FlexBox sendOptionsBox;
     FlexBox optionsSendQualBox;
     FlexBox optionsChangeAllQualBox;
     FlexBox optionsSendMutedBox;
+    FlexBox optionsSendFecBox;
+    FlexBox optionsSendParityBox;
     
     
     FlexBox effectsBox;
@@ -143,8 +150,11 @@ public:
     FlexBox sendlabbox;
     FlexBox recvlabbox;
 
-    int64_t lastBytesRecv = 0;
-    int64_t lastBytesSent = 0;
+    // the last telemetry we could read, kept while there is no consistent snapshot
+    SonobusAudioProcessor::PeerTelemetry telemetry;
+    uint32 telemetryTimestampMs = 0;
+    double sendRate = 0.0;
+    double recvRate = 0.0;
 
     int64_t lastDropped = 0;
     uint32 lastDroppedChangedTimestampMs = 0;
@@ -327,7 +337,6 @@ protected:
     bool isNarrow = false;
     bool peerModeFull = true; // default
 
-    uint32 lastUpdateTimestampMs = 0;
     
     Colour mutedBySoloColor;
     Colour mutedTextColor;
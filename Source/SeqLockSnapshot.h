@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2020 Jesse Chappell
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Holds the latest copy of a small plain struct, published by a single writer thread
+// and read by any number of other threads. The writer never waits, and readers never
+// take a lock, they just retry (a bounded number of times) if they overlapped with a publish.
+// The payload is kept in atomic words so that an overlapping read is not a data race.
+template <typename T>
+class SeqLockSnapshot
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLockSnapshot needs a trivially copyable type");
+
+public:
+    SeqLockSnapshot()
+    {
+        for (auto & word : data) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // only ever call from one thread at a time
+    void publish(const T & value) noexcept
+    {
+        uint32_t words[NumWords] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        const uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (int i=0; i < NumWords; ++i) {
+            data[i].store(words[i], std::memory_order_relaxed);
+        }
+
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // returns false if nothing has been published yet, or if we couldn't get
+    // a consistent copy because the writer was busy every time we looked
+    bool read(T & ret) const noexcept
+    {
+        uint32_t words[NumWords];
+
+        for (int tries=0; tries < MaxReadTries; ++tries) {
+            const uint32_t seq = sequence.load(std::memory_order_acquire);
+            if (seq & 1) {
+                continue; // publish in progress
+            }
+
+            for (int i=0; i < NumWords; ++i) {
+                words[i] = data[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == seq) {
+                if (seq == 0) {
+                    return false;
+                }
+                std::memcpy(&ret, words, sizeof(T));
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static constexpr int NumWords = (int) ((sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+    static constexpr int MaxReadTries = 16;
+
+    std::atomic<uint32_t> sequence { 0 };
+    std::atomic<uint32_t> data[NumWords];
+};
@@ -21,6 +21,7 @@
 #include <algorithm>
 
 #include "LatencyMeasurer.h"
+#include "LatencyTestEndpoints.h"
 #include "Metronome.h"
 
 using namespace SonoAudio;
@@ -37,9 +38,19 @@ typedef int socklen_t;
 #include <netdb.h>
 #endif
 
+#if JUCE_LINUX
+#include <sys/uio.h>
+#define SONOBUS_USE_RECVMMSG 1
+#define SONOBUS_USE_SENDMMSG 1
+#endif
+
 #define MAX_DELAY_SAMPLES 192000
 #define SENDBUFSIZE_SCALAR 2.0f
 #define PEER_PING_INTERVAL_MS 2000.0
+// how long the send and event threads sleep when nobody notifies them
+#define SEND_THREAD_IDLE_WAKE_MS 100
+#define EVENT_THREAD_IDLE_WAKE_MS 50
+#define TELEMETRY_PUBLISH_INTERVAL_MS 20.0
 
 String SonobusAudioProcessor::paramInGain     ("ingain");
 String SonobusAudioProcessor::paramDry     ("dry");
@@ -111,6 +122,10 @@ static String lastWindowWidthKey("lastWindowWidth");
 static String lastWindowHeightKey("lastWindowHeight");
 static String autoresizeDropRateThreshKey("autoDropRateThreshNew");
 static String reconnectServerLossKey("reconnServLoss");
+static String parallelPeerProcessingKey("parallelPeerProc");
+static String resampleQualityKey("resampleQuality");
+static String adaptiveNetBufferKey("adaptiveNetBuf");
+static String adaptiveNetBufferStretchKey("adaptiveNetBufStretch");
 
 static String compressorStateKey("CompressorState");
 static String expanderStateKey("ExpanderState");
@@ -149,6 +164,9 @@ static String peerNetbufKey("netbuf");
 static String peerNetbufAutoKey("netbufauto");
 static String peerSendFormatKey("sendformat");
 static String peerOrderPriorityKey("orderpriority");
+static String peerLossConcealmentKey("lossconceal");
+static String peerSendInbandFecKey("sendfec");
+static String peerSendParityKey("sendparity");
 
 
 #define METER_RMS_SEC 0.03
@@ -159,6 +177,25 @@ static String peerOrderPriorityKey("orderpriority");
 
 #define UDP_OVERHEAD_BYTES 0 // 28
 
+// max number of datagrams pulled from the socket per recv thread wakeup
+#define RECV_BATCH_PACKETS 32
+// max number of datagrams queued by the send thread before a flush
+#define SEND_BATCH_PACKETS 64
+// largest datagram we may see or send, packets to and from relayed peers carry an extra header
+#define MAX_DATAGRAM_BYTES (AOO_MAXPACKETSIZE + AOONET_RELAY_HEADER_SIZE)
+// aoo encode group of all peer sources, peers getting the same mix share one encoder
+#define SHARED_ENCODE_GROUP 1
+
+// blocks per XOR parity packet when sending parity FEC to a peer
+#define PARITY_FEC_GROUP_SIZE 4
+// max number of threads helping the audio thread with the peer receive processing
+#define MAX_PEER_WORKERS 4
+// how long the audio thread spins on the workers before taking over their unstarted jobs,
+// and how long it may wait in total before backing off to serial processing (fractions of the block duration)
+#define PEER_JOB_SPIN_FRACTION 0.1
+#define PEER_JOB_MAX_WAIT_FRACTION 0.25
+#define PEER_JOB_SERIAL_BLOCKS 500
+
 // get sockaddr, IPv4 or IPv6:
 static void *get_in_addr(struct sockaddr *sa)
 {
@@ -192,9 +229,18 @@ static addrinfo* getAddressInfo (bool isDatagram, const String& hostName, int po
     return nullptr;
 }
 
+// key for IPv4 address+port, 0 is never a valid key
+static uint64 getRawEndpointKey(const struct sockaddr * sa)
+{
+    if (sa->sa_family != AF_INET) return 0;
+    auto sin = (const struct sockaddr_in *) sa;
+    return (1ULL << 48) | ((uint64) ntohl(sin->sin_addr.s_addr) << 16) | (uint64) ntohs(sin->sin_port);
+}
+
 struct SonobusAudioProcessor::EndpointState {
     EndpointState(String ipaddr_="", int port_=0) : ipaddr(ipaddr_), port(port_) {
-        rawaddr.sa_family = AF_UNSPEC;
+        zerostruct(rawaddr);
+        rawaddr.ss_family = AF_UNSPEC;
     }
     
 
@@ -207,28 +253,115 @@ struct SonobusAudioProcessor::EndpointState {
     
     
     struct sockaddr * getRawAddr() {
-        if (rawaddr.sa_family == AF_UNSPEC) {
+        if (rawaddr.ss_family == AF_UNSPEC) {
             struct addrinfo * info = getAddressInfo(true, ipaddr, port);
             if (info) {
-                memcpy(&rawaddr, info->ai_addr, info->ai_addrlen);
+                memcpy(&rawaddr, info->ai_addr, jmin((size_t) info->ai_addrlen, sizeof(rawaddr)));
 
                 freeaddrinfo(info);
             }
         }
-        return &rawaddr;
+        return (struct sockaddr *) &rawaddr;
     }
     
+    void setRawAddr(const struct sockaddr * addr, size_t len) {
+        memcpy(&rawaddr, addr, jmin(len, sizeof(rawaddr)));
+    }
+    
+    // non-zero if this endpoint is in the raw address table
+    uint64 rawKey = 0;
+
+    // set to the connection server endpoint if this peer can only be reached through its relay
+    std::atomic<EndpointState*> relay { nullptr };
+    // only relayed packets coming from a server we use as relay are accepted
+    std::atomic<bool> isRelayServer { false };
     
     // runtime state
     int64_t sentBytes = 0;
     int64_t recvBytes = 0;
     
 private:
-    struct sockaddr rawaddr;
+    struct sockaddr_storage rawaddr;
     
 };
 
+// insert-only open addressing table from raw address key to endpoint.
+// the recv thread reads it without any locking, inserts happen under mEndpointsLock,
+// and when it gets too full a bigger copy is published while the old one is kept alive
+struct SonobusAudioProcessor::EndpointTable {
+    EndpointTable(int capacity_) : capacity(capacity_), slots(new std::atomic<EndpointState*>[capacity_]) {
+        for (int i=0; i < capacity; ++i) {
+            slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    static size_t hashKey(uint64 key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return (size_t) key;
+    }
+
+    EndpointState * find(uint64 key) const {
+        for (size_t i = hashKey(key) & (capacity - 1); ; i = (i + 1) & (capacity - 1)) {
+            auto ep = slots[i].load(std::memory_order_acquire);
+            if (ep == nullptr || ep->rawKey == key) {
+                return ep;
+            }
+        }
+    }
+
+    // caller makes sure there is room
+    void insert(EndpointState * ep) {
+        for (size_t i = hashKey(ep->rawKey) & (capacity - 1); ; i = (i + 1) & (capacity - 1)) {
+            if (slots[i].load(std::memory_order_relaxed) == nullptr) {
+                slots[i].store(ep, std::memory_order_release);
+                ++count;
+                return;
+            }
+        }
+    }
+
+    bool needsGrow() const { return (count + 1) * 2 > capacity; }
+
+    const int capacity; // power of 2
+    int count = 0;
+    std::unique_ptr<std::atomic<EndpointState*>[]> slots;
+};
+
+
+
+
+#if SONOBUS_USE_RECVMMSG
+// preallocated ring of packet slots filled by a single recvmmsg() call
+struct SonobusAudioProcessor::RecvPacketRing {
+    RecvPacketRing() {
+        for (int i=0; i < RECV_BATCH_PACKETS; ++i) {
+            iovecs[i].iov_base = buffers[i];
+            iovecs[i].iov_len = MAX_DATAGRAM_BYTES;
+            zerostruct(msgs[i]);
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
+    }
+
+    void resetNames() {
+        // recvmmsg overwrites these with the actual lengths
+        for (int i=0; i < RECV_BATCH_PACKETS; ++i) {
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
+    }
 
+    char buffers[RECV_BATCH_PACKETS][MAX_DATAGRAM_BYTES];
+    struct sockaddr_storage addrs[RECV_BATCH_PACKETS];
+    struct iovec iovecs[RECV_BATCH_PACKETS];
+    struct mmsghdr msgs[RECV_BATCH_PACKETS];
+};
+#else
+struct SonobusAudioProcessor::RecvPacketRing {};
+#endif
 
 
 #define LATENCY_ID_OFFSET 20000
@@ -259,24 +392,34 @@ struct SonobusAudioProcessor::RemotePeer {
         oursink.reset(aoo::isink::create(ourId));
         oursource.reset(aoo::isource::create(ourId));
         
-        // create latency sink/sources
-        latencysink.reset(aoo::isink::create(ourId + LATENCY_ID_OFFSET));
-        latencysource.reset(aoo::isource::create(ourId + LATENCY_ID_OFFSET));
-        echosink.reset(aoo::isink::create(ourId + ECHO_ID_OFFSET));
-        echosource.reset(aoo::isource::create(ourId + ECHO_ID_OFFSET));
+        // latency and echo sink/sources are only created while a test needs them, see createTestEndpoints()
+
+        oursink->set_loss_concealment(lossConcealment);
+        // never let the audio thread wait on a format change
+        oursink->set_nonblocking_process(1);
     }
 
     EndpointState * endpoint = 0;
+    SonobusAudioProcessor * owner = nullptr; // for the AOO event notifications
     int32_t ourId = AOO_ID_NONE;
     int32_t remoteSinkId = AOO_ID_NONE;
     int32_t remoteSourceId = AOO_ID_NONE;
     aoo::isink::pointer oursink;
     aoo::isource::pointer oursource;
 
+    // null unless our latency test (latency pair) or the remote's (echo pair) is running,
+    // only ever set or reset with mCoreLock write locked
     aoo::isink::pointer latencysink;
     aoo::isource::pointer latencysource;
     aoo::isink::pointer echosink;
     aoo::isource::pointer echosource;
+    // when nonzero, the idle pair is destroyed after this time (ms), giving the uninvite a chance to go out
+    std::atomic<double> latencyReleaseTimeMs { 0.0 };
+    std::atomic<double> echoReleaseTimeMs { 0.0 };
+    // set when one of our AOO objects queued an event or got a packet, so the
+    // event and send threads only have to visit this peer
+    std::atomic<bool> eventsPending { true };
+    std::atomic<bool> sendPending { true };
     bool activeLatencyTest = false;
     std::unique_ptr<MTDM> latencyProcessor;
     std::unique_ptr<LatencyMeasurer> latencyMeasurer;
@@ -295,6 +438,9 @@ struct SonobusAudioProcessor::RemotePeer {
     bool soloed = false;
     bool invitedPeer = false;
     int  formatIndex = -1; // default
+    bool sendInbandFec = false;
+    bool sendParity = false;
+    int  lossConcealment = AOO_LOSS_CONCEAL_FEC; // falls back to PLC without FEC data
     AudioCodecFormatInfo recvFormat;
     int reqRemoteSendFormatIndex = -1; // no pref
     int packetsize = 600;
@@ -306,6 +452,8 @@ struct SonobusAudioProcessor::RemotePeer {
     float recvStereoPan[MAX_PANNERS]; // only use 2
     // runtime state
     float _lastgain = 0.0f;
+    bool _recvSilent = false; // results of the receive stage for the final mix
+    bool _recvAnySubSolo = false;
     bool connected = false;
     String userName;
     String groupName;
@@ -370,11 +518,111 @@ struct SonobusAudioProcessor::RemotePeer {
 
 
 
+#if SONOBUS_USE_SENDMMSG
+// accumulates outgoing datagrams during a send thread pass, so they
+// can be handed to the kernel with a single sendmmsg() call
+struct SendPacketBatch {
+    SendPacketBatch() {
+        for (int i=0; i < SEND_BATCH_PACKETS; ++i) {
+            iovecs[i].iov_base = buffers[i];
+            iovecs[i].iov_len = 0;
+            zerostruct(msgs[i]);
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+        }
+    }
+
+    // returns false if this datagram can't be queued and must be sent directly
+    bool add(SonobusAudioProcessor::EndpointState * endpoint, const char *data, int32_t size)
+    {
+        if (size <= 0 || size > AOO_MAXPACKETSIZE) return false;
+
+        auto addr = endpoint->getRawAddr();
+        if (addr->sa_family != AF_INET) return false;
+
+        auto relay = endpoint->relay.load(std::memory_order_acquire);
+
+        int fd = endpoint->owner->getRawSocketHandle();
+        if (count == SEND_BATCH_PACKETS || (count > 0 && fd != sockfd)) {
+            flush();
+        }
+        sockfd = fd;
+
+        if (relay) {
+            // goes to the server, which forwards it to the peer
+            auto hsize = aoonet_relay_write_header(buffers[count], MAX_DATAGRAM_BYTES, addr);
+            addr = relay->getRawAddr();
+            if (hsize == 0 || addr->sa_family != AF_INET) return false;
+            memcpy(buffers[count] + hsize, data, size);
+            iovecs[count].iov_len = size + hsize;
+        }
+        else {
+            memcpy(buffers[count], data, size);
+            iovecs[count].iov_len = size;
+        }
+        memcpy(&addrs[count], addr, sizeof(struct sockaddr_in));
+        msgs[count].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        endpoints[count] = endpoint;
+        ++count;
+        return true;
+    }
+
+    void flush()
+    {
+        int sent = 0;
+        while (sent < count) {
+            int ret = ::sendmmsg(sockfd, msgs + sent, (unsigned int) (count - sent), 0);
+            if (ret <= 0) {
+                if (ret < 0 && errno == EINTR) continue;
+                DBG("Error sending UDP batch to endpoint " << endpoints[sent]->ipaddr);
+                // drop the failing datagram and carry on with the rest
+                ++sent;
+                continue;
+            }
+            for (int i = sent; i < sent + ret; ++i) {
+                // include UDP overhead
+                endpoints[i]->sentBytes += msgs[i].msg_len + UDP_OVERHEAD_BYTES;
+            }
+            sent += ret;
+        }
+        count = 0;
+    }
+
+    char buffers[SEND_BATCH_PACKETS][MAX_DATAGRAM_BYTES];
+    struct sockaddr_storage addrs[SEND_BATCH_PACKETS];
+    struct iovec iovecs[SEND_BATCH_PACKETS];
+    struct mmsghdr msgs[SEND_BATCH_PACKETS];
+    SonobusAudioProcessor::EndpointState * endpoints[SEND_BATCH_PACKETS];
+    int count = 0;
+    int sockfd = -1;
+};
+
+// only set on the send thread, everybody else sends directly
+static thread_local SendPacketBatch * sCurrentSendBatch = nullptr;
+#endif
+
 static int32_t endpoint_send(void *e, const char *data, int32_t size)
 {
     SonobusAudioProcessor::EndpointState * endpoint = static_cast<SonobusAudioProcessor::EndpointState*>(e);
+
+#if SONOBUS_USE_SENDMMSG
+    if (sCurrentSendBatch && sCurrentSendBatch->add(endpoint, data, size)) {
+        return size;
+    }
+#endif
+
     int result = -1;
-    if (endpoint->peer) {
+    if (auto relay = endpoint->relay.load(std::memory_order_acquire)) {
+        // the peer is only reachable through the connection server
+        char buf[MAX_DATAGRAM_BYTES];
+        int hsize = 0;
+        if (size <= AOO_MAXPACKETSIZE && (hsize = aoonet_relay_write_header(buf, sizeof(buf), endpoint->getRawAddr())) > 0) {
+            memcpy(buf + hsize, data, size);
+            result = (int) ::sendto(endpoint->owner->getRawSocketHandle(), buf, (size_t) (size + hsize), 0,
+                                    relay->getRawAddr(), sizeof(struct sockaddr_in));
+        }
+    } else if (endpoint->peer) {
         result = endpoint->owner->write(*(endpoint->peer), data, size);
     } else {
         result = endpoint->owner->write(endpoint->ipaddr, endpoint->port, data, size);
@@ -420,19 +668,29 @@ public:
         
         setPriority(Thread::Priority::highest);
 
+#if SONOBUS_USE_SENDMMSG
+        // everything sent during a pass gets queued and flushed together
+        sCurrentSendBatch = &_sendBatch;
+#endif
+
         bool shouldwait = false;
 
         while (!threadShouldExit()) {
-            // don't overcall it, but make sure it runs consistently
-            // if we are notified to send, the wait will return sooner than the timeout
+            // we are notified for every audio block and every received packet batch,
+            // the timeout only keeps the periodic pings going when nothing else happens
 
+            bool timedout = false;
             if (shouldwait) {
-                _processor.mSendWaitable.wait(20);
+                timedout = !_processor.mSendWaitable.wait(SEND_THREAD_IDLE_WAKE_MS);
             }
 
             auto sentinel = _processor.mNeedSendSentinel.get();
 
-            _processor.doSendData();
+            _processor.doSendData(timedout);
+
+#if SONOBUS_USE_SENDMMSG
+            _sendBatch.flush();
+#endif
 
             shouldwait = (sentinel == _processor.mNeedSendSentinel.get());
 
@@ -441,6 +699,10 @@ public:
     }
     
     SonobusAudioProcessor & _processor;
+
+#if SONOBUS_USE_SENDMMSG
+    SendPacketBatch _sendBatch;
+#endif
     
 };
 
@@ -475,12 +737,16 @@ public:
     {}
     
     void run() override {
+        juce::ScopedNoDenormals noDenormals;
 
         while (!threadShouldExit()) {
-         
-            Thread::sleep(20);
-            
-            _processor.handleEvents();                       
+            // the AOO objects wake us up when they queue an event, the timeout
+            // is for the telemetry and as a safety net
+            const bool notified = _processor.mEventWaitable.wait(EVENT_THREAD_IDLE_WAKE_MS);
+
+            _processor.handleEvents(!notified);
+
+            _processor.releaseIdleTestEndpoints();
         }
         
         DBG("Event thread finishing");
@@ -528,6 +794,31 @@ public:
     
 };
 
+class SonobusAudioProcessor::PeerProcessWorker : public juce::Thread
+{
+public:
+    PeerProcessWorker(SonobusAudioProcessor & processor, int index) : Thread("SonoBusPeerWorker" + String(index)) , _processor(processor) 
+    {}
+    
+    void run() override {
+        juce::ScopedNoDenormals noDenormals;
+
+        while (!threadShouldExit()) {
+            // woken up by the audio thread when a block has peers to share
+            if (!_wakeup.wait(100)) continue;
+
+            while (_processor.runPeerReceiveJob()) {}
+        }
+        
+        DBG("Peer worker finishing");
+    }
+
+    void wakeUp() { _wakeup.signal(); }
+    
+    SonobusAudioProcessor & _processor;
+    WaitableEvent _wakeup;
+};
+
 
 enum {
     OutMixBusIndex = 0,
@@ -856,6 +1147,8 @@ SonobusAudioProcessor::~SonobusAudioProcessor()
     mTransportSource.removeChangeListener(this);
 
     cleanupAoo();
+
+    stopPeerWorkers();
 }
 
 void SonobusAudioProcessor::moveOldMisplacedFiles()
@@ -915,6 +1208,7 @@ void SonobusAudioProcessor::initializeAoo(int udpPort)
     //mAooSink.reset(aoo::isink::create(1));
 
     mAooDummySource.reset(aoo::isource::create(0));
+    mAooDummySource->set_event_notify(notifyEvents, this);
 
 
 
@@ -931,6 +1225,13 @@ void SonobusAudioProcessor::initializeAoo(int udpPort)
     mUdpSocket->setSendBufferSize(1048576);
     mUdpSocket->setReceiveBufferSize(1048576);
 
+#if JUCE_WINDOWS
+    // there is no MSG_DONTWAIT for recvfrom here, so make the socket itself
+    // non-blocking, the receive thread must never hang on a stale wakeup
+    u_long nonblocking = 1;
+    ioctlsocket(mUdpSocket->getRawSocketHandle(), FIONBIO, &nonblocking);
+#endif
+
     /*
     int tos_local = 0x38; // QOS realtime DSCP
     int opterr = setsockopt(mUdpSocket->getRawSocketHandle(), IPPROTO_IP, IP_TOS,  &tos_local, sizeof(tos_local));
@@ -1006,6 +1307,9 @@ void SonobusAudioProcessor::initializeAoo(int udpPort)
     
     if (mUdpLocalPort > 0) {
         mAooClient.reset(aoo::net::iclient::create(mServerEndpoint.get(), client_send, mUdpLocalPort));
+        if (mAooClient) {
+            mAooClient->set_event_notify(notifyEvents, this);
+        }
     }
 
     
@@ -1074,7 +1378,10 @@ void SonobusAudioProcessor::cleanupAoo()
         mAooDummySource.reset();
         
         mRemotePeers.clear();
+        publishRemotePeerIds();
         
+        mEndpointTable = nullptr;
+        mEndpointTables.clear();
         mEndpoints.clear();
     }
 
@@ -1093,6 +1400,9 @@ void SonobusAudioProcessor::startAooServer()
         if (err != 0) {
             DBG("Error creating Aoo Server: " << err);
         }
+        else if (mAooServer) {
+            mAooServer->set_event_notify(notifyEvents, this);
+        }
     }
     
     if (mAooServer) {
@@ -1418,13 +1728,18 @@ void SonobusAudioProcessor::setRemotePeerAudioCodecFormat(int index, int formatI
         remote->oursource->setup(getSampleRate(), currSamplesPerBlock, remote->sendChannels);
         //remote->oursource->setup(getSampleRate(), remote->packetsize    , getTotalNumOutputChannels());        
         
-        setupSourceFormat(remote, remote->latencysource.get(), true);
-        remote->latencysource->setup(getSampleRate(), currSamplesPerBlock, 1);
-        setupSourceFormat(remote, remote->echosource.get(), true);
-        remote->echosource->setup(getSampleRate(), currSamplesPerBlock, 1);
+        if (remote->latencysource) {
+            setupSourceFormat(remote, remote->latencysource.get(), true);
+            remote->latencysource->setup(getSampleRate(), currSamplesPerBlock, 1);
+        }
+        if (remote->echosource) {
+            setupSourceFormat(remote, remote->echosource.get(), true);
+            remote->echosource->setup(getSampleRate(), currSamplesPerBlock, 1);
+        }
         
         remote->latencyDirty = true;
     }
+    publishRemotePeerTelemetry(index);
 }
 
 int SonobusAudioProcessor::getRemotePeerAudioCodecFormat(int index) const
@@ -1436,6 +1751,83 @@ int SonobusAudioProcessor::getRemotePeerAudioCodecFormat(int index) const
     return remote->formatIndex;
 }
 
+void SonobusAudioProcessor::setRemotePeerSendInbandFec(int index, bool flag)
+{
+    if (index >= mRemotePeers.size()) return;
+
+    const ScopedReadLock sl (mCoreLock);
+
+    auto remote = mRemotePeers.getUnchecked(index);
+    if (remote->sendInbandFec == flag) return;
+
+    remote->sendInbandFec = flag;
+
+    if (remote->oursource) {
+        setupSourceFormat(remote, remote->oursource.get());
+        remote->oursource->setup(getSampleRate(), currSamplesPerBlock, remote->sendChannels);
+    }
+    publishRemotePeerTelemetry(index);
+}
+
+bool SonobusAudioProcessor::getRemotePeerSendInbandFec(int index) const
+{
+    if (index >= mRemotePeers.size()) return false;
+
+    const ScopedReadLock sl (mCoreLock);
+    auto remote = mRemotePeers.getUnchecked(index);
+    return remote->sendInbandFec;
+}
+
+void SonobusAudioProcessor::setRemotePeerSendParity(int index, bool flag)
+{
+    if (index >= mRemotePeers.size()) return;
+
+    const ScopedReadLock sl (mCoreLock);
+
+    auto remote = mRemotePeers.getUnchecked(index);
+    if (remote->sendParity == flag) return;
+
+    remote->sendParity = flag;
+
+    if (remote->oursource) {
+        setupSourceFormat(remote, remote->oursource.get());
+    }
+    publishRemotePeerTelemetry(index);
+}
+
+bool SonobusAudioProcessor::getRemotePeerSendParity(int index) const
+{
+    if (index >= mRemotePeers.size()) return false;
+
+    const ScopedReadLock sl (mCoreLock);
+    auto remote = mRemotePeers.getUnchecked(index);
+    return remote->sendParity;
+}
+
+void SonobusAudioProcessor::setRemotePeerLossConcealment(int index, int mode)
+{
+    if (index >= mRemotePeers.size()) return;
+
+    const ScopedReadLock sl (mCoreLock);
+
+    auto remote = mRemotePeers.getUnchecked(index);
+    remote->lossConcealment = mode;
+
+    if (remote->oursink) {
+        remote->oursink->set_loss_concealment(mode);
+    }
+    publishRemotePeerTelemetry(index);
+}
+
+int SonobusAudioProcessor::getRemotePeerLossConcealment(int index) const
+{
+    if (index >= mRemotePeers.size()) return AOO_LOSS_CONCEALMENT;
+
+    const ScopedReadLock sl (mCoreLock);
+    auto remote = mRemotePeers.getUnchecked(index);
+    return remote->lossConcealment;
+}
+
 bool SonobusAudioProcessor::getRemotePeerReceiveAudioCodecFormat(int index, AudioCodecFormatInfo & retinfo) const
 {
     if (index >= mRemotePeers.size()) return false;
@@ -1464,6 +1856,7 @@ bool SonobusAudioProcessor::setRequestRemotePeerSendAudioCodecFormat(int index,
             remote->oursink->request_source_codec_change(remote->endpoint, remote->remoteSourceId, fmt.header);
 
             remote->reqRemoteSendFormatIndex = formatIndex; 
+            publishRemotePeerTelemetry(index);
             return true;
         }
         else {
@@ -1471,6 +1864,7 @@ bool SonobusAudioProcessor::setRequestRemotePeerSendAudioCodecFormat(int index,
         }
     } else {
         remote->reqRemoteSendFormatIndex = -1; // no preference
+        publishRemotePeerTelemetry(index);
         return true;
     }
 }
@@ -2193,6 +2587,16 @@ foleys::LevelMeterSource * SonobusAudioProcessor::getRemotePeerSendMeterSource(i
 
 SonobusAudioProcessor::EndpointState * SonobusAudioProcessor::findOrAddRawEndpoint(void * rawaddr)
 {
+    // fast path, no locking or string conversion for endpoints we already know
+    const uint64 key = getRawEndpointKey((struct sockaddr *)rawaddr);
+    if (key != 0) {
+        if (auto table = mEndpointTable.load(std::memory_order_acquire)) {
+            if (auto endpoint = table->find(key)) {
+                return endpoint;
+            }
+        }
+    }
+
     String ipaddr;
     int port = 0 ;
 
@@ -2226,10 +2630,47 @@ SonobusAudioProcessor::EndpointState * SonobusAudioProcessor::findOrAddEndpoint(
         endpoint->owner = mUdpSocket.get();
         endpoint->peer = std::make_unique<DatagramSocket::RemoteAddrInfo>(host, port);
         DBG("Added new endpoint for " << host << ":" << port);
+
+        addToEndpointTable(endpoint);
     }
     return endpoint;
 }
 
+void SonobusAudioProcessor::addToEndpointTable(EndpointState * endpoint)
+{
+    // assumes mEndpointsLock is held
+    // only numeric IPv4 hosts go in the table, so that a hostname endpoint
+    // never aliases the one created for packets coming from its address
+    struct sockaddr_in sin;
+    zerostruct(sin);
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons((uint16) endpoint->port);
+    if (inet_pton(AF_INET, endpoint->ipaddr.toRawUTF8(), &sin.sin_addr) != 1) {
+        return;
+    }
+
+    endpoint->setRawAddr((struct sockaddr *) &sin, sizeof(sin));
+    endpoint->rawKey = getRawEndpointKey((struct sockaddr *) &sin);
+
+    auto table = mEndpointTable.load(std::memory_order_relaxed);
+
+    if (table == nullptr || table->needsGrow()) {
+        // publish a bigger copy, the old one stays around for any concurrent readers
+        auto newtable = new EndpointTable(table ? table->capacity * 2 : 64);
+        for (auto ep : mEndpoints) {
+            if (ep->rawKey != 0 && ep != endpoint) {
+                newtable->insert(ep);
+            }
+        }
+        newtable->insert(endpoint);
+        mEndpointTables.add(newtable);
+        mEndpointTable.store(newtable, std::memory_order_release);
+    }
+    else {
+        table->insert(endpoint);
+    }
+}
+
 void SonobusAudioProcessor::updateSafetyMuting(RemotePeer * peer)
 {
     // assumed corelock already held
@@ -2263,42 +2704,129 @@ void SonobusAudioProcessor::updateSafetyMuting(RemotePeer * peer)
 
 void SonobusAudioProcessor::doReceiveData()
 {
+#if SONOBUS_USE_RECVMMSG
+    // drain as many datagrams as are waiting (up to the ring size) with one syscall
+    if (!mRecvPacketRing) {
+        mRecvPacketRing = std::make_unique<RecvPacketRing>();
+    }
+    auto & ring = *mRecvPacketRing;
+
+    ring.resetNames();
+    int npackets = ::recvmmsg(mUdpSocket->getRawSocketHandle(), ring.msgs, RECV_BATCH_PACKETS, MSG_DONTWAIT, nullptr);
+
+    if (npackets <= 0) {
+        if (npackets < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            DBG("Error receiving UDP batch: " << errno);
+        }
+        return;
+    }
+
+    bool gotaoo = false;
+
+    for (int i=0; i < npackets; ++i) {
+        int nbytes = (int) ring.msgs[i].msg_len;
+        if (nbytes <= 0) continue;
+
+        // find endpoint from sender info
+        EndpointState * endpoint = findOrAddRawEndpoint(&ring.addrs[i]);
+        if (!endpoint) continue;
+
+        endpoint->recvBytes += nbytes + UDP_OVERHEAD_BYTES;
+
+        gotaoo |= handleReceivedPacket(endpoint, ring.buffers[i], nbytes);
+    }
+
+    if (gotaoo) {
+        // notify send thread once for the whole batch, just for the peers involved
+        notifySendThread(false);
+    }
+
+#else
     // receive from udp port, and parse packet
-    char buf[AOO_MAXPACKETSIZE];
-    String senderIP;
-    int senderPort;
-    
-    int nbytes = mUdpSocket->read(buf, AOO_MAXPACKETSIZE, false, senderIP, senderPort);
+    char buf[MAX_DATAGRAM_BYTES];
+    struct sockaddr_storage senderaddr;
+    socklen_t senderaddrlen = sizeof(senderaddr);
+
+#ifdef MSG_DONTWAIT
+    const int flags = MSG_DONTWAIT;
+#else
+    const int flags = 0; // the socket is non-blocking (see initializeAoo)
+#endif
+    int nbytes = (int) ::recvfrom(mUdpSocket->getRawSocketHandle(), buf, MAX_DATAGRAM_BYTES, flags, (struct sockaddr *) &senderaddr, &senderaddrlen);
 
     if (nbytes == 0) return;
     else if (nbytes < 0) {
-        DBG("Error receiving UDP");
+#if JUCE_WINDOWS
+        if (WSAGetLastError() != WSAEWOULDBLOCK)
+#else
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+#endif
+        {
+            DBG("Error receiving UDP");
+        }
         return;
     }
-    
+
     // find endpoint from sender info
-    EndpointState * endpoint = findOrAddEndpoint(senderIP, senderPort);
+    EndpointState * endpoint = findOrAddRawEndpoint(&senderaddr);
+    if (!endpoint) return;
     
     endpoint->recvBytes += nbytes + UDP_OVERHEAD_BYTES;
     
+    if (handleReceivedPacket(endpoint, buf, nbytes)) {
+        // notify send thread, just for the peer involved
+        notifySendThread(false);
+    }
+#endif
+}
+
+bool SonobusAudioProcessor::handleReceivedPacket(EndpointState * endpoint, const char * buf, int nbytes)
+{
+    if (endpoint->isRelayServer.load(std::memory_order_relaxed)) {
+        // packet from a peer, forwarded by the connection server relay
+        struct sockaddr_storage srcaddr;
+        if (auto hsize = aoonet_relay_parse_header(buf, nbytes, &srcaddr, nullptr)) {
+            const char * inner = buf + hsize;
+            const int innerbytes = nbytes - hsize;
+
+            int32_t type;
+            if (aoonet_parse_pattern(inner, innerbytes, &type) > 0 && type == AOO_TYPE_PEER) {
+                // the client has to know that the handshake came through the relay
+                if (mAooClient) {
+                    mAooClient->handle_message(buf, nbytes, endpoint->getRawAddr());
+                }
+                return true;
+            }
+
+            EndpointState * peerEndpoint = findOrAddRawEndpoint(&srcaddr);
+            if (!peerEndpoint || peerEndpoint == endpoint) return false;
+
+            peerEndpoint->recvBytes += innerbytes + UDP_OVERHEAD_BYTES;
+            return handleReceivedPacket(peerEndpoint, inner, innerbytes);
+        }
+    }
+
     // parse packet for AOO events
     
     int32_t type, id, dummyid;
-    if ((aoo_parse_pattern(buf, nbytes, &type, &id) > 0)
+    int32_t onset = 0;
+    if (((onset = aoo_parse_pattern(buf, nbytes, &type, &id)) > 0)
         || (aoonet_parse_pattern(buf, nbytes, &type) > 0))
     {
         {
             
-            if (type == AOO_TYPE_SINK){
-                // forward OSC packet to matching sink(s)
-                const ScopedReadLock sl (mCoreLock);        
-                
-                for (auto & remote : mRemotePeers) {
-                    if (!remote->oursink) continue;
-                    
-                    if (id == AOO_ID_NONE) {
-                        // this is a compact data message, try them all
-                        if (remote->oursink->handle_message(buf, nbytes, endpoint, endpoint_send)) {
+            if (type == AOO_TYPE_SINK && id == AOO_ID_NONE) {
+                // this is a compact data message, the salt tells us which sink it belongs to
+                const ScopedReadLock sl (mCoreLock);
+
+                aoo_compact_data cdata;
+                if (auto sink = aoo_sink_find_compact(buf, nbytes, endpoint, &cdata)) {
+                    // only a pointer compare per peer here, the message was parsed by the lookup
+                    for (auto & remote : mRemotePeers) {
+                        if (remote->oursink.get() != sink) continue;
+
+                        remote->sendPending = true;
+                        if (remote->oursink->handle_compact(cdata)) {
                             remote->dataPacketsReceived += 1;
                             if (remote->recvAllow && !remote->recvActive) {
                                 remote->recvActive = true;
@@ -2306,11 +2834,20 @@ void SonobusAudioProcessor::doReceiveData()
                             if (remote->resetSafetyMuted) {
                                 updateSafetyMuting(remote);
                             }
-                            break;
                         }
+                        break;
                     }
+                }
+
+            } else if (type == AOO_TYPE_SINK){
+                // forward OSC packet to matching sink(s)
+                const ScopedReadLock sl (mCoreLock);        
+                
+                for (auto & remote : mRemotePeers) {
+                    if (!remote->oursink) continue;
                     
                     if (id == AOO_ID_WILDCARD || (remote->oursink->get_id(dummyid) && id == dummyid) ) {
+                        remote->sendPending = true;
                         if (remote->oursink->handle_message(buf, nbytes, endpoint, endpoint_send)) {
                             remote->dataPacketsReceived += 1;
                             if (remote->recvAllow && !remote->recvActive) {
@@ -2324,12 +2861,14 @@ void SonobusAudioProcessor::doReceiveData()
                         if (id != AOO_ID_WILDCARD) break;
                     }
                     
-                    if (remote->echosink->get_id(dummyid) && id == dummyid) {
+                    if (remote->echosink && remote->echosink->get_id(dummyid) && id == dummyid) {
                         remote->echosink->handle_message(buf, nbytes, endpoint, endpoint_send);
+                        remote->sendPending = true;
                         break;
                     }
-                    else if (remote->latencysink->get_id(dummyid) && id == dummyid) {
+                    else if (remote->latencysink && remote->latencysink->get_id(dummyid) && id == dummyid) {
                         remote->latencysink->handle_message(buf, nbytes, endpoint, endpoint_send);
+                        remote->sendPending = true;
                         break;
                     }
                     
@@ -2337,32 +2876,52 @@ void SonobusAudioProcessor::doReceiveData()
                 
             } else if (type == AOO_TYPE_SOURCE){
                 // forward OSC packet to matching sources(s)
-                const ScopedReadLock sl (mCoreLock);        
+                RemotePeer * echoInvitePeer = nullptr;
+                {
+                    const ScopedReadLock sl (mCoreLock);        
 
-                
-                if (mAooDummySource->get_id(dummyid) && id == dummyid) {
-                    // this is the special one that can accept blind invites
-                    mAooDummySource->handle_message(buf, nbytes, endpoint, endpoint_send);
-                }
-                else {
-                    for (auto & remote : mRemotePeers) {
-                        if (!remote->oursource) continue;
-                        if (id == AOO_ID_WILDCARD || (remote->oursource->get_id(dummyid) && id == dummyid)) {
-                            remote->oursource->handle_message(buf, nbytes, endpoint, endpoint_send);
-                            if (id != AOO_ID_WILDCARD) break;
-                        }
-                        
-                        if (remote->echosource->get_id(dummyid) && id == dummyid) {
-                            remote->echosource->handle_message(buf, nbytes, endpoint, endpoint_send);
-                            break;
-                        }
-                        else if (remote->latencysource->get_id(dummyid) && id == dummyid) {
-                            remote->latencysource->handle_message(buf, nbytes, endpoint, endpoint_send);
-                            break;
+                    if (mAooDummySource->get_id(dummyid) && id == dummyid) {
+                        // this is the special one that can accept blind invites
+                        mAooDummySource->handle_message(buf, nbytes, endpoint, endpoint_send);
+                    }
+                    else {
+                        for (auto & remote : mRemotePeers) {
+                            if (!remote->oursource) continue;
+                            if (id == AOO_ID_WILDCARD || (remote->oursource->get_id(dummyid) && id == dummyid)) {
+                                remote->oursource->handle_message(buf, nbytes, endpoint, endpoint_send);
+                                remote->sendPending = true;
+                                if (id != AOO_ID_WILDCARD) break;
+                            }
+
+                            if (remote->echosource && remote->echosource->get_id(dummyid) && id == dummyid) {
+                                remote->echosource->handle_message(buf, nbytes, endpoint, endpoint_send);
+                                remote->sendPending = true;
+                                break;
+                            }
+                            else if (remote->latencysource && remote->latencysource->get_id(dummyid) && id == dummyid) {
+                                remote->latencysource->handle_message(buf, nbytes, endpoint, endpoint_send);
+                                remote->sendPending = true;
+                                break;
+                            }
+                            else if (!remote->echosource && remote->endpoint == endpoint && id == remote->ourId + ECHO_ID_OFFSET
+                                     && LatencyTestEndpoints::isInvite(buf, nbytes, onset)) {
+                                // remote is starting a latency test, we need our echo pair for it
+                                echoInvitePeer = remote;
+                                break;
+                            }
                         }
                     }
                 }
 
+                // can't create it with the read lock held
+                if (echoInvitePeer && createTestEndpoints(echoInvitePeer, true)) {
+                    const ScopedReadLock sl (mCoreLock);
+                    if (mRemotePeers.contains(echoInvitePeer) && echoInvitePeer->echosource) {
+                        echoInvitePeer->echosource->handle_message(buf, nbytes, endpoint, endpoint_send);
+                        echoInvitePeer->sendPending = true;
+                    }
+                }
+
                 
             } else if (type == AOO_TYPE_CLIENT || type == AOO_TYPE_PEER){
                 // forward OSC packet to matching client
@@ -2397,9 +2956,8 @@ void SonobusAudioProcessor::doReceiveData()
             }
         }
 
-        // notify send thread
-        notifySendThread();
-
+        // caller will notify send thread
+        return true;
     }
     else if (handleOtherMessage(endpoint, buf, nbytes)) {
 
@@ -2408,7 +2966,8 @@ void SonobusAudioProcessor::doReceiveData()
         // not a valid AoO OSC message
         DBG("SonoBus: not a valid AOO message!");
     }
-        
+
+    return false;
 }
 
 // XXX
@@ -3227,11 +3786,19 @@ int32_t SonobusAudioProcessor::sendPeerMessage(RemotePeer * peer, const char *ms
 }
 
 
-void SonobusAudioProcessor::doSendData()
+void SonobusAudioProcessor::doSendData(bool allpeers)
 {
-    // just try to send for everybody
     const ScopedReadLock sl (mCoreLock);        
 
+    // a new audio block means everybody could have something to send,
+    // otherwise only the peers we received packets from
+    allpeers |= mSendAllPending.exchange(false);
+
+    bool sendnow[MAX_PEERS];
+    for (int i=0; i < mRemotePeers.size() && i < MAX_PEERS; ++i) {
+        sendnow[i] = mRemotePeers.getUnchecked(i)->sendPending.exchange(false) || allpeers;
+    }
+
     // send stuff until there is nothing left to send
     
     int32_t didsomething = 1;
@@ -3248,23 +3815,29 @@ void SonobusAudioProcessor::doSendData()
             mAooClient->send();
         }
         
-        for (auto & remote : mRemotePeers) {
-            if (remote->oursource) {
-                didsomething |= remote->oursource->send();
-                
-                if (didsomething) {
-                    remote->dataPacketsSent += 1;
+        for (int i=0; i < mRemotePeers.size(); ++i) {
+            auto remote = mRemotePeers.getUnchecked(i);
+
+            if (i >= MAX_PEERS || sendnow[i]) {
+                if (remote->oursource) {
+                    didsomething |= remote->oursource->send();
+
+                    if (didsomething) {
+                        remote->dataPacketsSent += 1;
+                    }
+                }
+                if (remote->oursink) {
+                    didsomething |= remote->oursink->send();
                 }
-            }
-            if (remote->oursink) {
-                didsomething |= remote->oursink->send();
-            }
 
-            if (remote->latencysource) {
-                didsomething |= remote->latencysource->send();
-                didsomething |= remote->latencysink->send();
-                didsomething |= remote->echosource->send();
-                didsomething |= remote->echosink->send();
+                if (remote->latencysource) {
+                    didsomething |= remote->latencysource->send();
+                    didsomething |= remote->latencysink->send();
+                }
+                if (remote->echosource) {
+                    didsomething |= remote->echosource->send();
+                    didsomething |= remote->echosink->send();
+                }
             }
 
             if ( nowtimems > (remote->lastSendPingTimeMs + PEER_PING_INTERVAL_MS) ) {
@@ -3337,7 +3910,7 @@ static int32_t gHandleClientEvents(void * user, const aoo_event ** events, int32
 }
 
 
-void SonobusAudioProcessor::handleEvents()
+void SonobusAudioProcessor::handleEvents(bool allpeers)
 {
     const ScopedReadLock sl (mCoreLock);        
     int32_t dummy = 0;
@@ -3359,7 +3932,17 @@ void SonobusAudioProcessor::handleEvents()
         mAooDummySource->handle_events(gHandleSourceEvents, &pp);
     }
 
+    bool needsend = false;
+
     for (auto & remote : mRemotePeers) {
+        // cleared before handling, so an event queued meanwhile flags it again
+        if (remote->eventsPending.exchange(false)) {
+            // our reaction (invites, format changes...) usually has to be sent out
+            remote->sendPending = true;
+            needsend = true;
+        }
+        else if (!allpeers) continue;
+
         if (remote->oursource) {
             remote->oursource->get_id(dummy);
             ProcessorIdPair pp(this, dummy);
@@ -3396,6 +3979,101 @@ void SonobusAudioProcessor::handleEvents()
         
     }
 
+    if (needsend) {
+        notifySendThread(false);
+    }
+
+    // the UI doesn't need it more often, no matter how many events come in
+    const double nowms = Time::getMillisecondCounterHiRes();
+    if (nowms - mLastTelemetryPublishMs >= TELEMETRY_PUBLISH_INTERVAL_MS) {
+        publishRemotePeerTelemetry();
+        mLastTelemetryPublishMs = nowms;
+    }
+}
+
+// aoo_notifyfn for the AOO objects of a peer, called on whichever thread queued the event
+void SonobusAudioProcessor::notifyPeerEvents(void * user)
+{
+    auto * remote = static_cast<RemotePeer*>(user);
+    remote->eventsPending = true;
+    remote->owner->mEventWaitable.signal();
+}
+
+// aoo_notifyfn for the dummy source, client and server
+void SonobusAudioProcessor::notifyEvents(void * user)
+{
+    static_cast<SonobusAudioProcessor*>(user)->mEventWaitable.signal();
+}
+
+// called with mCoreLock held
+void SonobusAudioProcessor::publishRemotePeerTelemetry()
+{
+    for (int i=0; i < mRemotePeers.size() && i < MAX_PEERS; ++i) {
+        publishRemotePeerTelemetry(i);
+    }
+}
+
+// called with mCoreLock held, on the event thread and by the setters of the state the UI shows
+void SonobusAudioProcessor::publishRemotePeerTelemetry(int index)
+{
+    if (index < 0 || index >= mRemotePeers.size() || index >= MAX_PEERS) {
+        return;
+    }
+
+    const double minBufferTimeMs = getSampleRate() > 0.0 ? 1000.0 * currSamplesPerBlock / getSampleRate() : 0.0;
+
+    // one writer at a time, and an older state can't overwrite a newer one
+    const ScopedLock pl (mPeerTelemetryPublishLock);
+    RemotePeer * remote = mRemotePeers.getUnchecked(index);
+
+    PeerTelemetry info;
+    info.peerId = remote->ourId;
+    info.packetsReceived = remote->dataPacketsReceived;
+    info.packetsSent = remote->dataPacketsSent;
+    info.packetsDropped = remote->dataPacketsDropped;
+    info.packetsResent = remote->dataPacketsResent;
+    if (remote->endpoint) {
+        info.bytesReceived = remote->endpoint->recvBytes;
+        info.bytesSent = remote->endpoint->sentBytes;
+        remote->endpoint->ipaddr.copyToUTF8(info.hostname, sizeof(info.hostname));
+        info.port = remote->endpoint->port;
+    }
+    info.connected = remote->connected;
+    info.sendActive = remote->sendActive;
+    info.sendAllow = remote->sendAllow;
+    info.recvActive = remote->recvActive;
+    info.recvAllow = remote->recvAllow;
+    info.latencyTestActive = remote->activeLatencyTest;
+    info.recvChannels = remote->recvChannels;
+    info.sendChannels = remote->sendChannels;
+    info.formatIndex = remote->formatIndex;
+    info.reqRemoteSendFormatIndex = remote->reqRemoteSendFormatIndex;
+    info.lossConcealment = remote->lossConcealment;
+    info.sendInbandFec = remote->sendInbandFec;
+    info.sendParity = remote->sendParity;
+    info.autosizeBufferMode = remote->autosizeBufferMode;
+    info.autoNetbufInitCompleted = remote->autoNetbufInitCompleted;
+    remote->recvFormat.name.copyToUTF8(info.recvFormatName, sizeof(info.recvFormatName));
+    info.safetyMuted = remote->resetSafetyMuted;
+    info.blockedUs = remote->blockedUs;
+    info.bufferTimeMs = (float) jmax((double)remote->buffertimeMs, minBufferTimeMs);
+    info.hasJitterStats = remote->oursink
+        && remote->oursink->get_source_jitter_stats(remote->endpoint, remote->remoteSourceId, info.jitterStats) > 0;
+
+    mPeerTelemetry[index].publish(info);
+}
+
+// called with mCoreLock held for writing, whenever mRemotePeers has changed
+void SonobusAudioProcessor::publishRemotePeerIds()
+{
+    const int count = jmin(mRemotePeers.size(), (int) MAX_PEERS);
+    for (int i=0; i < count; ++i) {
+        mPublishedPeerIds[i].store(mRemotePeers.getUnchecked(i)->ourId, std::memory_order_relaxed);
+    }
+    mPublishedPeerCount.store(count, std::memory_order_release);
+
+    // the indexes may have moved, don't wait for the event thread
+    publishRemotePeerTelemetry();
 }
 
 void SonobusAudioProcessor::sendPingEvent(RemotePeer * peer)
@@ -3577,15 +4255,22 @@ int32_t SonobusAudioProcessor::handleSourceEvents(const aoo_event ** events, int
                     }
                     else {
                         // find by echo id
+                        const ScopedReadLock sl (mCoreLock);
+
                         if (auto * echopeer = findRemotePeerByEchoId(es, sourceId)) {
-                            echopeer->echosource->add_sink(es, e->id, endpoint_send);                            
-                            echopeer->echosource->start();
-                            DBG("Invite to echo source adding sink " << e->id);
+                            if (echopeer->echosource) {
+                                echopeer->echosource->add_sink(es, e->id, endpoint_send);
+                                echopeer->echosource->start();
+                                LatencyTestEndpoints::retain(*echopeer, true);
+                                DBG("Invite to echo source adding sink " << e->id);
+                            }
                         }
                         else if (auto * latpeer = findRemotePeerByLatencyId(es, sourceId)) {
-                            echopeer->latencysource->add_sink(es, e->id, endpoint_send);                                                        
-                            echopeer->latencysource->start();
-                            DBG("Invite to our latency source adding sink " << e->id);
+                            if (latpeer->latencysource) {
+                                latpeer->latencysource->add_sink(es, e->id, endpoint_send);
+                                latpeer->latencysource->start();
+                                DBG("Invite to our latency source adding sink " << e->id);
+                            }
                         }
                         else {
                             // not one of our sources 
@@ -3635,14 +4320,22 @@ int32_t SonobusAudioProcessor::handleSourceEvents(const aoo_event ** events, int
                     
                 }
                 else if (auto * echopeer = findRemotePeerByEchoId(es, sourceId)) {
-                    echopeer->echosource->remove_sink(es, e->id);                            
-                    echopeer->echosource->stop();
-                    DBG("UnInvite to echo source adding sink " << e->id);
+                    const ScopedReadLock sl (mCoreLock);
+                    if (echopeer->echosource) {
+                        echopeer->echosource->remove_sink(es, e->id);
+                        echopeer->echosource->stop();
+                        // remote's latency test is over, free our echo pair
+                        LatencyTestEndpoints::scheduleRelease(*echopeer, true, Time::getMillisecondCounterHiRes());
+                    }
+                    DBG("UnInvite to echo source removing sink " << e->id);
                 }
                 else if (auto * latpeer = findRemotePeerByLatencyId(es, sourceId)) {
-                    echopeer->latencysource->remove_sink(es, e->id);
-                    echopeer->latencysource->stop();
-                    DBG("UnInvite to latency source adding sink " << e->id);
+                    const ScopedReadLock sl (mCoreLock);
+                    if (latpeer->latencysource) {
+                        latpeer->latencysource->remove_sink(es, e->id);
+                        latpeer->latencysource->stop();
+                    }
+                    DBG("UnInvite to latency source removing sink " << e->id);
                 }
 
                 else {
@@ -3667,8 +4360,12 @@ int32_t SonobusAudioProcessor::handleSourceEvents(const aoo_event ** events, int
                 // now we need to set our latency and echo source to match our main source's format
                 aoo_format_storage fmt;
                 if (peer->oursource->get_format(fmt) > 0) {
-                    peer->latencysource->set_format(fmt.header);
-                    peer->echosource->set_format(fmt.header);
+                    if (peer->latencysource) {
+                        peer->latencysource->set_format(fmt.header);
+                    }
+                    if (peer->echosource) {
+                        peer->echosource->set_format(fmt.header);
+                    }
 
                     AudioCodecFormatCodec codec = String(fmt.header.codec) == AOO_CODEC_OPUS ? CodecOpus : CodecPCM;
                     if (codec == CodecOpus) {
@@ -3917,8 +4614,12 @@ int32_t SonobusAudioProcessor::handleSinkEvents(const aoo_event ** events, int32
                                 peer->buffertimeMs += adjms;
                                 peer->totalEstLatency = peer->smoothPingTime.xbar + 2*peer->buffertimeMs + (1e3*currSamplesPerBlock/getSampleRate());
                                 peer->oursink->set_buffersize(peer->buffertimeMs);
-                                peer->echosink->set_buffersize(peer->buffertimeMs);
-                                peer->latencysink->set_buffersize(peer->buffertimeMs);
+                                if (peer->echosink) {
+                                    peer->echosink->set_buffersize(peer->buffertimeMs);
+                                }
+                                if (peer->latencysink) {
+                                    peer->latencysink->set_buffersize(peer->buffertimeMs);
+                                }
                                 peer->latencyDirty = true;
                                 peer->fillRatioSlow.reset();
                                 peer->fillRatio.reset();
@@ -4047,8 +4748,9 @@ int32_t SonobusAudioProcessor::handleSinkEvents(const aoo_event ** events, int32
                 }
 
 
-                if (peer->autosizeBufferMode == AutoNetBufferModeAutoFull) {
+                if (peer->autosizeBufferMode == AutoNetBufferModeAutoFull && !mAdaptiveNetBuffer.get()) {
                     // possibly adjust net buffer down, if it has been longer than threshold since last drop
+                    // (not needed if the sink adapts its fill level by itself)
                     double nowtime = Time::getMillisecondCounterHiRes();
                     const float nodropsthresh = 10.0; // no drops in 10 seconds
                     const float adjustlimit = 10; // don't adjust more often than once every 10 seconds
@@ -4067,8 +4769,12 @@ int32_t SonobusAudioProcessor::handleSinkEvents(const aoo_event ** events, int32
 
                                 peer->totalEstLatency = peer->smoothPingTime.xbar + 2*peer->buffertimeMs + (1e3*currSamplesPerBlock/getSampleRate());
                                 peer->oursink->set_buffersize(peer->buffertimeMs);
-                                peer->echosink->set_buffersize(peer->buffertimeMs);
-                                peer->latencysink->set_buffersize(peer->buffertimeMs);
+                                if (peer->echosink) {
+                                    peer->echosink->set_buffersize(peer->buffertimeMs);
+                                }
+                                if (peer->latencysink) {
+                                    peer->latencysink->set_buffersize(peer->buffertimeMs);
+                                }
                                 peer->latencyDirty = true;
 
                                 peer->fillRatioSlow.reset();
@@ -4320,6 +5026,12 @@ int32_t SonobusAudioProcessor::handleClientEvents(const aoo_event ** events, int
 
                 EndpointState * endpoint = findOrAddRawEndpoint(e->address);
                 if (endpoint) {
+                    EndpointState * relay = e->relay_address ? findOrAddRawEndpoint(e->relay_address) : nullptr;
+                    if (relay) {
+                        DBG("Peer " << e->user << " is only reachable through the server relay");
+                        relay->isRelayServer = true;
+                    }
+                    endpoint->relay = relay;
                  
                     // check if blocked
                     if (isAddressBlocked(endpoint->ipaddr)) {
@@ -4377,6 +5089,7 @@ int32_t SonobusAudioProcessor::handleClientEvents(const aoo_event ** events, int
                 if (endpoint) {
                     
                     removeAllRemotePeersWithEndpoint(endpoint);
+                    endpoint->relay = nullptr;
                 }
                 
                 //aoo_node_remove_peer(x->x_node, gensym(e->group), gensym(e->user));
@@ -4640,6 +5353,7 @@ bool SonobusAudioProcessor::removeAllRemotePeers()
     {
         const ScopedWriteLock slw (mCoreLock);
         mRemotePeers.clearQuick(false); // not deleting objects here
+        publishRemotePeerIds();
     }
     
     // reset matrix
@@ -4682,6 +5396,7 @@ bool SonobusAudioProcessor::removeRemotePeer(int index, bool sendblock)
             {
                 const ScopedWriteLock slw (mCoreLock);
                 mRemotePeers.remove(index, false); // not deleting in scoped write lock
+                publishRemotePeerIds();
             }
 
         }
@@ -5175,6 +5890,42 @@ void SonobusAudioProcessor::updateDynamicResampling()
     }
 }
 
+void SonobusAudioProcessor::setResampleQuality(int quality)
+{
+    quality = jlimit(AOO_RESAMPLE_LINEAR, AOO_RESAMPLE_SINC_LONG, quality);
+    if (mResampleQuality.exchange(quality) == quality) return;
+
+    const ScopedReadLock sl (mCoreLock);
+    for (int i=0; i < mRemotePeers.size(); ++i) {
+        RemotePeer * remote = mRemotePeers.getUnchecked(i);
+        remote->oursink->set_resample_quality(quality);
+        remote->oursource->set_resample_quality(quality);
+    }
+}
+
+void SonobusAudioProcessor::setAdaptiveNetBuffer(bool flag)
+{
+    mAdaptiveNetBuffer = flag;
+
+    const ScopedReadLock sl (mCoreLock);
+    for (int i=0; i < mRemotePeers.size(); ++i) {
+        RemotePeer * remote = mRemotePeers.getUnchecked(i);
+        remote->oursink->set_adaptive_buffer(flag ? 1 : 0);
+    }
+}
+
+void SonobusAudioProcessor::setAdaptiveNetBufferMaxStretch(float fraction)
+{
+    fraction = jlimit(0.001f, 0.1f, fraction);
+    mAdaptiveNetBufferMaxStretch = fraction;
+
+    const ScopedReadLock sl (mCoreLock);
+    for (int i=0; i < mRemotePeers.size(); ++i) {
+        RemotePeer * remote = mRemotePeers.getUnchecked(i);
+        remote->oursink->set_adaptive_maxstretch(fraction);
+    }
+}
+
 
 
 
@@ -5278,8 +6029,12 @@ void SonobusAudioProcessor::setRemotePeerBufferTime(int index, float bufferMs)
         remote->buffertimeMs = bufferMs;
         remote->totalEstLatency = remote->smoothPingTime.xbar + 2*remote->buffertimeMs + (1e3*currSamplesPerBlock/getSampleRate());
         remote->oursink->set_buffersize(remote->buffertimeMs); // ms
-        remote->echosink->set_buffersize(remote->buffertimeMs);
-        remote->latencysink->set_buffersize(remote->buffertimeMs);
+        if (remote->echosink) {
+            remote->echosink->set_buffersize(remote->buffertimeMs);
+        }
+        if (remote->latencysink) {
+            remote->latencysink->set_buffersize(remote->buffertimeMs);
+        }
         remote->fillRatioSlow.reset();
         remote->fillRatio.reset();
         remote->netBufAutoBaseline = (1e3*currSamplesPerBlock/getSampleRate()); // at least a process block
@@ -5302,6 +6057,7 @@ void SonobusAudioProcessor::setRemotePeerBufferTime(int index, float bufferMs)
             remote->totalEstLatency = remote->totalLatency + (remote->buffertimeMs - remote->bufferTimeAtRealLatency);
         }
 
+        publishRemotePeerTelemetry(index);
         sendRemotePeerInfoUpdate(index);
     }
 }
@@ -5341,6 +6097,7 @@ void SonobusAudioProcessor::setRemotePeerAutoresizeBufferMode(int index, Sonobus
         remote->fastDropRate.resetInitVal(0.0f);
 
         //remote->lastDroptime = 0;
+        publishRemotePeerTelemetry(index);
     }
 }
 
@@ -5367,16 +6124,47 @@ bool SonobusAudioProcessor::getRemotePeerReceiveBufferFillRatio(int index, float
 {
     retratio = 0.0f;
     retstddev = 0.0f;
-    const ScopedReadLock sl (mCoreLock);
-    if (index < mRemotePeers.size()) {
-        RemotePeer * remote = mRemotePeers.getUnchecked(index);
-        retratio = remote->fillRatio.xbar;
-        retstddev = remote->fillRatioSlow.s2xx;
+    PeerTelemetry info;
+    if (getRemotePeerTelemetry(index, info)) {
+        retratio = info.fillRatio;
+        retstddev = info.fillRatioStdDev;
+        return true;
+    }
+    return false;
+}
+
+bool SonobusAudioProcessor::getRemotePeerJitterStats(int index, aoo_jitter_stats & retstats) const
+{
+    PeerTelemetry info;
+    if (getRemotePeerTelemetry(index, info) && info.hasJitterStats) {
+        retstats = info.jitterStats;
         return true;
     }
     return false;
 }
 
+bool SonobusAudioProcessor::getRemotePeerTelemetry(int index, PeerTelemetry & retinfo) const
+{
+    // no lock, the snapshots stay valid for every index, even while peers are removed
+    if (index < 0 || index >= mPublishedPeerCount.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    // the snapshot may still be from the peer which was at this index before
+    if (!mPeerTelemetry[index].read(retinfo)
+        || retinfo.peerId != mPublishedPeerIds[index].load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    // the audio part may briefly belong to a different peer after a removal
+    PeerAudioTelemetry audioinfo;
+    if (mPeerAudioTelemetry[index].read(audioinfo) && audioinfo.peerId == retinfo.peerId) {
+        retinfo.fillRatio = audioinfo.fillRatio;
+        retinfo.fillRatioStdDev = audioinfo.fillRatioStdDev;
+    }
+    return true;
+}
+
 void SonobusAudioProcessor::setRemotePeerRecvActive(int index, bool active)
 {
     const ScopedReadLock sl (mCoreLock);        
@@ -5400,6 +6188,7 @@ void SonobusAudioProcessor::setRemotePeerRecvActive(int index, bool active)
             remote->oursink->uninvite_source(remote->endpoint, remote->remoteSourceId, endpoint_send);
         }
 #endif
+        publishRemotePeerTelemetry(index);
     }
 }
 
@@ -5429,6 +6218,7 @@ void SonobusAudioProcessor::setRemotePeerSendAllow(int index, bool allow, bool c
                 setRemotePeerSendActive(index, allow);
             }
         }
+        publishRemotePeerTelemetry(index);
     }
 }
 
@@ -5458,6 +6248,7 @@ void SonobusAudioProcessor::setRemotePeerRecvAllow(int index, bool allow, bool c
                 setRemotePeerRecvActive(index, allow);
             }
         }
+        publishRemotePeerTelemetry(index);
     }
 }
 
@@ -5504,82 +6295,50 @@ bool SonobusAudioProcessor::getRemotePeerSoloed(int index) const
 
 int64_t SonobusAudioProcessor::getRemotePeerPacketsReceived(int index) const
 {
-    const ScopedReadLock sl (mCoreLock);        
-    if (index < mRemotePeers.size()) {
-        RemotePeer * remote = mRemotePeers.getUnchecked(index);
-        return remote->dataPacketsReceived;
-    }
-    return 0;      
+    PeerTelemetry info;
+    return getRemotePeerTelemetry(index, info) ? info.packetsReceived : 0;
 }
 
 int64_t SonobusAudioProcessor::getRemotePeerPacketsSent(int index) const
 {
-    const ScopedReadLock sl (mCoreLock);        
-    if (index < mRemotePeers.size()) {
-        RemotePeer * remote = mRemotePeers.getUnchecked(index);
-        return remote->dataPacketsSent;
-    }
-    return 0;      
+    PeerTelemetry info;
+    return getRemotePeerTelemetry(index, info) ? info.packetsSent : 0;
 }
 
 int64_t SonobusAudioProcessor::getRemotePeerBytesSent(int index) const
 {
-    const ScopedReadLock sl (mCoreLock);        
-    if (index < mRemotePeers.size()) {
-        RemotePeer * remote = mRemotePeers.getUnchecked(index);
-        return remote->endpoint->sentBytes;
-    }
-    return 0;          
+    PeerTelemetry info;
+    return getRemotePeerTelemetry(index, info) ? info.bytesSent : 0;
 }
 
 int64_t SonobusAudioProcessor::getRemotePeerBytesReceived(int index) const
 {
-    const ScopedReadLock sl (mCoreLock);        
-    if (index < mRemotePeers.size()) {
-        RemotePeer * remote = mRemotePeers.getUnchecked(index);
-        return remote->endpoint->recvBytes;
-    }
-    return 0;      
+    PeerTelemetry info;
+    return getRemotePeerTelemetry(index, info) ? info.bytesReceived : 0;
 }
 
 int64_t  SonobusAudioProcessor::getRemotePeerPacketsDropped(int index) const
 {
-    const ScopedReadLock sl (mCoreLock);        
-    if (index < mRemotePeers.size()) {
-        RemotePeer * remote = mRemotePeers.getUnchecked(index);
-        return remote->dataPacketsDropped;
-    }
-    return 0;      
+    PeerTelemetry info;
+    return getRemotePeerTelemetry(index, info) ? info.packetsDropped : 0;
 }
 
 int64_t  SonobusAudioProcessor::getRemotePeerPacketsResent(int index) const
 {
-    const ScopedReadLock sl (mCoreLock);        
-    if (index < mRemotePeers.size()) {
-        RemotePeer * remote = mRemotePeers.getUnchecked(index);
-        return remote->dataPacketsResent;
-    }
-    return 0;      
+    PeerTelemetry info;
+    return getRemotePeerTelemetry(index, info) ? info.packetsResent : 0;
 }
 
 bool SonobusAudioProcessor::getRemotePeerSafetyMuted(int index) const
 {
-    const ScopedReadLock sl (mCoreLock);
-    if (index < mRemotePeers.size()) {
-        RemotePeer * remote = mRemotePeers.getUnchecked(index);
-        return remote->resetSafetyMuted;
-    }
-    return false;
+    PeerTelemetry info;
+    return getRemotePeerTelemetry(index, info) ? info.safetyMuted : false;
 }
 
 bool SonobusAudioProcessor::getRemotePeerBlockedUs(int index) const
 {
-    const ScopedReadLock sl (mCoreLock);
-    if (index < mRemotePeers.size()) {
-        RemotePeer * remote = mRemotePeers.getUnchecked(index);
-        return remote->blockedUs;
-    }
-    return false;
+    PeerTelemetry info;
+    return getRemotePeerTelemetry(index, info) ? info.blockedUs : false;
 }
 
 void  SonobusAudioProcessor::resetRemotePeerPacketStats(int index)
@@ -5760,9 +6519,20 @@ bool  SonobusAudioProcessor::isRemotePeerRecording(int index) const
 
 bool SonobusAudioProcessor::startRemotePeerLatencyTest(int index, float durationsec)
 {
+    RemotePeer * remote = nullptr;
+    {
+        const ScopedReadLock sl (mCoreLock);
+        if (index >= mRemotePeers.size()) return false;
+        remote = mRemotePeers.getUnchecked(index);
+    }
+
+    // our latency pair only exists while we are testing
+    if (!createTestEndpoints(remote, false)) {
+        return false;
+    }
+
     const ScopedReadLock sl (mCoreLock);        
-    if (index < mRemotePeers.size()) {
-        RemotePeer * remote = mRemotePeers.getUnchecked(index);
+    if (mRemotePeers.contains(remote)) {
         if (!remote->activeLatencyTest) {
             // invite remote's echosource to send to our latency sink
 
@@ -5786,6 +6556,7 @@ bool SonobusAudioProcessor::startRemotePeerLatencyTest(int index, float duration
 #endif
             remote->hasRealLatency = false;
             remote->activeLatencyTest = true;
+            publishRemotePeerTelemetry(mRemotePeers.indexOf(remote));
         }
         return true;
     }
@@ -5806,6 +6577,9 @@ bool SonobusAudioProcessor::stopRemotePeerLatencyTest(int index)
             remote->latencysource->stop();
 
             remote->activeLatencyTest = false;            
+
+            LatencyTestEndpoints::scheduleRelease(*remote, false, Time::getMillisecondCounterHiRes());
+            publishRemotePeerTelemetry(index);
         }
         return true;
     }
@@ -5827,6 +6601,7 @@ void SonobusAudioProcessor::setRemotePeerSendActive(int index, bool active)
         } else {
             remote->oursource->stop();            
         }
+        publishRemotePeerTelemetry(index);
     }
 }
 
@@ -5846,6 +6621,7 @@ void SonobusAudioProcessor::setRemotePeerConnected(int index, bool active)
     if (index < mRemotePeers.size()) {
         RemotePeer * remote = mRemotePeers.getUnchecked(index);
         remote->connected = active;
+        publishRemotePeerTelemetry(index);
     }
 }
 
@@ -5921,40 +6697,136 @@ SonobusAudioProcessor::RemotePeer *  SonobusAudioProcessor::findRemotePeerByRemo
     return retpeer;        
 }
 
-SonobusAudioProcessor::RemotePeer *  SonobusAudioProcessor::findRemotePeerByEchoId(EndpointState * endpoint, int32_t echoId)
+SonobusAudioProcessor::RemotePeer *  SonobusAudioProcessor::findRemotePeerByEchoId(EndpointState * endpoint, int32_t echoId)
+{
+    const ScopedReadLock sl (mCoreLock);        
+
+    RemotePeer * retpeer = 0;
+
+    for (auto s : mRemotePeers) {
+        if (s->endpoint == endpoint && s->ourId+ECHO_ID_OFFSET == echoId) {
+            retpeer = s;
+            break;
+        }
+    }
+        
+    return retpeer;        
+}
+
+SonobusAudioProcessor::RemotePeer *  SonobusAudioProcessor::findRemotePeerByLatencyId(EndpointState * endpoint, int32_t latId)
+{
+    const ScopedReadLock sl (mCoreLock);        
+
+    RemotePeer * retpeer = 0;
+
+    for (auto s : mRemotePeers) {
+        if (s->endpoint == endpoint && s->ourId+LATENCY_ID_OFFSET == latId) {
+            retpeer = s;
+            break;
+        }
+    }
+        
+    return retpeer;        
+}
+
+
+
+// creates the latency (or echo) sink/source pair of a peer if it isn't there yet,
+// call without mCoreLock held
+bool SonobusAudioProcessor::createTestEndpoints(RemotePeer * remote, bool echo)
+{
+    // destroyed after the write lock is released, if unused
+    aoo::isink::pointer sink;
+    aoo::isource::pointer source;
+
+    {
+        const ScopedReadLock sl (mCoreLock);
+
+        if (!mRemotePeers.contains(remote)) return false;
+
+        // also cancels any pending release
+        if (LatencyTestEndpoints::retain(*remote, echo)) return true;
+
+        const int32_t id = remote->ourId + (echo ? ECHO_ID_OFFSET : LATENCY_ID_OFFSET);
+        sink.reset(aoo::isink::create(id));
+        source.reset(aoo::isource::create(id));
+
+        int32_t flags = AOO_PROTOCOL_FLAG_COMPACT_DATA;
+        sink->set_option(aoo_opt_protocol_flags, &flags, sizeof(int32_t));
+        sink->set_nonblocking_process(1);
+        sink->set_buffersize(remote->buffertimeMs);
+        source->set_packetsize(remote->packetsize);
+
+        // never dynamic resampling the latency and echo ones
+        sink->set_dynamic_resampling(0);
+        source->set_dynamic_resampling(0);
+
+        source->set_ping_interval(2000);
+        source->set_respect_codec_change_requests(1);
+
+        sink->set_event_notify(notifyPeerEvents, remote);
+        source->set_event_notify(notifyPeerEvents, remote);
+
+        setupTestEndpoints(remote, sink.get(), source.get(), echo);
+    }
+
+    const ScopedWriteLock slw (mCoreLock);
+
+    if (!mRemotePeers.contains(remote)) return false;
+
+    if (LatencyTestEndpoints::install(*remote, echo, sink, source)) {
+        DBG("Created " << (echo ? "echo" : "latency") << " endpoints for peer " << remote->ourId);
+    }
+
+    return true;
+}
+
+void SonobusAudioProcessor::setupTestEndpoints(RemotePeer * remote, aoo::isink * sink, aoo::isource * source, bool echo)
 {
-    const ScopedReadLock sl (mCoreLock);        
+    setupSourceFormat(remote, source, true);
+    source->setup(getSampleRate(), currSamplesPerBlock, 1);
 
-    RemotePeer * retpeer = 0;
-
-    for (auto s : mRemotePeers) {
-        if (s->endpoint == endpoint && s->ourId+ECHO_ID_OFFSET == echoId) {
-            retpeer = s;
-            break;
-        }
+    if (echo) {
+        float sendbufsize = jmax(10.0, SENDBUFSIZE_SCALAR * 1000.0f * currSamplesPerBlock / getSampleRate());
+        source->set_buffersize(sendbufsize);
     }
-        
-    return retpeer;        
+
+    sink->setup(getSampleRate(), currSamplesPerBlock, 1);
 }
 
-SonobusAudioProcessor::RemotePeer *  SonobusAudioProcessor::findRemotePeerByLatencyId(EndpointState * endpoint, int32_t latId)
+// destroys latency and echo pairs whose test has been over for a while,
+// called on the event thread without mCoreLock held
+void SonobusAudioProcessor::releaseIdleTestEndpoints()
 {
-    const ScopedReadLock sl (mCoreLock);        
+    const double nowms = Time::getMillisecondCounterHiRes();
 
-    RemotePeer * retpeer = 0;
+    bool anydue = false;
+    {
+        const ScopedReadLock sl (mCoreLock);
+        for (auto remote : mRemotePeers) {
+            if (LatencyTestEndpoints::anyReleaseDue(*remote, nowms)) {
+                anydue = true;
+                break;
+            }
+        }
+    }
 
-    for (auto s : mRemotePeers) {
-        if (s->endpoint == endpoint && s->ourId+LATENCY_ID_OFFSET == latId) {
-            retpeer = s;
-            break;
+    if (!anydue) return;
+
+    // destroyed after the write lock is released
+    std::vector<aoo::isink::pointer> sinks;
+    std::vector<aoo::isource::pointer> sources;
+
+    const ScopedWriteLock slw (mCoreLock);
+
+    for (auto remote : mRemotePeers) {
+        if (LatencyTestEndpoints::takeDue(*remote, nowms, sinks, sources) > 0) {
+            DBG("Released latency/echo endpoints for peer " << remote->ourId);
         }
     }
-        
-    return retpeer;        
 }
 
 
-
 SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNecessary(EndpointState * endpoint, int32_t ourId, const String & username, const String & groupname)
 {
     const ScopedReadLock sl (mCoreLock);
@@ -5991,6 +6863,9 @@ SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNece
 
         retpeer = new RemotePeer(endpoint, newid);
 
+        retpeer->owner = this;
+        retpeer->oursink->set_event_notify(notifyPeerEvents, retpeer);
+        retpeer->oursource->set_event_notify(notifyPeerEvents, retpeer);
 
         retpeer->userName = username;
         retpeer->groupName = groupname;
@@ -6020,6 +6895,7 @@ SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNece
         
         retpeer->oursink->setup(getSampleRate(), currSamplesPerBlock, getMainBusNumOutputChannels());
         retpeer->oursink->set_buffersize(retpeer->buffertimeMs);
+        retpeer->oursink->set_loss_concealment(retpeer->lossConcealment);
 
         int32_t flags = AOO_PROTOCOL_FLAG_COMPACT_DATA;
         retpeer->oursink->set_option(aoo_opt_protocol_flags, &flags, sizeof(int32_t));
@@ -6034,43 +6910,18 @@ SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNece
         retpeer->oursource->set_packetsize(retpeer->packetsize);        
         //setupSourceUserFormat(retpeer, retpeer->oursource.get());
 
-        setupSourceFormat(retpeer, retpeer->latencysource.get(), true);
-        retpeer->latencysource->setup(getSampleRate(), currSamplesPerBlock, 1);
-        retpeer->latencysource->set_packetsize(retpeer->packetsize);
-        setupSourceFormat(retpeer, retpeer->echosource.get(), true);
-        retpeer->echosource->setup(getSampleRate(), currSamplesPerBlock, 1);
-        retpeer->echosource->set_buffersize(1000.0f * currSamplesPerBlock / getSampleRate());
-        retpeer->echosource->set_packetsize(retpeer->packetsize);
-
-        retpeer->latencysink->setup(getSampleRate(), currSamplesPerBlock, 1);
-        retpeer->echosink->setup(getSampleRate(), currSamplesPerBlock, 1);
-
-        retpeer->latencysink->set_option(aoo_opt_protocol_flags, &flags, sizeof(int32_t));
-        retpeer->echosink->set_option(aoo_opt_protocol_flags, &flags, sizeof(int32_t));
-
-        retpeer->latencysink->set_buffersize(retpeer->buffertimeMs);
-        retpeer->echosink->set_buffersize(retpeer->buffertimeMs);
-
-        // never dynamic resampling the latency and echo ones
-        retpeer->latencysink->set_dynamic_resampling(0);
-        retpeer->echosink->set_dynamic_resampling(0);
-        retpeer->latencysource->set_dynamic_resampling(0);
-        retpeer->echosource->set_dynamic_resampling(0);
-
-        
         retpeer->oursource->set_ping_interval(2000);
-        retpeer->latencysource->set_ping_interval(2000);
-        retpeer->echosource->set_ping_interval(2000);
-
         retpeer->oursource->set_respect_codec_change_requests(1);
-        retpeer->latencysource->set_respect_codec_change_requests(1);
-        retpeer->echosource->set_respect_codec_change_requests(1);
         
         //retpeer->latencyProcessor.reset(new MTDM(getSampleRate()));
         retpeer->latencyMeasurer.reset(new LatencyMeasurer());
         
         retpeer->oursink->set_dynamic_resampling(mDynamicResampling.get() ? 1 : 0);
         retpeer->oursource->set_dynamic_resampling(mDynamicResampling.get() ? 1 : 0);
+        retpeer->oursink->set_resample_quality(mResampleQuality.get());
+        retpeer->oursource->set_resample_quality(mResampleQuality.get());
+        retpeer->oursink->set_adaptive_buffer(mAdaptiveNetBuffer.get() ? 1 : 0);
+        retpeer->oursink->set_adaptive_maxstretch(mAdaptiveNetBufferMaxStretch.get());
 
         
         retpeer->workBuffer.setSize(2, currSamplesPerBlock, false, false, true);
@@ -6099,6 +6950,7 @@ SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNece
         {
             const ScopedWriteLock slw (mCoreLock);
             mRemotePeers.add(retpeer);
+            publishRemotePeerIds();
         }
 
         //updateRemotePeerUserFormat(mRemotePeers.size()-1);
@@ -6114,12 +6966,21 @@ SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNece
             if (findAndLoadCacheForPeer(retpeer)) {
                 
                 setupSourceFormat(retpeer, retpeer->oursource.get());
-                setupSourceFormat(retpeer, retpeer->latencysource.get(), true);
-                setupSourceFormat(retpeer, retpeer->echosource.get(), true);
+                if (retpeer->latencysource) {
+                    setupSourceFormat(retpeer, retpeer->latencysource.get(), true);
+                }
+                if (retpeer->echosource) {
+                    setupSourceFormat(retpeer, retpeer->echosource.get(), true);
+                }
 
                 retpeer->oursink->set_buffersize(retpeer->buffertimeMs);
-                retpeer->latencysink->set_buffersize(retpeer->buffertimeMs);
-                retpeer->echosink->set_buffersize(retpeer->buffertimeMs);
+                retpeer->oursink->set_loss_concealment(retpeer->lossConcealment);
+                if (retpeer->latencysink) {
+                    retpeer->latencysink->set_buffersize(retpeer->buffertimeMs);
+                }
+                if (retpeer->echosink) {
+                    retpeer->echosink->set_buffersize(retpeer->buffertimeMs);
+                }
                 
                 for (auto i=0; i < retpeer->numChanGroups && i < MAX_CHANGROUPS; ++i) {
                     retpeer->chanGroups[i].commitCompressorParams();
@@ -6151,6 +7012,9 @@ void SonobusAudioProcessor::commitCacheForPeer(RemotePeer * retpeer)
     newcache.numMultiChanGroups = retpeer->lastMultiNumChanGroups;
     newcache.modifiedChanGroups = retpeer->modifiedMultiChanGroups;
     newcache.orderPriority = retpeer->orderPriority;
+    newcache.lossConcealment = retpeer->lossConcealment;
+    newcache.sendInbandFec = retpeer->sendInbandFec;
+    newcache.sendParity = retpeer->sendParity;
 
     for (int i=0; i < retpeer->numChanGroups && i < MAX_CHANGROUPS; ++i) {
         newcache.channelGroupParams[i] = retpeer->chanGroups[i].params;
@@ -6210,6 +7074,9 @@ bool SonobusAudioProcessor::findAndLoadCacheForPeer(RemotePeer * retpeer)
         retpeer->lastMultiNumChanGroups = cache.numMultiChanGroups;
         retpeer->modifiedChanGroups = retpeer->modifiedMultiChanGroups = cache.modifiedChanGroups;
         retpeer->orderPriority  = cache.orderPriority;
+        retpeer->lossConcealment = cache.lossConcealment;
+        retpeer->sendInbandFec = cache.sendInbandFec;
+        retpeer->sendParity = cache.sendParity;
 
 
         for (int i=0; i < retpeer->numChanGroups  && i < MAX_CHANGROUPS; ++i) {
@@ -6255,6 +7122,7 @@ bool SonobusAudioProcessor::removeAllRemotePeersWithEndpoint(EndpointState * end
                 const ScopedWriteLock slw (mCoreLock);
 
                 removed.add(mRemotePeers.removeAndReturn(i));
+                publishRemotePeerIds();
             }
         }
     }
@@ -6281,6 +7149,7 @@ bool SonobusAudioProcessor::doRemoveRemotePeerIfNecessary(EndpointState * endpoi
             {
                 const ScopedWriteLock slw (mCoreLock);
                 removed.add(mRemotePeers.removeAndReturn(i));
+                publishRemotePeerIds();
             }
             break;
         }
@@ -6332,6 +7201,7 @@ bool SonobusAudioProcessor::formatInfoToAooFormat(const AudioCodecFormatInfo & i
             fmt->signal_type = info.signal_type;
             fmt->application_type = OPUS_APPLICATION_RESTRICTED_LOWDELAY;
             //fmt->application_type = OPUS_APPLICATION_AUDIO;
+            fmt->packet_loss = 0; // no in-band FEC
             
             return true;
         }
@@ -6351,8 +7221,22 @@ void SonobusAudioProcessor::setupSourceFormat(SonobusAudioProcessor::RemotePeer
     int channels = latencymode ? 1  :  peer ? peer->sendChannels : getMainBusNumInputChannels();
     
     if (formatInfoToAooFormat(info, channels, f)) {        
+        if (info.codec == CodecOpus && peer && peer->sendInbandFec && !latencymode) {
+            // FEC needs the SILK/hybrid modes, which aren't available in restricted lowdelay
+            aoo_format_opus *fmt = (aoo_format_opus *)&f;
+            fmt->application_type = OPUS_APPLICATION_AUDIO;
+            fmt->packet_loss = 10;
+        }
         source->set_format(f.header);        
     }
+
+    if (!latencymode) {
+        // peers receiving the same mix with the same format share one encoder,
+        // only worth it for codecs that are more expensive than comparing the input
+        source->set_encode_group(info.codec == CodecOpus ? SHARED_ENCODE_GROUP : 0);
+        // lets the peer rebuild a lost block without waiting for a resend
+        source->set_parity(peer && peer->sendParity ? PARITY_FEC_GROUP_SIZE : 0);
+    }
 }
 
 ValueTree SonobusAudioProcessor::getSendUserFormatLayoutTree()
@@ -7127,25 +8011,15 @@ void SonobusAudioProcessor::setupSourceFormatsForAll()
             s->oursink->setup(sampleRate, currSamplesPerBlock, sinkchan);
         }
 
-        if (s->latencysource) {
-            setupSourceFormat(s, s->latencysource.get(), true);
-            s->latencysource->setup(getSampleRate(), currSamplesPerBlock, 1);
-            setupSourceFormat(s, s->echosource.get(), true);
-            s->echosource->setup(getSampleRate(), currSamplesPerBlock, 1);
-            float sendbufsize = jmax(10.0, SENDBUFSIZE_SCALAR * 1000.0f * currSamplesPerBlock / getSampleRate());
-            s->echosource->set_buffersize(sendbufsize);
-
-            s->netBufAutoBaseline = (1e3*currSamplesPerBlock/getSampleRate()); // at least a process block
-
-            {
-                const ScopedWriteLock sl (s->sinkLock);
-
-                s->latencysink->setup(sampleRate, currSamplesPerBlock, 1);
-                s->echosink->setup(sampleRate, currSamplesPerBlock, 1);
-            }
+        s->netBufAutoBaseline = (1e3*currSamplesPerBlock/getSampleRate()); // at least a process block
 
-            //s->latencyProcessor.reset(new MTDM(sampleRate));
-            //s->latencyMeasurer.reset(new LatencyMeasurer());
+        if (s->latencysource) {
+            const ScopedWriteLock sl (s->sinkLock);
+            setupTestEndpoints(s, s->latencysink.get(), s->latencysource.get(), false);
+        }
+        if (s->echosource) {
+            const ScopedWriteLock sl (s->sinkLock);
+            setupTestEndpoints(s, s->echosink.get(), s->echosource.get(), true);
         }
 
         s->recvMeterSource.resize (s->recvChannels, meterRmsWindow);
@@ -7326,6 +8200,288 @@ void SonobusAudioProcessor::ensureBuffers(int numSamples)
 }
 
 
+// everything on the receive side of a peer which doesn't touch shared buffers,
+// may run on one of the peer workers.
+void SonobusAudioProcessor::processPeerReceive(RemotePeer * remote, int rindex, const PeerRecvContext & ctx)
+{
+    const int numSamples = ctx.numSamples;
+    const int mainBusOutputChannels = ctx.mainBusOutputChannels;
+
+    if (!remote->oursink) {
+        return;
+    }
+
+    // just in case, should be exceedingly rare this is necessary
+    if (remote->workBuffer.getNumSamples() < currSamplesPerBlock
+        || remote->recvChannels > remote->workBuffer.getNumChannels()
+        || mainBusOutputChannels > remote->workBuffer.getNumChannels()) {
+        remote->workBuffer.setSize(jmax(2, jmax(mainBusOutputChannels, remote->recvChannels)), currSamplesPerBlock, false, false, true);
+    }
+
+    remote->workBuffer.clear(0, numSamples);
+
+    // calculate fill ratio before processing the sink
+    float retratio = 0.0f;
+    if (remote->oursink->get_sourceoption(remote->endpoint, remote->remoteSourceId, aoo_opt_buffer_fill_ratio, &retratio, sizeof(retratio)) > 0) {
+        remote->fillRatio.Z *= 0.95;
+        remote->fillRatio.push(retratio);
+        remote->fillRatioSlow.Z *= 0.99;
+        remote->fillRatioSlow.push(retratio);
+
+        if (rindex < MAX_PEERS) {
+            PeerAudioTelemetry info;
+            info.peerId = remote->ourId;
+            info.fillRatio = remote->fillRatio.xbar;
+            info.fillRatioStdDev = remote->fillRatioSlow.s2xx;
+            mPeerAudioTelemetry[rindex].publish(info);
+        }
+    }
+
+    
+    {
+        // get audio data coming in from outside into tempbuf
+        const ScopedReadLock sl (remote->sinkLock); // not contended, should be able to get rid of
+
+        // just in case, should be exceedingly rare this is necessary
+        if (remote->workBuffer.getNumSamples() < currSamplesPerBlock
+            || remote->recvChannels > remote->workBuffer.getNumChannels()
+            || mainBusOutputChannels > remote->workBuffer.getNumChannels()) {
+            remote->workBuffer.setSize(jmax(2, jmax(mainBusOutputChannels, remote->recvChannels)), currSamplesPerBlock, false, false, true);
+        }
+
+        remote->workBuffer.clear(0, numSamples);
+
+        remote->oursink->process((float **)remote->workBuffer.getArrayOfWritePointers(), numSamples, ctx.t);
+    }
+
+    
+    // record individual tracks pre-compressor/level/pan, ignoring muting/solo, raw material
+
+    if (ctx.writerLocked) {
+        if (remote->fileWriter)
+        {
+            float *tmpbuf[MAX_PANNERS];
+            int numchan = remote->fileWriter->getWriter()->getNumChannels();
+            for (int i = 0; i < numchan && i < MAX_PANNERS; ++i) {
+                if (i < remote->recvChannels) {
+                    tmpbuf[i] = remote->workBuffer.getWritePointer(i);
+                }
+                else {
+                    tmpbuf[i] = silentBuffer.getWritePointer(0);
+                }
+            }
+            remote->fileWriter->write (tmpbuf, numSamples);
+        }
+    }
+
+    // write out per-user output bus
+    if (remote->recvActive && remote->recvChannels > 0) {
+        if (auto userbus = getBus(false, OutUserBaseBusIndex + rindex)) {
+            if (userbus->isEnabled()) {
+                int index = getChannelIndexInProcessBlockBuffer(false, OutUserBaseBusIndex + rindex, 0);
+                int cnt = getChannelCountOfBus(false, OutUserBaseBusIndex + rindex);
+                for (int i=0; i < cnt; ++i) {
+                    if (i < remote->recvChannels) {
+                        ctx.buffer->copyFrom(index+i, 0, remote->workBuffer, i, 0, numSamples);
+                    }
+                    else {
+                        // it should already be clear
+                        //buffer.clear(index+i, 0, numSamples);
+                    }
+                }
+            }
+        }
+    }
+
+    
+    // apply effects
+
+    float usegain = remote->gain;
+    bool wasSilent = false;
+
+    bool forceSilent = false;
+
+    // we get the stuff, but ignore it (either muted or others soloed)
+    if (!remote->recvActive || (ctx.anysoloed && !remote->soloed) || remote->resetSafetyMuted) {
+
+        usegain = 0.0f;
+        forceSilent = true;
+
+        if (remote->_lastgain <= 0.0f) {
+            wasSilent = true;
+        }
+    }
+
+    bool anysubsolo = false;
+    for (auto cgi = 0; cgi < remote->numChanGroups; ++cgi) {
+        if (remote->chanGroups[cgi].params.soloed) {
+            anysubsolo = true;
+            break;
+        }
+    }
+
+    for (auto cgi = 0; cgi < remote->numChanGroups; ++cgi) {
+        remote->chanGroups[cgi].processBlock(remote->workBuffer, remote->workBuffer, remote->chanGroups[cgi].params.chanStartIndex,  remote->chanGroups[cgi].params.numChannels, silentBuffer, numSamples, usegain);
+    }
+
+    remote->_lastgain = usegain;
+    remote->_recvSilent = wasSilent;
+    remote->_recvAnySubSolo = anysubsolo;
+
+
+    remote->recvMeterSource.measureBlock (remote->workBuffer, 0, numSamples);
+
+    for (auto cgi = 0; cgi < remote->numChanGroups; ++cgi) {
+        float redlev = 1.0f;
+        if (remote->chanGroups[cgi].params.compressorParams.enabled && remote->chanGroups[cgi].compressorOutputLevel) {
+            redlev = jlimit(0.0f, 1.0f, Decibels::decibelsToGain(*remote->chanGroups[cgi].compressorOutputLevel));
+        }
+        for (auto j=0; j < remote->chanGroups[cgi].params.numChannels; ++j) {
+            int ch = remote->chanGroups[cgi].params.chanStartIndex + j;
+            remote->recvMeterSource.setReductionLevel(ch, redlev);
+        }
+    }
+}
+
+void SonobusAudioProcessor::runPeerReceiveJobs(int count)
+{
+    // publish the jobs for this block, the generation keeps late workers from claiming stale ones
+    mPeerJobsDone.store(0, std::memory_order_relaxed);
+    ++mPeerJobGeneration;
+    mPeerJobState.store(((uint64) mPeerJobGeneration << 32) | ((uint64) count << 16), std::memory_order_release);
+
+    for (int i = 0; i < mPeerWorkers.size() && i < count - 1; ++i) {
+        mPeerWorkers.getUnchecked(i)->wakeUp();
+    }
+
+    // the audio thread does its share too, so we never wait on a job nobody has claimed yet
+    while (runPeerReceiveJob()) {}
+
+    if (mPeerJobsDone.load(std::memory_order_acquire) >= count) {
+        return;
+    }
+
+    // spin for a short while, the workers are usually almost done
+    const double blockms = 1e3 * mPeerRecvContext.numSamples / jmax(1.0, getSampleRate());
+    const double startms = Time::getMillisecondCounterHiRes();
+    double nowms = startms;
+
+    while (mPeerJobsDone.load(std::memory_order_acquire) < count && nowms - startms < PEER_JOB_SPIN_FRACTION * blockms) {
+        nowms = Time::getMillisecondCounterHiRes();
+    }
+
+    if (mPeerJobsDone.load(std::memory_order_acquire) >= count) {
+        return;
+    }
+
+    // a worker was likely preempted, take over any job it claimed but hasn't started yet
+    for (int i = 0; i < count; ++i) {
+        runPeerReceiveJob(i, mPeerJobGeneration);
+    }
+
+    // only jobs already running on a worker are left, they can't be abandoned halfway
+    while (mPeerJobsDone.load(std::memory_order_acquire) < count) {
+        Thread::yield();
+    }
+
+    if (Time::getMillisecondCounterHiRes() - startms > PEER_JOB_MAX_WAIT_FRACTION * blockms) {
+        // the workers aren't keeping up, process serially for a while
+        mPeerJobSerialBlocks = PEER_JOB_SERIAL_BLOCKS;
+        DBG("Peer worker overran, processing serially for " << PEER_JOB_SERIAL_BLOCKS << " blocks");
+    }
+}
+
+bool SonobusAudioProcessor::runPeerReceiveJob()
+{
+    auto state = mPeerJobState.load(std::memory_order_acquire);
+
+    while (true) {
+        int next = (int) (state & 0xffff);
+        int count = (int) ((state >> 16) & 0xffff);
+
+        if (next >= count) {
+            return false;
+        }
+
+        if (mPeerJobState.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel)) {
+            runPeerReceiveJob(next, (uint32) (state >> 32));
+            return true;
+        }
+    }
+}
+
+bool SonobusAudioProcessor::runPeerReceiveJob(int index, uint32 generation)
+{
+    // whoever marks the job started for this generation first runs it,
+    // a worker waking up late for an older generation must not touch it
+    auto started = mPeerJobStarted[index].load(std::memory_order_acquire);
+    do {
+        if ((int32) (generation - started) <= 0) {
+            return false;
+        }
+    } while (!mPeerJobStarted[index].compare_exchange_weak(started, generation, std::memory_order_acq_rel));
+
+    processPeerReceive(mRemotePeers.getUnchecked(index), index, mPeerRecvContext);
+    mPeerJobsDone.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+void SonobusAudioProcessor::setParallelPeerProcessing(bool flag)
+{
+    mParallelPeerProcessing = flag;
+
+    if (flag && mPeerWorkers.isEmpty()) {
+        startPeerWorkers();
+    }
+    else if (!flag && !mPeerWorkers.isEmpty()) {
+        stopPeerWorkers();
+    }
+}
+
+void SonobusAudioProcessor::startPeerWorkers()
+{
+    // leave a core for the audio thread and one for the rest
+    int numworkers = jlimit(1, MAX_PEER_WORKERS, SystemStats::getNumCpus() - 2);
+
+    OwnedArray<PeerProcessWorker> workers;
+
+    for (int i = 0; i < numworkers; ++i) {
+        auto * worker = workers.add(new PeerProcessWorker(*this, i));
+
+#if JUCE_WINDOWS
+        worker->startThread(Thread::Priority::highest);
+#else
+        if (!worker->startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(1).withMaximumProcessingTimeMs(5)))
+        {
+            DBG("Peer worker failed to start realtime: trying regular");
+            worker->startThread(Thread::Priority::highest);
+        }
+#endif
+    }
+
+    const ScopedWriteLock sl (mCoreLock);
+    mPeerWorkers.swapWith(workers);
+}
+
+void SonobusAudioProcessor::stopPeerWorkers()
+{
+    OwnedArray<PeerProcessWorker> workers;
+
+    {
+        // no block is using them after this
+        const ScopedWriteLock sl (mCoreLock);
+        mPeerWorkers.swapWith(workers);
+    }
+
+    for (auto * worker : workers) {
+        worker->signalThreadShouldExit();
+        worker->wakeUp();
+    }
+    for (auto * worker : workers) {
+        worker->stopThread(400);
+    }
+}
+
 void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
 {
     ScopedNoDenormals noDenormals;
@@ -7806,142 +8962,37 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
         
         tempBuffer.clear(0, numSamples);
         
-        int rindex = 0;
-        
-        for (auto & remote : mRemotePeers) 
-        {
-            
-            if (!remote->oursink) { 
-                ++rindex;
-                continue;                
-            }
-
-            // just in case, should be exceedingly rare this is necessary
-            if (remote->workBuffer.getNumSamples() < currSamplesPerBlock
-                || remote->recvChannels > remote->workBuffer.getNumChannels()
-                || mainBusOutputChannels > remote->workBuffer.getNumChannels()) {
-                remote->workBuffer.setSize(jmax(2, jmax(mainBusOutputChannels, remote->recvChannels)), currSamplesPerBlock, false, false, true);
-            }
-
-            remote->workBuffer.clear(0, numSamples);
-
-            // calculate fill ratio before processing the sink
-            float retratio = 0.0f;
-            if (remote->oursink->get_sourceoption(remote->endpoint, remote->remoteSourceId, aoo_opt_buffer_fill_ratio, &retratio, sizeof(retratio)) > 0) {
-                remote->fillRatio.Z *= 0.95;
-                remote->fillRatio.push(retratio);
-                remote->fillRatioSlow.Z *= 0.99;
-                remote->fillRatioSlow.push(retratio);
-            }
-
-            
-            {
-                // get audio data coming in from outside into tempbuf
-                const ScopedReadLock sl (remote->sinkLock); // not contended, should be able to get rid of
-
-                // just in case, should be exceedingly rare this is necessary
-                if (remote->workBuffer.getNumSamples() < currSamplesPerBlock
-                    || remote->recvChannels > remote->workBuffer.getNumChannels()
-                    || mainBusOutputChannels > remote->workBuffer.getNumChannels()) {
-                    remote->workBuffer.setSize(jmax(2, jmax(mainBusOutputChannels, remote->recvChannels)), currSamplesPerBlock, false, false, true);
-                }
-
-                remote->workBuffer.clear(0, numSamples);
-
-                remote->oursink->process((float **)remote->workBuffer.getArrayOfWritePointers(), numSamples, t);
-            }
-
-            
-            // record individual tracks pre-compressor/level/pan, ignoring muting/solo, raw material
-
-            if (userwritingpossible) {
-                const ScopedTryLock sl (writerLock);
-                if (sl.isLocked() && remote->fileWriter)
-                {
-                    float *tmpbuf[MAX_PANNERS];
-                    int numchan = remote->fileWriter->getWriter()->getNumChannels();
-                    for (int i = 0; i < numchan && i < MAX_PANNERS; ++i) {
-                        if (i < remote->recvChannels) {
-                            tmpbuf[i] = remote->workBuffer.getWritePointer(i);
-                        }
-                        else {
-                            tmpbuf[i] = silentBuffer.getWritePointer(0);
-                        }
-                    }
-                    remote->fileWriter->write (tmpbuf, numSamples);
-                }
-            }
-
-            // write out per-user output bus
-            if (remote->recvActive && remote->recvChannels > 0) {
-                if (auto userbus = getBus(false, OutUserBaseBusIndex + rindex)) {
-                    if (userbus->isEnabled()) {
-                        int index = getChannelIndexInProcessBlockBuffer(false, OutUserBaseBusIndex + rindex, 0);
-                        int cnt = getChannelCountOfBus(false, OutUserBaseBusIndex + rindex);
-                        for (int i=0; i < cnt; ++i) {
-                            if (i < remote->recvChannels) {
-                                buffer.copyFrom(index+i, 0, remote->workBuffer, i, 0, numSamples);
-                            }
-                            else {
-                                // it should already be clear
-                                //buffer.clear(index+i, 0, numSamples);
-                            }
-                        }
-                    }
-                }
-            }
-
-            
-            // apply effects
-
-            float usegain = remote->gain;
-            bool wasSilent = false;
-
-            bool forceSilent = false;
-
-            // we get the stuff, but ignore it (either muted or others soloed)
-            if (!remote->recvActive || (anysoloed && !remote->soloed) || remote->resetSafetyMuted) {
-
-                usegain = 0.0f;
-                forceSilent = true;
-
-                if (remote->_lastgain <= 0.0f) {
-                    wasSilent = true;
-                }
-            }
-
-            bool anysubsolo = false;
-            for (auto cgi = 0; cgi < remote->numChanGroups; ++cgi) {
-                if (remote->chanGroups[cgi].params.soloed) {
-                    anysubsolo = true;
-                    break;
-                }
-            }
-
-            for (auto cgi = 0; cgi < remote->numChanGroups; ++cgi) {
-                remote->chanGroups[cgi].processBlock(remote->workBuffer, remote->workBuffer, remote->chanGroups[cgi].params.chanStartIndex,  remote->chanGroups[cgi].params.numChannels, silentBuffer, numSamples, usegain);
-            }
+        // the recording writers are only touched from here on the audio thread, so grab the lock once for all peers
+        const ScopedTryLock wsl (writerLock, userwritingpossible);
 
-            remote->_lastgain = usegain;
+        PeerRecvContext & ctx = mPeerRecvContext;
+        ctx.buffer = &buffer;
+        ctx.numSamples = numSamples;
+        ctx.t = t;
+        ctx.anysoloed = anysoloed;
+        ctx.writerLocked = userwritingpossible && wsl.isLocked();
+        ctx.mainBusOutputChannels = mainBusOutputChannels;
 
+        if (mPeerJobSerialBlocks > 0) {
+            --mPeerJobSerialBlocks;
+        }
 
-            remote->recvMeterSource.measureBlock (remote->workBuffer, 0, numSamples);
-
-            for (auto cgi = 0; cgi < remote->numChanGroups; ++cgi) {
-                float redlev = 1.0f;
-                if (remote->chanGroups[cgi].params.compressorParams.enabled && remote->chanGroups[cgi].compressorOutputLevel) {
-                    redlev = jlimit(0.0f, 1.0f, Decibels::decibelsToGain(*remote->chanGroups[cgi].compressorOutputLevel));
-                }
-                for (auto j=0; j < remote->chanGroups[cgi].params.numChannels; ++j) {
-                    int ch = remote->chanGroups[cgi].params.chanStartIndex + j;
-                    remote->recvMeterSource.setReductionLevel(ch, redlev);
-                }
+        if (mParallelPeerProcessing.get() && mPeerWorkers.size() > 0 && mRemotePeers.size() > 1 && mRemotePeers.size() <= MAX_PEERS
+            && mPeerJobSerialBlocks == 0) {
+            // everything up to the final panning is independent per peer, share it with the workers
+            runPeerReceiveJobs(mRemotePeers.size());
+        }
+        else {
+            for (int rindex = 0; rindex < mRemotePeers.size(); ++rindex) {
+                processPeerReceive(mRemotePeers.getUnchecked(rindex), rindex, ctx);
             }
+        }
 
-            ++rindex;
-            
-            if (wasSilent) continue; // can skip the rest, already fully muted/absent
+        for (auto & remote : mRemotePeers) 
+        {
+            if (!remote->oursink || remote->_recvSilent) continue; // can skip the rest, already fully muted/absent
             
+            float usegain = remote->_lastgain;
             float tgain = mainBusOutputChannels == 1 && remote->recvChannels > 0 ? 1.0f/(float)remote->recvChannels : 1.0f;
             tgain *= usegain; // handles main solo
 
@@ -7949,7 +9000,7 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
             for (auto i = 0; i < remote->numChanGroups; ++i)
             {
                 // apply solo muting to the gain here
-                float adjgain = anysubsolo && !remote->chanGroups[i].params.soloed ? 0.0f : tgain;
+                float adjgain = remote->_recvAnySubSolo && !remote->chanGroups[i].params.soloed ? 0.0f : tgain;
                 // todo change dest ch target
                 int dstch = remote->chanGroups[i].params.panDestStartIndex;
                 int dstcnt = jmin(totalOutputChannels, remote->chanGroups[i].params.panDestChannels);
@@ -8025,14 +9076,16 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
                 
                 // now process echo and latency stuff
                 
-                workBuffer.clear(0, 0, numSamples);
-                if (remote->echosink->process((float **)workBuffer.getArrayOfWritePointers(), numSamples, t)) {
-                    //DBG("received something from our ECHO sink");
-                    remote->echosource->process((const float **)workBuffer.getArrayOfReadPointers(), numSamples, t);
+                if (remote->echosink) {
+                    workBuffer.clear(0, 0, numSamples);
+                    if (remote->echosink->process((float **)workBuffer.getArrayOfWritePointers(), numSamples, t)) {
+                        //DBG("received something from our ECHO sink");
+                        remote->echosource->process((const float **)workBuffer.getArrayOfReadPointers(), numSamples, t);
+                    }
                 }
 
                 
-                if (remote->activeLatencyTest && remote->latencyMeasurer) {
+                if (remote->activeLatencyTest && remote->latencyMeasurer && remote->latencysink) {
                     workBuffer.clear(0, 0, numSamples);
                     if (remote->latencysink->process((float **)workBuffer.getArrayOfWritePointers(), numSamples, t)) {
                         //DBG("received something from our latency sink");
@@ -8543,6 +9596,10 @@ void SonobusAudioProcessor::getStateInformationWithOptions(MemoryBlock& destData
     extraTree.setProperty(lastWindowHeightKey, var((int)mPluginWindowHeight), nullptr);
     extraTree.setProperty(autoresizeDropRateThreshKey, var((float)mAutoresizeDropRateThresh), nullptr);
     extraTree.setProperty(reconnectServerLossKey, mReconnectAfterServerLoss.get(), nullptr);
+    extraTree.setProperty(parallelPeerProcessingKey, mParallelPeerProcessing.get(), nullptr);
+    extraTree.setProperty(resampleQualityKey, mResampleQuality.get(), nullptr);
+    extraTree.setProperty(adaptiveNetBufferKey, mAdaptiveNetBuffer.get(), nullptr);
+    extraTree.setProperty(adaptiveNetBufferStretchKey, mAdaptiveNetBufferMaxStretch.get(), nullptr);
 
     extraTree.appendChild(mVideoLinkInfo.getValueTree(), nullptr);
     
@@ -8713,6 +9770,14 @@ void SonobusAudioProcessor::setStateInformationWithOptions (const void* data, in
 
             setReconnectAfterServerLoss(extraTree.getProperty(reconnectServerLossKey, mReconnectAfterServerLoss.get()));
 
+            setParallelPeerProcessing(extraTree.getProperty(parallelPeerProcessingKey, mParallelPeerProcessing.get()));
+
+            setResampleQuality(extraTree.getProperty(resampleQualityKey, mResampleQuality.get()));
+
+            setAdaptiveNetBuffer(extraTree.getProperty(adaptiveNetBufferKey, mAdaptiveNetBuffer.get()));
+
+            setAdaptiveNetBufferMaxStretch(extraTree.getProperty(adaptiveNetBufferStretchKey, mAdaptiveNetBufferMaxStretch.get()));
+
             
             ValueTree videoinfo = extraTree.getChildWithName(videoLinkInfoKey);
             if (videoinfo.isValid()) {
@@ -8882,6 +9947,9 @@ ValueTree SonobusAudioProcessor::PeerStateCache::getValueTree() const
     item.setProperty(numChanGroupsKey, numChanGroups, nullptr);
     item.setProperty(peerLevelKey, mainGain, nullptr);
     item.setProperty(peerOrderPriorityKey, orderPriority, nullptr);
+    item.setProperty(peerLossConcealmentKey, lossConcealment, nullptr);
+    item.setProperty(peerSendInbandFecKey, sendInbandFec, nullptr);
+    item.setProperty(peerSendParityKey, sendParity, nullptr);
 
     ValueTree channelGroupsTree(channelGroupsStateKey);
 
@@ -8915,6 +9983,9 @@ void SonobusAudioProcessor::PeerStateCache::setFromValueTree(const ValueTree & i
 
     mainGain = item.getProperty(peerLevelKey, mainGain);
     orderPriority = item.getProperty(peerOrderPriorityKey, orderPriority);
+    lossConcealment = item.getProperty(peerLossConcealmentKey, lossConcealment);
+    sendInbandFec = item.getProperty(peerSendInbandFecKey, sendInbandFec);
+    sendParity = item.getProperty(peerSendParityKey, sendParity);
 
     // backwards compat
     channelGroupParams[0].pan[0] = item.getProperty(peerMonoPanKey, channelGroupParams[0].pan[0]);
@@ -21,6 +21,7 @@
 #include "zitaRev.h"
 
 #include "SoundboardChannelProcessor.h"
+#include "SeqLockSnapshot.h"
 
 typedef MVerb<float> MVerbFloat;
 
@@ -324,6 +325,7 @@ public:
     EndpointState * findOrAddRawEndpoint(void * rawaddr);
 
     int getUdpLocalPort() const { return mUdpLocalPort; }
+
     IPAddress getLocalIPAddress() const { return mLocalIPAddress; }
     
 
@@ -419,6 +421,8 @@ public:
 
 
     bool getRemotePeerReceiveBufferFillRatio(int index, float & retratio, float & retstddev) const;
+    // arrival time histogram and jitter statistics measured by the sink
+    bool getRemotePeerJitterStats(int index, aoo_jitter_stats & retstats) const;
 
     
     void setRemotePeerSendActive(int index, bool active);
@@ -449,6 +453,47 @@ public:
 
     bool getRemotePeerSafetyMuted(int index) const;
     bool getRemotePeerBlockedUs(int index) const;
+
+    // measured state of a remote peer, published by the audio and event threads
+    // (and right away by the setters of the state it includes).
+    // reading it never takes mCoreLock, so it is what the UI should poll.
+    struct PeerTelemetry
+    {
+        int32_t peerId = AOO_ID_NONE;
+        int64_t packetsReceived = 0;
+        int64_t packetsSent = 0;
+        int64_t bytesReceived = 0;
+        int64_t bytesSent = 0;
+        int64_t packetsDropped = 0;
+        int64_t packetsResent = 0;
+        bool connected = false;
+        bool sendActive = false;
+        bool sendAllow = false;
+        bool recvActive = false;
+        bool recvAllow = false;
+        bool latencyTestActive = false;
+        int recvChannels = 0;
+        int sendChannels = 0;
+        int formatIndex = -1;
+        int reqRemoteSendFormatIndex = -1;
+        int lossConcealment = 0;
+        bool sendInbandFec = false;
+        bool sendParity = false;
+        AutoNetBufferMode autosizeBufferMode = AutoNetBufferModeOff;
+        bool autoNetbufInitCompleted = false;
+        char recvFormatName[48] = {};
+        char hostname[64] = {};
+        int port = 0;
+        bool safetyMuted = false;
+        bool blockedUs = false;
+        float bufferTimeMs = 0.0f; // actual, at least one process block
+        float fillRatio = 0.0f;
+        float fillRatioStdDev = 0.0f;
+        bool hasJitterStats = false;
+        aoo_jitter_stats jitterStats;
+    };
+
+    bool getRemotePeerTelemetry(int index, PeerTelemetry & retinfo) const;
     
     struct LatencyInfo
     {
@@ -609,6 +654,18 @@ public:
     bool setRequestRemotePeerSendAudioCodecFormat(int index, int formatIndex);
     int getRequestRemotePeerSendAudioCodecFormat(int index) const; // -1 is no preferences
     
+    // in-band FEC in the Opus stream we send (switches away from the restricted lowdelay mode)
+    void setRemotePeerSendInbandFec(int index, bool flag);
+    bool getRemotePeerSendInbandFec(int index) const;
+
+    // XOR parity packets with the stream we send, for any codec
+    void setRemotePeerSendParity(int index, bool flag);
+    bool getRemotePeerSendParity(int index) const;
+
+    // how lost blocks from the remote end are concealed, one of AOO_LOSS_CONCEAL_*
+    void setRemotePeerLossConcealment(int index, int mode);
+    int getRemotePeerLossConcealment(int index) const;
+
     int getRemotePeerSendPacketsize(int index) const;
     void setRemotePeerSendPacketsize(int index, int psize);
 
@@ -766,6 +823,24 @@ public:
     bool getReconnectAfterServerLoss() const { return mReconnectAfterServerLoss.get(); }
     void setReconnectAfterServerLoss(bool flag) { mReconnectAfterServerLoss = flag; }
 
+    // process the receive side of the peers on a pool of worker threads
+    bool getParallelPeerProcessing() const { return mParallelPeerProcessing.get(); }
+    void setParallelPeerProcessing(bool flag);
+
+    // interpolation quality used when resampling peer audio, one of AOO_RESAMPLE_*
+    int getResampleQuality() const { return mResampleQuality.get(); }
+    void setResampleQuality(int quality);
+
+    // let the peer sinks adapt their fill level continuously (by slightly changing the
+    // playback speed), in auto full mode the buffer size is then only increased
+    bool getAdaptiveNetBuffer() const { return mAdaptiveNetBuffer.get(); }
+    void setAdaptiveNetBuffer(bool flag);
+
+    // max. relative playback speed change while adapting (0.01 == 1%), a larger value
+    // reaches the target latency faster but the pitch change becomes audible
+    float getAdaptiveNetBufferMaxStretch() const { return mAdaptiveNetBufferMaxStretch.get(); }
+    void setAdaptiveNetBufferMaxStretch(float fraction);
+
 
     PeerDisplayMode getPeerDisplayMode() const { return mPeerDisplayMode; }
     void setPeerDisplayMode(PeerDisplayMode mode) { mPeerDisplayMode = mode; }
@@ -840,6 +915,9 @@ private:
         int numMultiChanGroups = 0;
         bool modifiedChanGroups = false;
         int orderPriority = -1;
+        int lossConcealment = AOO_LOSS_CONCEAL_FEC;
+        bool sendInbandFec = false;
+        bool sendParity = false;
     };
 
     // key is peer name
@@ -852,8 +930,13 @@ private:
     void cleanupAoo();
     
     void doReceiveData();
-    void doSendData();
-    void handleEvents();
+    void doSendData(bool allpeers = true);
+    void handleEvents(bool allpeers = true);
+    static void notifyPeerEvents(void * user);
+    static void notifyEvents(void * user);
+
+    bool handleReceivedPacket(EndpointState * endpoint, const char * buf, int nbytes);
+    void addToEndpointTable(EndpointState * endpoint);
 
     bool handleOtherMessage(EndpointState * endpoint, const char *msg, int32_t n);
 
@@ -878,6 +961,9 @@ private:
     RemotePeer *  findRemotePeer(EndpointState * endpoint, int32_t ourId);
     RemotePeer *  findRemotePeerByEchoId(EndpointState * endpoint, int32_t echoId);
     RemotePeer *  findRemotePeerByLatencyId(EndpointState * endpoint, int32_t latId);
+    bool createTestEndpoints(RemotePeer * remote, bool echo);
+    void setupTestEndpoints(RemotePeer * remote, aoo::isink * sink, aoo::isource * source, bool echo);
+    void releaseIdleTestEndpoints();
     RemotePeer *  findRemotePeerByRemoteSourceId(EndpointState * endpoint, int32_t sourceId);
     RemotePeer *  findRemotePeerByRemoteSinkId(EndpointState * endpoint, int32_t sinkId);
     RemotePeer *  doAddRemotePeerIfNecessary(EndpointState * endpoint, int32_t ourId=AOO_ID_NONE, const String & username={}, const String & groupname={});
@@ -984,6 +1070,10 @@ private:
     Atomic<bool>   mSyncMetToHost  { false };
     Atomic<bool>   mSyncMetStartToPlayback  { false };
     Atomic<bool>   mReconnectAfterServerLoss  { true };
+    Atomic<bool>   mParallelPeerProcessing  { false };
+    Atomic<int>    mResampleQuality  { AOO_RESAMPLE_LINEAR };
+    Atomic<bool>   mAdaptiveNetBuffer  { false };
+    Atomic<float>  mAdaptiveNetBufferMaxStretch  { AOO_ADAPTIVE_MAXSTRETCH };
 
     Atomic<float>   mInputReverbLevel  { 1.0f };
     Atomic<float>   mInputReverbSize  { 0.15f };
@@ -1096,9 +1186,12 @@ private:
     
     class SendThread;
     class RecvThread;
+    struct RecvPacketRing;
+    struct EndpointTable;
     class EventThread;
     class ServerThread;
     class ClientThread;
+    class PeerProcessWorker;
     
     CriticalSection  mEndpointsLock;
     ReadWriteLock    mCoreLock;
@@ -1106,6 +1199,11 @@ private:
     CriticalSection  mSourceFormatLock;
 
     OwnedArray<EndpointState> mEndpoints;
+    // lock-free lookup of endpoints by raw sender address, older tables are kept alive until cleanup
+    std::atomic<EndpointTable*> mEndpointTable { nullptr };
+    OwnedArray<EndpointTable> mEndpointTables;
+
+    std::unique_ptr<RecvPacketRing> mRecvPacketRing;
     
     OwnedArray<RemotePeer> mRemotePeers;
 
@@ -1152,15 +1250,44 @@ private:
     void initFormats();
     
     bool mRemoteSendMatrix[MAX_PEERS][MAX_PEERS];
+
+    // per peer index telemetry, each written by only one thread
+    struct PeerAudioTelemetry
+    {
+        int32_t peerId = AOO_ID_NONE;
+        float fillRatio = 0.0f;
+        float fillRatioStdDev = 0.0f;
+    };
+
+    void publishRemotePeerTelemetry();
+    void publishRemotePeerTelemetry(int index);
+    void publishRemotePeerIds();
+
+    SeqLockSnapshot<PeerTelemetry> mPeerTelemetry[MAX_PEERS]; // event thread and setters, see mPeerTelemetryPublishLock
+    CriticalSection mPeerTelemetryPublishLock; // one writer at a time, readers don't take it
+    // mRemotePeers as seen by the lock-free readers, updated with every change of it
+    std::atomic<int> mPublishedPeerCount { 0 };
+    std::atomic<int32_t> mPublishedPeerIds[MAX_PEERS] {};
+    SeqLockSnapshot<PeerAudioTelemetry> mPeerAudioTelemetry[MAX_PEERS]; // audio thread (or peer workers)
     
     
-    void notifySendThread() {
+    // allpeers: everybody may have something to send (new audio block), otherwise
+    // only the peers flagged with sendPending are visited
+    void notifySendThread(bool allpeers = true) {
+        if (allpeers) {
+            mSendAllPending = true;
+        }
         mNeedSendSentinel += 1;
         mSendWaitable.signal();
     }
     
     WaitableEvent  mSendWaitable;
     Atomic<int>   mNeedSendSentinel  { 0 };
+    std::atomic<bool> mSendAllPending { true };
+
+    // signaled by the AOO objects when they queue an event
+    WaitableEvent  mEventWaitable;
+    double mLastTelemetryPublishMs = 0.0; // event thread
 
 
     std::unique_ptr<SendThread> mSendThread;
@@ -1169,6 +1296,34 @@ private:
     std::unique_ptr<ServerThread> mServerThread;
     std::unique_ptr<ClientThread> mClientThread;
 
+    // per block state shared with the peer workers
+    struct PeerRecvContext {
+        AudioBuffer<float> * buffer = nullptr;
+        int numSamples = 0;
+        uint64_t t = 0;
+        bool anysoloed = false;
+        bool writerLocked = false;
+        int mainBusOutputChannels = 0;
+    };
+
+    void processPeerReceive(RemotePeer * remote, int rindex, const PeerRecvContext & ctx);
+    void runPeerReceiveJobs(int count);
+    bool runPeerReceiveJob();
+    bool runPeerReceiveJob(int index, uint32 generation);
+    void startPeerWorkers();
+    void stopPeerWorkers();
+
+    OwnedArray<PeerProcessWorker> mPeerWorkers;
+    PeerRecvContext mPeerRecvContext;
+    // generation (32) | job count (16) | next job (16)
+    std::atomic<uint64> mPeerJobState { 0 };
+    std::atomic<int> mPeerJobsDone { 0 };
+    uint32 mPeerJobGeneration = 0;
+    // generation each job was last started in
+    std::atomic<uint32> mPeerJobStarted[MAX_PEERS] {};
+    // blocks left to process serially after the workers overran
+    int mPeerJobSerialBlocks = 0;
+
 
     // Input channelgroups
     SonoAudio::ChannelGroup mInputChannelGroups[MAX_CHANGROUPS];
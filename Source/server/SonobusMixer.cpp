@@ -0,0 +1,893 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2020 Jesse Chappell
+
+#include "SonobusMixer.h"
+
+#include "aoo/aoo_pcm.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/uio.h>
+#define MIX_USE_MMSG 1
+#endif
+
+// clients we haven't heard from for this long are dropped
+#define MIX_CLIENT_TIMEOUT_SEC 10.0
+// invitations which haven't been confirmed for this long are dropped
+#define MIX_PENDING_TIMEOUT_SEC 5.0
+// max. number of unconfirmed invitations at any time
+#define MIX_MAX_PENDING 32
+// center pan attenuation, same default as ChannelGroup (-4.5 dB)
+#define MIX_CENTER_PAN_LAW 0.596f
+// max number of datagrams per recvmmsg()/sendmmsg() call
+#define MIX_BATCH_PACKETS 64
+
+struct SonobusMixer::Endpoint
+{
+    SonobusMixer * owner = nullptr;
+    struct sockaddr_storage addr;
+    int addrlen = 0;
+    double lastRecvTime = 0.0;
+};
+
+struct SonobusMixer::Client
+{
+    SonobusMixer * owner = nullptr;
+    Endpoint * endpoint = nullptr;
+    std::string host;          // IP address, see isHostAllowed()
+    int32_t id = 0;            // our source and sink id, random (see makeClientId())
+    int32_t remoteSinkId = 0;  // the client uses the same id for its source
+    aoo::isource::pointer source;
+    aoo::isink::pointer sink;
+
+    double inviteTime = 0.0;
+    // the client has shown that it gets our messages (see confirmClient())
+    std::atomic<bool> confirmed { false };
+
+    std::atomic<int> inChannels { 0 }; // 0 until we know the format of the client's stream
+    bool hasInput = false;
+
+    // ChannelGroup style gain and pan model, applied to the client's contribution
+    std::atomic<float> gain { 1.0f };
+    std::atomic<float> pan { 0.0f };   // mono
+    std::atomic<float> panStereo[2] = { { -1.0f }, { 1.0f } };
+
+    std::vector<aoo_sample> input[2];
+    std::vector<aoo_sample> contrib[2];
+};
+
+#if MIX_USE_MMSG
+// every client sends and receives a packet per block, so one syscall per
+// direction and block instead of one per client makes a big difference
+struct SonobusMixer::PacketBatch
+{
+    PacketBatch()
+    {
+        std::memset(recvMsgs, 0, sizeof(recvMsgs));
+        std::memset(sendMsgs, 0, sizeof(sendMsgs));
+        for (int i = 0; i < MIX_BATCH_PACKETS; ++i) {
+            recvIovecs[i].iov_base = recvBuffers[i];
+            recvIovecs[i].iov_len = AOO_MAXPACKETSIZE;
+            recvMsgs[i].msg_hdr.msg_iov = &recvIovecs[i];
+            recvMsgs[i].msg_hdr.msg_iovlen = 1;
+            recvMsgs[i].msg_hdr.msg_name = &recvAddrs[i];
+            sendIovecs[i].iov_base = sendBuffers[i];
+            sendMsgs[i].msg_hdr.msg_iov = &sendIovecs[i];
+            sendMsgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    void resetNames()
+    {
+        // recvmmsg overwrites these with the actual lengths
+        for (int i = 0; i < MIX_BATCH_PACKETS; ++i) {
+            recvMsgs[i].msg_hdr.msg_namelen = sizeof(recvAddrs[i]);
+        }
+    }
+
+    bool add(Endpoint * endpoint, const char * data, int32_t size)
+    {
+        if (size <= 0 || size > AOO_MAXPACKETSIZE) {
+            return false;
+        }
+        if (numSend == MIX_BATCH_PACKETS) {
+            flush();
+        }
+        std::memcpy(sendBuffers[numSend], data, size);
+        sendIovecs[numSend].iov_len = size;
+        sendMsgs[numSend].msg_hdr.msg_name = &endpoint->addr;
+        sendMsgs[numSend].msg_hdr.msg_namelen = endpoint->addrlen;
+        ++numSend;
+        return true;
+    }
+
+    void flush()
+    {
+        int sent = 0;
+        while (sent < numSend) {
+            int ret = ::sendmmsg(sock, sendMsgs + sent, (unsigned int) (numSend - sent), 0);
+            if (ret <= 0) {
+                if (ret < 0 && errno == EINTR) continue;
+                // drop the failing datagram and carry on with the rest
+                ++sent;
+                continue;
+            }
+            sent += ret;
+        }
+        numSend = 0;
+    }
+
+    int sock = -1;
+
+    char recvBuffers[MIX_BATCH_PACKETS][AOO_MAXPACKETSIZE];
+    struct sockaddr_storage recvAddrs[MIX_BATCH_PACKETS];
+    struct iovec recvIovecs[MIX_BATCH_PACKETS];
+    struct mmsghdr recvMsgs[MIX_BATCH_PACKETS];
+
+    char sendBuffers[MIX_BATCH_PACKETS][AOO_MAXPACKETSIZE];
+    struct iovec sendIovecs[MIX_BATCH_PACKETS];
+    struct mmsghdr sendMsgs[MIX_BATCH_PACKETS];
+    int numSend = 0;
+};
+#else
+struct SonobusMixer::PacketBatch {};
+#endif
+
+namespace {
+
+double nowSeconds()
+{
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+double threadCpuSeconds()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0.0;
+    }
+    auto ticks = [](const FILETIME & ft) {
+        return ((uint64_t) ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    };
+    return (ticks(kernel) + ticks(user)) * 1e-7;
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0.0;
+    }
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+uint64_t endpointKey(const struct sockaddr * sa)
+{
+    if (sa->sa_family != AF_INET) {
+        return 0; // LATER IPv6
+    }
+    auto sin = (const struct sockaddr_in *) sa;
+    return ((uint64_t) sin->sin_addr.s_addr << 16) | sin->sin_port;
+}
+
+std::string hostName(const SonobusMixer::Endpoint * endpoint)
+{
+    char buf[INET_ADDRSTRLEN] = {};
+    auto sin = (const struct sockaddr_in *) &endpoint->addr;
+    inet_ntop(AF_INET, (void *) &sin->sin_addr, buf, sizeof(buf));
+    return buf;
+}
+
+// same pan law as ChannelGroup::processPan()
+void panGains(float upan, float & left, float & right)
+{
+    const float law = MIX_CENTER_PAN_LAW + (std::fabs(upan) * (1.0f - MIX_CENTER_PAN_LAW));
+    left = (upan >= 0.0f ? (1.0f - upan) : 1.0f) * law;
+    right = (upan >= 0.0f ? 1.0f : (1.0f + upan)) * law;
+}
+
+int32_t endpointSend(void * e, const char * data, int32_t size)
+{
+    auto endpoint = static_cast<SonobusMixer::Endpoint *>(e);
+    return endpoint->owner->sendTo(endpoint, data, size);
+}
+
+} // namespace
+
+
+SonobusMixer::SonobusMixer(int port, int sampleRate, int blockSize, int bufferMs)
+    : mPort(port), mSampleRate(sampleRate), mBlockSize(blockSize), mBufferMs(bufferMs)
+{
+    for (int ch = 0; ch < 2; ++ch) {
+        mTotal[ch].resize(mBlockSize);
+        mOutput[ch].resize(mBlockSize);
+    }
+}
+
+SonobusMixer::~SonobusMixer()
+{
+    stop();
+}
+
+bool SonobusMixer::start(std::string & errmsg)
+{
+    aoo_initialize();
+
+    mSocket = (int) ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (mSocket < 0) {
+        errmsg = "couldn't create socket";
+        return false;
+    }
+
+    struct sockaddr_in sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = INADDR_ANY;
+    sa.sin_port = htons((uint16_t) mPort);
+    if (::bind(mSocket, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+        errmsg = "couldn't bind to port " + std::to_string(mPort);
+        stop();
+        return false;
+    }
+    if (mPort == 0) {
+        // an ephemeral port, see getPort()
+        socklen_t len = sizeof(sa);
+        ::getsockname(mSocket, (struct sockaddr *) &sa, &len);
+        mPort = ntohs(sa.sin_port);
+    }
+
+    // we get a stream from every client, so make room for bursts
+    int bufsize = 1 << 21;
+    ::setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, (const char *) &bufsize, sizeof(bufsize));
+    ::setsockopt(mSocket, SOL_SOCKET, SO_SNDBUF, (const char *) &bufsize, sizeof(bufsize));
+
+#ifdef _WIN32
+    u_long nonblocking = 1;
+    ioctlsocket(mSocket, FIONBIO, &nonblocking);
+#else
+    fcntl(mSocket, F_SETFL, fcntl(mSocket, F_GETFL) | O_NONBLOCK);
+#endif
+
+    mHandshakeSource.reset(aoo::isource::create(0));
+
+    mBatch = std::make_unique<PacketBatch>();
+#if MIX_USE_MMSG
+    mBatch->sock = mSocket;
+#endif
+
+    mQuit = false;
+    mThread = std::thread([this]() {
+        run();
+    });
+    return true;
+}
+
+void SonobusMixer::stop()
+{
+    mQuit = true;
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+
+    if (mSocket >= 0) {
+#ifdef _WIN32
+        closesocket(mSocket);
+#else
+        ::close(mSocket);
+#endif
+        mSocket = -1;
+    }
+}
+
+MixerStats SonobusMixer::getStats() const
+{
+    MixerStats stats;
+    stats.numClients = mNumClients.load(std::memory_order_relaxed);
+    stats.pendingClients = mNumPending.load(std::memory_order_relaxed);
+    stats.rejectedClients = mRejectedClients.load(std::memory_order_relaxed);
+    stats.blocks = mBlocks.load(std::memory_order_relaxed);
+    stats.lateBlocks = mLateBlocks.load(std::memory_order_relaxed);
+    stats.cpuSeconds = mCpuSeconds.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void SonobusMixer::allowHost(const std::string & host)
+{
+    std::lock_guard<std::mutex> lock(mHostLock);
+    mAllowedHosts[host]++;
+}
+
+void SonobusMixer::disallowHost(const std::string & host)
+{
+    std::lock_guard<std::mutex> lock(mHostLock);
+    auto it = mAllowedHosts.find(host);
+    if (it != mAllowedHosts.end() && --it->second <= 0) {
+        mAllowedHosts.erase(it);
+    }
+}
+
+bool SonobusMixer::isHostAllowed(const std::string & host) const
+{
+    if (!mHostAuthRequired.load()) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(mHostLock);
+    return mAllowedHosts.count(host) > 0;
+}
+
+std::vector<MixerClientInfo> SonobusMixer::getClients() const
+{
+    std::vector<MixerClientInfo> result;
+    std::lock_guard<std::mutex> lock(mClientLock);
+    for (auto & client : mClients) {
+        if (!client->confirmed.load()) {
+            continue;
+        }
+        MixerClientInfo info;
+        info.id = client->id;
+        info.address = client->host + ":"
+            + std::to_string(ntohs(((const struct sockaddr_in *) &client->endpoint->addr)->sin_port));
+        info.inChannels = client->inChannels.load();
+        info.gain = client->gain.load();
+        info.pan = client->pan.load();
+        info.panStereo[0] = client->panStereo[0].load();
+        info.panStereo[1] = client->panStereo[1].load();
+        result.push_back(info);
+    }
+    return result;
+}
+
+bool SonobusMixer::setClientGain(int32_t id, float gain)
+{
+    std::lock_guard<std::mutex> lock(mClientLock);
+    auto client = findClient(id);
+    if (!client) {
+        return false;
+    }
+    client->gain = std::max(0.0f, gain);
+    return true;
+}
+
+bool SonobusMixer::setClientPan(int32_t id, float pan)
+{
+    std::lock_guard<std::mutex> lock(mClientLock);
+    auto client = findClient(id);
+    if (!client) {
+        return false;
+    }
+    client->pan = std::min(1.0f, std::max(-1.0f, pan));
+    return true;
+}
+
+bool SonobusMixer::setClientStereoPan(int32_t id, float left, float right)
+{
+    std::lock_guard<std::mutex> lock(mClientLock);
+    auto client = findClient(id);
+    if (!client) {
+        return false;
+    }
+    client->panStereo[0] = std::min(1.0f, std::max(-1.0f, left));
+    client->panStereo[1] = std::min(1.0f, std::max(-1.0f, right));
+    return true;
+}
+
+int32_t SonobusMixer::sendTo(Endpoint * endpoint, const char * data, int32_t size)
+{
+#if MIX_USE_MMSG
+    if (mBatchSends && mBatch->add(endpoint, data, size)) {
+        return size;
+    }
+#endif
+    return (int32_t) ::sendto(mSocket, data, (size_t) size, 0,
+                              (const struct sockaddr *) &endpoint->addr, endpoint->addrlen);
+}
+
+void SonobusMixer::run()
+{
+    using clock = std::chrono::steady_clock;
+    const auto blockDuration = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(mBlockSize / (double) mSampleRate));
+
+    auto deadline = clock::now();
+    double lastIdleCheck = nowSeconds();
+
+    while (!mQuit.load()) {
+        auto now = clock::now();
+        if (now >= deadline) {
+            processBlock();
+            sendAll();
+            handleAllEvents();
+
+            deadline += blockDuration;
+            if (clock::now() > deadline + blockDuration) {
+                // fell behind, don't try to catch up with a burst of blocks
+                mLateBlocks.fetch_add(1, std::memory_order_relaxed);
+                deadline = clock::now() + blockDuration;
+            }
+
+            double nowsec = nowSeconds();
+            if (nowsec - lastIdleCheck > 1.0) {
+                removeIdleClients();
+                lastIdleCheck = nowsec;
+            }
+
+            mCpuSeconds.store(threadCpuSeconds(), std::memory_order_relaxed);
+            now = clock::now();
+        }
+
+        auto waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+        receivePackets((int) std::max<int64_t>(0, waitMs));
+    }
+
+    // say goodbye
+    for (auto & client : mClients) {
+        if (client->confirmed.load()) {
+            client->sink->uninvite_all();
+            client->sink->send();
+        }
+    }
+    std::lock_guard<std::mutex> lock(mClientLock);
+    mClients.clear();
+    mClientsById.clear();
+    mNumClients = 0;
+    mNumPending = 0;
+}
+
+void SonobusMixer::receivePackets(int timeoutMs)
+{
+#ifdef _WIN32
+    WSAPOLLFD pfd = { (SOCKET) mSocket, POLLIN, 0 };
+    if (WSAPoll(&pfd, 1, timeoutMs) <= 0) {
+        return;
+    }
+#else
+    struct pollfd pfd = { mSocket, POLLIN, 0 };
+    if (::poll(&pfd, 1, timeoutMs) <= 0) {
+        return;
+    }
+#endif
+
+    // drain the socket
+#if MIX_USE_MMSG
+    auto & batch = *mBatch;
+    while (true) {
+        batch.resetNames();
+        int count = ::recvmmsg(mSocket, batch.recvMsgs, MIX_BATCH_PACKETS, MSG_DONTWAIT, nullptr);
+        if (count <= 0) {
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            auto & hdr = batch.recvMsgs[i].msg_hdr;
+            int nbytes = (int) batch.recvMsgs[i].msg_len;
+            if (nbytes <= 0) {
+                continue;
+            }
+            if (auto endpoint = findOrAddEndpoint(hdr.msg_name, (int) hdr.msg_namelen)) {
+                handlePacket(endpoint, batch.recvBuffers[i], nbytes);
+            }
+        }
+    }
+#else
+    char buf[AOO_MAXPACKETSIZE];
+    while (true) {
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        int nbytes = (int) ::recvfrom(mSocket, buf, sizeof(buf), 0, (struct sockaddr *) &addr, &addrlen);
+        if (nbytes <= 0) {
+            break;
+        }
+        if (auto endpoint = findOrAddEndpoint(&addr, (int) addrlen)) {
+            handlePacket(endpoint, buf, nbytes);
+        }
+    }
+#endif
+}
+
+SonobusMixer::Endpoint * SonobusMixer::findOrAddEndpoint(const void * rawaddr, int addrlen)
+{
+    const uint64_t key = endpointKey((const struct sockaddr *) rawaddr);
+    if (key == 0) {
+        return nullptr;
+    }
+
+    auto & endpoint = mEndpoints[key];
+    if (!endpoint) {
+        endpoint = std::make_unique<Endpoint>();
+        endpoint->owner = this;
+        std::memcpy(&endpoint->addr, rawaddr, std::min<size_t>(addrlen, sizeof(endpoint->addr)));
+        endpoint->addrlen = addrlen;
+    }
+    return endpoint.get();
+}
+
+void SonobusMixer::handlePacket(Endpoint * endpoint, const char * buf, int nbytes)
+{
+    int32_t type, id;
+    if (aoo_parse_pattern(buf, nbytes, &type, &id) <= 0) {
+        // e.g. SonoBus peer info messages, which we don't need
+        return;
+    }
+
+    endpoint->lastRecvTime = nowSeconds();
+
+    if (type == AOO_TYPE_SINK) {
+        if (id == AOO_ID_NONE) {
+            // compact data message, the salt tells us which sink it belongs to
+            aoo_compact_data cdata;
+            if (auto sink = aoo_sink_find_compact(buf, nbytes, endpoint, &cdata)) {
+                sink->handle_compact(cdata);
+            }
+        }
+        else if (auto client = findClient(id)) {
+            client->sink->handle_message(buf, nbytes, endpoint, endpointSend);
+        }
+    }
+    else if (type == AOO_TYPE_SOURCE) {
+        if (id == 0) {
+            mHandshakeSource->handle_message(buf, nbytes, endpoint, endpointSend);
+        }
+        else if (auto client = findClient(id)) {
+            client->source->handle_message(buf, nbytes, endpoint, endpointSend);
+        }
+    }
+}
+
+SonobusMixer::Client * SonobusMixer::findClient(int32_t id) const
+{
+    auto it = mClientsById.find(id);
+    return it != mClientsById.end() ? it->second : nullptr;
+}
+
+void SonobusMixer::handleInvitation(Endpoint * endpoint, int32_t remoteSinkId, int32_t flags)
+{
+    for (auto & client : mClients) {
+        if (client->endpoint == endpoint && client->remoteSinkId == remoteSinkId) {
+            return; // repeated invitation
+        }
+    }
+
+    if (!isHostAllowed(hostName(endpoint))) {
+        mRejectedClients.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // the client limit includes pending invitations, a flood of them can't
+    // push out confirmed clients but it can keep new ones from connecting
+    // until they time out.
+    if ((int) mClients.size() >= mMaxClients || mNumPending.load() >= MIX_MAX_PENDING) {
+        mRejectedClients.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    addClient(endpoint, remoteSinkId, flags);
+}
+
+int32_t SonobusMixer::makeClientId() const
+{
+    // the ids are the return path token (see confirmClient()), so they must
+    // not be guessable. Stay well below INT32_MAX, SonoBus adds an offset
+    // to get the ids of the latency echo sources.
+    std::random_device rd;
+    int32_t id;
+    do {
+        id = (int32_t) (rd() & 0x3fffffff);
+    } while (id == 0 || findClient(id));
+    return id;
+}
+
+SonobusMixer::Client * SonobusMixer::addClient(Endpoint * endpoint, int32_t remoteSinkId, int32_t flags)
+{
+    auto client = std::make_unique<Client>();
+    client->owner = this;
+    client->endpoint = endpoint;
+    client->host = hostName(endpoint);
+    client->id = makeClientId();
+    client->remoteSinkId = remoteSinkId;
+    client->inviteTime = nowSeconds();
+
+    for (int ch = 0; ch < 2; ++ch) {
+        client->input[ch].resize(mBlockSize);
+        client->contrib[ch].resize(mBlockSize);
+    }
+
+    client->sink.reset(aoo::isink::create(client->id));
+    client->sink->setup(mSampleRate, mBlockSize, 2);
+    client->sink->set_buffersize(mBufferMs);
+
+    // until we know better, send back 16 bit PCM
+    client->source.reset(aoo::isource::create(client->id));
+    client->source->setup(mSampleRate, mBlockSize, 2);
+    aoo_format_pcm fmt;
+    fmt.header.codec = AOO_CODEC_PCM;
+    fmt.header.nchannels = 2;
+    fmt.header.samplerate = mSampleRate;
+    fmt.header.blocksize = mBlockSize;
+    fmt.bitdepth = AOO_PCM_INT16;
+    client->source->set_format(fmt.header);
+
+    // NOTE: the source only sends the format until the client is confirmed,
+    // because processBlock() doesn't feed it before; no pings either.
+    client->source->set_ping_interval(0);
+    client->source->add_sink(endpoint, remoteSinkId, endpointSend);
+    client->source->set_sinkoption(endpoint, remoteSinkId, aoo_opt_protocol_flags, &flags, sizeof(int32_t));
+    client->source->start();
+
+    // the client has a source waiting for us with the same id as its sink
+    client->sink->invite_source(endpoint, remoteSinkId, endpointSend);
+
+    auto ret = client.get();
+    {
+        std::lock_guard<std::mutex> lock(mClientLock);
+        mClientsById[ret->id] = ret;
+        mClients.push_back(std::move(client));
+    }
+    updateClientCounts();
+
+    return ret;
+}
+
+// Called when a message to the client's sink or source id arrives from the
+// client's address. Only the client can know the (random) ids, so it must
+// have received our replies and we can start streaming to it.
+void SonobusMixer::confirmClient(Client * client)
+{
+    if (!client->confirmed.exchange(true)) {
+        client->source->set_ping_interval(AOO_PING_INTERVAL);
+        updateClientCounts();
+    }
+}
+
+void SonobusMixer::removeClient(Client * client)
+{
+    // don't send anything to an address that has never been confirmed
+    if (client->confirmed.load()) {
+        client->sink->uninvite_all();
+        client->sink->send();
+    }
+    client->source->remove_all();
+
+    {
+        std::lock_guard<std::mutex> lock(mClientLock);
+        mClientsById.erase(client->id);
+        mClients.erase(std::remove_if(mClients.begin(), mClients.end(),
+                                      [client](const std::unique_ptr<Client> & c) { return c.get() == client; }),
+                       mClients.end());
+    }
+    updateClientCounts();
+}
+
+void SonobusMixer::updateClientCounts()
+{
+    int confirmed = (int) std::count_if(mClients.begin(), mClients.end(),
+                                        [](const std::unique_ptr<Client> & c) { return c->confirmed.load(); });
+    mNumClients = confirmed;
+    mNumPending = (int) mClients.size() - confirmed;
+}
+
+void SonobusMixer::removeIdleClients()
+{
+    const double now = nowSeconds();
+    std::vector<Client *> idle;
+    for (auto & client : mClients) {
+        if (client->confirmed.load()
+                ? (now - client->endpoint->lastRecvTime > MIX_CLIENT_TIMEOUT_SEC)
+                : (now - client->inviteTime > MIX_PENDING_TIMEOUT_SEC)) {
+            idle.push_back(client.get());
+        }
+        else if (!isHostAllowed(client->host)) {
+            idle.push_back(client.get()); // e.g. the user has logged out
+        }
+    }
+    for (auto client : idle) {
+        removeClient(client);
+    }
+
+    // forget endpoints which never connected or are gone
+    for (auto it = mEndpoints.begin(); it != mEndpoints.end(); ) {
+        auto endpoint = it->second.get();
+        bool inuse = std::any_of(mClients.begin(), mClients.end(),
+                                 [endpoint](const std::unique_ptr<Client> & c) { return c->endpoint == endpoint; });
+        if (!inuse && now - endpoint->lastRecvTime > MIX_CLIENT_TIMEOUT_SEC) {
+            it = mEndpoints.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void SonobusMixer::processBlock()
+{
+    const uint64_t t = aoo_osctime_get();
+    const int n = mBlockSize;
+
+    std::fill(mTotal[0].begin(), mTotal[0].end(), 0.0f);
+    std::fill(mTotal[1].begin(), mTotal[1].end(), 0.0f);
+
+    // decode everybody once and build the total mix
+    for (auto & client : mClients) {
+        aoo_sample * in[2] = { client->input[0].data(), client->input[1].data() };
+        const int inChannels = client->inChannels.load(std::memory_order_relaxed);
+        client->hasInput = client->confirmed.load(std::memory_order_relaxed) && inChannels > 0
+            && client->sink->process(in, n, t) > 0;
+        if (!client->hasInput) {
+            continue;
+        }
+
+        auto cl = client->contrib[0].data();
+        auto cr = client->contrib[1].data();
+        const float g = client->gain.load(std::memory_order_relaxed);
+
+        if (inChannels == 1) {
+            float lgain, rgain;
+            panGains(client->pan.load(std::memory_order_relaxed), lgain, rgain);
+            lgain *= g;
+            rgain *= g;
+            for (int i = 0; i < n; ++i) {
+                cl[i] = in[0][i] * lgain;
+                cr[i] = in[0][i] * rgain;
+            }
+        }
+        else {
+            float l0, r0, l1, r1;
+            panGains(client->panStereo[0].load(std::memory_order_relaxed), l0, r0);
+            panGains(client->panStereo[1].load(std::memory_order_relaxed), l1, r1);
+            for (int i = 0; i < n; ++i) {
+                cl[i] = (in[0][i] * l0 + in[1][i] * l1) * g;
+                cr[i] = (in[0][i] * r0 + in[1][i] * r1) * g;
+            }
+        }
+
+        auto tl = mTotal[0].data();
+        auto tr = mTotal[1].data();
+        for (int i = 0; i < n; ++i) {
+            tl[i] += cl[i];
+            tr[i] += cr[i];
+        }
+    }
+
+    // mix-minus: everybody gets the total without themselves, so this is O(N) rather than O(N^2)
+    for (auto & client : mClients) {
+        if (!client->confirmed.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        const aoo_sample * out[2];
+        if (client->hasInput) {
+            for (int ch = 0; ch < 2; ++ch) {
+                auto dst = mOutput[ch].data();
+                auto tot = mTotal[ch].data();
+                auto own = client->contrib[ch].data();
+                for (int i = 0; i < n; ++i) {
+                    dst[i] = tot[i] - own[i];
+                }
+                out[ch] = dst;
+            }
+        }
+        else {
+            out[0] = mTotal[0].data();
+            out[1] = mTotal[1].data();
+        }
+        client->source->process(out, n, t);
+    }
+
+    mBlocks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SonobusMixer::sendAll()
+{
+    mBatchSends = true;
+
+    mHandshakeSource->send();
+    for (auto & client : mClients) {
+        client->source->send();
+        client->sink->send();
+    }
+
+#if MIX_USE_MMSG
+    mBatch->flush();
+#endif
+    mBatchSends = false;
+}
+
+void SonobusMixer::handleAllEvents()
+{
+    mHandshakeSource->handle_events(handleHandshakeEvents, this);
+
+    for (auto & client : mClients) {
+        if (client->sink->events_available()) {
+            client->sink->handle_events(handleClientSinkEvents, client.get());
+        }
+        if (client->source->events_available()) {
+            client->source->handle_events(handleClientSourceEvents, client.get());
+        }
+    }
+}
+
+int32_t SonobusMixer::handleHandshakeEvents(void * user, const aoo_event ** events, int32_t n)
+{
+    auto mixer = static_cast<SonobusMixer *>(user);
+
+    for (int i = 0; i < n; ++i) {
+        if (events[i]->type == AOO_INVITE_EVENT) {
+            // a new client connects just like to any other peer
+            auto e = (const aoo_sink_event *) events[i];
+            auto endpoint = static_cast<Endpoint *>(e->endpoint);
+            mixer->handleInvitation(endpoint, e->id, e->flags);
+        }
+    }
+    return 1;
+}
+
+int32_t SonobusMixer::handleClientSourceEvents(void * user, const aoo_event ** events, int32_t n)
+{
+    auto client = static_cast<Client *>(user);
+
+    for (int i = 0; i < n; ++i) {
+        if (events[i]->type == AOO_INVITE_EVENT) {
+            auto e = (const aoo_sink_event *) events[i];
+            // only the client itself may invite its source. The id is no
+            // secret for the client, anybody else could claim (spoof) an
+            // address which hasn't been confirmed or authorized.
+            if (e->endpoint != client->endpoint) {
+                client->owner->mRejectedClients.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            // the client switched from the handshake source to ours
+            client->owner->confirmClient(client);
+            client->source->add_sink(e->endpoint, e->id, endpointSend);
+            client->source->set_sinkoption(e->endpoint, e->id, aoo_opt_protocol_flags, (void *) &e->flags, sizeof(int32_t));
+        }
+        else if (events[i]->type == AOO_UNINVITE_EVENT) {
+            // the client doesn't want to receive right now (or is leaving, see removeIdleClients())
+            auto e = (const aoo_sink_event *) events[i];
+            if (e->endpoint == client->endpoint) {
+                client->source->remove_sink(e->endpoint, e->id);
+            }
+        }
+    }
+    return 1;
+}
+
+int32_t SonobusMixer::handleClientSinkEvents(void * user, const aoo_event ** events, int32_t n)
+{
+    auto client = static_cast<Client *>(user);
+
+    for (int i = 0; i < n; ++i) {
+        if (events[i]->type == AOO_SOURCE_FORMAT_EVENT) {
+            auto e = (const aoo_source_event *) events[i];
+            // the client's stream got to our sink. NOTE: not the "add" event,
+            // we get that for our own invitation already.
+            if (e->endpoint == client->endpoint && e->id == client->remoteSinkId) {
+                client->owner->confirmClient(client);
+            }
+            aoo_format_storage f;
+            if (client->sink->get_source_format(e->endpoint, e->id, f) > 0) {
+                client->inChannels = std::min(2, f.header.nchannels);
+
+                // send the mix back in the format the client uses, but always in stereo
+                f.header.nchannels = 2;
+                client->source->set_format(f.header);
+            }
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2020 Jesse Chappell
+
+// Optional mixing server (MCU) for the headless connection server.
+// A client connects to it like to any other SonoBus peer (direct connect to
+// host:port), sends it one stream and gets back one stereo stream with all the
+// other clients mixed in (mix-minus). Upload bandwidth and decode load of each
+// client then no longer grow with the size of the group.
+//
+// We only stream to a client once it has proven that it receives at its
+// address: its stream (or its invitation to our source) must reach the
+// randomly numbered sink/source we created for it, which it can only know
+// from our reply. Until then a spoofed invitation costs two small messages.
+
+#pragma once
+
+#include "aoo/aoo.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct MixerStats
+{
+    int numClients = 0;
+    int pendingClients = 0;      // invited us, but haven't confirmed their address yet
+    int64_t rejectedClients = 0; // not allowed, too many clients or spoofed invitations
+    int64_t blocks = 0;      // processed blocks since startup
+    int64_t lateBlocks = 0;  // blocks we couldn't process in time
+    double cpuSeconds = 0.0; // mixer thread CPU time since startup
+};
+
+struct MixerClientInfo
+{
+    int32_t id = 0;
+    std::string address;     // IP:port
+    int inChannels = 0;      // 0 until the client's stream arrives
+    float gain = 1.0f;
+    float pan = 0.0f;        // mono input
+    float panStereo[2] = { -1.0f, 1.0f };
+};
+
+class SonobusMixer
+{
+public:
+    SonobusMixer(int port, int sampleRate = 48000, int blockSize = 256, int bufferMs = 20);
+    ~SonobusMixer();
+
+    // call before start()
+    void setMaxClients(int maxClients) { mMaxClients = maxClients; }
+
+    bool start(std::string & errmsg);
+    void stop();
+
+    // the UDP port, the actual one after start() if 0 was passed
+    int getPort() const { return mPort; }
+
+    MixerStats getStats() const;
+
+    // If required, only clients from hosts (IP addresses) which have been
+    // allowed may connect, e.g. those of the users logged in to the connection
+    // server. Hosts are reference counted, and clients of a host which is no
+    // longer allowed are dropped.
+    void setHostAuthRequired(bool required) { mHostAuthRequired = required; }
+    void allowHost(const std::string & host);
+    void disallowHost(const std::string & host);
+
+    // ChannelGroup style gain and pan of a client's contribution to the mix,
+    // applied from the next block on. They return false for an unknown client.
+    std::vector<MixerClientInfo> getClients() const;
+    bool setClientGain(int32_t id, float gain);
+    bool setClientPan(int32_t id, float pan);
+    bool setClientStereoPan(int32_t id, float left, float right);
+
+    struct Endpoint;
+    struct Client;
+    struct PacketBatch;
+
+    // reply function for our sources and sinks
+    int32_t sendTo(Endpoint * endpoint, const char * data, int32_t size);
+
+private:
+    void run();
+
+    void receivePackets(int timeoutMs);
+    void handlePacket(Endpoint * endpoint, const char * buf, int nbytes);
+    Endpoint * findOrAddEndpoint(const void * rawaddr, int addrlen);
+
+    void processBlock();
+    void sendAll();
+    void handleAllEvents();
+    void removeIdleClients();
+
+    void handleInvitation(Endpoint * endpoint, int32_t remoteSinkId, int32_t flags);
+    bool isHostAllowed(const std::string & host) const;
+    int32_t makeClientId() const;
+    Client * addClient(Endpoint * endpoint, int32_t remoteSinkId, int32_t flags);
+    void confirmClient(Client * client);
+    void removeClient(Client * client);
+    void updateClientCounts();
+    Client * findClient(int32_t id) const;
+
+    static int32_t handleHandshakeEvents(void * user, const aoo_event ** events, int32_t n);
+    static int32_t handleClientSourceEvents(void * user, const aoo_event ** events, int32_t n);
+    static int32_t handleClientSinkEvents(void * user, const aoo_event ** events, int32_t n);
+
+    int mPort;
+    int mSampleRate;
+    int mBlockSize;
+    int mBufferMs;
+    int mMaxClients = 64;
+
+    int mSocket = -1;
+    // batched socket I/O where the platform supports it
+    std::unique_ptr<PacketBatch> mBatch;
+    bool mBatchSends = false;
+    std::thread mThread;
+    std::atomic<bool> mQuit { false };
+
+    // accepts the initial invitation of a connecting client (see SonobusAudioProcessor)
+    aoo::isource::pointer mHandshakeSource;
+
+    std::unordered_map<uint64_t, std::unique_ptr<Endpoint>> mEndpoints;
+    // only changed by the mixer thread, which doesn't need the lock for reading
+    std::vector<std::unique_ptr<Client>> mClients;
+    std::unordered_map<int32_t, Client *> mClientsById;
+    mutable std::mutex mClientLock;
+
+    std::atomic<bool> mHostAuthRequired { false };
+    std::unordered_map<std::string, int> mAllowedHosts;
+    mutable std::mutex mHostLock;
+
+    // mix of all clients, each client gets this minus its own contribution
+    std::vector<aoo_sample> mTotal[2];
+    std::vector<aoo_sample> mOutput[2];
+
+    std::atomic<int> mNumClients { 0 };
+    std::atomic<int> mNumPending { 0 };
+    std::atomic<int64_t> mRejectedClients { 0 };
+    std::atomic<int64_t> mBlocks { 0 };
+    std::atomic<int64_t> mLateBlocks { 0 };
+    std::atomic<double> mCpuSeconds { 0.0 };
+};
@@ -0,0 +1,503 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2020 Jesse Chappell
+
+// Headless SonoBus connection server.
+// Runs the AOO rendezvous server without any JUCE, GUI or audio dependencies,
+// so it can be deployed on small machines. Options can be given on the
+// command line or in a simple "key = value" config file.
+
+#include "aoo/aoo_net.hpp"
+#include "SonobusMixer.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#ifndef SONOBUS_SERVER_VERSION
+#define SONOBUS_SERVER_VERSION "unknown"
+#endif
+
+namespace {
+
+struct ServerOptions
+{
+    int port = 10999;
+    int statsInterval = 60; // seconds, 0 = off
+    bool jsonStats = false;
+    bool logEvents = false;
+    bool relay = false;
+    int relayRate = 1000000; // bytes per second and session, 0 = unlimited
+    int mixPort = 0; // 0 = mixer off
+    int mixBuffer = 20; // ms
+    int mixMaxClients = 64;
+    bool mixAuth = true; // only logged in users may use the mixer
+    std::string mixGroup; // if set, only members of this group may use the mixer
+};
+
+std::atomic<bool> quitRequested { false };
+
+void signalHandler(int)
+{
+    quitRequested = true;
+}
+
+std::string timeStamp()
+{
+    char buf[32];
+    std::time_t now = std::time(nullptr);
+    std::tm tmval;
+#ifdef _WIN32
+    gmtime_s(&tmval, &now);
+#else
+    gmtime_r(&now, &tmval);
+#endif
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tmval);
+    return buf;
+}
+
+void printUsage(const char * progname)
+{
+    std::printf("usage: %s [options]\n"
+                "  -p, --port PORT             TCP/UDP port to listen on (default 10999)\n"
+                "  -c, --config FILE           read options from FILE (key = value lines)\n"
+                "  -i, --stats-interval SECS   print statistics every SECS seconds, 0 = off (default 60)\n"
+                "  -j, --json                  print statistics as JSON lines\n"
+                "  -v, --log-events            log user and group joins/leaves\n"
+                "  -r, --relay                 relay UDP traffic for peers that can't connect directly\n"
+                "      --relay-rate BYTES      max. bytes/s per relayed peer pair, 0 = unlimited (default 1000000)\n"
+                "  -m, --mix-port PORT         run a mixing server on this UDP port, 0 = off (default 0)\n"
+                "      --mix-buffer MS         mixer jitter buffer in ms (default 20)\n"
+                "      --mix-max-clients N     max. number of mixer clients (default 64)\n"
+                "      --mix-group NAME        only members of this group may use the mixer\n"
+                "      --mix-open              let anybody use the mixer, not only logged in users\n"
+                "  -V, --version               print version and exit\n"
+                "  -h, --help                  show this help\n"
+                "config file keys: port, stats-interval, stats-format (text|json), log-events (true|false),\n"
+                "                  relay (true|false), relay-rate, mix-port, mix-buffer, mix-max-clients,\n"
+                "                  mix-group, mix-auth (true|false)\n",
+                progname);
+}
+
+bool parseBool(const std::string & value, bool & ret)
+{
+    if (value == "1" || value == "true" || value == "yes" || value == "on") {
+        ret = true;
+        return true;
+    }
+    if (value == "0" || value == "false" || value == "no" || value == "off") {
+        ret = false;
+        return true;
+    }
+    return false;
+}
+
+bool parseInt(const std::string & value, int minval, int maxval, int & ret)
+{
+    char * end = nullptr;
+    long val = std::strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || val < minval || val > maxval) {
+        return false;
+    }
+    ret = (int) val;
+    return true;
+}
+
+bool applyOption(ServerOptions & opts, const std::string & key, const std::string & value)
+{
+    if (key == "port") {
+        return parseInt(value, 1, 65535, opts.port);
+    }
+    else if (key == "stats-interval") {
+        return parseInt(value, 0, 86400, opts.statsInterval);
+    }
+    else if (key == "stats-format") {
+        if (value == "json" || value == "text") {
+            opts.jsonStats = value == "json";
+            return true;
+        }
+        return false;
+    }
+    else if (key == "log-events") {
+        return parseBool(value, opts.logEvents);
+    }
+    else if (key == "relay") {
+        return parseBool(value, opts.relay);
+    }
+    else if (key == "relay-rate") {
+        return parseInt(value, 0, 1000000000, opts.relayRate);
+    }
+    else if (key == "mix-port") {
+        return parseInt(value, 0, 65535, opts.mixPort);
+    }
+    else if (key == "mix-buffer") {
+        return parseInt(value, 1, 1000, opts.mixBuffer);
+    }
+    else if (key == "mix-max-clients") {
+        return parseInt(value, 1, 10000, opts.mixMaxClients);
+    }
+    else if (key == "mix-group") {
+        opts.mixGroup = value;
+        return !value.empty();
+    }
+    else if (key == "mix-auth") {
+        return parseBool(value, opts.mixAuth);
+    }
+    return false;
+}
+
+std::string trim(const std::string & str)
+{
+    auto first = str.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+        return "";
+    }
+    auto last = str.find_last_not_of(" \t\r\n");
+    return str.substr(first, last - first + 1);
+}
+
+bool loadConfigFile(ServerOptions & opts, const std::string & path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::fprintf(stderr, "couldn't open config file %s\n", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    int lineno = 0;
+    while (std::getline(file, line)) {
+        ++lineno;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        auto pos = line.find('=');
+        if (pos == std::string::npos
+            || !applyOption(opts, trim(line.substr(0, pos)), trim(line.substr(pos + 1)))) {
+            std::fprintf(stderr, "%s:%d: invalid option '%s'\n", path.c_str(), lineno, line.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// returns 0 to continue, 1 for a clean exit, -1 for an error
+int parseArgs(ServerOptions & opts, int argc, char ** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto needValue = [&]() -> const char * {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 1;
+        }
+        else if (arg == "-V" || arg == "--version") {
+            std::printf("sonobus-server %s\n", SONOBUS_SERVER_VERSION);
+            return 1;
+        }
+        else if (arg == "-j" || arg == "--json") {
+            opts.jsonStats = true;
+        }
+        else if (arg == "-v" || arg == "--log-events") {
+            opts.logEvents = true;
+        }
+        else if (arg == "-r" || arg == "--relay") {
+            opts.relay = true;
+        }
+        else if (arg == "--mix-open") {
+            opts.mixAuth = false;
+        }
+        else if (arg == "-c" || arg == "--config") {
+            auto value = needValue();
+            if (!value || !loadConfigFile(opts, value)) {
+                return -1;
+            }
+        }
+        else if (arg == "-p" || arg == "--port" || arg == "-i" || arg == "--stats-interval"
+                 || arg == "--relay-rate" || arg == "-m" || arg == "--mix-port" || arg == "--mix-buffer"
+                 || arg == "--mix-max-clients" || arg == "--mix-group") {
+            auto value = needValue();
+            auto key = (arg == "-p" || arg == "--port") ? "port"
+                     : (arg == "--relay-rate") ? "relay-rate"
+                     : (arg == "-m" || arg == "--mix-port") ? "mix-port"
+                     : (arg == "--mix-buffer") ? "mix-buffer"
+                     : (arg == "--mix-max-clients") ? "mix-max-clients"
+                     : (arg == "--mix-group") ? "mix-group" : "stats-interval";
+            if (!value || !applyOption(opts, key, value)) {
+                if (value) {
+                    std::fprintf(stderr, "invalid value for %s: %s\n", arg.c_str(), value);
+                }
+                return -1;
+            }
+        }
+        else {
+            std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+            printUsage(argv[0]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// every client needs a socket, so make sure we aren't limited
+// by the (often very low) default soft limit for open files.
+void raiseFileLimit()
+{
+#ifndef _WIN32
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) != 0) {
+            std::fprintf(stderr, "couldn't raise open file limit\n");
+        }
+    }
+#endif
+}
+
+struct EventContext
+{
+    const ServerOptions * opts;
+    SonobusMixer * mixer;
+    // IP addresses of the logged in users, for the mixer's host authorization
+    std::unordered_map<std::string, std::string> userHosts;
+};
+
+int32_t handleEvents(void * user, const aoo_event ** events, int32_t n)
+{
+    auto ctx = static_cast<EventContext *>(user);
+    auto opts = ctx->opts;
+
+    for (int i = 0; i < n; ++i) {
+        switch (events[i]->type) {
+        case AOONET_SERVER_USER_JOIN_EVENT:
+        case AOONET_SERVER_USER_LEAVE_EVENT:
+        {
+            auto e = (const aoonet_server_user_event *)events[i];
+            const bool join = events[i]->type == AOONET_SERVER_USER_JOIN_EVENT;
+            if (opts->logEvents) {
+                std::printf("%s user %s: %s\n", timeStamp().c_str(), join ? "join" : "leave", e->name);
+            }
+            if (join) {
+                ctx->userHosts[e->name] = e->address;
+            }
+            if (ctx->mixer && opts->mixGroup.empty()) {
+                if (join) {
+                    ctx->mixer->allowHost(e->address);
+                }
+                else {
+                    ctx->mixer->disallowHost(e->address);
+                }
+            }
+            if (!join) {
+                ctx->userHosts.erase(e->name);
+            }
+            break;
+        }
+        case AOONET_SERVER_GROUP_JOIN_EVENT:
+        case AOONET_SERVER_GROUP_LEAVE_EVENT:
+        {
+            auto e = (const aoonet_server_group_event *)events[i];
+            const bool join = events[i]->type == AOONET_SERVER_GROUP_JOIN_EVENT;
+            if (opts->logEvents) {
+                std::printf("%s group %s: %s (%s)\n", timeStamp().c_str(), join ? "join" : "leave", e->group, e->user);
+            }
+            // users leave their groups before they are gone themselves
+            auto it = ctx->userHosts.find(e->user);
+            if (ctx->mixer && opts->mixGroup == e->group && it != ctx->userHosts.end()) {
+                if (join) {
+                    ctx->mixer->allowHost(it->second);
+                }
+                else {
+                    ctx->mixer->disallowHost(it->second);
+                }
+            }
+            break;
+        }
+        case AOONET_SERVER_ERROR_EVENT:
+        {
+            auto e = (const aoonet_server_event *)events[i];
+            std::fprintf(stderr, "%s error: %s\n", timeStamp().c_str(), e->errormsg);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return 1;
+}
+
+void printStats(const ServerOptions & opts, const aoonet_server_stats & stats,
+                const aoonet_server_stats & last, double elapsed)
+{
+    double tcprate = elapsed > 0.0 ? (stats.tcp_messages - last.tcp_messages) / elapsed : 0.0;
+    double udprate = elapsed > 0.0 ? (stats.udp_messages - last.udp_messages) / elapsed : 0.0;
+
+    if (opts.jsonStats) {
+        std::printf("{\"time\":\"%s\",\"clients\":%d,\"users\":%d,\"groups\":%d,"
+                    "\"tcp_messages\":%lld,\"udp_messages\":%lld,"
+                    "\"tcp_messages_per_sec\":%.2f,\"udp_messages_per_sec\":%.2f,"
+                    "\"send_queue_bytes\":%lld,\"max_send_queue\":%d,"
+                    "\"send_blocked\":%lld,\"send_overflows\":%lld,"
+                    "\"relay_sessions\":%d,\"relay_packets\":%lld,\"relay_bytes\":%lld,\"relay_dropped\":%lld,"
+                    "\"rejected_clients\":%lld}\n",
+                    timeStamp().c_str(), stats.num_clients, stats.num_users, stats.num_groups,
+                    (long long) stats.tcp_messages, (long long) stats.udp_messages,
+                    tcprate, udprate,
+                    (long long) stats.send_queue_bytes, stats.max_send_queue,
+                    (long long) stats.send_blocked, (long long) stats.send_overflows,
+                    stats.relay_sessions, (long long) stats.relay_packets,
+                    (long long) stats.relay_bytes, (long long) stats.relay_dropped,
+                    (long long) stats.rejected_clients);
+    }
+    else {
+        std::printf("%s stats: clients %d, users %d, groups %d, tcp msgs/s %.2f, udp msgs/s %.2f, "
+                    "queued %lld bytes (max %d), blocked %lld, overflows %lld, "
+                    "relay sessions %d, relayed %lld packets/%lld bytes, relay drops %lld, rejected %lld\n",
+                    timeStamp().c_str(), stats.num_clients, stats.num_users, stats.num_groups,
+                    tcprate, udprate,
+                    (long long) stats.send_queue_bytes, stats.max_send_queue,
+                    (long long) stats.send_blocked, (long long) stats.send_overflows,
+                    stats.relay_sessions, (long long) stats.relay_packets,
+                    (long long) stats.relay_bytes, (long long) stats.relay_dropped,
+                    (long long) stats.rejected_clients);
+    }
+}
+
+void printMixerStats(const ServerOptions & opts, const MixerStats & stats,
+                     const MixerStats & last, double elapsed)
+{
+    // CPU load of the mixer thread, in percent of one core
+    double cpu = elapsed > 0.0 ? 100.0 * (stats.cpuSeconds - last.cpuSeconds) / elapsed : 0.0;
+    double cpuPerClient = stats.numClients > 0 ? cpu / stats.numClients : 0.0;
+
+    if (opts.jsonStats) {
+        std::printf("{\"time\":\"%s\",\"mixer_clients\":%d,\"mixer_pending_clients\":%d,"
+                    "\"mixer_rejected_clients\":%lld,\"mixer_cpu_percent\":%.2f,"
+                    "\"mixer_cpu_percent_per_client\":%.3f,\"mixer_late_blocks\":%lld}\n",
+                    timeStamp().c_str(), stats.numClients, stats.pendingClients,
+                    (long long) stats.rejectedClients, cpu, cpuPerClient, (long long) stats.lateBlocks);
+    }
+    else {
+        std::printf("%s mixer: clients %d (%d pending, %lld rejected), cpu %.2f%% (%.3f%% per client), "
+                    "late blocks %lld\n",
+                    timeStamp().c_str(), stats.numClients, stats.pendingClients,
+                    (long long) stats.rejectedClients, cpu, cpuPerClient, (long long) stats.lateBlocks);
+    }
+}
+
+} // namespace
+
+
+int main(int argc, char ** argv)
+{
+    ServerOptions opts;
+
+    int ret = parseArgs(opts, argc, argv);
+    if (ret != 0) {
+        return ret > 0 ? 0 : 1;
+    }
+
+    // we might be logging to a pipe or file
+    std::setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    std::signal(SIGINT, signalHandler);
+    std::signal(SIGTERM, signalHandler);
+#ifdef SIGPIPE
+    // writing to a connection which was just closed by the client must not kill us
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    raiseFileLimit();
+
+    int32_t err = 0;
+    aoo::net::iserver::pointer server(aoo::net::iserver::create(opts.port, &err));
+    if (!server) {
+        std::fprintf(stderr, "couldn't create server on port %d: %s (%d)\n",
+                     opts.port, std::strerror(err), err);
+        return 1;
+    }
+
+    server->set_relay(opts.relay, opts.relayRate);
+
+    std::printf("%s sonobus-server %s listening on port %d%s\n", timeStamp().c_str(), SONOBUS_SERVER_VERSION, opts.port,
+                opts.relay ? " (relay enabled)" : "");
+
+    std::unique_ptr<SonobusMixer> mixer;
+    if (opts.mixPort > 0) {
+        mixer = std::make_unique<SonobusMixer>(opts.mixPort, 48000, 256, opts.mixBuffer);
+        mixer->setMaxClients(opts.mixMaxClients);
+        mixer->setHostAuthRequired(opts.mixAuth || !opts.mixGroup.empty());
+        std::string errmsg;
+        if (!mixer->start(errmsg)) {
+            std::fprintf(stderr, "couldn't start mixer: %s\n", errmsg.c_str());
+            return 1;
+        }
+        std::printf("%s mixer listening on UDP port %d%s\n", timeStamp().c_str(), opts.mixPort,
+                    !opts.mixGroup.empty() ? " (group members only)" : opts.mixAuth ? " (logged in users only)" : "");
+    }
+
+    EventContext eventContext { &opts, mixer.get() };
+
+    std::thread serverThread([&server]() {
+        server->run();
+    });
+
+    using clock = std::chrono::steady_clock;
+    auto lastStatsTime = clock::now();
+    aoonet_server_stats lastStats = {};
+    MixerStats lastMixerStats;
+
+    while (!quitRequested.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        // always drain the event queue, even if we don't log anything
+        server->handle_events(handleEvents, &eventContext);
+
+        auto now = clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastStatsTime).count();
+        if (opts.statsInterval > 0 && elapsed >= opts.statsInterval) {
+            aoonet_server_stats stats;
+            server->get_stats(stats);
+            printStats(opts, stats, lastStats, elapsed);
+            lastStats = stats;
+            if (mixer) {
+                auto mixerStats = mixer->getStats();
+                printMixerStats(opts, mixerStats, lastMixerStats, elapsed);
+                lastMixerStats = mixerStats;
+            }
+            lastStatsTime = now;
+        }
+    }
+
+    std::printf("%s shutting down\n", timeStamp().c_str());
+
+    if (mixer) {
+        mixer->stop();
+    }
+
+    server->quit();
+    serverThread.join();
+    server->handle_events(handleEvents, &eventContext);
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Benchmark for the /data and compact /d message serializer and parser,
+// compared to oscpack: million messages per second for each.
+//
+//   bench-data-message [--blobsize 333] [--seconds 0.5 (per run)]
+
+#include "TestUtils.h"
+#include "OscpackData.h"
+
+#include <vector>
+
+namespace {
+
+volatile int32_t sink_; // keeps the results alive
+
+// returns million calls per second
+template<typename F>
+double measure(double seconds, F && fn)
+{
+    long count = 0;
+    int32_t check = 0;
+    double t0 = nowSeconds(), elapsed = 0;
+    while (elapsed < seconds) {
+        for (int i = 0; i < 10000; ++i) {
+            check += fn();
+        }
+        count += 10000;
+        elapsed = nowSeconds() - t0;
+    }
+    sink_ = check;
+    return count / elapsed * 1e-6;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    if (hasFlag(argc, argv, "help")) {
+        std::printf("bench-data-message [--blobsize 333] [--seconds 0.5 (per run)]\n");
+        return 0;
+    }
+    const int blobsize = atoi(getArg(argc, argv, "blobsize", "333"));
+    const double seconds = atof(getArg(argc, argv, "seconds", "0.5"));
+
+    std::vector<char> blob(blobsize, 1);
+    aoo::data_packet d {};
+    d.sequence = 1000;
+    d.samplerate = 48000;
+    d.channel = 0;
+    d.totalsize = blobsize;
+    d.nframes = 1;
+    d.framenum = 0;
+    d.data = blob.data();
+    d.size = blobsize;
+
+    aoo::data_message_header header;
+    header.init(12);
+
+    std::vector<char> buf(AOO_MAXPACKETSIZE);
+    const auto size = (int32_t) buf.size();
+
+    std::printf("Mmsg/s, blob size %d\n", blobsize);
+    std::printf("%-14s %10s %10s\n", "", "oscpack", "aoo");
+
+    {
+        auto ref = measure(seconds, [&]() {
+            ++d.sequence;
+            return oscpackWriteData(buf.data(), size, 12, 1, 2, d);
+        });
+        auto own = measure(seconds, [&]() {
+            ++d.sequence;
+            return aoo::write_data_message(buf.data(), size, header, 1, 2, d);
+        });
+        std::printf("%-14s %10.2f %10.2f\n", "write /data", ref, own);
+    }
+    {
+        auto n = aoo::write_data_message(buf.data(), size, header, 1, 2, d);
+        int32_t src, salt;
+        aoo::data_packet p;
+        auto ref = measure(seconds, [&]() {
+            oscpackParseData(buf.data(), n, src, salt, p);
+            return p.sequence;
+        });
+        auto own = measure(seconds, [&]() {
+            aoo::parse_data_message(buf.data(), n, src, salt, p);
+            return p.sequence;
+        });
+        std::printf("%-14s %10.2f %10.2f\n", "parse /data", ref, own);
+    }
+    for (bool sendrate : { false, true }) {
+        auto ref = measure(seconds, [&]() {
+            ++d.sequence;
+            return oscpackWriteCompactData(buf.data(), size, 2, d, sendrate);
+        });
+        auto own = measure(seconds, [&]() {
+            ++d.sequence;
+            return aoo::write_compact_data_message(buf.data(), size, 2, d, sendrate);
+        });
+        std::printf("%-14s %10.2f %10.2f\n", sendrate ? "write /d (sr)" : "write /d", ref, own);
+
+        auto n = aoo::write_compact_data_message(buf.data(), size, 2, d, sendrate);
+        int32_t salt;
+        aoo::data_packet p;
+        ref = measure(seconds, [&]() {
+            oscpackParseCompactData(buf.data(), n, salt, p);
+            return p.sequence;
+        });
+        own = measure(seconds, [&]() {
+            aoo::parse_compact_data_message(buf.data(), n, salt, p);
+            return p.sequence;
+        });
+        std::printf("%-14s %10.2f %10.2f\n", sendrate ? "parse /d (sr)" : "parse /d", ref, own);
+    }
+    return 0;
+}
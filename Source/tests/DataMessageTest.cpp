@@ -0,0 +1,149 @@
+// Tests the hand-written /data and /d message serializer and parser:
+// the messages must be byte-identical to what oscpack writes, parse back
+// to the same packet and malformed messages must be rejected.
+
+#include "TestUtils.h"
+#include "OscpackData.h"
+
+#include "aoo/aoo_utils.hpp"
+
+#include <vector>
+
+namespace {
+
+aoo::data_packet makePacket(const std::vector<char> & blob)
+{
+    aoo::data_packet d {};
+    d.sequence = 123456;
+    d.samplerate = 48000.123;
+    d.channel = 3;
+    d.totalsize = (int32_t) blob.size() * 3;
+    d.nframes = 3;
+    d.framenum = 1;
+    d.data = blob.data();
+    d.size = (int32_t) blob.size();
+    return d;
+}
+
+bool samePacket(const aoo::data_packet & a, const aoo::data_packet & b)
+{
+    return a.sequence == b.sequence && a.samplerate == b.samplerate
+        && a.channel == b.channel && a.totalsize == b.totalsize
+        && a.nframes == b.nframes && a.framenum == b.framenum
+        && a.size == b.size && !memcmp(a.data, b.data, a.size);
+}
+
+// every blob size pads differently
+void testData()
+{
+    for (int32_t sink : { 0, 7, 12345, 2147483647 }) {
+        aoo::data_message_header header;
+        header.init(sink);
+        for (int size = 0; size <= 9; ++size) {
+            std::vector<char> blob(size);
+            for (int i = 0; i < size; ++i) blob[i] = (char) (i * 37 + 1);
+            auto d = makePacket(blob);
+
+            char ref[256], buf[256];
+            auto nref = oscpackWriteData(ref, sizeof(ref), sink, 5, -17, d);
+            auto n = aoo::write_data_message(buf, sizeof(buf), header, 5, -17, d);
+            CHECK(n == nref);
+            CHECK(!memcmp(buf, ref, n));
+
+            int32_t src, salt;
+            aoo::data_packet p;
+            CHECK(aoo::parse_data_message(buf, n, src, salt, p));
+            CHECK(src == 5 && salt == -17);
+            CHECK(samePacket(p, d));
+
+            // a buffer which is too small
+            CHECK(aoo::write_data_message(buf, n - 1, header, 5, -17, d) == 0);
+        }
+    }
+}
+
+void testCompactData()
+{
+    for (bool sendrate : { false, true }) {
+        for (int size = 0; size <= 9; ++size) {
+            std::vector<char> blob(size);
+            for (int i = 0; i < size; ++i) blob[i] = (char) (i * 37 + 1);
+            auto d = makePacket(blob);
+
+            char ref[256], buf[256];
+            auto nref = oscpackWriteCompactData(ref, sizeof(ref), 99, d, sendrate);
+            auto n = aoo::write_compact_data_message(buf, sizeof(buf), 99, d, sendrate);
+            CHECK(n == nref);
+            CHECK(!memcmp(buf, ref, n));
+
+            int32_t salt;
+            aoo::data_packet p, q;
+            CHECK(aoo::parse_compact_data_message(buf, n, salt, p));
+            CHECK(salt == 99);
+            CHECK(p.sequence == d.sequence);
+            CHECK(p.samplerate == (sendrate ? d.samplerate : 0));
+            CHECK(p.size == size && !memcmp(p.data, blob.data(), size));
+            CHECK(p.channel == 0 && p.nframes == 1 && p.framenum == 0 && p.totalsize == size);
+
+            int32_t refsalt;
+            oscpackParseCompactData(buf, n, refsalt, q);
+            CHECK(refsalt == salt && samePacket(p, q));
+
+            CHECK(aoo::write_compact_data_message(buf, n - 1, 99, d, sendrate) == 0);
+        }
+    }
+}
+
+// truncated messages, bad blob sizes and other messages
+void testMalformed()
+{
+    std::vector<char> blob(64, 1);
+    auto d = makePacket(blob);
+    aoo::data_message_header header;
+    header.init(1);
+
+    char buf[256];
+    int32_t src, salt;
+    aoo::data_packet p;
+
+    auto n = aoo::write_data_message(buf, sizeof(buf), header, 1, 2, d);
+    bool rejected = true;
+    for (int32_t m = 0; m < n - 64; ++m) {
+        if (aoo::parse_data_message(buf, m, src, salt, p)) rejected = false;
+    }
+    CHECK(rejected);
+    // the blob is longer than the message
+    CHECK(!aoo::parse_data_message(buf, n - 4, src, salt, p));
+    aoo::to_bytes<int32_t>(-1, buf + n - 64 - 4);
+    CHECK(!aoo::parse_data_message(buf, n, src, salt, p));
+
+    n = aoo::write_compact_data_message(buf, sizeof(buf), 2, d, true);
+    rejected = true;
+    for (int32_t m = 0; m < n - 64; ++m) {
+        if (aoo::parse_compact_data_message(buf, m, salt, p)) rejected = false;
+    }
+    CHECK(rejected);
+    CHECK(!aoo::parse_compact_data_message(buf, n - 4, salt, p));
+
+    // other messages with a similar address
+    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    msg << osc::BeginMessage("/d") << 1 << 2 << 3 << osc::EndMessage;
+    CHECK(!aoo::parse_compact_data_message(buf, (int32_t) msg.Size(), salt, p));
+    msg.Clear();
+    msg << osc::BeginMessage("/dd") << 1 << 2 << osc::Blob(blob.data(), 4) << osc::EndMessage;
+    CHECK(!aoo::parse_compact_data_message(buf, (int32_t) msg.Size(), salt, p));
+    msg.Clear();
+    msg << osc::BeginMessage("/aoo/sink/1/data") << 1 << 2 << osc::EndMessage;
+    CHECK(!aoo::parse_data_message(buf, (int32_t) msg.Size(), src, salt, p));
+}
+
+} // namespace
+
+int main()
+{
+    testData();
+    testCompactData();
+    testMalformed();
+
+    return testResult("test-data-message");
+}
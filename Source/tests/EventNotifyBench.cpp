@@ -0,0 +1,362 @@
+// Benchmark for the way SonobusAudioProcessor's event and send threads wake
+// up: polling every peer every 20 ms vs. the AOO event notifications
+// (aoo_opt_event_notify), which flag the peers that have work and wake the
+// thread, with the same idle timeouts as the processor (50 and 100 ms).
+//
+// For both it measures the CPU time of the two threads while nothing
+// happens, the ping event latency (a /ping arrives at a source until the
+// event thread handles the event) and the resend turnaround (a data request
+// arrives at a source until the send thread has sent the block again).
+//
+//   bench-event-notify [--peers 30] [--seconds 5 (idle)] [--samples 200]
+
+#include "TestUtils.h"
+
+#ifdef _WIN32
+
+int main()
+{
+    std::printf("bench-event-notify: not supported on Windows\n");
+    return 0;
+}
+
+#else
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+#include "oscpack/osc/OscOutboundPacketStream.h"
+#include "oscpack/osc/OscReceivedElements.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// same as in SonobusPluginProcessor.cpp
+const int pollIntervalMs = 20;
+const int eventIdleWakeMs = 50;
+const int sendIdleWakeMs = 100;
+
+const int sinkId = 1000;
+
+// like juce::WaitableEvent
+struct Waitable {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool signaled = false;
+
+    bool wait(int ms)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool ret = cond.wait_for(lock, std::chrono::milliseconds(ms), [this]() { return signaled; });
+        signaled = false;
+        return ret;
+    }
+
+    void signal()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            signaled = true;
+        }
+        cond.notify_one();
+    }
+};
+
+struct Bench;
+
+struct Peer {
+    Bench * owner = nullptr;
+    int32_t id = 0;
+    aoo::isource::pointer source;
+    aoo::isink::pointer sink;
+    std::atomic<bool> eventsPending { true };
+    std::atomic<bool> sendPending { true };
+    std::atomic<int32_t> salt { -1 };
+    std::atomic<double> requestTime { 0 }; // of the pending data request
+};
+
+double threadCpuSeconds(std::thread & thread)
+{
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(thread.native_handle(), &clock) != 0
+        || clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct Bench {
+    bool notify;
+    std::vector<std::unique_ptr<Peer>> peers;
+    Waitable eventWaitable;
+    Waitable sendWaitable;
+    std::atomic<bool> quit { false };
+    std::atomic<long> eventWakeups { 0 };
+    std::atomic<long> sendWakeups { 0 };
+    std::atomic<double> pingTime { 0 };
+    std::vector<double> pingLatency;   // event thread only
+    std::vector<double> resendLatency; // send thread only
+    std::thread eventThread;
+    std::thread sendThread;
+
+    Bench(int numPeers, bool notify_) : notify(notify_)
+    {
+        for (int i = 0; i < numPeers; ++i) {
+            auto peer = std::make_unique<Peer>();
+            peer->owner = this;
+            peer->id = i + 1;
+            peer->source.reset(aoo::isource::create(peer->id));
+            peer->sink.reset(aoo::isink::create(peer->id));
+
+            aoo_format_pcm fmt {};
+            fmt.header.codec = AOO_CODEC_PCM;
+            fmt.header.nchannels = 1;
+            fmt.header.samplerate = 48000;
+            fmt.header.blocksize = 256;
+            fmt.bitdepth = AOO_PCM_FLOAT32;
+            peer->source->set_format(fmt.header);
+            peer->source->setup(48000, 256, 1);
+            peer->source->set_buffersize(20);
+            // only our own pings
+            peer->source->set_ping_interval(1000000);
+            peer->sink->setup(48000, 256, 1);
+            peer->sink->set_buffersize(20);
+            if (notify) {
+                peer->source->set_event_notify(notifyPeer, peer.get());
+                peer->sink->set_event_notify(notifyPeer, peer.get());
+            }
+
+            // fill the history buffer, so there is something to resend
+            peer->source->add_sink(peer.get(), sinkId, send);
+            peer->source->start();
+            std::vector<aoo_sample> buf(256, 0.1f);
+            const aoo_sample * chn[1] = { buf.data() };
+            for (int b = 0; b < 20; ++b) {
+                peer->source->process(chn, 256, aoo_osctime_get());
+                peer->source->send();
+            }
+            peers.push_back(std::move(peer));
+        }
+
+        eventThread = std::thread([this]() { runEvents(); });
+        sendThread = std::thread([this]() { runSend(); });
+    }
+
+    ~Bench()
+    {
+        quit = true;
+        eventWaitable.signal();
+        sendWaitable.signal();
+        eventThread.join();
+        sendThread.join();
+    }
+
+    double cpuSeconds()
+    {
+        return threadCpuSeconds(eventThread) + threadCpuSeconds(sendThread);
+    }
+
+    // like SonobusAudioProcessor::notifyPeerEvents()
+    static void notifyPeer(void * user)
+    {
+        auto peer = static_cast<Peer *>(user);
+        peer->eventsPending = true;
+        peer->owner->eventWaitable.signal();
+    }
+
+    static int32_t send(void * user, const char * data, int32_t n)
+    {
+        auto peer = static_cast<Peer *>(user);
+        double t = peer->requestTime.load();
+        if (t > 0 && peer->requestTime.compare_exchange_strong(t, 0.0)) {
+            peer->owner->resendLatency.push_back(nowSeconds() - t);
+        }
+        if (peer->salt.load() < 0) {
+            osc::ReceivedPacket packet(data, n);
+            if (packet.IsMessage()) {
+                osc::ReceivedMessage msg(packet);
+                if (std::strstr(msg.AddressPattern(), "/format")) {
+                    auto it = msg.ArgumentsBegin();
+                    ++it; // source id
+                    ++it; // version
+                    peer->salt = it->AsInt32();
+                }
+            }
+        }
+        return n;
+    }
+
+    static int32_t handleSourceEvents(void * user, const aoo_event ** events, int32_t n)
+    {
+        auto self = static_cast<Bench *>(user);
+        for (int i = 0; i < n; ++i) {
+            if (events[i]->type == AOO_PING_EVENT) {
+                self->pingLatency.push_back(nowSeconds() - self->pingTime.load());
+            }
+        }
+        return 1;
+    }
+
+    static int32_t handleSinkEvents(void *, const aoo_event **, int32_t)
+    {
+        return 1;
+    }
+
+    // like SonobusAudioProcessor::EventThread and handleEvents()
+    void runEvents()
+    {
+        while (!quit.load()) {
+            bool allpeers = true;
+            if (notify) {
+                allpeers = !eventWaitable.wait(eventIdleWakeMs);
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(pollIntervalMs));
+            }
+            ++eventWakeups;
+            for (auto & peer : peers) {
+                if (notify && !peer->eventsPending.exchange(false) && !allpeers) {
+                    continue;
+                }
+                peer->source->handle_events(handleSourceEvents, this);
+                peer->sink->handle_events(handleSinkEvents, this);
+            }
+        }
+    }
+
+    // like SonobusAudioProcessor::SendThread and doSendData()
+    void runSend()
+    {
+        std::vector<char> sendnow(peers.size());
+        while (!quit.load()) {
+            bool timedout = !sendWaitable.wait(notify ? sendIdleWakeMs : pollIntervalMs);
+            ++sendWakeups;
+            const bool allpeers = !notify || timedout;
+            for (size_t i = 0; i < peers.size(); ++i) {
+                sendnow[i] = peers[i]->sendPending.exchange(false) || allpeers;
+            }
+            bool didsomething = true;
+            while (didsomething) {
+                didsomething = false;
+                for (size_t i = 0; i < peers.size(); ++i) {
+                    if (sendnow[i]) {
+                        didsomething |= peers[i]->source->send() != 0;
+                        didsomething |= peers[i]->sink->send() != 0;
+                    }
+                }
+            }
+        }
+    }
+
+    // a /ping from the peer's sink, as the receive thread would deliver it
+    void receivePing(Peer & peer)
+    {
+        char buf[256];
+        char address[64];
+        snprintf(address, sizeof(address), "/aoo/src/%d/ping", peer.id);
+        osc::OutboundPacketStream msg(buf, sizeof(buf));
+        msg << osc::BeginMessage(address) << (int32_t) sinkId
+            << osc::TimeTag(aoo_osctime_get()) << osc::TimeTag(aoo_osctime_get())
+            << (int32_t) 0 << osc::EndMessage;
+        pingTime = nowSeconds();
+        peer.source->handle_message(msg.Data(), (int32_t) msg.Size(), &peer, send);
+    }
+
+    // a request for a block in the history buffer
+    void receiveDataRequest(Peer & peer)
+    {
+        char buf[256];
+        char address[64];
+        snprintf(address, sizeof(address), "/aoo/src/%d/data", peer.id);
+        osc::OutboundPacketStream msg(buf, sizeof(buf));
+        msg << osc::BeginMessage(address) << (int32_t) sinkId << peer.salt.load()
+            << (int32_t) 5 << (int32_t) 0 << osc::EndMessage;
+        peer.requestTime = nowSeconds();
+        peer.source->handle_message(msg.Data(), (int32_t) msg.Size(), &peer, send);
+        // what the receive thread does
+        peer.sendPending = true;
+        sendWaitable.signal();
+    }
+};
+
+struct Percentiles {
+    double median = 0, p95 = 0, max = 0;
+};
+
+Percentiles percentiles(std::vector<double> v)
+{
+    Percentiles p;
+    if (!v.empty()) {
+        std::sort(v.begin(), v.end());
+        p.median = v[v.size() / 2] * 1000;
+        p.p95 = v[v.size() * 95 / 100] * 1000;
+        p.max = v.back() * 1000;
+    }
+    return p;
+}
+
+void run(bool notify, int numPeers, double idleSeconds, int samples)
+{
+    Bench bench(numPeers, notify);
+    // let the threads handle the setup
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    double cpu0 = bench.cpuSeconds();
+    long events0 = bench.eventWakeups, sends0 = bench.sendWakeups;
+    std::this_thread::sleep_for(std::chrono::duration<double>(idleSeconds));
+    double idlecpu = (bench.cpuSeconds() - cpu0) / idleSeconds * 100;
+    double eventrate = (bench.eventWakeups - events0) / idleSeconds;
+    double sendrate = (bench.sendWakeups - sends0) / idleSeconds;
+
+    // 20 pings and 20 data requests per second, spread over the peers
+    for (int i = 0; i < samples; ++i) {
+        auto & peer = *bench.peers[i % numPeers];
+        bench.receivePing(peer);
+        std::this_thread::sleep_for(std::chrono::milliseconds(25));
+        bench.receiveDataRequest(peer);
+        std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    }
+
+    auto ping = percentiles(bench.pingLatency);
+    auto resend = percentiles(bench.resendLatency);
+    std::printf("%-7s %9.3f %7.1f %7.1f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f%s\n",
+                notify ? "notify" : "poll", idlecpu, eventrate, sendrate,
+                ping.median, ping.p95, ping.max, resend.median, resend.p95, resend.max,
+                ((int) bench.pingLatency.size() < samples || (int) bench.resendLatency.size() < samples)
+                    ? " (missing samples!)" : "");
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    if (hasFlag(argc, argv, "help")) {
+        std::printf("bench-event-notify [--peers 30] [--seconds 5 (idle)] [--samples 200]\n");
+        return 0;
+    }
+    const int peers = std::max(1, atoi(getArg(argc, argv, "peers", "30")));
+    const double seconds = atof(getArg(argc, argv, "seconds", "5"));
+    const int samples = atoi(getArg(argc, argv, "samples", "200"));
+
+    aoo_initialize();
+
+    std::printf("%d peers, times in ms\n", peers);
+    std::printf("%-7s %9s %7s %7s %20s %20s\n", "", "idle", "wakeups/s", "", "ping event", "resend");
+    std::printf("%-7s %9s %7s %7s %6s %6s %6s %6s %6s %6s\n", "mode", "CPU%", "event", "send",
+                "p50", "p95", "max", "p50", "p95", "max");
+    run(false, peers, seconds, samples);
+    run(true, peers, seconds, samples);
+    return 0;
+}
+
+#endif
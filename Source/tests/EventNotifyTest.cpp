@@ -0,0 +1,169 @@
+// Tests the event notification (aoo_opt_event_notify) of sources and sinks,
+// which SonobusAudioProcessor relies on to only visit peers with pending
+// events: whenever an object has events, its notify function must have been
+// called since they were last handled, with the user pointer it was set with.
+// The stream has losses and a pause, so the sink also pushes block loss and
+// source state events, from the network and the audio side.
+
+#include "TestUtils.h"
+#include "Loopback.h"
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+#include "src/common.hpp"
+
+#include <atomic>
+
+namespace {
+
+const int blocksize = 64;
+const int samplerate = 48000;
+
+struct Notified {
+    std::atomic<int> count { 0 };
+    int handled = 0; // count when the events were last handled
+    int events = 0;
+    int missed = 0;  // events found without a notification
+
+    static void notify(void * user)
+    {
+        static_cast<Notified *>(user)->count++;
+    }
+
+    static int32_t handleEvents(void * user, const aoo_event ** events, int32_t n)
+    {
+        static_cast<Notified *>(user)->events += n;
+        return 1;
+    }
+
+    // like SonobusAudioProcessor::handleEvents(), but also looks at the
+    // objects which weren't notified
+    template<typename T>
+    void poll(T & obj)
+    {
+        if (obj.events_available() > 0) {
+            if (count == handled) {
+                ++missed;
+            }
+            obj.handle_events(handleEvents, this);
+        }
+        handled = count;
+    }
+};
+
+// drops every packet (and resend) of some blocks once the stream is going
+struct DropBlocks {
+    int dropped = 0;
+
+    bool operator()(const char * data, int32_t n)
+    {
+        int32_t src, salt;
+        aoo::data_packet d;
+        if ((aoo::parse_compact_data_message(data, n, salt, d)
+             || (strstr(data, "/data") && aoo::parse_data_message(data, n, src, salt, d)))
+            && d.sequence >= 20 && d.sequence % 20 == 0) {
+            ++dropped;
+            return false;
+        }
+        return true;
+    }
+};
+
+void testStream()
+{
+    aoo::isource::pointer source(aoo::isource::create(1));
+    aoo::isink::pointer sink(aoo::isink::create(1));
+    Notified sourceNotified, sinkNotified;
+
+    aoo_format_pcm fmt {};
+    fmt.header.codec = AOO_CODEC_PCM;
+    fmt.header.nchannels = 1;
+    fmt.header.samplerate = samplerate;
+    fmt.header.blocksize = blocksize;
+    fmt.bitdepth = AOO_PCM_FLOAT32;
+
+    source->set_format(fmt.header);
+    source->setup(samplerate, blocksize, 1);
+    source->set_buffersize(100);
+    source->set_event_notify(Notified::notify, &sourceNotified);
+    sink->setup(samplerate, blocksize, 1);
+    sink->set_buffersize(20);
+    sink->set_event_notify(Notified::notify, &sinkNotified);
+
+    // the sink asks for the stream, so the source gets an invite event
+    Link link;
+    DropBlocks drop;
+    link.toSink.tap = std::ref(drop);
+    link.source = source.get();
+    link.sink = sink.get();
+    sink->invite_source(&link.toSource, 1, Wire::send);
+    while (sink->send()) {}
+    link.deliver();
+    CHECK(sourceNotified.count == 1);
+    CHECK(source->events_available() == 1);
+    sourceNotified.poll(*source);
+    CHECK(sourceNotified.events == 1);
+
+    source->add_sink(&link.toSink, 1, Wire::send);
+    source->start();
+
+    for (int b = 0; b < 600; ++b) {
+        float in[blocksize] = {}, out[blocksize];
+        const aoo_sample * inptr[1] = { in };
+        aoo_sample * outptr[1] = { out };
+        // a pause in the middle, the sink notices the stream stopping and starting
+        if (b < 250 || b >= 350) {
+            source->process(inptr, blocksize, aoo_osctime_get());
+            while (source->send()) {}
+        }
+        link.deliver();
+        sink->process(outptr, blocksize, aoo_osctime_get());
+        while (sink->send()) {}
+        link.deliver();
+
+        sourceNotified.poll(*source);
+        sinkNotified.poll(*sink);
+    }
+    std::printf("source: %d notifications, %d events, %d missed\n",
+                sourceNotified.count.load(), sourceNotified.events, sourceNotified.missed);
+    std::printf("sink: %d notifications, %d events, %d missed (%d packets dropped)\n",
+                sinkNotified.count.load(), sinkNotified.events, sinkNotified.missed, drop.dropped);
+    CHECK(drop.dropped > 20);
+    CHECK(sinkNotified.events > 10);
+    CHECK(sinkNotified.missed == 0);
+    CHECK(sourceNotified.missed == 0);
+}
+
+// without a notify function nothing is called, the events are still there
+void testUnset()
+{
+    aoo::isource::pointer source(aoo::isource::create(1));
+    aoo::isink::pointer sink(aoo::isink::create(1));
+    source->setup(samplerate, blocksize, 1);
+    sink->setup(samplerate, blocksize, 1);
+
+    Notified notified;
+    source->set_event_notify(Notified::notify, &notified);
+    source->set_event_notify(nullptr, nullptr);
+
+    Wire toSource;
+    sink->invite_source(&toSource, 1, Wire::send);
+    while (sink->send()) {}
+    toSource.deliver([&](const char * data, int32_t n) {
+        source->handle_message(data, n, &toSource, Wire::send);
+    });
+    CHECK(notified.count == 0);
+    CHECK(source->events_available() == 1);
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+
+    testStream();
+    testUnset();
+
+    return testResult("test-event-notify");
+}
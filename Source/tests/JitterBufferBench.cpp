@@ -0,0 +1,248 @@
+// Benchmark for the sink's jitter buffer (aoo::jitter_buffer) compared to
+// the sorted block_queue it replaced, on the same packet traces: in order,
+// reordered, with losses and both, with one or several frames per block.
+//
+// Each trace is played like the sink does it: a packet completes a block
+// in the buffer (or inserts it), and every packet plays out the block that
+// is 'latency' blocks behind the newest one, dropping what is older. Both
+// buffers must play and lose the same blocks.
+//
+//   bench-jitter-buffer [--blocks 100000] [--latency 8] [--capacity 16]
+//                       [--blocksize 2048 (bytes)] [--seconds 0.5 (per run)]
+
+#include "TestUtils.h"
+
+#include "src/common.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+// the old sink buffer (before the jitter buffer), kept for comparison:
+// a sorted array of blocks which are shifted on insert and pop
+class block_queue {
+public:
+    void resize(int32_t n){
+        blocks_.resize(n);
+        size_ = 0;
+    }
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == capacity(); }
+    int32_t size() const { return size_; }
+    int32_t capacity() const { return blocks_.size(); }
+
+    aoo::block* insert(int32_t seq, double sr, int32_t chn,
+                       int32_t nbytes, int32_t nframes){
+        aoo::block *it;
+        if (empty() || seq > back().sequence){
+            it = end();
+        } else {
+            it = std::lower_bound(begin(), end(), seq, [](auto& a, auto& b){
+                return a.sequence < b;
+            });
+        }
+        if (full()){
+            if (it > begin()){
+                aoo::block temp = std::move(front());
+                std::move(begin() + 1, it, begin());
+                *(--it) = std::move(temp);
+            }
+        } else {
+            if (it != end()){
+                aoo::block temp = std::move(*end());
+                std::move_backward(it, end(), end() + 1);
+                *it = std::move(temp);
+            }
+            size_++;
+        }
+        it->set(seq, sr, chn, nbytes, nframes);
+        return it;
+    }
+
+    aoo::block* find(int32_t seq){
+        if (empty()){
+            return nullptr;
+        } else if (back().sequence == seq){
+            return &back();
+        }
+        auto result = std::lower_bound(begin(), end(), seq, [](auto& a, auto& b){
+            return a.sequence < b;
+        });
+        if (result != end() && result->sequence == seq){
+            return result;
+        }
+        return nullptr;
+    }
+
+    void pop_front(){
+        if (size_ > 1){
+            aoo::block temp = std::move(front());
+            std::move(begin() + 1, end(), begin());
+            back() = std::move(temp);
+        }
+        size_--;
+    }
+
+    aoo::block& front(){ return blocks_.front(); }
+    aoo::block& back(){ return blocks_[size_ - 1]; }
+    aoo::block* begin(){ return blocks_.data(); }
+    aoo::block* end(){ return blocks_.data() + size_; }
+private:
+    std::vector<aoo::block> blocks_;
+    int32_t size_ = 0;
+};
+
+struct Packet {
+    int32_t sequence;
+    int32_t frame;
+};
+
+struct Trace {
+    const char * name;
+    int nframes;
+    std::vector<Packet> packets;
+};
+
+// 'reorder': share of packets which arrive up to 'maxdelay' packets late,
+// 'loss': share of packets which never arrive
+Trace makeTrace(const char * name, int nblocks, int nframes,
+                double reorder, int maxdelay, double loss)
+{
+    Trace trace { name, nframes, {} };
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::uniform_int_distribution<int> delay(1, maxdelay);
+
+    for (int32_t seq = 0; seq < nblocks; ++seq) {
+        for (int32_t f = 0; f < nframes; ++f) {
+            if (chance(rng) >= loss) {
+                trace.packets.push_back({ seq, f });
+            }
+        }
+    }
+    // move some packets back
+    auto & p = trace.packets;
+    for (size_t i = 0; i < p.size(); ++i) {
+        if (chance(rng) < reorder) {
+            size_t to = std::min(p.size() - 1, i + (size_t) delay(rng));
+            std::rotate(p.begin() + i, p.begin() + i + 1, p.begin() + to + 1);
+        }
+    }
+    return trace;
+}
+
+struct Result {
+    int64_t played = 0;
+    int64_t lost = 0;
+    int64_t checksum = 0;
+};
+
+template<typename Queue>
+Result play(Queue & queue, const Trace & trace, int latency, int blocksize,
+            const std::vector<char> & payload)
+{
+    Result result;
+    const int32_t framesize = blocksize / trace.nframes;
+    int32_t newest = -1;
+    int32_t next = 0; // next block to play
+
+    for (auto & packet : trace.packets) {
+        // like sink's source_desc::add_packet()
+        if (packet.sequence >= next) {
+            auto block = queue.find(packet.sequence);
+            if (!block) {
+                block = queue.insert(packet.sequence, 48000, 0, blocksize, trace.nframes);
+            }
+            if (block && !block->has_frame(packet.frame)) {
+                block->add_frame(packet.frame, payload.data() + packet.frame * framesize, framesize);
+            }
+            newest = std::max(newest, packet.sequence);
+        }
+        // play out what is 'latency' blocks behind
+        for (; next <= newest - latency; ++next) {
+            while (!queue.empty() && queue.front().sequence < next) {
+                queue.pop_front();
+            }
+            if (!queue.empty() && queue.front().sequence == next && queue.front().complete()) {
+                result.checksum += queue.front().data()[next % blocksize];
+                ++result.played;
+                queue.pop_front();
+            } else {
+                ++result.lost;
+            }
+        }
+    }
+    return result;
+}
+
+// returns million packets per second
+template<typename Queue>
+double measure(const Trace & trace, int capacity, int latency, int blocksize,
+               double seconds, Result & result)
+{
+    std::vector<char> payload(blocksize);
+    for (int i = 0; i < blocksize; ++i) {
+        payload[i] = (char) (i * 7);
+    }
+    long count = 0;
+    double t0 = nowSeconds(), elapsed = 0;
+    while (elapsed < seconds) {
+        Queue queue;
+        queue.resize(capacity, blocksize);
+        result = play(queue, trace, latency, blocksize, payload);
+        count += trace.packets.size();
+        elapsed = nowSeconds() - t0;
+    }
+    return count / elapsed * 1e-6;
+}
+
+// block_queue::resize() doesn't know about the block size
+struct OldQueue : block_queue {
+    void resize(int32_t n, int32_t){ block_queue::resize(n); }
+};
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    if (hasFlag(argc, argv, "help")) {
+        std::printf("bench-jitter-buffer [--blocks 100000] [--latency 8] [--capacity 16]\n"
+                    "                    [--blocksize 2048 (bytes)] [--seconds 0.5 (per run)]\n");
+        return 0;
+    }
+    const int blocks = atoi(getArg(argc, argv, "blocks", "100000"));
+    const int latency = atoi(getArg(argc, argv, "latency", "8"));
+    const int capacity = atoi(getArg(argc, argv, "capacity", "16"));
+    const int blocksize = atoi(getArg(argc, argv, "blocksize", "2048"));
+    const double seconds = atof(getArg(argc, argv, "seconds", "0.5"));
+
+    std::vector<Trace> traces;
+    for (int nframes : { 1, 4 }) {
+        traces.push_back(makeTrace("in order", blocks, nframes, 0.0, 0, 0.0));
+        traces.push_back(makeTrace("reorder 10%", blocks, nframes, 0.1, 4 * nframes, 0.0));
+        traces.push_back(makeTrace("loss 5%", blocks, nframes, 0.0, 0, 0.05));
+        traces.push_back(makeTrace("reorder+loss", blocks, nframes, 0.1, 4 * nframes, 0.05));
+    }
+
+    std::printf("capacity %d, latency %d blocks, %d bytes per block, million packets/s\n",
+                capacity, latency, blocksize);
+    std::printf("%-14s %6s %12s %12s %8s %8s\n", "trace", "frames", "block_queue",
+                "jitter_buf", "speedup", "lost");
+    int mismatches = 0;
+    for (auto & trace : traces) {
+        Result oldresult, newresult;
+        double oldrate = measure<OldQueue>(trace, capacity, latency, blocksize, seconds, oldresult);
+        double newrate = measure<aoo::jitter_buffer>(trace, capacity, latency, blocksize, seconds, newresult);
+        const bool same = oldresult.played == newresult.played && oldresult.lost == newresult.lost
+            && oldresult.checksum == newresult.checksum;
+        if (!same) {
+            ++mismatches;
+        }
+        std::printf("%-14s %6d %12.2f %12.2f %7.2fx %8lld%s\n", trace.name, trace.nframes,
+                    oldrate, newrate, newrate / oldrate, (long long) newresult.lost,
+                    same ? "" : " (different result!)");
+    }
+    return mismatches ? 1 : 0;
+}
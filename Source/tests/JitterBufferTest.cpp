@@ -0,0 +1,105 @@
+// Tests the sink's jitter buffer (aoo::jitter_buffer).
+
+#include "TestUtils.h"
+
+#include "src/common.hpp"
+
+#include <vector>
+
+namespace {
+
+const int capacity = 8;
+const int blocksize = 64;
+
+bool insertBlock(aoo::jitter_buffer & buf, int32_t seq)
+{
+    auto slot = buf.insert(seq, 48000, 0, blocksize, 1);
+    if (!slot) return false;
+    std::vector<char> data(blocksize, (char) seq);
+    slot->add_frame(0, data.data(), blocksize);
+    return true;
+}
+
+bool holds(aoo::jitter_buffer & buf, int32_t seq)
+{
+    auto slot = buf.find(seq);
+    return slot && slot->complete() && slot->data()[0] == (char) seq;
+}
+
+// blocks which arrive out of order, but within the capacity
+void testReorder()
+{
+    aoo::jitter_buffer buf;
+    buf.resize(capacity, blocksize);
+
+    for (int32_t seq : { 10, 12, 11, 14, 13 }) {
+        CHECK(insertBlock(buf, seq));
+    }
+    CHECK(buf.size() == 5);
+    CHECK(buf.front().sequence == 10);
+    CHECK(buf.back().sequence == 14);
+
+    int32_t expected = 10;
+    for (auto & slot : buf) {
+        CHECK(slot.sequence == expected);
+        ++expected;
+    }
+    CHECK(expected == 15);
+}
+
+// a late block whose slot holds a newer one must be rejected,
+// not replace the newer block
+void testLateBlock()
+{
+    aoo::jitter_buffer buf;
+    buf.resize(capacity, blocksize);
+
+    for (int32_t seq = 10; seq < 18; ++seq) {
+        CHECK(insertBlock(buf, seq));
+    }
+    CHECK(buf.full());
+    buf.pop_front(); // 10 has been read, 9 would still be >= 'next'
+    buf.pop_front();
+
+    // 9 maps to the slot of 17, 2 to the slot of 10
+    CHECK(!insertBlock(buf, 9));
+    CHECK(!insertBlock(buf, 2));
+    CHECK(holds(buf, 17));
+    CHECK(buf.size() == 6);
+    CHECK(buf.front().sequence == 12);
+    CHECK(buf.back().sequence == 17);
+
+    // the oldest block that still fits
+    CHECK(insertBlock(buf, 11));
+    CHECK(holds(buf, 11));
+    CHECK(holds(buf, 17));
+    CHECK(buf.front().sequence == 11);
+    CHECK(buf.size() == 7);
+}
+
+// a block far ahead drops the outdated ones which occupy its slot
+void testNewerBlock()
+{
+    aoo::jitter_buffer buf;
+    buf.resize(capacity, blocksize);
+
+    for (int32_t seq = 0; seq < 4; ++seq) {
+        CHECK(insertBlock(buf, seq));
+    }
+    CHECK(insertBlock(buf, 8)); // slot of 0
+    CHECK(!buf.find(0));
+    CHECK(holds(buf, 8));
+    CHECK(holds(buf, 1));
+    CHECK(buf.front().sequence == 1);
+}
+
+} // namespace
+
+int main()
+{
+    testReorder();
+    testLateBlock();
+    testNewerBlock();
+
+    return testResult("test-jitter-buffer");
+}
@@ -0,0 +1,165 @@
+// Tests the sink's arrival lateness statistics (aoo_opt_jitter_stats).
+//
+// The blocks go through the loopback in real time, but every 10th block is
+// held back for one or more block periods, so it arrives late and out of
+// order. These late blocks must show up in the percentiles, whether the sink
+// sees them as reordered or as resent; the statistics are useless for sizing
+// the buffer otherwise.
+
+#include "TestUtils.h"
+#include "Loopback.h"
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+#include "src/common.hpp"
+
+#include <chrono>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int samplerate = 48000;
+const int blocksize = 480; // 10 ms
+const double periodms = 1000.0 * blocksize / samplerate;
+
+// holds back every frame of every 'interval'th block for 'delay' periods
+// (but not their resends)
+struct HoldBack {
+    int interval;
+    int delay;
+    int period = 0;
+    std::set<std::pair<int32_t, int32_t>> seen;
+    std::vector<std::pair<int, std::vector<char>>> held; // release period + message
+
+    bool operator()(const char * data, int32_t n)
+    {
+        int32_t src, salt;
+        aoo::data_packet d;
+        if (n > 10 && !memcmp(data, "/aoo/sink/", 10) && strstr(data, "/data")
+            && aoo::parse_data_message(data, n, src, salt, d)) {
+            if (d.sequence % interval == interval - 1 && seen.emplace(d.sequence, d.framenum).second) {
+                held.emplace_back(period + delay, std::vector<char>(data, data + n));
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+aoo_jitter_stats run(int interval, int delay, int nblocks, int buffersize)
+{
+    aoo::isource::pointer source(aoo::isource::create(1));
+    aoo::isink::pointer sink(aoo::isink::create(1));
+
+    aoo_format_pcm fmt {};
+    fmt.header.codec = AOO_CODEC_PCM;
+    fmt.header.nchannels = 1;
+    fmt.header.samplerate = samplerate;
+    fmt.header.blocksize = blocksize;
+    fmt.bitdepth = AOO_PCM_FLOAT32;
+
+    source->set_format(fmt.header);
+    source->setup(samplerate, blocksize, 1);
+    source->set_buffersize(100);
+    sink->setup(samplerate, blocksize, 1);
+    sink->set_buffersize(buffersize);
+
+    Link link;
+    HoldBack hold { interval, delay };
+    link.toSink.tap = std::ref(hold);
+    link.connect(source.get(), 1, sink.get(), 1);
+    source->start();
+
+    std::vector<aoo_sample> in(blocksize, 0.5f), out(blocksize);
+    const aoo_sample * inptr[1] = { in.data() };
+    aoo_sample * outptr[1] = { out.data() };
+
+    const auto period = std::chrono::microseconds((int) (periodms * 1000));
+    auto next = std::chrono::steady_clock::now();
+    for (int b = 0; b < nblocks; ++b) {
+        hold.period = b;
+        source->process(inptr, blocksize, aoo_osctime_get());
+        while (source->send()) {}
+        link.deliver();
+        // held blocks arrive after the current one
+        for (auto it = hold.held.begin(); it != hold.held.end();) {
+            if (it->first <= b) {
+                sink->handle_message(it->second.data(), (int32_t) it->second.size(),
+                                     &link.toSource, Wire::send);
+                it = hold.held.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        sink->process(outptr, blocksize, aoo_osctime_get());
+        while (sink->send()) {}
+        link.deliver();
+
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+
+    aoo_jitter_stats stats {};
+    CHECK(sink->get_source_jitter_stats(&link.toSource, 1, stats) > 0);
+    return stats;
+}
+
+void testInOrder()
+{
+    auto stats = run(1000000, 0, 100, 100);
+    std::printf("in order: count %d, p50 %g, p95 %g, p99 %g, max %g ms\n",
+                stats.count, stats.p50, stats.p95, stats.p99, stats.max);
+    CHECK(stats.count >= 95);
+    CHECK(stats.max_reorder == 0);
+}
+
+// 10% of the blocks are one period late: p95 and p99 must reflect that,
+// the median must not.
+// NOTE: the exact counts depend on the scheduler, a busy machine may cost
+// a few blocks (or make a few more of them late).
+void testReordered()
+{
+    auto stats = run(10, 1, 200, 30);
+    std::printf("reordered: count %d, p50 %g, p95 %g, p99 %g, max %g ms\n",
+                stats.count, stats.p50, stats.p95, stats.p99, stats.max);
+    CHECK(stats.count >= 180);
+    CHECK(stats.p50 < periodms * 0.5);
+    CHECK(stats.p95 >= periodms * 0.8);
+    CHECK(stats.p99 >= periodms * 0.8);
+    CHECK(stats.max >= periodms * 0.8);
+
+    // the 20 held blocks are in the late bins
+    int late = 0;
+    for (int i = 0; i < AOO_JITTER_HISTOGRAM_SIZE; ++i) {
+        if ((i + 1) * stats.binwidth > periodms * 0.8) late += stats.histogram[i];
+    }
+    CHECK(late >= 17 && late <= 30);
+}
+
+// held back long enough for the sink to ask for the block again: the resent
+// block arrives first (instead of the held one), and it is late as well
+void testResent()
+{
+    auto stats = run(10, 6, 200, 100);
+    std::printf("resent: count %d, p50 %g, p95 %g, p99 %g, max %g ms\n",
+                stats.count, stats.p50, stats.p95, stats.p99, stats.max);
+    CHECK(stats.count >= 180);
+    CHECK(stats.p50 < periodms * 0.5);
+    CHECK(stats.p95 >= periodms * 1.5 && stats.p95 < periodms * 6);
+    CHECK(stats.p99 >= periodms * 1.5 && stats.p99 < periodms * 6);
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+
+    testInOrder();
+    testReordered();
+    testResent();
+
+    return testResult("test-jitter-stats");
+}
@@ -0,0 +1,180 @@
+// Tests the bookkeeping for the latency and echo sink/source pairs of a peer
+// (LatencyTestEndpoints.h), which SonobusAudioProcessor only creates while a
+// latency test runs: the echo pair is created when the remote's /invite for
+// our echo source arrives and must get that invite, a pair which lost the
+// race to another thread is left to the caller, and idle pairs are released
+// only after the delay, unless they are needed again in between.
+
+#include "TestUtils.h"
+#include "Loopback.h"
+
+#include "../LatencyTestEndpoints.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+const int32_t ourId = 1;
+const int32_t echoId = ourId + 40000; // ECHO_ID_OFFSET
+const int blocksize = 64;
+const int samplerate = 48000;
+
+// the members of SonobusAudioProcessor::RemotePeer the functions work on
+struct Peer {
+    aoo::isink::pointer latencysink;
+    aoo::isource::pointer latencysource;
+    aoo::isink::pointer echosink;
+    aoo::isource::pointer echosource;
+    std::atomic<double> latencyReleaseTimeMs { 0.0 };
+    std::atomic<double> echoReleaseTimeMs { 0.0 };
+    bool activeLatencyTest = false;
+};
+
+// like SonobusAudioProcessor::createTestEndpoints(), without the locks
+bool createPair(Peer & peer, bool echo)
+{
+    if (LatencyTestEndpoints::retain(peer, echo)) return true;
+
+    aoo::isink::pointer sink(aoo::isink::create(echoId));
+    aoo::isource::pointer source(aoo::isource::create(echoId));
+    sink->setup(samplerate, blocksize, 1);
+    source->setup(samplerate, blocksize, 1);
+    LatencyTestEndpoints::install(peer, echo, sink, source);
+    return true;
+}
+
+// the messages the remote's latency sink sends to our echo source
+struct Remote {
+    Wire wire;
+    aoo::isink::pointer sink { aoo::isink::create(ourId) };
+
+    Remote()
+    {
+        sink->setup(samplerate, blocksize, 1);
+    }
+
+    std::vector<std::string> collect()
+    {
+        while (sink->send()) {}
+        std::vector<std::string> msgs;
+        wire.deliver([&](const char * data, int32_t n) {
+            msgs.emplace_back(data, data + n);
+        });
+        return msgs;
+    }
+};
+
+bool isEchoInvite(const std::string & msg)
+{
+    int32_t type, id;
+    const int32_t onset = aoo_parse_pattern(msg.data(), (int32_t) msg.size(), &type, &id);
+    return type == AOO_TYPE_SOURCE && id == echoId
+        && LatencyTestEndpoints::isInvite(msg.data(), (int32_t) msg.size(), onset);
+}
+
+void testEchoInvite()
+{
+    Remote remote;
+    Peer peer;
+
+    remote.sink->invite_source(&remote.wire, echoId, Wire::send);
+    auto msgs = remote.collect();
+    std::string invite;
+    for (auto & msg : msgs) {
+        if (isEchoInvite(msg)) invite = msg;
+    }
+    CHECK(!invite.empty());
+
+    // the invite creates the echo pair, which then gets the invite
+    CHECK(!peer.echosink);
+    CHECK(createPair(peer, true));
+    CHECK(peer.echosink && peer.echosource);
+    CHECK(!peer.latencysink && !peer.latencysource);
+    CHECK(peer.echosource->events_available() == 0);
+    peer.echosource->handle_message(invite.data(), (int32_t) invite.size(), &remote.wire, Wire::send);
+    CHECK(peer.echosource->events_available() > 0);
+
+    // the uninvite at the end of the remote's test isn't taken for an invite
+    remote.sink->uninvite_source(&remote.wire, echoId, Wire::send);
+    int uninvites = 0;
+    for (auto & msg : remote.collect()) {
+        CHECK(!isEchoInvite(msg));
+        uninvites += msg.find(AOO_MSG_UNINVITE) != std::string::npos;
+    }
+    CHECK(uninvites > 0);
+}
+
+void testInstallRace()
+{
+    Peer peer;
+    CHECK(createPair(peer, false));
+    auto sink = peer.latencysink.get();
+
+    // another thread was faster, its pair stays
+    aoo::isink::pointer othersink(aoo::isink::create(2));
+    aoo::isource::pointer othersource(aoo::isource::create(2));
+    CHECK(!LatencyTestEndpoints::install(peer, false, othersink, othersource));
+    CHECK(peer.latencysink.get() == sink);
+    CHECK(othersink && othersource);
+
+    // retain finds the existing pair, no new one
+    CHECK(LatencyTestEndpoints::retain(peer, false));
+    CHECK(peer.latencysink.get() == sink);
+}
+
+void testRelease()
+{
+    const double delay = TEST_ENDPOINT_RELEASE_DELAY_MS;
+    const double t0 = 1000.0;
+    Peer peer;
+    std::vector<aoo::isink::pointer> sinks;
+    std::vector<aoo::isource::pointer> sources;
+
+    // nothing to release without pairs
+    LatencyTestEndpoints::scheduleRelease(peer, true, t0);
+    CHECK(!LatencyTestEndpoints::anyReleaseDue(peer, t0 + 2 * delay));
+
+    // the echo pair goes after the delay
+    createPair(peer, true);
+    createPair(peer, false);
+    peer.activeLatencyTest = true;
+    LatencyTestEndpoints::scheduleRelease(peer, true, t0);
+    CHECK(!LatencyTestEndpoints::anyReleaseDue(peer, t0 + delay / 2));
+    CHECK(LatencyTestEndpoints::takeDue(peer, t0 + delay / 2, sinks, sources) == 0);
+    CHECK(LatencyTestEndpoints::anyReleaseDue(peer, t0 + delay + 1));
+    CHECK(LatencyTestEndpoints::takeDue(peer, t0 + delay + 1, sinks, sources) == 1);
+    CHECK(!peer.echosink && !peer.echosource);
+    CHECK(peer.echoReleaseTimeMs == 0.0);
+    CHECK(sinks.size() == 1 && sources.size() == 1 && sinks[0] && sources[0]);
+
+    // needed again before the delay is over: the release is off
+    createPair(peer, true);
+    LatencyTestEndpoints::scheduleRelease(peer, true, t0);
+    CHECK(createPair(peer, true));
+    CHECK(!LatencyTestEndpoints::isReleaseDue(peer, true, t0 + 2 * delay));
+    CHECK(peer.echosink);
+
+    // our latency pair stays while our test runs, even if it was scheduled
+    LatencyTestEndpoints::scheduleRelease(peer, false, t0);
+    CHECK(!LatencyTestEndpoints::isReleaseDue(peer, false, t0 + 2 * delay));
+    peer.activeLatencyTest = false;
+    CHECK(LatencyTestEndpoints::isReleaseDue(peer, false, t0 + 2 * delay));
+    CHECK(LatencyTestEndpoints::takeDue(peer, t0 + 2 * delay, sinks, sources) == 1);
+    CHECK(!peer.latencysink && !peer.latencysource);
+    CHECK(peer.echosink && peer.echosource);
+    CHECK(sinks.size() == 2);
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+
+    testEchoInvite();
+    testInstallRace();
+    testRelease();
+
+    return testResult("test-latency-test-endpoints");
+}
@@ -0,0 +1,79 @@
+// In-memory network between AOO sources and sinks for the tests.
+
+#pragma once
+
+#include "aoo/aoo.hpp"
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// One direction of a link. It is used as the endpoint and the reply function
+// of the sending side: messages are queued and handed to the receiving side
+// by deliver(), so nothing is ever called reentrantly.
+class Wire {
+public:
+    static int32_t send(void * user, const char * data, int32_t n)
+    {
+        auto wire = static_cast<Wire *>(user);
+        if (wire->tap && !wire->tap(data, n)) {
+            return n; // dropped
+        }
+        std::lock_guard<std::mutex> lock(wire->mutex);
+        wire->queue.emplace_back(data, data + n);
+        return n;
+    }
+
+    template<typename F>
+    int deliver(F && fn)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.swap(queue);
+        }
+        int count = (int) pending.size();
+        for (auto & msg : pending) {
+            fn(msg.data(), (int32_t) msg.size());
+        }
+        pending.clear();
+        return count;
+    }
+
+    // sees every message before it is queued, return false to drop it
+    std::function<bool(const char *, int32_t)> tap;
+
+private:
+    std::mutex mutex;
+    std::vector<std::vector<char>> queue;
+    std::vector<std::vector<char>> pending;
+};
+
+// a source sending to a sink, the ids are the same on both ends
+struct Link {
+    aoo::isource * source = nullptr;
+    aoo::isink * sink = nullptr;
+    int32_t sourceId = 0;
+    int32_t sinkId = 0;
+    Wire toSink;
+    Wire toSource;
+
+    void connect(aoo::isource * src, int32_t srcid, aoo::isink * snk, int32_t snkid)
+    {
+        source = src;
+        sourceId = srcid;
+        sink = snk;
+        sinkId = snkid;
+        source->add_sink(&toSink, sinkId, Wire::send);
+    }
+
+    // hand over everything sent so far, in both directions
+    void deliver()
+    {
+        toSink.deliver([this](const char * data, int32_t n) {
+            sink->handle_message(data, n, &toSource, Wire::send);
+        });
+        toSource.deliver([this](const char * data, int32_t n) {
+            source->handle_message(data, n, &toSink, Wire::send);
+        });
+    }
+};
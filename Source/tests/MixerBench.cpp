@@ -0,0 +1,102 @@
+// Benchmark for the mixing server (SonobusMixer) with many headless clients
+// on the loopback interface. All clients send a mono PCM stream and get the
+// stereo mix-minus back; it reports how long it takes until all of them are
+// connected, the CPU time of the mixer thread (in total and per client), the
+// blocks the mixer couldn't process in time and how many clients hear the
+// others.
+//
+//   bench-mixer [--clients 50] [--seconds 5] [--port 10995]
+
+#include "TestUtils.h"
+#include "MixerClient.h"
+#include "../server/SonobusMixer.h"
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// runs the clients in real time, for at least one block
+void runFor(const std::vector<std::unique_ptr<MixerClient>> & clients, double seconds)
+{
+    const auto period = std::chrono::microseconds(1000000 * MixerClient::blocksize / MixerClient::samplerate);
+    auto next = std::chrono::steady_clock::now();
+    const double end = nowSeconds() + seconds;
+    do {
+        auto t = aoo_osctime_get();
+        for (auto & client : clients) {
+            client->tick(t);
+        }
+        next += period;
+        std::this_thread::sleep_until(next);
+    } while (nowSeconds() < end);
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    if (hasFlag(argc, argv, "help")) {
+        std::printf("bench-mixer [--clients 50] [--seconds 5] [--port 10995]\n");
+        return 0;
+    }
+    const int count = atoi(getArg(argc, argv, "clients", "50"));
+    const double seconds = atof(getArg(argc, argv, "seconds", "5"));
+    const int port = atoi(getArg(argc, argv, "port", "10995"));
+
+    aoo_initialize();
+
+    SonobusMixer mixer(port, MixerClient::samplerate, MixerClient::blocksize);
+    mixer.setMaxClients(count);
+    std::string errmsg;
+    if (!mixer.start(errmsg)) {
+        std::fprintf(stderr, "couldn't start mixer: %s\n", errmsg.c_str());
+        return 1;
+    }
+
+    // one client connects every block
+    std::vector<std::unique_ptr<MixerClient>> clients;
+    double t0 = nowSeconds();
+    for (int i = 0; i < count; ++i) {
+        clients.push_back(std::make_unique<MixerClient>(port, 1, 1, 0.01f));
+        clients.back()->connect();
+        runFor(clients, 0.0);
+    }
+    while (mixer.getStats().numClients < count && nowSeconds() - t0 < 10) {
+        runFor(clients, 0.05);
+    }
+    double connectms = (nowSeconds() - t0) * 1000;
+    // let the buffers settle
+    runFor(clients, 0.5);
+
+    auto before = mixer.getStats();
+    double wall0 = nowSeconds();
+    runFor(clients, seconds);
+    auto after = mixer.getStats();
+    double elapsed = nowSeconds() - wall0;
+
+    // everybody hears the other count - 1 clients at the center
+    const double expected = 0.01 * 0.596 * (count - 1);
+    int hearing = 0;
+    for (auto & client : clients) {
+        if (std::fabs(client->output(0).back() - expected) < expected * 0.1) {
+            ++hearing;
+        }
+    }
+
+    double cpu = (after.cpuSeconds - before.cpuSeconds) / elapsed * 100;
+    std::printf("%d clients (%d connected in %.0f ms, %d pending, %lld rejected)\n",
+                count, after.numClients, connectms, after.pendingClients,
+                (long long) after.rejectedClients);
+    std::printf("mixer CPU %.2f%% of one core, %.3f%% per client, %lld of %lld blocks late\n",
+                cpu, after.numClients > 0 ? cpu / after.numClients : 0.0,
+                (long long) (after.lateBlocks - before.lateBlocks),
+                (long long) (after.blocks - before.blocks));
+    std::printf("%d of %d clients get the full mix\n", hearing, count);
+
+    mixer.stop();
+    return 0;
+}
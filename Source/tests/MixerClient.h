@@ -0,0 +1,174 @@
+// A SonoBus client for the mixer test and benchmark. It talks UDP to a
+// SonobusMixer on the loopback interface the way SonobusAudioProcessor does:
+// invite the mixer's handshake source 0, stream to the sink which invites
+// our source and invite back the source which sends to our sink.
+
+#pragma once
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+class MixerClient {
+public:
+    static const int samplerate = 48000;
+    static const int blocksize = 256;
+
+    MixerClient(int mixerPort, int32_t id, int channels, float level)
+        : id_(id)
+    {
+        sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+        fcntl(sock_, F_SETFL, fcntl(sock_, F_GETFL) | O_NONBLOCK);
+        mixer_.sin_family = AF_INET;
+        mixer_.sin_port = htons(mixerPort);
+        mixer_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        aoo_format_pcm fmt {};
+        fmt.header.codec = AOO_CODEC_PCM;
+        fmt.header.nchannels = channels;
+        fmt.header.samplerate = samplerate;
+        fmt.header.blocksize = blocksize;
+        fmt.bitdepth = AOO_PCM_FLOAT32;
+
+        source_.reset(aoo::isource::create(id));
+        source_->setup(samplerate, blocksize, channels);
+        source_->set_format(fmt.header);
+        sink_.reset(aoo::isink::create(id));
+        sink_->setup(samplerate, blocksize, 2);
+        sink_->set_buffersize(40);
+
+        for (int ch = 0; ch < 2; ++ch) {
+            in_[ch].assign(blocksize, level);
+            out_[ch].assign(blocksize, 0.0f);
+        }
+    }
+
+    ~MixerClient()
+    {
+        close(sock_);
+    }
+
+    void connect()
+    {
+        sink_->invite_source(this, 0, send);
+    }
+
+    // one block of audio in both directions
+    void tick(uint64_t t)
+    {
+        const aoo_sample * in[2] = { in_[0].data(), in_[1].data() };
+        source_->process(in, blocksize, t);
+        while (source_->send()) {}
+
+        receive();
+
+        aoo_sample * out[2] = { out_[0].data(), out_[1].data() };
+        sink_->process(out, blocksize, t);
+        while (sink_->send()) {}
+
+        if (source_->events_available()) {
+            source_->handle_events(handleSourceEvents, this);
+        }
+        if (sink_->events_available()) {
+            sink_->handle_events(handleSinkEvents, this);
+        }
+    }
+
+    void setLevel(float level)
+    {
+        for (int ch = 0; ch < 2; ++ch) {
+            in_[ch].assign(blocksize, level);
+        }
+    }
+
+    int32_t id() const { return id_; }
+    // the local port, so the mixer's client can be found
+    int port() const
+    {
+        sockaddr_in sa {};
+        socklen_t len = sizeof(sa);
+        getsockname(sock_, (sockaddr *) &sa, &len);
+        return ntohs(sa.sin_port);
+    }
+    // the last block we got from the mixer
+    const std::vector<aoo_sample> & output(int ch) const { return out_[ch]; }
+    // the mixer invited our source
+    bool invited() const { return invited_; }
+    int64_t receivedPackets() const { return receivedPackets_; }
+    int64_t receivedBytes() const { return receivedBytes_; }
+
+private:
+    static int32_t send(void * user, const char * data, int32_t n)
+    {
+        auto client = static_cast<MixerClient *>(user);
+        return (int32_t) sendto(client->sock_, data, n, 0,
+                                (const sockaddr *) &client->mixer_, sizeof(client->mixer_));
+    }
+
+    void receive()
+    {
+        char buf[AOO_MAXPACKETSIZE];
+        int n;
+        while ((n = (int) recv(sock_, buf, sizeof(buf), 0)) > 0) {
+            ++receivedPackets_;
+            receivedBytes_ += n;
+            int32_t type, id;
+            if (aoo_parse_pattern(buf, n, &type, &id) <= 0) {
+                continue;
+            }
+            if (type == AOO_TYPE_SINK) {
+                sink_->handle_message(buf, n, this, send);
+            }
+            else if (type == AOO_TYPE_SOURCE) {
+                source_->handle_message(buf, n, this, send);
+            }
+        }
+    }
+
+    static int32_t handleSourceEvents(void * user, const aoo_event ** events, int32_t n)
+    {
+        auto client = static_cast<MixerClient *>(user);
+        for (int i = 0; i < n; ++i) {
+            if (events[i]->type == AOO_INVITE_EVENT) {
+                auto e = (const aoo_sink_event *) events[i];
+                client->source_->add_sink(e->endpoint, e->id, send);
+                client->source_->start();
+                client->invited_ = true;
+            }
+        }
+        return 1;
+    }
+
+    static int32_t handleSinkEvents(void * user, const aoo_event ** events, int32_t n)
+    {
+        auto client = static_cast<MixerClient *>(user);
+        for (int i = 0; i < n; ++i) {
+            if (events[i]->type == AOO_SOURCE_ADD_EVENT) {
+                auto e = (const aoo_source_event *) events[i];
+                if (e->id != 0) {
+                    client->sink_->uninvite_source(e->endpoint, 0, send);
+                    client->sink_->invite_source(e->endpoint, e->id, send);
+                }
+            }
+        }
+        return 1;
+    }
+
+    int sock_ = -1;
+    sockaddr_in mixer_ {};
+    int32_t id_;
+    aoo::isource::pointer source_;
+    aoo::isink::pointer sink_;
+    std::vector<aoo_sample> in_[2];
+    std::vector<aoo_sample> out_[2];
+    bool invited_ = false;
+    int64_t receivedPackets_ = 0;
+    int64_t receivedBytes_ = 0;
+};
@@ -0,0 +1,226 @@
+// Tests the mixing server (SonobusMixer) with clients on the loopback
+// interface: the mix-minus with the per-client gain and pan, that nothing
+// but the handshake replies goes to an address which hasn't confirmed the
+// invitation (or invites a client's source on its behalf), the client limit
+// and the host authorization.
+
+#include "TestUtils.h"
+
+#ifdef _WIN32
+
+int main()
+{
+    std::printf("test-mixer: not supported on Windows\n");
+    return 0;
+}
+
+#else
+
+#include "MixerClient.h"
+#include "../server/SonobusMixer.h"
+
+#include "oscpack/osc/OscOutboundPacketStream.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+namespace {
+
+// runs the clients in real time
+void runFor(const std::vector<MixerClient *> & clients, double seconds)
+{
+    const auto period = std::chrono::microseconds(1000000 * MixerClient::blocksize / MixerClient::samplerate);
+    auto next = std::chrono::steady_clock::now();
+    const double end = nowSeconds() + seconds;
+    while (nowSeconds() < end) {
+        auto t = aoo_osctime_get();
+        for (auto client : clients) {
+            client->tick(t);
+        }
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+// on an ephemeral port, so the test can run in parallel with the others
+std::unique_ptr<SonobusMixer> startMixer(int maxClients = 64)
+{
+    auto mixer = std::make_unique<SonobusMixer>(0, MixerClient::samplerate, MixerClient::blocksize);
+    mixer->setMaxClients(maxClients);
+    std::string errmsg;
+    if (!mixer->start(errmsg)) {
+        std::fprintf(stderr, "couldn't start mixer: %s\n", errmsg.c_str());
+        std::exit(1);
+    }
+    return mixer;
+}
+
+int32_t mixerIdOf(const SonobusMixer & mixer, const MixerClient & client)
+{
+    for (auto & info : mixer.getClients()) {
+        if (info.address == "127.0.0.1:" + std::to_string(client.port())) {
+            return info.id;
+        }
+    }
+    return 0;
+}
+
+// a mono client at the center and a silent one: each gets the other one
+void testMix()
+{
+    auto mixer = startMixer();
+    const int port = mixer->getPort();
+    MixerClient a(port, 1, 1, 0.5f), b(port, 1, 2, 0.0f);
+    a.connect();
+    b.connect();
+    runFor({ &a, &b }, 1.0);
+
+    auto stats = mixer->getStats();
+    CHECK(stats.numClients == 2 && stats.pendingClients == 0);
+    CHECK_NEAR(b.output(0).back(), 0.5 * 0.596, 0.01);
+    CHECK_NEAR(b.output(1).back(), 0.5 * 0.596, 0.01);
+    CHECK_NEAR(a.output(0).back(), 0.0, 0.001);
+
+    // hard left, then half the gain
+    const int32_t id = mixerIdOf(*mixer, a);
+    CHECK(id != 0);
+    CHECK(mixer->setClientPan(id, -1.0f));
+    runFor({ &a, &b }, 0.2);
+    CHECK_NEAR(b.output(0).back(), 0.5, 0.01);
+    CHECK_NEAR(b.output(1).back(), 0.0, 0.001);
+
+    CHECK(mixer->setClientGain(id, 0.5f));
+    runFor({ &a, &b }, 0.2);
+    CHECK_NEAR(b.output(0).back(), 0.25, 0.01);
+
+    bool found = false;
+    for (auto & info : mixer->getClients()) {
+        if (info.id == id) {
+            found = true;
+            CHECK(info.inChannels == 1 && info.gain == 0.5f && info.pan == -1.0f);
+        }
+    }
+    CHECK(found);
+    CHECK(!mixer->setClientGain(0, 1.0f));
+}
+
+// an invitation from a spoofed address: the victim must not get the mix
+void testSpoofedInvitation()
+{
+    auto mixer = startMixer();
+    const int port = mixer->getPort();
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in sa {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    char buf[AOO_MAXPACKETSIZE];
+    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    msg << osc::BeginMessage("/aoo/src/0/invite") << (int32_t) 1 << (int32_t) 0 << osc::EndMessage;
+    sendto(sock, msg.Data(), msg.Size(), 0, (const sockaddr *) &sa, sizeof(sa));
+
+    // a real client keeps the mixer busy meanwhile
+    MixerClient other(port, 1, 1, 0.5f);
+    other.connect();
+    runFor({ &other }, 1.0);
+
+    auto stats = mixer->getStats();
+    CHECK(stats.numClients == 1 && stats.pendingClients == 1);
+
+    // our invitation and the format of our stream, but no audio
+    int packets = 0, bytes = 0, n;
+    while ((n = (int) recv(sock, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        ++packets;
+        bytes += n;
+        CHECK(!strstr(buf, "/data") && strcmp(buf, "/d"));
+    }
+    std::printf("spoofed invitation: %d packets, %d bytes\n", packets, bytes);
+    CHECK(packets <= 2);
+    CHECK(bytes < 256);
+
+    // a client knows the id of its own source at the mixer, it must not be
+    // able to invite it on behalf of somebody else
+    const int32_t id = mixerIdOf(*mixer, other);
+    CHECK(id != 0);
+    int victim = socket(AF_INET, SOCK_DGRAM, 0);
+    std::string address = "/aoo/src/" + std::to_string(id) + "/invite";
+    osc::OutboundPacketStream msg2(buf, sizeof(buf));
+    msg2 << osc::BeginMessage(address.c_str()) << (int32_t) 1 << (int32_t) 0 << osc::EndMessage;
+    sendto(victim, msg2.Data(), msg2.Size(), 0, (const sockaddr *) &sa, sizeof(sa));
+    const auto rejected = mixer->getStats().rejectedClients;
+    runFor({ &other }, 0.5);
+
+    packets = 0;
+    while (recv(victim, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+        ++packets;
+    }
+    std::printf("spoofed client invitation: %d packets\n", packets);
+    CHECK(packets == 0);
+    CHECK(mixer->getStats().rejectedClients == rejected + 1);
+    CHECK(mixer->getStats().numClients == 1);
+
+    close(victim);
+    close(sock);
+}
+
+void testMaxClients()
+{
+    auto mixer = startMixer(2);
+    const int port = mixer->getPort();
+    MixerClient a(port, 1, 1, 0.1f), b(port, 1, 1, 0.1f), c(port, 1, 1, 0.1f);
+    a.connect();
+    b.connect();
+    runFor({ &a, &b }, 0.3);
+    c.connect();
+    runFor({ &a, &b, &c }, 0.5);
+
+    auto stats = mixer->getStats();
+    CHECK(stats.numClients == 2);
+    CHECK(stats.rejectedClients == 1);
+    CHECK(a.invited() && b.invited() && !c.invited());
+}
+
+void testHostAuth()
+{
+    auto mixer = startMixer();
+    const int port = mixer->getPort();
+    mixer->setHostAuthRequired(true);
+
+    MixerClient a(port, 1, 1, 0.1f);
+    a.connect();
+    runFor({ &a }, 0.3);
+    CHECK(mixer->getStats().numClients == 0);
+    CHECK(mixer->getStats().rejectedClients == 1);
+    CHECK(!a.invited());
+
+    mixer->allowHost("127.0.0.1");
+    MixerClient b(port, 1, 1, 0.1f);
+    b.connect();
+    runFor({ &b }, 0.3);
+    CHECK(mixer->getStats().numClients == 1);
+    CHECK(b.invited());
+
+    // e.g. the user logged out, the client is dropped within a second or so
+    mixer->disallowHost("127.0.0.1");
+    runFor({ &b }, 1.5);
+    CHECK(mixer->getStats().numClients == 0);
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+
+    testMix();
+    testSpoofedInvitation();
+    testMaxClients();
+    testHostAuth();
+
+    return testResult("test-mixer");
+}
+
+#endif
@@ -0,0 +1,80 @@
+// Data messages written and parsed with oscpack, the way AOO did it before
+// it got its own serializer. The tests compare against these and the
+// benchmarks use them as the baseline.
+
+#pragma once
+
+#include "aoo/aoo.h"
+#include "src/common.hpp"
+
+#include "oscpack/osc/OscOutboundPacketStream.h"
+#include "oscpack/osc/OscReceivedElements.h"
+
+#include <cstdio>
+
+inline int32_t oscpackWriteData(char * buf, int32_t size, int32_t sink,
+                                int32_t src, int32_t salt, const aoo::data_packet & d)
+{
+    osc::OutboundPacketStream msg(buf, size);
+    char address[64];
+    snprintf(address, sizeof(address), "%s%s/%d%s",
+             AOO_MSG_DOMAIN, AOO_MSG_SINK, sink, AOO_MSG_DATA);
+    msg << osc::BeginMessage(address)
+        << src << salt << d.sequence << d.samplerate << d.channel
+        << d.totalsize << d.nframes << d.framenum
+        << osc::Blob(d.data, d.size) << osc::EndMessage;
+    return (int32_t) msg.Size();
+}
+
+inline int32_t oscpackWriteCompactData(char * buf, int32_t size, int32_t salt,
+                                       const aoo::data_packet & d, bool sendrate)
+{
+    osc::OutboundPacketStream msg(buf, size);
+    msg << osc::BeginMessage(AOO_MSG_COMPACT_DATA) << salt << d.sequence;
+    if (sendrate) {
+        msg << d.samplerate;
+    }
+    msg << osc::Blob(d.data, d.size) << osc::EndMessage;
+    return (int32_t) msg.Size();
+}
+
+inline void oscpackParseData(const char * data, int32_t n, int32_t & src,
+                             int32_t & salt, aoo::data_packet & d)
+{
+    osc::ReceivedPacket packet(data, n);
+    osc::ReceivedMessage msg(packet);
+    auto it = msg.ArgumentsBegin();
+    src = (it++)->AsInt32();
+    salt = (it++)->AsInt32();
+    d.sequence = (it++)->AsInt32();
+    d.samplerate = (it++)->AsDouble();
+    d.channel = (it++)->AsInt32();
+    d.totalsize = (it++)->AsInt32();
+    d.nframes = (it++)->AsInt32();
+    d.framenum = (it++)->AsInt32();
+    const void * blobdata;
+    osc::osc_bundle_element_size_t blobsize;
+    (it++)->AsBlob(blobdata, blobsize);
+    d.data = (const char *) blobdata;
+    d.size = (int32_t) blobsize;
+}
+
+inline void oscpackParseCompactData(const char * data, int32_t n, int32_t & salt,
+                                    aoo::data_packet & d)
+{
+    osc::ReceivedPacket packet(data, n);
+    osc::ReceivedMessage msg(packet);
+    auto it = msg.ArgumentsBegin();
+    salt = (it++)->AsInt32();
+    d.sequence = (it++)->AsInt32();
+    d.samplerate = msg.ArgumentCount() == 4 ? (it++)->AsDouble() : 0;
+    const void * blobdata;
+    osc::osc_bundle_element_size_t blobsize;
+    (it++)->AsBlob(blobdata, blobsize);
+    d.channel = 0;
+    d.nframes = 1;
+    d.framenum = 0;
+    d.data = (const char *) blobdata;
+    d.size = (int32_t) blobsize;
+    d.totalsize = d.size;
+}
@@ -0,0 +1,174 @@
+// Tests the XOR parity FEC (aoo_opt_parity).
+//
+// The source sends a ramp with a parity packet after every group of blocks.
+// The link drops one block of every group, including all of its resends, so
+// the sink can only get it back by rebuilding it from the parity and the
+// other blocks of the group. The ramp must come out without any gap; without
+// parity the same losses must show up.
+
+#include "TestUtils.h"
+#include "Loopback.h"
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+#include "src/common.hpp"
+
+#include <cmath>
+#include <set>
+
+namespace {
+
+const int blocksize = 64;
+const int samplerate = 48000;
+const int groupsize = 4;
+const double rampstep = 1.0 / 65536; // exact in float32 for our number of samples
+
+int32_t handleSinkEvents(void * user, const aoo_event ** events, int32_t n)
+{
+    auto lost = static_cast<int *>(user);
+    for (int i = 0; i < n; ++i) {
+        if (events[i]->type == AOO_BLOCK_LOST_EVENT) {
+            *lost += reinterpret_cast<const aoo_block_lost_event *>(events[i])->count;
+        }
+    }
+    return 1;
+}
+
+// drops every attempt to send the block at 'dropindex' of each group, once
+// the stream is going
+struct DropOnePerGroup {
+    int dropindex;
+    int parities = 0;
+    std::set<int32_t> droppedseqs;
+
+    bool operator()(const char * data, int32_t n)
+    {
+        if (n <= 10 || memcmp(data, "/aoo/sink/", 10)) {
+            return true;
+        }
+        if (strstr(data, "/parity")) {
+            ++parities;
+            return true;
+        }
+        int32_t src, salt;
+        aoo::data_packet d;
+        if (strstr(data, "/data") && aoo::parse_data_message(data, n, src, salt, d)
+            && d.sequence >= 2 * groupsize && d.sequence % groupsize == dropindex) {
+            droppedseqs.insert(d.sequence);
+            return false;
+        }
+        return true;
+    }
+};
+
+struct Result {
+    int blocks = 0;     // dropped blocks
+    int parities = 0;   // parity packets sent
+    int lost = 0;       // blocks the sink reported as lost
+    int breaks = 0;     // places where the ramp doesn't continue
+    int samples = 0;    // ramp samples checked
+};
+
+Result run(int parity, int dropindex, int nblocks)
+{
+    aoo::isource::pointer source(aoo::isource::create(1));
+    aoo::isink::pointer sink(aoo::isink::create(1));
+
+    aoo_format_pcm fmt {};
+    fmt.header.codec = AOO_CODEC_PCM;
+    fmt.header.nchannels = 1;
+    fmt.header.samplerate = samplerate;
+    fmt.header.blocksize = blocksize;
+    fmt.bitdepth = AOO_PCM_FLOAT32;
+
+    source->set_format(fmt.header);
+    source->setup(samplerate, blocksize, 1);
+    source->set_buffersize(100);
+    source->set_dynamic_resampling(0);
+    source->set_parity(parity);
+    sink->setup(samplerate, blocksize, 1);
+    sink->set_buffersize(20);
+    sink->set_dynamic_resampling(0);
+
+    Link link;
+    DropOnePerGroup drop { dropindex };
+    link.toSink.tap = std::ref(drop);
+    link.connect(source.get(), 1, sink.get(), 1);
+    source->start();
+
+    Result result;
+    bool started = false;
+    int64_t prev = 0;
+    for (int b = 0; b < nblocks; ++b) {
+        float in[blocksize], out[blocksize];
+        for (int i = 0; i < blocksize; ++i) {
+            in[i] = (float) ((b * blocksize + i + 1) * rampstep);
+        }
+        const aoo_sample * inptr[1] = { in };
+        source->process(inptr, blocksize, aoo_osctime_get());
+        while (source->send()) {}
+        link.deliver();
+
+        aoo_sample * outptr[1] = { out };
+        sink->process(outptr, blocksize, aoo_osctime_get());
+        while (sink->send()) {}
+        link.deliver();
+        sink->handle_events(handleSinkEvents, &result.lost);
+
+        // the first block of the ramp is faded in, after that every
+        // sample must be the next one
+        if (!started) {
+            started = out[blocksize - 1] != 0.f;
+            continue;
+        }
+        for (int i = 0; i < blocksize; ++i) {
+            const int64_t k = std::llrint(out[i] / rampstep);
+            if (prev > 0 && k != prev + 1) {
+                ++result.breaks;
+            }
+            prev = k;
+            ++result.samples;
+        }
+    }
+    result.blocks = (int) drop.droppedseqs.size();
+    result.parities = drop.parities;
+    return result;
+}
+
+void testRebuild()
+{
+    // the first, a middle and the last block of the group
+    for (int dropindex : { 0, 1, groupsize - 1 }) {
+        auto r = run(groupsize, dropindex, 400);
+        std::printf("parity %d, drop block %d of each group: %d dropped, %d parities, %d lost, %d breaks\n",
+                    groupsize, dropindex, r.blocks, r.parities, r.lost, r.breaks);
+        CHECK(r.blocks > 80);
+        CHECK(r.parities >= r.blocks);
+        CHECK(r.lost == 0);
+        CHECK(r.breaks == 0);
+        CHECK(r.samples > 300 * blocksize);
+    }
+}
+
+// the same losses without parity, so we know the test actually drops something
+void testWithoutParity()
+{
+    auto r = run(0, 1, 400);
+    std::printf("no parity: %d dropped, %d parities, %d lost, %d breaks\n",
+                r.blocks, r.parities, r.lost, r.breaks);
+    CHECK(r.parities == 0);
+    CHECK(r.blocks > 80);
+    CHECK(r.breaks >= r.blocks);
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+
+    testRebuild();
+    testWithoutParity();
+
+    return testResult("test-parity");
+}
@@ -0,0 +1,177 @@
+// Benchmark for the PCM codec's sample conversion: the SSE2 kernels (as
+// built into the library on x86) against the generic block loops used on
+// other platforms, for each bit depth, encoding and decoding. The encoders
+// must agree within 1 LSB (the SSE2 kernels round exact halves to even),
+// the decoders exactly. float64 has no block kernels, it is there as the
+// per-sample reference.
+//
+//   bench-pcm-codec [--blocksize 256] [--channels 2] [--seconds 0.5 (per run)]
+
+#include "TestUtils.h"
+
+#include "aoo/aoo_pcm.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+// PcmCodecGeneric.cpp
+extern "C" void aoo_codec_pcm_generic_setup(aoo_codec_registerfn fn);
+
+namespace {
+
+const aoo_codec * registered_ = nullptr;
+
+int32_t registerCodec(const char *, const aoo_codec * codec)
+{
+    registered_ = codec;
+    return 1;
+}
+
+const aoo_codec * getCodec(void (*setup)(aoo_codec_registerfn))
+{
+    setup(registerCodec);
+    return registered_;
+}
+
+struct Codec {
+    const aoo_codec * codec;
+    void * encoder;
+    void * decoder;
+
+    Codec(const aoo_codec * c, aoo_pcm_bitdepth bitdepth, int blocksize, int channels)
+        : codec(c), encoder(c->encoder_new()), decoder(c->decoder_new())
+    {
+        aoo_format_pcm fmt {};
+        fmt.header.codec = AOO_CODEC_PCM;
+        fmt.header.nchannels = channels;
+        fmt.header.samplerate = 48000;
+        fmt.header.blocksize = blocksize;
+        fmt.bitdepth = bitdepth;
+        codec->encoder_setformat(encoder, &fmt.header);
+        codec->decoder_setformat(decoder, &fmt.header);
+    }
+
+    ~Codec()
+    {
+        codec->encoder_free(encoder);
+        codec->decoder_free(decoder);
+    }
+
+    int32_t encode(const std::vector<aoo_sample> & in, std::vector<char> & out)
+    {
+        return codec->encoder_encode(encoder, in.data(), (int32_t) in.size(),
+                                     out.data(), (int32_t) out.size());
+    }
+
+    int32_t decode(const std::vector<char> & in, int32_t size, std::vector<aoo_sample> & out)
+    {
+        return codec->decoder_decode(decoder, in.data(), size, out.data(), (int32_t) out.size());
+    }
+};
+
+// returns million samples per second
+template<typename F>
+double measure(double seconds, int32_t samples, F && fn)
+{
+    long count = 0;
+    double t0 = nowSeconds(), elapsed = 0;
+    while (elapsed < seconds) {
+        for (int i = 0; i < 1000; ++i) {
+            fn();
+        }
+        count += 1000;
+        elapsed = nowSeconds() - t0;
+    }
+    return count * (double) samples / elapsed * 1e-6;
+}
+
+// the big endian integer in a 3 or 2 byte sample
+int32_t wireValue(const char * b, int samplesize)
+{
+    auto u = (const uint8_t *) b;
+    if (samplesize == 3) {
+        return (int32_t) (((uint32_t) u[0] << 24) | ((uint32_t) u[1] << 16) | ((uint32_t) u[2] << 8)) >> 8;
+    } else {
+        return (int16_t) ((u[0] << 8) | u[1]);
+    }
+}
+
+bool sameEncoding(const std::vector<char> & a, const std::vector<char> & b, aoo_pcm_bitdepth bitdepth)
+{
+    if (bitdepth != AOO_PCM_INT16 && bitdepth != AOO_PCM_INT24) {
+        return a == b;
+    }
+    const int samplesize = bitdepth == AOO_PCM_INT24 ? 3 : 2;
+    for (size_t i = 0; i < a.size(); i += samplesize) {
+        if (std::abs(wireValue(&a[i], samplesize) - wireValue(&b[i], samplesize)) > 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    if (hasFlag(argc, argv, "help")) {
+        std::printf("bench-pcm-codec [--blocksize 256] [--channels 2] [--seconds 0.5 (per run)]\n");
+        return 0;
+    }
+    const int blocksize = atoi(getArg(argc, argv, "blocksize", "256"));
+    const int channels = atoi(getArg(argc, argv, "channels", "2"));
+    const double seconds = atof(getArg(argc, argv, "seconds", "0.5"));
+
+    const aoo_codec * simd = getCodec(aoo_codec_pcm_setup);
+    const aoo_codec * generic = getCodec(aoo_codec_pcm_generic_setup);
+
+    // a sine with some clipping
+    const int32_t n = blocksize * channels;
+    std::vector<aoo_sample> input(n);
+    for (int32_t i = 0; i < n; ++i) {
+        input[i] = (aoo_sample) (1.2 * std::sin(i * 0.05));
+    }
+
+    struct Depth {
+        aoo_pcm_bitdepth bitdepth;
+        const char * name;
+        int size;
+    };
+    const Depth depths[] = {
+        { AOO_PCM_INT16, "int16", 2 },
+        { AOO_PCM_INT24, "int24", 3 },
+        { AOO_PCM_FLOAT32, "float32", 4 },
+        { AOO_PCM_FLOAT64, "float64", 8 },
+    };
+
+    std::printf("%d samples per block (%d channels), million samples/s\n", n, channels);
+    std::printf("%-8s %9s %9s %8s %9s %9s %8s\n", "", "encode", "", "", "decode", "", "");
+    std::printf("%-8s %9s %9s %8s %9s %9s %8s\n", "bitdepth", "generic", "SSE2", "speedup",
+                "generic", "SSE2", "speedup");
+    int mismatches = 0;
+    for (auto & depth : depths) {
+        Codec a(generic, depth.bitdepth, blocksize, channels);
+        Codec b(simd, depth.bitdepth, blocksize, channels);
+        std::vector<char> bytesa(n * depth.size), bytesb(n * depth.size);
+        std::vector<aoo_sample> outa(n), outb(n);
+
+        const int32_t size = a.encode(input, bytesa);
+        b.encode(input, bytesb);
+        a.decode(bytesb, size, outa);
+        b.decode(bytesb, size, outb);
+        const bool same = sameEncoding(bytesa, bytesb, depth.bitdepth) && outa == outb;
+        if (!same) {
+            ++mismatches;
+        }
+
+        double enca = measure(seconds, n, [&]() { a.encode(input, bytesa); });
+        double encb = measure(seconds, n, [&]() { b.encode(input, bytesb); });
+        double deca = measure(seconds, n, [&]() { a.decode(bytesa, size, outa); });
+        double decb = measure(seconds, n, [&]() { b.decode(bytesb, size, outb); });
+        std::printf("%-8s %9.1f %9.1f %7.2fx %9.1f %9.1f %7.2fx%s\n", depth.name,
+                    enca, encb, encb / enca, deca, decb, decb / deca,
+                    same ? "" : " (different result!)");
+    }
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,8 @@
+// The PCM codec with the generic block loops instead of the SSE2 kernels,
+// registered as aoo_codec_pcm_generic_setup() so it can run next to the
+// real one (see PcmCodecBench.cpp).
+
+#define AOO_PCM_SSE2 0
+#define aoo_codec_pcm_setup aoo_codec_pcm_generic_setup
+
+#include "src/codec_pcm.cpp"
@@ -0,0 +1,206 @@
+// Tests the PCM codec's sample conversion: float -> int24/int16 -> float
+// round trips over the full scale, the clipping edges and every tail length
+// the block kernels leave to the per-sample code.
+
+#include "TestUtils.h"
+
+#include "aoo/aoo_pcm.h"
+#include "src/common.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace {
+
+const double lsb24 = 1.0 / 8388608.0;
+const double lsb16 = 1.0 / 32768.0;
+
+struct Codec {
+    std::unique_ptr<aoo::encoder> encoder;
+    std::unique_ptr<aoo::decoder> decoder;
+    int samplesize;
+
+    Codec(aoo_pcm_bitdepth bitdepth, int samplesize) : samplesize(samplesize)
+    {
+        aoo_format_pcm fmt {};
+        fmt.header.codec = AOO_CODEC_PCM;
+        fmt.header.nchannels = 1;
+        fmt.header.samplerate = 48000;
+        fmt.header.blocksize = 64;
+        fmt.bitdepth = bitdepth;
+        auto c = aoo::find_codec(AOO_CODEC_PCM);
+        encoder = c->create_encoder();
+        decoder = c->create_decoder();
+        CHECK(encoder->set_format(fmt.header));
+        CHECK(decoder->set_format(fmt.header));
+    }
+
+    std::vector<char> encode(const std::vector<aoo_sample> & s)
+    {
+        std::vector<char> buf(s.size() * samplesize);
+        int32_t n = encoder->encode(s.data(), (int32_t) s.size(), buf.data(), (int32_t) buf.size());
+        CHECK(n == (int32_t) buf.size());
+        return buf;
+    }
+
+    std::vector<aoo_sample> decode(const std::vector<char> & buf)
+    {
+        std::vector<aoo_sample> s(buf.size() / samplesize);
+        int32_t n = decoder->decode(buf.data(), (int32_t) buf.size(), s.data(), (int32_t) s.size());
+        CHECK(n == (int32_t) s.size());
+        return s;
+    }
+
+    // each sample on its own, i.e. without the block kernels
+    std::vector<char> encodeEach(const std::vector<aoo_sample> & s)
+    {
+        std::vector<char> buf;
+        for (auto x : s) {
+            auto b = encode({ x });
+            buf.insert(buf.end(), b.begin(), b.end());
+        }
+        return buf;
+    }
+};
+
+// the big endian integer in a 3 or 2 byte sample
+int32_t wireValue(const char * b, int samplesize)
+{
+    auto u = (const uint8_t *) b;
+    if (samplesize == 3) {
+        return (int32_t) (((uint32_t) u[0] << 24) | ((uint32_t) u[1] << 16) | ((uint32_t) u[2] << 8)) >> 8;
+    } else {
+        return (int16_t) ((u[0] << 8) | u[1]);
+    }
+}
+
+// edge values, surrounded by ordinary samples, at every position of a block
+// and with every tail length
+std::vector<aoo_sample> edgeSignal(int n, int offset)
+{
+    const aoo_sample edges[] = { 1.f, -1.f, 1.5f, -1.5f, 1000.f, -1000.f,
+                                 std::nextafter(1.f, 0.f), std::nextafter(-1.f, 0.f),
+                                 std::nextafter(1.f, 2.f), std::nextafter(-1.f, -2.f),
+                                 0.f, -0.f, 1e-9f, -1e-9f,
+                                 (aoo_sample) lsb24, (aoo_sample) -lsb24,
+                                 INFINITY, -INFINITY };
+    const int nedges = sizeof(edges) / sizeof(edges[0]);
+    std::vector<aoo_sample> s(n);
+    for (int i = 0; i < n; ++i) {
+        s[i] = (i + offset) % 3 ? 0.3f * std::sin(0.1f * i) : edges[(i + offset) % nedges];
+    }
+    return s;
+}
+
+// the clipping edges and full scale
+void testFullScale(Codec & codec, int32_t fullscale)
+{
+    const int ss = codec.samplesize;
+    auto buf = codec.encode({ 1.f, -1.f, 1.5f, -1.5f, 1000.f, -1000.f, INFINITY, -INFINITY, 0.f });
+    CHECK(wireValue(&buf[0 * ss], ss) == fullscale);
+    CHECK(wireValue(&buf[1 * ss], ss) == -fullscale); // not wrapped around to the minimum
+    CHECK(wireValue(&buf[2 * ss], ss) == fullscale);
+    CHECK(wireValue(&buf[3 * ss], ss) == -fullscale);
+    CHECK(wireValue(&buf[4 * ss], ss) == fullscale);
+    CHECK(wireValue(&buf[5 * ss], ss) == -fullscale);
+    CHECK(wireValue(&buf[6 * ss], ss) == fullscale);
+    CHECK(wireValue(&buf[7 * ss], ss) == -fullscale);
+    CHECK(wireValue(&buf[8 * ss], ss) == 0);
+    CHECK((uint8_t) buf[0] == 0x7f && (uint8_t) buf[1] == 0xff); // big endian
+
+    // the most negative value on the wire still decodes to -1
+    std::vector<char> minbuf(ss, 0);
+    minbuf[0] = (char) 0x80;
+    CHECK(codec.decode(minbuf)[0] == -1.f);
+}
+
+// every sample in [-1, 1] comes back within 1 LSB (plus the difference
+// between the encoder's and decoder's scale), larger samples are clipped
+void testRoundTrip(Codec & codec, double lsb)
+{
+    const int n = 200001;
+    std::vector<aoo_sample> in(n);
+    for (int i = 0; i < n; ++i) {
+        in[i] = -1.25f + 2.5f * (float) i / (n - 1);
+    }
+    auto out = codec.decode(codec.encode(in));
+    double maxerr = 0;
+    bool monotonic = true;
+    for (int i = 0; i < n; ++i) {
+        double expected = std::max(-1.0, std::min(1.0, (double) in[i]));
+        maxerr = std::max(maxerr, std::abs(out[i] - expected));
+        if (i > 0 && out[i] < out[i - 1]) monotonic = false;
+        CHECK(std::abs(out[i]) <= 1.f);
+    }
+    CHECK(maxerr <= 1.5 * lsb);
+    CHECK(monotonic);
+}
+
+// the block kernels and the per-sample code write the same bytes,
+// whatever is left over for the tail
+void testTails(Codec & codec)
+{
+    for (int n = 1; n <= 40; ++n) {
+        for (int offset = 0; offset < 4; ++offset) {
+            auto in = edgeSignal(n, offset);
+            auto block = codec.encode(in);
+            auto each = codec.encodeEach(in);
+            bool same = true;
+            for (int i = 0; i < n; ++i) {
+                // the kernels may round exact halves to even
+                if (std::abs(wireValue(&block[i * codec.samplesize], codec.samplesize)
+                             - wireValue(&each[i * codec.samplesize], codec.samplesize)) > 1) {
+                    same = false;
+                }
+            }
+            CHECK(same);
+
+            // decoding in one go and sample by sample agrees exactly
+            auto out = codec.decode(block);
+            bool decoded = true;
+            for (int i = 0; i < n; ++i) {
+                std::vector<char> one(block.begin() + i * codec.samplesize,
+                                      block.begin() + (i + 1) * codec.samplesize);
+                if (codec.decode(one)[0] != out[i]) decoded = false;
+            }
+            CHECK(decoded);
+        }
+    }
+}
+
+void testFloat32()
+{
+    Codec codec(AOO_PCM_FLOAT32, 4);
+    for (int n = 1; n <= 20; ++n) {
+        auto in = edgeSignal(n, 0);
+        auto out = codec.decode(codec.encode(in));
+        bool same = true;
+        for (int i = 0; i < n; ++i) {
+            if (out[i] != in[i]) same = false;
+        }
+        CHECK(same);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+
+    Codec int24(AOO_PCM_INT24, 3);
+    testFullScale(int24, 8388607);
+    testRoundTrip(int24, lsb24);
+    testTails(int24);
+
+    Codec int16(AOO_PCM_INT16, 2);
+    testFullScale(int16, 32767);
+    testRoundTrip(int16, lsb16);
+    testTails(int16);
+
+    testFloat32();
+
+    return testResult("test-pcm-codec");
+}
@@ -0,0 +1,440 @@
+// Integration test for the connection server's UDP relay on the loopback
+// interface. Two clients can't reach each other directly (their send
+// function only lets packets to the server through), so they must fall back
+// to the relay after the handshake timeout and then exchange packets through
+// it. Strangers must not be able to use the relay or to register an endpoint
+// which doesn't belong to them.
+
+#include "TestUtils.h"
+
+#include "aoo/aoo.h"
+#include "aoo/aoo_net.h"
+#include "src/net_utils.hpp"
+#include "src/SLIP.hpp"
+
+#ifdef _WIN32
+
+int main()
+{
+    std::printf("test-relay: not supported on Windows\n");
+    return 0;
+}
+
+#else
+
+#include "oscpack/osc/OscOutboundPacketStream.h"
+#include "oscpack/osc/OscReceivedElements.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int port = 10997;
+const char * payloadPrefix = "test:";
+
+sockaddr_in loopback(int p)
+{
+    sockaddr_in sa {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(p);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sa;
+}
+
+int openUdpSocket()
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    auto sa = loopback(0);
+    bind(sock, (sockaddr *) &sa, sizeof(sa));
+    return sock;
+}
+
+int localPort(int sock)
+{
+    sockaddr_in sa {};
+    socklen_t len = sizeof(sa);
+    getsockname(sock, (sockaddr *) &sa, &len);
+    return ntohs(sa.sin_port);
+}
+
+// returns the next datagram within 'timeout' seconds, or an empty string
+std::string receive(int sock, double timeout, sockaddr_storage * from = nullptr)
+{
+    pollfd fd { sock, POLLIN, 0 };
+    if (poll(&fd, 1, (int) (timeout * 1000)) > 0) {
+        char buf[AOO_MAXPACKETSIZE + AOONET_RELAY_HEADER_SIZE];
+        sockaddr_storage sa;
+        socklen_t len = sizeof(sa);
+        auto n = recvfrom(sock, buf, sizeof(buf), 0, (sockaddr *) &sa, &len);
+        if (n > 0) {
+            if (from) *from = sa;
+            return std::string(buf, n);
+        }
+    }
+    return std::string();
+}
+
+void sendRelayed(int sock, const sockaddr_in & dest, const std::string & payload)
+{
+    char buf[AOO_MAXPACKETSIZE + AOONET_RELAY_HEADER_SIZE];
+    auto onset = aoonet_relay_write_header(buf, sizeof(buf), &dest);
+    memcpy(buf + onset, payload.data(), payload.size());
+    auto server = loopback(port);
+    sendto(sock, buf, onset + payload.size(), 0, (sockaddr *) &server, sizeof(server));
+}
+
+void sendRegistration(int sock, int64_t token)
+{
+    char buf[64];
+    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    msg << osc::BeginMessage(AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_RELAY)
+        << (osc::int64) token << osc::EndMessage;
+    auto server = loopback(port);
+    sendto(sock, msg.Data(), msg.Size(), 0, (sockaddr *) &server, sizeof(server));
+}
+
+// returns the result of a /aoo/client/relay reply, or -1 if there is none
+int relayReplyResult(const std::string & packet, std::string * errmsg = nullptr)
+{
+    if (packet.empty()) return -1;
+    try {
+        osc::ReceivedPacket p(packet.data(), (osc::osc_bundle_element_size_t) packet.size());
+        osc::ReceivedMessage msg(p);
+        if (strcmp(msg.AddressPattern(), AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_RELAY)) {
+            return -1;
+        }
+        auto it = msg.ArgumentsBegin();
+        int result = (it++)->AsInt32();
+        if (errmsg) *errmsg = (it++)->AsString();
+        return result;
+    } catch (const osc::Exception &) {
+        return -1;
+    }
+}
+
+bool sameAddress(const sockaddr_storage & a, const sockaddr_in & b)
+{
+    auto sa = (const sockaddr_in *) &a;
+    return sa->sin_family == AF_INET && sa->sin_addr.s_addr == b.sin_addr.s_addr
+        && sa->sin_port == b.sin_port;
+}
+
+struct PeerJoin {
+    int type;
+    sockaddr_storage address;
+    bool relayed;
+    sockaddr_storage relay;
+};
+
+// an AOO client whose peers are unreachable
+struct Client {
+    int sock;
+    aoonet_client * client;
+    std::thread runThread;
+    std::thread ioThread;
+    std::atomic<bool> quit { false };
+    std::atomic<int> blocked { 0 }; // direct packets which didn't go through
+    std::atomic<bool> swallowRelayReplies { false };
+
+    std::mutex mutex;
+    int connected = -1;
+    std::vector<PeerJoin> peerEvents;
+    std::vector<std::pair<sockaddr_storage, std::string>> relayed; // test payloads
+    std::vector<std::string> relayReplies;
+
+    Client()
+    {
+        sock = openUdpSocket();
+        client = aoonet_client_new(this, sendfn, localPort(sock));
+        runThread = std::thread([this]() { aoonet_client_run(client); });
+        ioThread = std::thread([this]() { io(); });
+    }
+
+    ~Client()
+    {
+        aoonet_client_disconnect(client);
+        quit = true;
+        ioThread.join();
+        aoonet_client_quit(client);
+        runThread.join();
+        aoonet_client_free(client);
+        close(sock);
+    }
+
+    sockaddr_in address() const { return loopback(localPort(sock)); }
+
+    static int32_t sendfn(void * user, const char * data, int32_t n, void * addr)
+    {
+        auto self = static_cast<Client *>(user);
+        auto sa = static_cast<const sockaddr_in *>(addr);
+        if (sa->sin_family != AF_INET || ntohs(sa->sin_port) != port) {
+            self->blocked++;
+            return n;
+        }
+        return (int32_t) sendto(self->sock, data, n, 0, (const sockaddr *) sa, sizeof(*sa));
+    }
+
+    static int32_t handleEvents(void * user, const aoo_event ** events, int32_t n)
+    {
+        auto self = static_cast<Client *>(user);
+        std::lock_guard<std::mutex> lock(self->mutex);
+        for (int i = 0; i < n; ++i) {
+            auto type = events[i]->type;
+            if (type == AOONET_CLIENT_CONNECT_EVENT) {
+                self->connected = ((const aoonet_client_event *) events[i])->result > 0;
+            } else if (type == AOONET_CLIENT_PEER_JOIN_EVENT || type == AOONET_CLIENT_PEER_JOINFAIL_EVENT) {
+                auto e = (const aoonet_client_peer_event *) events[i];
+                PeerJoin p {};
+                p.type = type;
+                memcpy(&p.address, e->address, e->length);
+                p.relayed = e->relay_address != nullptr;
+                if (p.relayed) memcpy(&p.relay, e->relay_address, e->relay_length);
+                self->peerEvents.push_back(p);
+            }
+        }
+        return 1;
+    }
+
+    void io()
+    {
+        while (!quit) {
+            sockaddr_storage from;
+            auto packet = receive(sock, 0.005, &from);
+            if (!packet.empty()) {
+                sockaddr_storage src;
+                int32_t onset = aoonet_relay_parse_header(packet.data(), (int32_t) packet.size(), &src, nullptr);
+                if (onset && !packet.compare(onset, strlen(payloadPrefix), payloadPrefix)) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    relayed.emplace_back(src, packet.substr(onset));
+                } else if (relayReplyResult(packet) >= 0 && swallowRelayReplies) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    relayReplies.push_back(packet);
+                } else {
+                    aoonet_client_handle_message(client, packet.data(), (int32_t) packet.size(), &from);
+                }
+            }
+            aoonet_client_send(client);
+            aoonet_client_handle_events(client, handleEvents, this);
+        }
+    }
+
+    template<typename F>
+    bool waitFor(F && pred, double timeout)
+    {
+        double t0 = nowSeconds();
+        while (nowSeconds() - t0 < timeout) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (pred()) return true;
+            }
+            usleep(1000);
+        }
+        return false;
+    }
+
+    bool hasRelayed(const std::string & payload, const sockaddr_in & src, double timeout)
+    {
+        return waitFor([&]() {
+            for (auto & r : relayed) {
+                if (r.second == payload && sameAddress(r.first, src)) return true;
+            }
+            return false;
+        }, timeout);
+    }
+};
+
+// logs in over TCP with a public address of our choice; returns the relay token
+int64_t forgedLogin(int tcpsock, const sockaddr_in & claimed)
+{
+    auto server = loopback(port);
+    if (connect(tcpsock, (sockaddr *) &server, sizeof(server)) != 0) return 0;
+
+    char buf[AOO_MAXPACKETSIZE];
+    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    msg << osc::BeginMessage(AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_LOGIN)
+        << "mallory" << "secret" << "127.0.0.1" << (int32_t) ntohs(claimed.sin_port)
+        << "127.0.0.1" << (int32_t) ntohs(claimed.sin_port) << (osc::int64) 0
+        << osc::EndMessage;
+    aoo::SLIP slip;
+    slip.setup(4096);
+    slip.write_packet((const uint8_t *) msg.Data(), (int32_t) msg.Size());
+    uint8_t frame[4096];
+    auto n = slip.read_bytes(frame, sizeof(frame));
+    send(tcpsock, frame, n, MSG_NOSIGNAL);
+
+    aoo::SLIP recvbuf;
+    recvbuf.setup(65536);
+    double t0 = nowSeconds();
+    while (nowSeconds() - t0 < 5) {
+        pollfd fd { tcpsock, POLLIN, 0 };
+        if (poll(&fd, 1, 100) <= 0) continue;
+        char data[4096];
+        auto count = recv(tcpsock, data, sizeof(data), 0);
+        if (count <= 0) return 0;
+        recvbuf.write_bytes((const uint8_t *) data, (int32_t) count);
+        uint8_t packet[4096];
+        int32_t size;
+        while ((size = recvbuf.read_packet(packet, sizeof(packet))) > 0) {
+            osc::ReceivedPacket p((const char *) packet, size);
+            osc::ReceivedMessage reply(p);
+            if (!strcmp(reply.AddressPattern(), AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_LOGIN)) {
+                auto it = reply.ArgumentsBegin();
+                if ((it++)->AsInt32() <= 0) return 0;
+                it++; // error message
+                return (it++)->AsInt64();
+            }
+        }
+    }
+    return 0;
+}
+
+void testHeader()
+{
+    char buf[AOONET_RELAY_HEADER_SIZE];
+    sockaddr_storage out;
+    int32_t len = 0;
+
+    auto sa = loopback(12345);
+    CHECK(aoonet_relay_write_header(buf, sizeof(buf), &sa) == AOONET_RELAY_HEADER_SIZE_IPV4);
+    CHECK(aoonet_relay_write_header(buf, AOONET_RELAY_HEADER_SIZE_IPV4 - 1, &sa) == 0);
+    CHECK(aoonet_relay_parse_header(buf, AOONET_RELAY_HEADER_SIZE_IPV4, &out, &len) == AOONET_RELAY_HEADER_SIZE_IPV4);
+    CHECK(len == sizeof(sockaddr_in));
+    CHECK(aoo::net::ip_address((sockaddr *) &out, len) == aoo::net::ip_address((sockaddr *) &sa, sizeof(sa)));
+
+    sockaddr_in6 sa6 {};
+    sa6.sin6_family = AF_INET6;
+    sa6.sin6_port = htons(4321);
+    inet_pton(AF_INET6, "2001:db8::17", &sa6.sin6_addr);
+    CHECK(aoonet_relay_write_header(buf, sizeof(buf), &sa6) == AOONET_RELAY_HEADER_SIZE_IPV6);
+    CHECK(aoonet_relay_parse_header(buf, AOONET_RELAY_HEADER_SIZE_IPV6 - 1, &out, &len) == 0);
+    CHECK(aoonet_relay_parse_header(buf, AOONET_RELAY_HEADER_SIZE_IPV6, &out, &len) == AOONET_RELAY_HEADER_SIZE_IPV6);
+    CHECK(len == sizeof(sockaddr_in6));
+    aoo::net::ip_address a6((sockaddr *) &out, len);
+    CHECK(a6 == aoo::net::ip_address((sockaddr *) &sa6, sizeof(sa6)));
+    CHECK(a6.name() == "2001:db8::17" && a6.port() == 4321);
+    CHECK(aoo::net::ip_address("2001:db8::17", 4321) == a6);
+    CHECK(aoo::net::ip_address("2001:db8::18", 4321) != a6);
+    CHECK(aoo::net::ip_address_hash()(aoo::net::ip_address("2001:db8::17", 4321))
+          == aoo::net::ip_address_hash()(a6));
+
+    // not a relay packet
+    CHECK(aoonet_relay_parse_header("/aoo/peer/ping\0\0,\0\0\0", 20, &out, &len) == 0);
+}
+
+void testRelay()
+{
+    int32_t err = 0;
+    auto server = aoonet_server_new(port, &err);
+    CHECK(server != nullptr);
+    if (!server) return;
+    aoonet_server_set_relay(server, 1, 0);
+    std::thread serverThread([&]() { aoonet_server_run(server); });
+
+    auto stats = [&]() {
+        aoonet_server_stats s {};
+        aoonet_server_get_stats(server, &s);
+        return s;
+    };
+
+    {
+        Client a, b;
+        aoonet_client_connect(a.client, "127.0.0.1", port, "alice", "pwd");
+        aoonet_client_connect(b.client, "127.0.0.1", port, "bob", "pwd");
+        CHECK(a.waitFor([&]() { return a.connected == 1; }, 5));
+        CHECK(b.waitFor([&]() { return b.connected == 1; }, 5));
+
+        aoonet_client_group_join(a.client, "relaytest", "pwd");
+        aoonet_client_group_join(b.client, "relaytest", "pwd");
+
+        // the direct handshake times out, then both must use the relay
+        CHECK(a.waitFor([&]() { return !a.peerEvents.empty(); }, 15));
+        CHECK(b.waitFor([&]() { return !b.peerEvents.empty(); }, 15));
+        CHECK(a.blocked > 0 && b.blocked > 0);
+        for (auto * c : { &a, &b }) {
+            std::lock_guard<std::mutex> lock(c->mutex);
+            CHECK(c->peerEvents.size() == 1);
+            if (c->peerEvents.empty()) return;
+            auto & e = c->peerEvents[0];
+            CHECK(e.type == AOONET_CLIENT_PEER_JOIN_EVENT);
+            CHECK(e.relayed);
+            CHECK(ntohs(((const sockaddr_in *) &e.relay)->sin_port) == port);
+        }
+        // the peers know each other by their public (= observed) addresses
+        CHECK(sameAddress(a.peerEvents[0].address, b.address()));
+        CHECK(sameAddress(b.peerEvents[0].address, a.address()));
+
+        // packets go through in both directions, tagged with the source
+        sendRelayed(a.sock, b.address(), "test:hello bob");
+        sendRelayed(b.sock, a.address(), "test:hello alice");
+        CHECK(b.hasRelayed("test:hello bob", a.address(), 2));
+        CHECK(a.hasRelayed("test:hello alice", b.address(), 2));
+        CHECK(stats().relay_sessions >= 2);
+
+        // strangers can't use the relay...
+        int stranger = openUdpSocket();
+        auto dropped = stats().relay_dropped;
+        sendRelayed(stranger, b.address(), "test:spam");
+        CHECK(!b.hasRelayed("test:spam", loopback(localPort(stranger)), 0.3));
+        CHECK(stats().relay_dropped > dropped);
+
+        // ... or register without a valid token; they don't get a reply either
+        dropped = stats().relay_dropped;
+        sendRegistration(stranger, 0x1234567887654321LL);
+        CHECK(relayReplyResult(receive(stranger, 0.3)) == -1);
+        CHECK(stats().relay_dropped > dropped);
+
+        // a client which claims somebody else's address at login...
+        int tcpsock = socket(AF_INET, SOCK_STREAM, 0);
+        auto token = forgedLogin(tcpsock, a.address());
+        CHECK(token != 0);
+        // ...can't register from its own endpoint (conflicting)
+        std::string errmsg;
+        sendRegistration(stranger, token);
+        CHECK(relayReplyResult(receive(stranger, 1), &errmsg) == 0);
+        std::printf("conflicting registration: %s\n", errmsg.c_str());
+        // ...nor from the claimed one, which is already taken (duplicate)
+        a.swallowRelayReplies = true;
+        sendRegistration(a.sock, token);
+        CHECK(a.waitFor([&]() { return !a.relayReplies.empty(); }, 1));
+        if (!a.relayReplies.empty()) {
+            CHECK(relayReplyResult(a.relayReplies[0], &errmsg) == 0);
+            std::printf("duplicate registration: %s\n", errmsg.c_str());
+        }
+        a.swallowRelayReplies = false;
+
+        // and alice still gets her packets
+        sendRelayed(b.sock, a.address(), "test:still there");
+        CHECK(a.hasRelayed("test:still there", b.address(), 2));
+
+        close(tcpsock);
+        close(stranger);
+    }
+
+    aoonet_server_quit(server);
+    serverThread.join();
+    aoonet_server_free(server);
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+
+    testHeader();
+    testRelay();
+
+    return testResult("test-relay");
+}
+
+#endif
@@ -0,0 +1,79 @@
+// Benchmark for the dynamic resampler: time per output sample for each
+// interpolation quality and channel count, at a slightly drifting ratio
+// (as with drift correction) and at a fixed 44.1 -> 48 kHz ratio.
+//
+//   bench-resampler [--blocksize 128] [--seconds 1 (of audio per run)]
+
+#include "TestUtils.h"
+
+#include "src/common.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const char * qualityName(int q)
+{
+    switch (q) {
+    case AOO_RESAMPLE_LINEAR: return "linear";
+    case AOO_RESAMPLE_CUBIC: return "cubic";
+    case AOO_RESAMPLE_SINC_SHORT: return "sinc8";
+    case AOO_RESAMPLE_SINC_LONG: return "sinc32";
+    default: return "?";
+    }
+}
+
+// returns ns per output sample (per channel)
+double run(int quality, int nchannels, int blocksize, int srfrom, double srto, double seconds)
+{
+    aoo::dynamic_resampler r;
+    r.setup(blocksize, blocksize, srfrom, (int) srto, nchannels, quality);
+    r.update(srfrom, srto);
+
+    std::vector<aoo_sample> in(blocksize * nchannels), out(blocksize * nchannels);
+    for (int i = 0; i < blocksize; ++i) {
+        for (int c = 0; c < nchannels; ++c) {
+            in[i * nchannels + c] = 0.5f * std::sin(0.01f * i + c);
+        }
+    }
+
+    const long nblocks = (long) (seconds * srto / blocksize);
+    long produced = 0;
+    float check = 0;
+    double t0 = nowSeconds();
+    for (long b = 0; b < nblocks; ++b) {
+        while (r.read_available() < blocksize * nchannels) {
+            r.write(in.data(), blocksize * nchannels);
+        }
+        r.read(out.data(), blocksize * nchannels);
+        check += out[b % out.size()];
+        produced += blocksize;
+    }
+    double elapsed = nowSeconds() - t0;
+    if (check == 12345.f) std::printf(" "); // keep the result alive
+    return elapsed * 1e9 / (double) (produced * nchannels);
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    if (hasFlag(argc, argv, "help")) {
+        std::printf("bench-resampler [--blocksize 128] [--seconds 1 (of audio per run)]\n");
+        return 0;
+    }
+    const int blocksize = atoi(getArg(argc, argv, "blocksize", "128"));
+    const double seconds = atof(getArg(argc, argv, "seconds", "1"));
+
+    std::printf("ns per output sample, blocksize %d\n", blocksize);
+    std::printf("%-8s %4s %14s %14s\n", "quality", "ch", "drift 48k", "44.1k->48k");
+    for (int q = AOO_RESAMPLE_LINEAR; q <= AOO_RESAMPLE_SINC_LONG; ++q) {
+        for (int nch : { 1, 2, 8 }) {
+            double drift = run(q, nch, blocksize, 48000, 48000 * 1.0001, seconds);
+            double convert = run(q, nch, blocksize, 44100, 48000, seconds);
+            std::printf("%-8s %4d %14.2f %14.2f\n", qualityName(q), nch, drift, convert);
+        }
+    }
+    return 0;
+}
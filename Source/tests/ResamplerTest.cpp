@@ -0,0 +1,149 @@
+// Tests the dynamic resampler's interpolation presets.
+
+#include "TestUtils.h"
+
+#include "src/common.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const int blocksize = 64;
+
+// a sine for each channel, every channel with its own frequency
+float signal(int frame, int channel)
+{
+    return 0.5f * std::sin(0.01f * (channel + 1) * frame);
+}
+
+struct Run {
+    aoo::dynamic_resampler r;
+    int nchannels;
+    int written = 0; // frames
+
+    Run(int nch, int quality, int srfrom, double srto) : nchannels(nch)
+    {
+        r.setup(blocksize, blocksize, srfrom, (int) srto, nch, quality);
+        r.update(srfrom, srto);
+    }
+
+    // returns one block of output frames
+    std::vector<aoo_sample> next()
+    {
+        std::vector<aoo_sample> in(blocksize * nchannels), out(blocksize * nchannels);
+        while (r.read_available() < blocksize * nchannels) {
+            for (int i = 0; i < blocksize; ++i) {
+                for (int c = 0; c < nchannels; ++c) {
+                    in[i * nchannels + c] = signal(written + i, c);
+                }
+            }
+            r.write(in.data(), blocksize * nchannels);
+            written += blocksize;
+        }
+        r.read(out.data(), blocksize * nchannels);
+        return out;
+    }
+};
+
+// every channel gets the same result, no matter how many channels
+// there are or how they are grouped in the filter loop
+void testChannelsMatchMono()
+{
+    for (int q = AOO_RESAMPLE_LINEAR; q <= AOO_RESAMPLE_SINC_LONG; ++q) {
+        for (int nch : { 2, 5, 8 }) {
+            std::vector<Run *> mono;
+            for (int c = 0; c < nch; ++c) {
+                mono.push_back(new Run(1, q, 44100, 48000));
+            }
+            Run multi(nch, q, 44100, 48000);
+            // mono run 'c' gets the signal of channel 'c'
+            float maxdiff = 0;
+            for (int b = 0; b < 50; ++b) {
+                auto out = multi.next();
+                for (int c = 0; c < nch; ++c) {
+                    // replace the mono signal by the one of channel c
+                    auto & m = *mono[c];
+                    std::vector<aoo_sample> in(blocksize), res(blocksize);
+                    while (m.r.read_available() < blocksize) {
+                        for (int i = 0; i < blocksize; ++i) {
+                            in[i] = signal(m.written + i, c);
+                        }
+                        m.r.write(in.data(), blocksize);
+                        m.written += blocksize;
+                    }
+                    m.r.read(res.data(), blocksize);
+                    for (int i = 0; i < blocksize; ++i) {
+                        maxdiff = std::max(maxdiff, std::abs(res[i] - out[i * nch + c]));
+                    }
+                }
+            }
+            CHECK(maxdiff < 1e-5f);
+            for (auto m : mono) delete m;
+        }
+    }
+}
+
+// the output is the input signal, delayed by the reported latency
+void testAccuracy()
+{
+    const double tolerance[] = { 1e-3, 1e-4, 1e-4, 1e-4 };
+    for (int q = AOO_RESAMPLE_LINEAR; q <= AOO_RESAMPLE_SINC_LONG; ++q) {
+        Run run(1, q, 48000, 48000 * 1.01);
+        double ratio = 48000.0 / (48000 * 1.01);
+        double maxerr = 0;
+        int frame = 0;
+        for (int b = 0; b < 100; ++b) {
+            auto out = run.next();
+            for (int i = 0; i < blocksize; ++i, ++frame) {
+                double pos = frame * ratio - run.r.latency();
+                if (b > 10) {
+                    double expected = 0.5 * std::sin(0.01 * pos);
+                    maxerr = std::max(maxerr, std::abs(out[i] - expected));
+                }
+            }
+        }
+        CHECK(maxerr < tolerance[q]);
+    }
+}
+
+// changing the quality keeps the buffered audio: nothing is
+// dropped and the output doesn't go silent
+void testSetQuality()
+{
+    Run run(2, AOO_RESAMPLE_LINEAR, 44100, 48000);
+    for (int b = 0; b < 20; ++b) run.next();
+
+    for (int q : { AOO_RESAMPLE_SINC_LONG, AOO_RESAMPLE_CUBIC, AOO_RESAMPLE_SINC_SHORT }) {
+        auto avail = run.r.read_available();
+        aoo::dynamic_resampler::quality_change change;
+        run.r.prepare_quality(q, change);
+        CHECK(run.r.set_quality(change));
+        CHECK(run.r.quality() == q);
+        CHECK(run.r.read_available() == avail);
+
+        float peak = 0;
+        for (int b = 0; b < 10; ++b) {
+            for (auto s : run.next()) peak = std::max(peak, std::abs(s));
+        }
+        CHECK(peak > 0.4f && peak < 0.55f);
+    }
+
+    // a change prepared for another setup is not applied
+    aoo::dynamic_resampler::quality_change change;
+    run.r.prepare_quality(AOO_RESAMPLE_LINEAR, change);
+    run.r.setup(blocksize, blocksize, 48000, 48000, 2, AOO_RESAMPLE_CUBIC);
+    CHECK(!run.r.set_quality(change));
+    CHECK(run.r.quality() == AOO_RESAMPLE_CUBIC);
+}
+
+} // namespace
+
+int main()
+{
+    testChannelsMatchMono();
+    testAccuracy();
+    testSetQuality();
+
+    return testResult("test-resampler");
+}
@@ -0,0 +1,411 @@
+// Benchmark for the connection server with many clients on the loopback
+// interface. For every client count it measures how long it takes until all
+// TCP connections are accepted, the TCP ping round trip to all clients, the
+// login and group join round trips (all clients log in as different users,
+// then join groups of 8, so the server's user and group tables fill up),
+// the server's CPU time while the clients are idle and the UDP /ping
+// throughput.
+//
+// Finally the process runs out of file descriptors while clients keep
+// connecting: the server must reject them (see "rejected") and keep working
+// instead of spinning or losing track of the listening socket.
+//
+//   bench-server-scaling [--clients 50,200,1000] [--seconds 1 (per run)] [--port 10998]
+
+#include "TestUtils.h"
+
+#include "aoo/aoo.h"
+#include "aoo/aoo_net.h"
+#include "src/SLIP.hpp"
+
+#ifdef _WIN32
+
+int main()
+{
+    std::printf("bench-server-scaling: not supported on Windows\n");
+    return 0;
+}
+
+#else
+
+#include "oscpack/osc/OscOutboundPacketStream.h"
+#include "oscpack/osc/OscReceivedElements.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int usersPerGroup = 8;
+
+// runs the server in its own thread, so that we can measure its CPU time
+struct Server {
+    aoonet_server * server = nullptr;
+    std::thread thread;
+    clockid_t clock;
+
+    explicit Server(int port)
+    {
+        int32_t err = 0;
+        server = aoonet_server_new(port, &err);
+        if (!server) {
+            std::fprintf(stderr, "couldn't create server on port %d (%d)\n", port, err);
+            std::exit(1);
+        }
+        thread = std::thread([this]() { aoonet_server_run(server); });
+        pthread_getcpuclockid(thread.native_handle(), &clock);
+    }
+
+    ~Server()
+    {
+        aoonet_server_quit(server);
+        thread.join();
+        aoonet_server_free(server);
+    }
+
+    double cpuSeconds() const
+    {
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    aoonet_server_stats stats() const
+    {
+        aoonet_server_stats s {};
+        aoonet_server_get_stats(server, &s);
+        return s;
+    }
+
+    // waits until 'pred' is true for the server stats, returns false on timeout
+    template<typename F>
+    bool waitFor(F && pred, double timeout = 10) const
+    {
+        double t0 = nowSeconds();
+        while (!pred(stats())) {
+            if (nowSeconds() - t0 > timeout) return false;
+            usleep(500);
+        }
+        return true;
+    }
+};
+
+sockaddr_in loopback(int port)
+{
+    sockaddr_in sa {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sa;
+}
+
+std::vector<int> openSockets(int count)
+{
+    std::vector<int> sockets;
+    for (int i = 0; i < count; ++i) {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) {
+            std::fprintf(stderr, "socket() failed after %d clients (%d), "
+                         "raise the file descriptor limit\n", i, errno);
+            std::exit(1);
+        }
+        sockets.push_back(sock);
+    }
+    return sockets;
+}
+
+void closeSockets(std::vector<int> & sockets)
+{
+    for (auto s : sockets) close(s);
+    sockets.clear();
+}
+
+// sends /aoo/server/ping to every client and waits for all the replies;
+// returns the time in milliseconds or -1 on timeout
+double tcpPingAll(const std::vector<int> & sockets)
+{
+    char msgbuf[64];
+    osc::OutboundPacketStream msg(msgbuf, sizeof(msgbuf));
+    msg << osc::BeginMessage(AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_PING) << osc::EndMessage;
+    aoo::SLIP slip;
+    slip.setup(256);
+    slip.write_packet((const uint8_t *) msg.Data(), (int32_t) msg.Size());
+    uint8_t frame[256];
+    auto framesize = slip.read_bytes(frame, sizeof(frame));
+
+    std::vector<pollfd> fds;
+    for (auto s : sockets) {
+        fds.push_back({ s, POLLIN, 0 });
+    }
+
+    double t0 = nowSeconds();
+    for (auto s : sockets) {
+        if (send(s, frame, framesize, MSG_NOSIGNAL) != framesize) return -1;
+    }
+    // each reply is a single small frame
+    size_t pending = fds.size();
+    while (pending > 0) {
+        if (nowSeconds() - t0 > 10) return -1;
+        if (poll(fds.data(), fds.size(), 100) <= 0) continue;
+        for (auto & fd : fds) {
+            if (fd.fd >= 0 && (fd.revents & POLLIN)) {
+                char buf[256];
+                if (recv(fd.fd, buf, sizeof(buf), 0) > 0) {
+                    fd.fd = -fd.fd - 1; // ignore from now on
+                    --pending;
+                }
+            }
+        }
+    }
+    return (nowSeconds() - t0) * 1000;
+}
+
+// sends a request to every client and waits until each one got a reply with
+// the given address and a successful result (the first argument after
+// 'resultindex' others); returns the time in milliseconds or -1 on timeout
+// or error. Other messages (e.g. peer notifications) are skipped.
+double requestAll(const std::vector<int> & sockets,
+                  const std::function<void(osc::OutboundPacketStream &, int)> & request,
+                  const char * replyaddress, int resultindex)
+{
+    std::vector<aoo::SLIP> slips(sockets.size());
+    std::vector<pollfd> fds;
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        slips[i].setup(65536);
+        fds.push_back({ sockets[i], POLLIN, 0 });
+    }
+
+    double t0 = nowSeconds();
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        char msgbuf[256];
+        osc::OutboundPacketStream msg(msgbuf, sizeof(msgbuf));
+        request(msg, (int) i);
+        aoo::SLIP slip;
+        slip.setup(512);
+        slip.write_packet((const uint8_t *) msg.Data(), (int32_t) msg.Size());
+        uint8_t frame[512];
+        auto framesize = slip.read_bytes(frame, sizeof(frame));
+        if (send(sockets[i], frame, framesize, MSG_NOSIGNAL) != framesize) return -1;
+    }
+
+    size_t pending = fds.size();
+    bool failed = false;
+    while (pending > 0) {
+        if (nowSeconds() - t0 > 10) return -1;
+        if (poll(fds.data(), fds.size(), 100) <= 0) continue;
+        for (size_t i = 0; i < fds.size(); ++i) {
+            auto & fd = fds[i];
+            if (fd.fd < 0 || !(fd.revents & POLLIN)) continue;
+            uint8_t buf[4096];
+            auto n = recv(fd.fd, buf, sizeof(buf), 0);
+            if (n <= 0) return -1;
+            slips[i].write_bytes(buf, (int32_t) n);
+            uint8_t packet[4096];
+            int32_t size;
+            while ((size = slips[i].read_packet(packet, sizeof(packet))) > 0) {
+                osc::ReceivedPacket p((const char *) packet, size);
+                if (!p.IsMessage()) continue;
+                osc::ReceivedMessage msg(p);
+                if (std::strcmp(msg.AddressPattern(), replyaddress) != 0) continue;
+                auto it = msg.ArgumentsBegin();
+                for (int k = 0; k < resultindex; ++k) ++it;
+                if (it->AsInt32() != 1) failed = true;
+                fd.fd = -fd.fd - 1; // done
+                --pending;
+                break;
+            }
+        }
+    }
+    return failed ? -1 : (nowSeconds() - t0) * 1000;
+}
+
+double loginAll(const std::vector<int> & sockets)
+{
+    return requestAll(sockets, [](osc::OutboundPacketStream & msg, int i) {
+        std::string name = "user" + std::to_string(i);
+        msg << osc::BeginMessage(AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_LOGIN)
+            << name.c_str() << "pwd" << "127.0.0.1" << (int32_t) (20000 + i)
+            << "127.0.0.1" << (int32_t) (20000 + i) << osc::EndMessage;
+    }, AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_LOGIN, 0);
+}
+
+double joinAll(const std::vector<int> & sockets)
+{
+    return requestAll(sockets, [](osc::OutboundPacketStream & msg, int i) {
+        std::string name = "group" + std::to_string(i / usersPerGroup);
+        msg << osc::BeginMessage(AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_GROUP AOONET_MSG_JOIN)
+            << name.c_str() << "pwd" << osc::EndMessage;
+    }, AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_GROUP AOONET_MSG_JOIN, 1);
+}
+
+// sends UDP /ping messages as fast as the replies come back, with up to
+// 'window' messages in flight; returns the replies per second
+double udpPingRate(int port, double seconds, int window = 64)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    auto sa = loopback(port);
+    connect(sock, (sockaddr *) &sa, sizeof(sa));
+
+    char msgbuf[64];
+    osc::OutboundPacketStream msg(msgbuf, sizeof(msgbuf));
+    msg << osc::BeginMessage(AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_PING) << osc::EndMessage;
+
+    long replies = 0;
+    int inflight = 0;
+    double t0 = nowSeconds(), elapsed = 0;
+    while (elapsed < seconds) {
+        while (inflight < window) {
+            send(sock, msg.Data(), msg.Size(), 0);
+            ++inflight;
+        }
+        pollfd fd { sock, POLLIN, 0 };
+        if (poll(&fd, 1, 10) > 0) {
+            char buf[256];
+            while (recv(sock, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+                ++replies;
+                --inflight;
+            }
+        } else {
+            inflight = 0; // lost packets
+        }
+        elapsed = nowSeconds() - t0;
+    }
+    close(sock);
+    return replies / elapsed;
+}
+
+void run(int port, int count, double seconds)
+{
+    Server server(port);
+    auto sa = loopback(port);
+    auto sockets = openSockets(count);
+
+    double t0 = nowSeconds();
+    for (auto s : sockets) {
+        if (connect(s, (sockaddr *) &sa, sizeof(sa)) != 0) {
+            std::fprintf(stderr, "connect() failed (%d)\n", errno);
+            std::exit(1);
+        }
+    }
+    bool ok = server.waitFor([&](const aoonet_server_stats & s) { return s.num_clients >= count; });
+    double connectms = (nowSeconds() - t0) * 1000;
+
+    double pingms = tcpPingAll(sockets);
+    double loginms = loginAll(sockets);
+    double joinms = joinAll(sockets);
+
+    double cpu0 = server.cpuSeconds();
+    usleep((useconds_t) (seconds * 1e6));
+    double idlecpu = (server.cpuSeconds() - cpu0) / seconds * 100;
+
+    cpu0 = server.cpuSeconds();
+    double rate = udpPingRate(port, seconds);
+    double udpcpu = (server.cpuSeconds() - cpu0) / seconds * 100;
+
+    std::printf("%8d %12.2f %12.2f %10.2f %10.2f %10.3f %14.0f %10.1f%s\n", count, connectms,
+                pingms, loginms, joinms, idlecpu, rate, udpcpu, ok ? "" : " (not all clients accepted)");
+
+    closeSockets(sockets);
+}
+
+// lets the server run out of file descriptors while clients are connecting
+void runOutOfFiles(int port, int count, double seconds)
+{
+    Server server(port);
+    auto sa = loopback(port);
+    // open the client sockets first, they must not be affected by the limit
+    auto sockets = openSockets(count);
+
+    struct rlimit old;
+    getrlimit(RLIMIT_NOFILE, &old);
+    int maxfd = 0;
+    for (int fd = 0; fd < (int) old.rlim_cur && fd < 65536; ++fd) {
+        if (fcntl(fd, F_GETFD) != -1) maxfd = fd;
+    }
+    const int spare = 4;
+    struct rlimit lim = old;
+    lim.rlim_cur = maxfd + 1 + spare;
+    if (setrlimit(RLIMIT_NOFILE, &lim) != 0) {
+        std::printf("couldn't lower the file descriptor limit (%d)\n", errno);
+        closeSockets(sockets);
+        return;
+    }
+
+    for (auto s : sockets) {
+        connect(s, (sockaddr *) &sa, sizeof(sa));
+    }
+    bool done = server.waitFor([&](const aoonet_server_stats & s) {
+        return s.num_clients + s.rejected_clients >= count;
+    });
+    auto stats = server.stats();
+
+    // the server must not spin once it has caught up
+    double cpu0 = server.cpuSeconds();
+    usleep((useconds_t) (seconds * 1e6));
+    double idlecpu = (server.cpuSeconds() - cpu0) / seconds * 100;
+
+    setrlimit(RLIMIT_NOFILE, &old);
+
+    // and it still answers
+    double rate = udpPingRate(port, 0.2);
+
+    std::printf("out of files: %d clients, %d accepted, %lld rejected%s, idle CPU %.3f%%, "
+                "UDP ping %.0f/s\n", count, stats.num_clients,
+                (long long) stats.rejected_clients, done ? "" : " (some never handled!)",
+                idlecpu, rate);
+
+    closeSockets(sockets);
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    if (hasFlag(argc, argv, "help")) {
+        std::printf("bench-server-scaling [--clients 50,200,1000] "
+                    "[--seconds 1 (per run)] [--port 10998]\n");
+        return 0;
+    }
+    std::string clients = getArg(argc, argv, "clients", "50,200,1000");
+    const double seconds = atof(getArg(argc, argv, "seconds", "1"));
+    const int port = atoi(getArg(argc, argv, "port", "10998"));
+
+    aoo_initialize();
+
+    std::vector<int> counts;
+    for (size_t pos = 0; pos < clients.size();) {
+        counts.push_back(atoi(clients.c_str() + pos));
+        auto comma = clients.find(',', pos);
+        pos = comma == std::string::npos ? clients.size() : comma + 1;
+    }
+
+    // we need a descriptor for each client on both ends
+    struct rlimit lim;
+    getrlimit(RLIMIT_NOFILE, &lim);
+    if (lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    std::printf("%8s %12s %12s %10s %10s %10s %14s %10s\n", "clients", "connect ms",
+                "TCP ping ms", "login ms", "join ms", "idle CPU%", "UDP ping/s", "UDP CPU%");
+    for (auto count : counts) {
+        run(port, count, seconds);
+    }
+    runOutOfFiles(port, 100, seconds);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,247 @@
+// Tests the connection server's per-client send queues on the loopback
+// interface. A client which never reads fills its queue with the peer
+// notifications of a join/leave storm in its group and must be
+// disconnected, while a client which keeps reading gets every notification
+// and the server keeps answering.
+
+#include "TestUtils.h"
+
+#include "aoo/aoo.h"
+#include "aoo/aoo_net.h"
+#include "src/SLIP.hpp"
+
+#ifdef _WIN32
+
+int main()
+{
+    std::printf("test-server-send-queue: not supported on Windows\n");
+    return 0;
+}
+
+#else
+
+#include "oscpack/osc/OscOutboundPacketStream.h"
+#include "oscpack/osc/OscReceivedElements.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+const int port = 10994;
+const char * groupName = "storm";
+
+// a TCP connection to the server, speaking SLIP encoded OSC
+struct Connection {
+    int sock = -1;
+    aoo::SLIP reader;
+    int peerJoins = 0;  // of the 'churn' user
+    int peerLeaves = 0;
+    int pings = 0;
+    bool closed = false; // by the server
+
+    explicit Connection(int rcvbuf = 0)
+    {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (rcvbuf > 0) {
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        }
+        sockaddr_in sa {};
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(port);
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        CHECK(connect(sock, (sockaddr *) &sa, sizeof(sa)) == 0);
+        reader.setup(65536);
+    }
+
+    ~Connection()
+    {
+        close(sock);
+    }
+
+    void send(const osc::OutboundPacketStream & msg)
+    {
+        aoo::SLIP slip;
+        slip.setup(1024);
+        slip.write_packet((const uint8_t *) msg.Data(), (int32_t) msg.Size());
+        uint8_t frame[1024];
+        auto n = slip.read_bytes(frame, sizeof(frame));
+        CHECK(::send(sock, frame, n, MSG_NOSIGNAL) == n);
+    }
+
+    void login(const char * name)
+    {
+        char buf[256];
+        osc::OutboundPacketStream msg(buf, sizeof(buf));
+        msg << osc::BeginMessage(AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_LOGIN)
+            << name << "pwd" << "127.0.0.1" << (int32_t) 20000
+            << "127.0.0.1" << (int32_t) 20000 << osc::EndMessage;
+        send(msg);
+    }
+
+    void join()
+    {
+        char buf[256];
+        osc::OutboundPacketStream msg(buf, sizeof(buf));
+        msg << osc::BeginMessage(AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_GROUP AOONET_MSG_JOIN)
+            << groupName << "pwd" << osc::EndMessage;
+        send(msg);
+    }
+
+    void leave()
+    {
+        char buf[256];
+        osc::OutboundPacketStream msg(buf, sizeof(buf));
+        msg << osc::BeginMessage(AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_GROUP AOONET_MSG_LEAVE)
+            << groupName << osc::EndMessage;
+        send(msg);
+    }
+
+    void ping()
+    {
+        char buf[64];
+        osc::OutboundPacketStream msg(buf, sizeof(buf));
+        msg << osc::BeginMessage(AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_PING) << osc::EndMessage;
+        send(msg);
+    }
+
+    // /peer/join and /peer/leave: group, user, ...
+    static bool isChurn(const osc::ReceivedMessage & msg)
+    {
+        auto it = msg.ArgumentsBegin();
+        ++it;
+        return !std::strcmp(it->AsString(), "churn");
+    }
+
+    // reads everything that is there, waiting up to 'timeoutms' for the first bytes
+    void drain(int timeoutms = 0)
+    {
+        pollfd fd { sock, POLLIN, 0 };
+        while (!closed && poll(&fd, 1, timeoutms) > 0) {
+            uint8_t buf[16384];
+            auto n = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n <= 0) {
+                closed = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+                break;
+            }
+            reader.write_bytes(buf, (int32_t) n);
+            uint8_t packet[4096];
+            int32_t size;
+            while ((size = reader.read_packet(packet, sizeof(packet))) > 0) {
+                osc::ReceivedPacket p((const char *) packet, size);
+                if (!p.IsMessage()) continue;
+                osc::ReceivedMessage msg(p);
+                const char * address = msg.AddressPattern();
+                if (!std::strcmp(address, AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_PEER AOONET_MSG_JOIN)) {
+                    peerJoins += isChurn(msg);
+                } else if (!std::strcmp(address, AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_PEER AOONET_MSG_LEAVE)) {
+                    peerLeaves += isChurn(msg);
+                } else if (!std::strcmp(address, AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_PING)) {
+                    ++pings;
+                }
+            }
+            timeoutms = 0;
+        }
+    }
+};
+
+aoonet_server_stats getStats(aoonet_server * server)
+{
+    aoonet_server_stats s {};
+    aoonet_server_get_stats(server, &s);
+    return s;
+}
+
+void testSlowClient(aoonet_server * server)
+{
+    Connection stalled(4096); // never reads
+    Connection watcher;
+    Connection churn;
+
+    stalled.login("stalled");
+    stalled.join();
+    watcher.login("watcher");
+    watcher.join();
+    churn.login("churn");
+    // let the logins and joins go through in this order
+    watcher.drain(200);
+    churn.drain(200);
+    CHECK(getStats(server).num_clients == 3);
+
+    // every join and leave of 'churn' is a notification for both others
+    int cycles = 0;
+    double t0 = nowSeconds();
+    while (getStats(server).send_overflows == 0 && nowSeconds() - t0 < 10) {
+        for (int i = 0; i < 100; ++i, ++cycles) {
+            churn.join();
+            churn.leave();
+        }
+        watcher.drain();
+        churn.drain();
+    }
+    // a few more with the stalled client gone
+    for (int i = 0; i < 100; ++i, ++cycles) {
+        churn.join();
+        churn.leave();
+    }
+
+    // the watcher gets everything, and the server still answers
+    watcher.ping();
+    t0 = nowSeconds();
+    while (watcher.pings == 0 && !watcher.closed && nowSeconds() - t0 < 10) {
+        watcher.drain(100);
+        churn.drain();
+    }
+    auto stats = getStats(server);
+    std::printf("%d join/leave cycles, %lld overflows, %d clients left, "
+                "watcher got %d joins and %d leaves\n", cycles,
+                (long long) stats.send_overflows, stats.num_clients,
+                watcher.peerJoins, watcher.peerLeaves);
+    CHECK(stats.send_overflows == 1);
+    CHECK(stats.num_clients == 2);
+    CHECK(watcher.pings == 1);
+    CHECK(!watcher.closed);
+    CHECK(watcher.peerJoins == cycles);
+    CHECK(watcher.peerLeaves == cycles);
+    CHECK(!churn.closed);
+
+    // the stalled client finds its connection closed after the queued data
+    stalled.drain(1000);
+    t0 = nowSeconds();
+    while (!stalled.closed && nowSeconds() - t0 < 5) {
+        stalled.drain(100);
+    }
+    CHECK(stalled.closed);
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+
+    int32_t err = 0;
+    auto server = aoonet_server_new(port, &err);
+    if (!server) {
+        std::fprintf(stderr, "couldn't create server on port %d (%d)\n", port, err);
+        return 1;
+    }
+    std::thread thread([server]() { aoonet_server_run(server); });
+
+    testSlowClient(server);
+
+    aoonet_server_quit(server);
+    thread.join();
+    aoonet_server_free(server);
+
+    return testResult("test-server-send-queue");
+}
+
+#endif
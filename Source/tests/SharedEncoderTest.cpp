@@ -0,0 +1,304 @@
+// Tests sources which share an encoder (aoo_opt_encode_group).
+//
+// The sources use a small stateful test codec: every packet holds the
+// difference to the previous block as well as the block itself. A
+// receiver can therefore tell whether the packets of one stream came
+// from one continuous encoder state, which is what a real stateful codec
+// like Opus needs.
+
+#include "TestUtils.h"
+
+#include "aoo/aoo.hpp"
+#include "src/common.hpp"
+
+#include <cmath>
+#include <map>
+#include <vector>
+
+#define DELTA_CODEC "delta"
+
+namespace {
+
+int encodeCount = 0;
+
+struct DeltaCodec {
+    aoo_format format {};
+    std::vector<int32_t> prev;
+};
+
+void * deltaNew() { return new DeltaCodec; }
+
+void deltaFree(void * x) { delete static_cast<DeltaCodec *>(x); }
+
+int32_t deltaSetFormat(void * x, aoo_format * f)
+{
+    if (strcmp(f->codec, DELTA_CODEC)) return 0;
+    auto c = static_cast<DeltaCodec *>(x);
+    c->format = *f;
+    c->format.codec = DELTA_CODEC;
+    c->prev.assign(f->nchannels * f->blocksize, 0);
+    return 1;
+}
+
+int32_t deltaGetFormat(void * x, aoo_format_storage * f)
+{
+    auto c = static_cast<DeltaCodec *>(x);
+    if (!c->format.codec) return 0;
+    f->header = c->format;
+    return sizeof(aoo_format);
+}
+
+int32_t deltaWriteFormat(void * x, aoo_format * f, char *, int32_t)
+{
+    if (x) *f = static_cast<DeltaCodec *>(x)->format;
+    return 0; // no extra settings
+}
+
+int32_t deltaReadFormat(void * x, aoo_format * f, const char *, int32_t)
+{
+    return deltaSetFormat(x, f) ? 0 : -1;
+}
+
+// packet: n deltas followed by n absolute values, as 20 bit fixed point
+int32_t deltaEncode(void * x, const aoo_sample * s, int32_t n, char * buf, int32_t size)
+{
+    auto c = static_cast<DeltaCodec *>(x);
+    if (size < n * 8 || (int32_t) c->prev.size() != n) return 0;
+    auto out = reinterpret_cast<int32_t *>(buf);
+    for (int32_t i = 0; i < n; ++i) {
+        int32_t q = (int32_t) std::lrint(s[i] * (1 << 20));
+        out[i] = q - c->prev[i];
+        out[n + i] = q;
+        c->prev[i] = q;
+    }
+    ++encodeCount;
+    return n * 8;
+}
+
+int32_t deltaDecode(void *, const char *, int32_t, aoo_sample *, int32_t) { return 0; }
+
+int32_t deltaReset(void * x)
+{
+    auto c = static_cast<DeltaCodec *>(x);
+    std::fill(c->prev.begin(), c->prev.end(), 0);
+    return 1;
+}
+
+int32_t deltaCopyState(void * dst, const void * src)
+{
+    static_cast<DeltaCodec *>(dst)->prev = static_cast<const DeltaCodec *>(src)->prev;
+    return 1;
+}
+
+const aoo_codec deltaCodec = {
+    DELTA_CODEC,
+    deltaNew, deltaFree, deltaSetFormat, deltaGetFormat, deltaReadFormat, deltaWriteFormat,
+    deltaEncode, deltaReset,
+    deltaNew, deltaFree, deltaSetFormat, deltaGetFormat, deltaReadFormat,
+    deltaDecode, deltaReset,
+    nullptr,
+    deltaCopyState
+};
+
+const int blocksize = 64;
+const int samplerate = 48000;
+
+// what one receiver got from one source
+struct Stream {
+    std::map<int32_t, std::vector<int32_t>> packets; // by sequence
+    int blocks = 0;
+    int breaks = 0; // packets which don't continue the previous one
+};
+
+int32_t receive(void * user, const char * data, int32_t n)
+{
+    auto stream = static_cast<Stream *>(user);
+    int32_t src, salt;
+    aoo::data_packet d;
+    if (n > 10 && !memcmp(data, "/aoo/sink/", 10) && strstr(data, "/data")
+        && aoo::parse_data_message(data, n, src, salt, d) && d.size > 0) {
+        auto ptr = reinterpret_cast<const int32_t *>(d.data);
+        stream->packets[d.sequence].assign(ptr, ptr + d.size / 4);
+    }
+    return n;
+}
+
+// check that each packet's delta leads from the previous packet to its own value
+void checkStream(Stream & stream)
+{
+    const std::vector<int32_t> * prev = nullptr;
+    int32_t prevseq = -1;
+    for (auto & it : stream.packets) {
+        auto & p = it.second;
+        const int n = (int) p.size() / 2;
+        if (prev && it.first == prevseq + 1) {
+            for (int i = 0; i < n; ++i) {
+                if ((*prev)[n + i] + p[i] != p[n + i]) {
+                    ++stream.breaks;
+                    break;
+                }
+            }
+        }
+        prev = &p;
+        prevseq = it.first;
+        ++stream.blocks;
+    }
+}
+
+struct Peer {
+    aoo::isource::pointer source;
+    Stream stream;
+};
+
+void setupPeer(Peer & peer, int id, int group)
+{
+    peer.source.reset(aoo::isource::create(id));
+    aoo_format fmt { DELTA_CODEC, 1, samplerate, blocksize };
+    peer.source->set_format(fmt);
+    peer.source->setup(samplerate, blocksize, 1);
+    peer.source->set_buffersize(100);
+    peer.source->set_packetsize(1024); // one frame per block
+    peer.source->set_dynamic_resampling(0);
+    peer.source->set_encode_group(group);
+    peer.source->add_sink(&peer.stream, 1, receive);
+    peer.source->start();
+}
+
+void processBlock(Peer & peer, float freq, int block)
+{
+    float buf[blocksize];
+    for (int i = 0; i < blocksize; ++i) {
+        buf[i] = 0.5f * std::sin(freq * (block * blocksize + i));
+    }
+    const aoo_sample * chn[1] = { buf };
+    peer.source->process(chn, blocksize, aoo_osctime_get());
+}
+
+// three sources with the same mix: every block is encoded once and all
+// streams stay continuous. Then one source gets a different mix: it leaves
+// the group without a break in its stream and the other two carry on.
+void testDivergingMember()
+{
+    Peer peers[3];
+    for (int i = 0; i < 3; ++i) {
+        setupPeer(peers[i], i + 1, 1);
+    }
+
+    encodeCount = 0;
+    const int nblocks = 100;
+    for (int b = 0; b < nblocks; ++b) {
+        for (auto & p : peers) processBlock(p, 0.01f, b);
+        for (auto & p : peers) while (p.source->send()) {}
+    }
+    CHECK(encodeCount == nblocks);
+
+    encodeCount = 0;
+    for (int b = nblocks; b < 2 * nblocks; ++b) {
+        processBlock(peers[0], 0.01f, b);
+        processBlock(peers[1], 0.01f, b);
+        processBlock(peers[2], 0.02f, b); // different mix
+        for (auto & p : peers) while (p.source->send()) {}
+    }
+    // the shared encoder and the one which left
+    CHECK(encodeCount == 2 * nblocks);
+
+    for (auto & p : peers) {
+        checkStream(p.stream);
+        CHECK(p.stream.blocks == 2 * nblocks);
+        CHECK(p.stream.breaks == 0);
+    }
+}
+
+// one source lags a few blocks behind the others, but still gets
+// the blocks from the shared encoder's history.
+void testLaggingMember()
+{
+    Peer peers[2];
+    for (int i = 0; i < 2; ++i) {
+        setupPeer(peers[i], i + 1, 2);
+    }
+
+    encodeCount = 0;
+    const int nblocks = 120;
+    for (int b = 0; b < nblocks; ++b) {
+        for (auto & p : peers) processBlock(p, 0.03f, b);
+        while (peers[0].source->send()) {}
+        if ((b % 4) == 3) {
+            while (peers[1].source->send()) {}
+        }
+    }
+    while (peers[1].source->send()) {}
+    CHECK(encodeCount == nblocks);
+
+    for (auto & p : peers) {
+        checkStream(p.stream);
+        CHECK(p.stream.blocks == nblocks);
+        CHECK(p.stream.breaks == 0);
+    }
+}
+
+// a source which is taken out of the group continues
+// from the current state of the shared encoder.
+void testLeavingGroup()
+{
+    Peer peers[2];
+    for (int i = 0; i < 2; ++i) {
+        setupPeer(peers[i], i + 1, 3);
+    }
+
+    encodeCount = 0;
+    const int nblocks = 50;
+    for (int b = 0; b < nblocks; ++b) {
+        for (auto & p : peers) processBlock(p, 0.01f, b);
+        for (auto & p : peers) while (p.source->send()) {}
+    }
+    peers[1].source->set_encode_group(0);
+    for (int b = nblocks; b < 2 * nblocks; ++b) {
+        for (auto & p : peers) processBlock(p, 0.01f, b);
+        for (auto & p : peers) while (p.source->send()) {}
+    }
+    CHECK(encodeCount == 3 * nblocks);
+
+    for (auto & p : peers) {
+        checkStream(p.stream);
+        CHECK(p.stream.blocks == 2 * nblocks);
+        CHECK(p.stream.breaks == 0);
+    }
+}
+
+// without an encode group, every source runs its own encoder
+void testNoGroup()
+{
+    Peer peers[2];
+    for (int i = 0; i < 2; ++i) {
+        setupPeer(peers[i], i + 1, 0);
+    }
+
+    encodeCount = 0;
+    const int nblocks = 50;
+    for (int b = 0; b < nblocks; ++b) {
+        for (auto & p : peers) processBlock(p, 0.01f, b);
+        for (auto & p : peers) while (p.source->send()) {}
+    }
+    CHECK(encodeCount == 2 * nblocks);
+
+    for (auto & p : peers) {
+        checkStream(p.stream);
+        CHECK(p.stream.breaks == 0);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+    aoo_register_codec(DELTA_CODEC, &deltaCodec);
+
+    testDivergingMember();
+    testLaggingMember();
+    testLeavingGroup();
+    testNoGroup();
+
+    return testResult("test-shared-encoder");
+}
@@ -0,0 +1,187 @@
+// Tests the sink's fast path for data packets (source_desc::handle_data()):
+// blocks which arrive complete and in order are decoded straight from the
+// receive buffer, everything else goes through the jitter buffer.
+//
+// The source sends the same ramp three times: in order (fast path), with
+// every pair of blocks swapped and split into several frames (both queued).
+// The packet counters (aoo_opt_packet_counters) tell which path was taken,
+// and the sink must put out exactly the same samples in all three cases.
+
+#include "TestUtils.h"
+#include "Loopback.h"
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+#include "src/common.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const int blocksize = 64;
+const int samplerate = 48000;
+const int nblocks = 400;
+const int checkblocks = 300;
+const double rampstep = 1.0 / 65536; // exact in float32 for our number of samples
+
+enum class Mode {
+    inOrder,
+    swapped,
+    multiFrame
+};
+
+const char * modeName(Mode mode)
+{
+    switch (mode) {
+        case Mode::inOrder: return "in order";
+        case Mode::swapped: return "swapped pairs";
+        default: return "multi-frame";
+    }
+}
+
+// the sequence number of a (compact) data message, or -1
+int32_t dataSequence(const char * data, int32_t n)
+{
+    int32_t src, salt;
+    aoo::data_packet d;
+    if (aoo::parse_compact_data_message(data, n, salt, d)) {
+        return d.sequence;
+    }
+    if (n > 10 && !memcmp(data, "/aoo/sink/", 10) && strstr(data, "/data")
+        && aoo::parse_data_message(data, n, src, salt, d)) {
+        return d.sequence;
+    }
+    return -1;
+}
+
+struct Result {
+    std::vector<float> output; // from the first non-zero sample
+    aoo_packet_counters counters {};
+    int breaks = 0; // places where the ramp doesn't continue
+};
+
+Result run(Mode mode)
+{
+    aoo::isource::pointer source(aoo::isource::create(1));
+    aoo::isink::pointer sink(aoo::isink::create(1));
+
+    aoo_format_pcm fmt {};
+    fmt.header.codec = AOO_CODEC_PCM;
+    fmt.header.nchannels = 1;
+    fmt.header.samplerate = samplerate;
+    fmt.header.blocksize = blocksize;
+    fmt.bitdepth = AOO_PCM_FLOAT32;
+
+    source->set_format(fmt.header);
+    source->setup(samplerate, blocksize, 1);
+    source->set_buffersize(100);
+    source->set_dynamic_resampling(0);
+    if (mode == Mode::multiFrame) {
+        // the smallest possible packets: the 80 byte data header (see
+        // source.cpp) + 64 bytes, so a block takes 4 frames
+        source->set_packetsize(80 + 64);
+    }
+    sink->setup(samplerate, blocksize, 1);
+    sink->set_buffersize(20);
+    sink->set_dynamic_resampling(0);
+
+    Link link;
+    link.connect(source.get(), 1, sink.get(), 1);
+    source->start();
+
+    Result result;
+    std::vector<char> held; // the even block of a swapped pair
+    for (int b = 0; b < nblocks; ++b) {
+        float in[blocksize], out[blocksize];
+        for (int i = 0; i < blocksize; ++i) {
+            in[i] = (float) ((b * blocksize + i + 1) * rampstep);
+        }
+        const aoo_sample * inptr[1] = { in };
+        source->process(inptr, blocksize, aoo_osctime_get());
+        while (source->send()) {}
+
+        link.toSink.deliver([&](const char * data, int32_t n) {
+            const int32_t seq = dataSequence(data, n);
+            // the stream must be going before we hold anything back
+            if (mode == Mode::swapped && seq >= 4 && seq % 2 == 0 && held.empty()) {
+                held.assign(data, data + n);
+                return;
+            }
+            sink->handle_message(data, n, &link.toSource, Wire::send);
+            if (seq % 2 == 1 && !held.empty()) {
+                sink->handle_message(held.data(), (int32_t) held.size(), &link.toSource, Wire::send);
+                held.clear();
+            }
+        });
+        link.toSource.deliver([&](const char * data, int32_t n) {
+            source->handle_message(data, n, &link.toSink, Wire::send);
+        });
+
+        aoo_sample * outptr[1] = { out };
+        sink->process(outptr, blocksize, aoo_osctime_get());
+        while (sink->send()) {}
+        link.deliver();
+
+        for (int i = 0; i < blocksize; ++i) {
+            if (!result.output.empty() || out[i] != 0.f) {
+                result.output.push_back(out[i]);
+            }
+        }
+    }
+    sink->get_source_packet_counters(&link.toSource, 1, result.counters);
+
+    // after the faded in first block, every sample must be the next one
+    int64_t prev = 0;
+    for (size_t i = blocksize; i < result.output.size(); ++i) {
+        const int64_t k = std::llrint(result.output[i] / rampstep);
+        if (prev > 0 && k != prev + 1) {
+            ++result.breaks;
+        }
+        prev = k;
+    }
+    return result;
+}
+
+void testSameOutput()
+{
+    Result results[3];
+    const Mode modes[3] = { Mode::inOrder, Mode::swapped, Mode::multiFrame };
+    for (int m = 0; m < 3; ++m) {
+        auto & r = results[m];
+        r = run(modes[m]);
+        std::printf("%s: %lld packets, %lld on the fast path, %d samples, %d breaks\n",
+                    modeName(modes[m]), (long long) r.counters.received,
+                    (long long) r.counters.fastpath, (int) r.output.size(), r.breaks);
+        CHECK(r.output.size() >= (size_t) checkblocks * blocksize);
+        CHECK(r.breaks == 0);
+    }
+    // which path the blocks took
+    CHECK(results[0].counters.received >= checkblocks);
+    CHECK(results[0].counters.fastpath == results[0].counters.received);
+    CHECK(results[1].counters.received >= checkblocks);
+    CHECK(results[1].counters.fastpath <= 4); // before the swapping starts
+    CHECK(results[2].counters.received >= 4 * checkblocks);
+    CHECK(results[2].counters.fastpath == 0);
+
+    // the fast path must decode exactly like the jitter buffer
+    for (int m = 1; m < 3; ++m) {
+        int mismatches = 0;
+        for (size_t i = 0; i < (size_t) checkblocks * blocksize
+             && i < results[0].output.size() && i < results[m].output.size(); ++i) {
+            mismatches += results[0].output[i] != results[m].output[i];
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+
+    testSameOutput();
+
+    return testResult("test-sink-fast-path");
+}
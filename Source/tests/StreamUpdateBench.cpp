@@ -0,0 +1,213 @@
+// Stress benchmark for updates while audio is running.
+//
+// Runs sources streaming to sinks in real time: an audio thread calls
+// process() on all of them once per block, a network thread sends and
+// delivers the messages and a control thread keeps changing things
+// (sink buffer size, source resend buffer, source format, stream restarts).
+// Prints how long process() took on the audio thread and how many blocks
+// the sinks lost or the sources had to repeat or send empty.
+//
+//   bench-stream-update [--seconds 10] [--pairs 8] [--interval 20]
+//                       [--blocksize 128] [--channels 2]
+
+#include "TestUtils.h"
+#include "Loopback.h"
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+#include "src/common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int samplerate = 48000;
+
+struct Stats {
+    std::vector<double> times; // us
+
+    void print(const char * name)
+    {
+        if (times.empty()) return;
+        std::sort(times.begin(), times.end());
+        double sum = 0;
+        for (auto t : times) sum += t;
+        auto pct = [&](double p) { return times[(size_t) (p * (times.size() - 1))]; };
+        std::printf("%-14s mean %7.2f us  p50 %7.2f  p99 %7.2f  p99.9 %7.2f  max %8.2f\n",
+                    name, sum / times.size(), pct(0.5), pct(0.99), pct(0.999), times.back());
+    }
+};
+
+struct Counts {
+    std::atomic<int> blocks { 0 };
+    std::atomic<int> empty { 0 };
+    std::atomic<int> lost { 0 };
+};
+
+Counts counts;
+
+int32_t handleSinkEvents(void *, const aoo_event ** events, int32_t n)
+{
+    for (int i = 0; i < n; ++i) {
+        if (events[i]->type == AOO_BLOCK_LOST_EVENT) {
+            counts.lost += reinterpret_cast<const aoo_block_lost_event *>(events[i])->count;
+        }
+    }
+    return 1;
+}
+
+bool countData(const char * data, int32_t n)
+{
+    int32_t src, salt;
+    aoo::data_packet d;
+    if (n > 10 && !memcmp(data, "/aoo/sink/", 10) && strstr(data, "/data")
+        && aoo::parse_data_message(data, n, src, salt, d)) {
+        ++counts.blocks;
+        if (d.totalsize == 0) ++counts.empty;
+    }
+    return true;
+}
+
+struct Pair {
+    aoo::isource::pointer source;
+    aoo::isink::pointer sink;
+    Link link;
+};
+
+aoo_format_pcm makeFormat(int channels, int blocksize)
+{
+    aoo_format_pcm fmt {};
+    fmt.header.codec = AOO_CODEC_PCM;
+    fmt.header.nchannels = channels;
+    fmt.header.samplerate = samplerate;
+    fmt.header.blocksize = blocksize;
+    fmt.bitdepth = AOO_PCM_FLOAT32;
+    return fmt;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    if (hasFlag(argc, argv, "help")) {
+        std::printf("bench-stream-update [--seconds 10] [--pairs 8] [--interval 20 (ms between changes)]\n"
+                    "                    [--blocksize 128] [--channels 2]\n");
+        return 0;
+    }
+    const double seconds = atof(getArg(argc, argv, "seconds", "10"));
+    const int npairs = atoi(getArg(argc, argv, "pairs", "8"));
+    const int interval = atoi(getArg(argc, argv, "interval", "20"));
+    const int blocksize = atoi(getArg(argc, argv, "blocksize", "128"));
+    const int channels = atoi(getArg(argc, argv, "channels", "2"));
+
+    aoo_initialize();
+
+    std::vector<std::unique_ptr<Pair>> pairs;
+    for (int i = 0; i < npairs; ++i) {
+        auto p = std::make_unique<Pair>();
+        p->source.reset(aoo::isource::create(i + 1));
+        p->sink.reset(aoo::isink::create(i + 1));
+        auto fmt = makeFormat(channels, blocksize);
+        p->source->set_format(fmt.header);
+        p->source->setup(samplerate, blocksize, channels);
+        p->source->set_buffersize(100);
+        p->sink->setup(samplerate, blocksize, channels);
+        p->sink->set_buffersize(20);
+        p->link.toSink.tap = countData;
+        p->link.connect(p->source.get(), i + 1, p->sink.get(), i + 1);
+        p->source->start();
+        pairs.push_back(std::move(p));
+    }
+
+    std::atomic<bool> quit { false };
+    Stats sourceStats, sinkStats;
+
+    std::thread audio([&]() {
+        std::vector<float> in(blocksize * channels), out(blocksize * channels);
+        std::vector<const aoo_sample *> inptr(channels);
+        std::vector<aoo_sample *> outptr(channels);
+        for (int c = 0; c < channels; ++c) {
+            inptr[c] = in.data() + c * blocksize;
+            outptr[c] = out.data() + c * blocksize;
+        }
+        const auto period = std::chrono::duration<double>((double) blocksize / samplerate);
+        auto next = std::chrono::steady_clock::now();
+        int block = 0;
+        while (!quit.load()) {
+            for (int i = 0; i < blocksize * channels; ++i) {
+                in[i] = (float) ((block * blocksize + i) % 1000) / 1000.f;
+            }
+            for (auto & p : pairs) {
+                auto t = aoo_osctime_get();
+                double t0 = nowSeconds();
+                p->source->process(inptr.data(), blocksize, t);
+                double t1 = nowSeconds();
+                p->sink->process(outptr.data(), blocksize, t);
+                double t2 = nowSeconds();
+                sourceStats.times.push_back((t1 - t0) * 1e6);
+                sinkStats.times.push_back((t2 - t1) * 1e6);
+            }
+            ++block;
+            next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+            std::this_thread::sleep_until(next);
+        }
+    });
+
+    std::thread network([&]() {
+        while (!quit.load()) {
+            for (auto & p : pairs) {
+                while (p->source->send()) {}
+                while (p->sink->send()) {}
+                p->link.deliver();
+                p->sink->handle_events(handleSinkEvents, nullptr);
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+    });
+
+    int changes = 0;
+    const double start = nowSeconds();
+    while (nowSeconds() - start < seconds) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        auto & p = pairs[changes % pairs.size()];
+        switch (changes % 4) {
+        case 0:
+            p->sink->set_buffersize((changes / 4) % 2 ? 20 : 40);
+            break;
+        case 1:
+            p->source->set_resend_buffersize((changes / 4) % 2 ? 1000 : 30000);
+            break;
+        case 2:
+        {
+            // a new stream with the same format
+            p->source->stop();
+            p->source->start();
+            break;
+        }
+        case 3:
+        {
+            auto fmt = makeFormat(channels, (changes / 4) % 2 ? blocksize : blocksize * 2);
+            p->source->set_format(fmt.header);
+            break;
+        }
+        }
+        ++changes;
+    }
+
+    quit = true;
+    audio.join();
+    network.join();
+
+    std::printf("%d pairs, %d ch, blocksize %d, %d changes in %g s\n",
+                npairs, channels, blocksize, changes, seconds);
+    sourceStats.print("source process");
+    sinkStats.print("sink process");
+    std::printf("blocks sent %d, empty %d, lost at the sinks %d\n",
+                counts.blocks.load(), counts.empty.load(), counts.lost.load());
+
+    return 0;
+}
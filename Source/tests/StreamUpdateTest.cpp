@@ -0,0 +1,296 @@
+// Tests how sources and sinks handle updates while audio is running.
+//
+// - a source which can't take its update lock in process() must not send
+//   an empty block in its place, every sink would reset its stream for it.
+// - a sink must keep its decoder when a source restarts its stream with
+//   the same format, and only create a new one when the format changes.
+
+#include "TestUtils.h"
+#include "Loopback.h"
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+#include "src/common.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define COUNT_CODEC "count"
+
+namespace {
+
+const int blocksize = 64;
+const int samplerate = 48000;
+
+//------------------- a float codec which counts its decoders ----------------//
+
+std::atomic<int> decoderCount { 0 };
+
+struct CountCodec {
+    aoo_format format {};
+};
+
+void * countNew() { return new CountCodec; }
+
+void * countDecoderNew() { ++decoderCount; return new CountCodec; }
+
+void countFree(void * x) { delete static_cast<CountCodec *>(x); }
+
+int32_t countSetFormat(void * x, aoo_format * f)
+{
+    if (strcmp(f->codec, COUNT_CODEC)) return 0;
+    auto c = static_cast<CountCodec *>(x);
+    c->format = *f;
+    c->format.codec = COUNT_CODEC;
+    return 1;
+}
+
+int32_t countGetFormat(void * x, aoo_format_storage * f)
+{
+    auto c = static_cast<CountCodec *>(x);
+    if (!c->format.codec) return 0;
+    f->header = c->format;
+    return sizeof(aoo_format);
+}
+
+int32_t countWriteFormat(void * x, aoo_format * f, char *, int32_t)
+{
+    if (x) *f = static_cast<CountCodec *>(x)->format;
+    return 0;
+}
+
+int32_t countReadFormat(void * x, aoo_format * f, const char *, int32_t)
+{
+    return countSetFormat(x, f) ? 0 : -1;
+}
+
+int32_t countEncode(void *, const aoo_sample * s, int32_t n, char * buf, int32_t size)
+{
+    if (size < n * (int32_t) sizeof(float)) return 0;
+    memcpy(buf, s, n * sizeof(float));
+    return n * sizeof(float);
+}
+
+int32_t countDecode(void *, const char * buf, int32_t size, aoo_sample * s, int32_t n)
+{
+    if (!buf) {
+        std::fill(s, s + n, 0.f);
+        return n;
+    }
+    n = std::min<int32_t>(n, size / sizeof(float));
+    memcpy(s, buf, n * sizeof(float));
+    return n;
+}
+
+int32_t countReset(void *) { return 1; }
+
+const aoo_codec countCodec = {
+    COUNT_CODEC,
+    countNew, countFree, countSetFormat, countGetFormat, countReadFormat, countWriteFormat,
+    countEncode, countReset,
+    countDecoderNew, countFree, countSetFormat, countGetFormat, countReadFormat,
+    countDecode, countReset,
+    nullptr,
+    nullptr
+};
+
+//------------------------------------------------------------------------//
+
+struct SinkEvents {
+    int lost = 0;
+    int gaps = 0;
+    int formats = 0;
+};
+
+int32_t handleSinkEvents(void * user, const aoo_event ** events, int32_t n)
+{
+    auto counts = static_cast<SinkEvents *>(user);
+    for (int i = 0; i < n; ++i) {
+        switch (events[i]->type) {
+        case AOO_BLOCK_LOST_EVENT:
+            counts->lost += reinterpret_cast<const aoo_block_lost_event *>(events[i])->count;
+            break;
+        case AOO_BLOCK_GAP_EVENT: ++counts->gaps; break;
+        case AOO_SOURCE_FORMAT_EVENT: ++counts->formats; break;
+        default: break;
+        }
+    }
+    return 1;
+}
+
+struct Pair {
+    aoo::isource::pointer source;
+    aoo::isink::pointer sink;
+    Link link;
+    SinkEvents events;
+    int block = 0;
+    float output[blocksize];
+
+    void setup(const aoo_format & fmt)
+    {
+        source.reset(aoo::isource::create(1));
+        sink.reset(aoo::isink::create(1));
+        source->set_format(const_cast<aoo_format &>(fmt));
+        source->setup(samplerate, blocksize, 1);
+        source->set_buffersize(100);
+        source->set_dynamic_resampling(0);
+        sink->setup(samplerate, blocksize, 1);
+        sink->set_buffersize(20);
+        sink->set_dynamic_resampling(0);
+        link.connect(source.get(), 1, sink.get(), 1);
+        source->start();
+    }
+
+    // one block of a ramp, so that every block is different
+    void run(int nblocks)
+    {
+        for (int b = 0; b < nblocks; ++b, ++block) {
+            float buf[blocksize];
+            for (int i = 0; i < blocksize; ++i) {
+                buf[i] = (float) ((block * blocksize + i) % 1000) / 1000.f;
+            }
+            const aoo_sample * in[1] = { buf };
+            source->process(in, blocksize, aoo_osctime_get());
+            while (source->send()) {}
+            link.deliver();
+            aoo_sample * out[1] = { output };
+            sink->process(out, blocksize, aoo_osctime_get());
+            while (sink->send()) {}
+            link.deliver();
+            sink->handle_events(handleSinkEvents, &events);
+        }
+    }
+};
+
+// watches the data messages going to the sink
+struct DataTap {
+    int blocks = 0;
+    int empty = 0;
+    int gaps = 0; // sequence numbers which were skipped
+    int repeated = 0;
+    int32_t lastseq = -1;
+    int32_t lastsalt = 0;
+    std::vector<char> lastdata;
+
+    bool operator()(const char * data, int32_t n)
+    {
+        int32_t src, salt;
+        aoo::data_packet d;
+        if (n > 10 && !memcmp(data, "/aoo/sink/", 10) && strstr(data, "/data")
+            && aoo::parse_data_message(data, n, src, salt, d)) {
+            if (salt != lastsalt) {
+                lastseq = -1; // new stream
+                lastsalt = salt;
+            }
+            if (lastseq >= 0 && d.sequence != lastseq + 1) {
+                gaps += d.sequence - lastseq - 1;
+            }
+            lastseq = d.sequence;
+            ++blocks;
+            if (d.totalsize == 0) {
+                ++empty;
+            } else if ((int32_t) lastdata.size() == d.size && !memcmp(lastdata.data(), d.data, d.size)) {
+                ++repeated;
+            }
+            lastdata.assign(d.data, d.data + d.size);
+        }
+        return true;
+    }
+};
+
+aoo_format_pcm makePcmFormat()
+{
+    aoo_format_pcm fmt {};
+    fmt.header.codec = AOO_CODEC_PCM;
+    fmt.header.nchannels = 1;
+    fmt.header.samplerate = samplerate;
+    fmt.header.blocksize = blocksize;
+    fmt.bitdepth = AOO_PCM_FLOAT32;
+    return fmt;
+}
+
+// another thread keeps resizing the resend buffer, which takes the source's
+// update lock without starting a new stream. The sink must get every block.
+void testUpdateLockContention()
+{
+    Pair pair;
+    auto fmt = makePcmFormat();
+    pair.setup(fmt.header);
+
+    DataTap tap;
+    pair.link.toSink.tap = std::ref(tap);
+
+    pair.run(50); // get the stream going
+
+    std::atomic<bool> quit { false };
+    std::thread writer([&]() {
+        bool big = false;
+        while (!quit.load()) {
+            // a long buffer takes a while to allocate
+            pair.source->set_resend_buffersize(big ? 60000 : 100);
+            big = !big;
+        }
+    });
+
+    // until process() had to give up on the lock a few times
+    const double start = nowSeconds();
+    while (tap.repeated + tap.empty < 5 && nowSeconds() - start < 10) {
+        pair.run(100);
+    }
+    quit = true;
+    writer.join();
+    pair.run(50);
+
+    std::printf("contention: %d blocks, %d repeated, %d empty\n", tap.blocks, tap.repeated, tap.empty);
+    CHECK(tap.blocks == pair.block);
+    CHECK(tap.empty == 0);
+    CHECK(tap.gaps == 0);
+    CHECK(pair.events.lost == 0);
+}
+
+// restarting the stream with the same format keeps the decoder,
+// a different format replaces it
+void testFormatKeepsDecoder()
+{
+    aoo_format fmt { COUNT_CODEC, 1, samplerate, blocksize };
+    Pair pair;
+    pair.setup(fmt);
+
+    decoderCount = 0;
+    pair.run(100);
+    CHECK(decoderCount == 1);
+    CHECK(pair.events.formats == 1);
+
+    // new stream (new salt), same format
+    pair.source->stop();
+    pair.source->start();
+    pair.run(100);
+    CHECK(decoderCount == 1);
+    CHECK(pair.events.formats == 2);
+
+    // the audio still gets through
+    float sum = 0;
+    for (auto s : pair.output) sum += std::abs(s);
+    CHECK(sum > 0);
+
+    // different format
+    aoo_format fmt2 { COUNT_CODEC, 1, samplerate, blocksize * 2 };
+    pair.source->set_format(fmt2);
+    pair.run(100);
+    CHECK(decoderCount == 2);
+    CHECK(pair.events.formats == 3);
+}
+
+} // namespace
+
+int main()
+{
+    aoo_initialize();
+    aoo_register_codec(COUNT_CODEC, &countCodec);
+
+    testUpdateLockContention();
+    testFormatKeepsDecoder();
+
+    return testResult("test-stream-update");
+}
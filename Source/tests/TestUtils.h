@@ -0,0 +1,74 @@
+// Helpers shared by the test and benchmark executables.
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+
+// A failed check prints its location and makes testResult() return 1,
+// the test carries on so that one run shows all failures.
+static int testFailures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        ++testFailures; \
+    } \
+} while (0)
+
+#define CHECK_NEAR(a, b, eps) do { \
+    double va_ = (a), vb_ = (b); \
+    if (!(va_ >= vb_ - (eps) && va_ <= vb_ + (eps))) { \
+        std::fprintf(stderr, "%s:%d: check failed: %s (%g) == %s (%g) +- %g\n", \
+                     __FILE__, __LINE__, #a, va_, #b, vb_, (double)(eps)); \
+        ++testFailures; \
+    } \
+} while (0)
+
+static inline int testResult(const char * name)
+{
+    if (testFailures) {
+        std::fprintf(stderr, "%s: %d check(s) failed\n", name, testFailures);
+        return 1;
+    }
+    std::printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+static inline double nowSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// CPU time used by the whole process, in seconds
+static inline double processCpuSeconds()
+{
+    return (double) std::clock() / CLOCKS_PER_SEC;
+}
+
+// returns the value of "--name value" or "--name=value", or def
+static inline const char * getArg(int argc, char ** argv, const char * name, const char * def)
+{
+    const size_t len = std::strlen(name);
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--", 2) == 0 && std::strncmp(argv[i] + 2, name, len) == 0) {
+            const char * rest = argv[i] + 2 + len;
+            if (*rest == '=') return rest + 1;
+            if (*rest == 0 && i + 1 < argc) return argv[i + 1];
+        }
+    }
+    return def;
+}
+
+static inline bool hasFlag(int argc, char ** argv, const char * name)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--", 2) == 0 && std::strcmp(argv[i] + 2, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
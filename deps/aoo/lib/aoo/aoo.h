@@ -52,6 +52,19 @@ extern "C"
  #define AOO_SINK_BUFSIZE 100
 #endif
 
+// adaptive sink buffer: default max. deviation from the nominal playback speed
+// (see aoo_opt_adaptive_maxstretch). 1% is a pitch change of about 17 cents,
+// which is hard to hear, but it also means that 100 ms of extra latency take
+// at least 10 seconds to drain.
+#ifndef AOO_ADAPTIVE_MAXSTRETCH
+ #define AOO_ADAPTIVE_MAXSTRETCH 0.01
+#endif
+
+// adaptive sink buffer: safety margin on top of the measured jitter in ms
+#ifndef AOO_ADAPTIVE_MARGIN
+ #define AOO_ADAPTIVE_MARGIN 2
+#endif
+
 // time DLL filter bandwidth
 #ifndef AOO_TIMEFILTER_BANDWIDTH
 // #define AOO_TIMEFILTER_BANDWIDTH 0.012
@@ -83,6 +96,26 @@ extern "C"
  #define AOO_SEND_REDUNDANCY 1
 #endif
 
+// parity FEC group size (0: off)
+#ifndef AOO_SEND_PARITY
+ #define AOO_SEND_PARITY 0
+#endif
+
+// max. parity FEC group size
+#define AOO_PARITY_MAXBLOCKS 16
+
+// how long the source's process() may wait in us for the update lock
+// before it gives up and has the previous block repeated instead
+#ifndef AOO_SOURCE_LOCK_WAIT
+ #define AOO_SOURCE_LOCK_WAIT 200
+#endif
+
+// number of recent blocks a shared encoder keeps for members
+// which lag behind (see aoo_opt_encode_group)
+#ifndef AOO_SHARED_ENCODER_HISTORY
+ #define AOO_SHARED_ENCODER_HISTORY 8
+#endif
+
 // max. number of resend attempts per packet
 #ifndef AOO_RESEND_LIMIT
  #define AOO_RESEND_LIMIT 5
@@ -98,6 +131,25 @@ extern "C"
  #define AOO_RESEND_MAXNUMFRAMES 16
 #endif
 
+// how the sink deals with blocks that are lost for good
+#define AOO_LOSS_CONCEAL_NONE 0 // replace with silence and fade in afterwards
+#define AOO_LOSS_CONCEAL_PLC 1 // let the codec conceal the missing block
+#define AOO_LOSS_CONCEAL_FEC 2 // try in-band FEC of the following block first, then PLC
+
+#ifndef AOO_LOSS_CONCEALMENT
+ #define AOO_LOSS_CONCEALMENT AOO_LOSS_CONCEAL_PLC
+#endif
+
+// resampler interpolation quality
+#define AOO_RESAMPLE_LINEAR 0 // 2-point linear (cheapest)
+#define AOO_RESAMPLE_CUBIC 1 // 4-point Hermite
+#define AOO_RESAMPLE_SINC_SHORT 2 // 8-tap windowed sinc
+#define AOO_RESAMPLE_SINC_LONG 3 // 32-tap windowed sinc
+
+#ifndef AOO_RESAMPLE_QUALITY
+ #define AOO_RESAMPLE_QUALITY AOO_RESAMPLE_LINEAR
+#endif
+
 // initialize AoO library - call only once!
 AOO_API void aoo_initialize(void);
 
@@ -118,6 +170,8 @@ AOO_API void aoo_terminate(void);
 #define AOO_MSG_DATA_LEN 5
 #define AOO_MSG_PING "/ping"
 #define AOO_MSG_PING_LEN 5
+#define AOO_MSG_PARITY "/parity"
+#define AOO_MSG_PARITY_LEN 7
 #define AOO_MSG_INVITE "/invite"
 #define AOO_MSG_INVITE_LEN 7
 #define AOO_MSG_UNINVITE "/uninvite"
@@ -358,7 +412,91 @@ typedef enum aoo_option
     // For sources, send an optional userformat blob along with the format messages
     // ---
     // Could be used for any purpose (channel layouts, labels, etc)
-    aoo_opt_userformat
+    aoo_opt_userformat,
+    // Loss concealment mode (int32_t)
+    // ---
+    // What the sink does with a block that didn't arrive in time
+    // and won't be resent anymore, see AOO_LOSS_CONCEAL_*.
+    // AOO_LOSS_CONCEAL_FEC only helps if the source encodes with
+    // in-band FEC (e.g. Opus with 'packet_loss' > 0), otherwise
+    // it behaves like AOO_LOSS_CONCEAL_PLC.
+    aoo_opt_loss_concealment,
+    // Parity FEC group size (int32_t)
+    // ---
+    // If > 1, the source sends an extra XOR parity packet after
+    // every N consecutive single-frame blocks. A sink can use it to
+    // rebuild one lost block of the group right away, without waiting
+    // for a resend. Costs 1/N extra bandwidth, compared to 100% for
+    // each step of redundancy. 0 or 1 = off (default),
+    // max. AOO_PARITY_MAXBLOCKS.
+    aoo_opt_parity,
+    // Encode group (int32_t)
+    // ---
+    // Sources with the same (non-zero) encode group and the same format
+    // share a single encoder: each block is encoded once and every member
+    // sends the output of the same encoder stream. A source whose audio
+    // differs from the group's continues with its own encoder, starting
+    // from a copy of the shared encoder state; it can only join again
+    // at the start of a new stream. Needs a codec which can copy its
+    // encoder state (encoder_copystate), otherwise the option has no
+    // effect. Useful when many sources send an identical mix. 0 = off (default)
+    aoo_opt_encode_group,
+    // Non-blocking process (int32_t)
+    // ---
+    // The sink always decodes on the network thread (aoo_sink_handle_message())
+    // and aoo_sink_process() only reads the decoded samples from a lockfree queue.
+    // If enabled, aoo_sink_process() also never waits for a source which
+    // is being reconfigured on another thread (format change, buffer resize),
+    // the source is simply skipped for that block. Off by default.
+    aoo_opt_nonblocking_process,
+    // Resample quality (int32_t)
+    // ---
+    // The interpolation used when converting between the local
+    // and the stream samplerate, see AOO_RESAMPLE_*. The higher
+    // presets sound cleaner (less aliasing and high frequency loss)
+    // but cost more CPU and add a few samples of latency.
+    // Changing it doesn't interrupt the stream.
+    aoo_opt_resample_quality,
+    // Data packet counters (aoo_packet_counters)
+    // ---
+    // This is a read-only option used for sink::get_sourceoption().
+    // 'fastpath' counts the packets which arrived as complete
+    // single-frame blocks in the expected order; they are decoded
+    // straight from the receive buffer without going through the
+    // block queue.
+    aoo_opt_packet_counters,
+    // Adaptive buffer (int32_t)
+    // ---
+    // If enabled, the sink measures the arrival jitter of each source
+    // and plays it back slightly faster or slower (see aoo_opt_adaptive_maxstretch)
+    // to keep the buffer fill level at the lowest safe value, instead of
+    // always keeping the buffer full. The buffer size option then only
+    // sets the upper limit. Off by default.
+    aoo_opt_adaptive_buffer,
+    // Jitter statistics (aoo_jitter_stats)
+    // ---
+    // This is a read-only option used for sink::get_sourceoption().
+    // The sink timestamps every incoming block and keeps a histogram
+    // of how late it arrived compared to its nominal send time, together
+    // with burst, reorder and loss statistics. Older measurements are
+    // gradually aged out (see AOO_JITTER_HISTOGRAM_AGE); everything is
+    // reset when the source format or buffer size changes.
+    aoo_opt_jitter_stats,
+    // Event notification (aoo_event_notify)
+    // ---
+    // If set, 'fn' is called with 'user' whenever a new event has been
+    // queued, so the application can wake up its event thread instead of
+    // polling events_available(). It runs on whichever thread produced the
+    // event (network, audio or send thread), so it must be cheap and must
+    // not call back into the object. Set it before other threads use the object.
+    aoo_opt_event_notify,
+    // Adaptive buffer max. stretch (float)
+    // ---
+    // The max. relative deviation from the nominal playback speed while
+    // the adaptive buffer moves the fill level, between 0.001 and 0.1
+    // (default: AOO_ADAPTIVE_MAXSTRETCH). Larger values reach the target
+    // latency faster, at the cost of an audible pitch change while doing so.
+    aoo_opt_adaptive_maxstretch
 } aoo_option;
 
 #define AOO_ARG(x) &x, sizeof(x)
@@ -389,6 +527,50 @@ typedef struct aoo_format_storage
     char data[256];
 } aoo_format_storage;
 
+typedef struct aoo_packet_counters
+{
+    int64_t received; // all data packets
+    int64_t fastpath; // packets which took the fast path
+} aoo_packet_counters;
+
+// number of histogram bins; the last bin also collects
+// everything which doesn't fit into the histogram.
+#ifndef AOO_JITTER_HISTOGRAM_SIZE
+ #define AOO_JITTER_HISTOGRAM_SIZE 128
+#endif
+
+// histogram bin width in ms
+#ifndef AOO_JITTER_HISTOGRAM_BINWIDTH
+ #define AOO_JITTER_HISTOGRAM_BINWIDTH 0.5
+#endif
+
+// halve all histogram bins once they hold more than this
+// number of blocks, so that the statistics follow changes
+// of the network conditions.
+#ifndef AOO_JITTER_HISTOGRAM_AGE
+ #define AOO_JITTER_HISTOGRAM_AGE 8192
+#endif
+
+typedef struct aoo_jitter_stats
+{
+    // arrival lateness of blocks compared to their nominal send time
+    int32_t histogram[AOO_JITTER_HISTOGRAM_SIZE];
+    float binwidth; // histogram bin width in ms
+    int32_t count; // (aged) number of blocks in the histogram
+    float p50; // lateness percentiles in ms
+    float p95;
+    float p99;
+    float max; // max. lateness in ms
+    float jitter; // current (decaying) peak lateness in ms
+    float max_interval; // longest time between two blocks in ms
+    // number of blocks which arrived (almost) at the same time,
+    // typically caused by scheduling jitter on the sender side.
+    int32_t max_burst;
+    int32_t max_reorder; // max. reorder depth in blocks
+    int32_t max_lossrun; // max. number of consecutive lost blocks
+    int32_t lossruns; // number of loss runs
+} aoo_jitter_stats;
+
 // create a new AoO source instance
 AOO_API aoo_source * aoo_source_new(int32_t id);
 
@@ -515,6 +697,35 @@ static inline int32_t aoo_source_get_redundancy(aoo_source *src, int32_t *n) {
     return aoo_source_get_option(src, aoo_opt_redundancy, AOO_ARG(*n));
 }
 
+static inline int32_t aoo_source_set_parity(aoo_source *src, int32_t n) {
+    return aoo_source_set_option(src, aoo_opt_parity, AOO_ARG(n));
+}
+
+static inline int32_t aoo_source_get_parity(aoo_source *src, int32_t *n) {
+    return aoo_source_get_option(src, aoo_opt_parity, AOO_ARG(*n));
+}
+
+static inline int32_t aoo_source_set_encode_group(aoo_source *src, int32_t n) {
+    return aoo_source_set_option(src, aoo_opt_encode_group, AOO_ARG(n));
+}
+
+static inline int32_t aoo_source_get_encode_group(aoo_source *src, int32_t *n) {
+    return aoo_source_get_option(src, aoo_opt_encode_group, AOO_ARG(*n));
+}
+
+static inline int32_t aoo_source_set_event_notify(aoo_source *src, aoo_notifyfn fn, void *user) {
+    aoo_event_notify n = { fn, user };
+    return aoo_source_set_option(src, aoo_opt_event_notify, AOO_ARG(n));
+}
+
+static inline int32_t aoo_source_set_resample_quality(aoo_source *src, int32_t q) {
+    return aoo_source_set_option(src, aoo_opt_resample_quality, AOO_ARG(q));
+}
+
+static inline int32_t aoo_source_get_resample_quality(aoo_source *src, int32_t *q) {
+    return aoo_source_get_option(src, aoo_opt_resample_quality, AOO_ARG(*q));
+}
+
 static inline int32_t aoo_source_set_sink_channelonset(aoo_source *src, void *endpoint, int32_t id, int32_t onset) {
     return aoo_source_set_sinkoption(src, endpoint, id, aoo_opt_channelonset, AOO_ARG(onset));
 }
@@ -557,6 +768,28 @@ AOO_API int32_t aoo_sink_uninvite_all(aoo_sink *sink);
 AOO_API int32_t aoo_sink_handle_message(aoo_sink *sink, const char *data, int32_t n,
                                         void *src, aoo_replyfn fn);
 
+// a compact data message, as parsed by aoo_sink_find_compact()
+typedef struct aoo_compact_data
+{
+    void *source; // the source (looked up by salt), opaque
+    int32_t salt;
+    int32_t sequence;
+    double samplerate; // 0: same as the last block
+    const char *data;
+    int32_t size;
+} aoo_compact_data;
+
+// find the sink which receives the stream a compact data message belongs to,
+// by looking up its salt. returns NULL if no sink knows about it (yet). (always threadsafe)
+// on success, 'msg' holds the parsed message, which can be passed on to
+// aoo_sink_handle_compact(), so it doesn't have to be parsed and looked up again.
+AOO_API aoo_sink * aoo_sink_find_compact(const char *data, int32_t n, void *endpoint,
+                                         aoo_compact_data *msg);
+
+// handle a compact data message returned by aoo_sink_find_compact()
+// (threadsafe, but not reentrant)
+AOO_API int32_t aoo_sink_handle_compact(aoo_sink *sink, const aoo_compact_data *msg);
+
 // send outgoing messages - will call the reply function (threadsafe, but not reentrant)
 AOO_API int32_t aoo_sink_send(aoo_sink *sink);
 
@@ -645,6 +878,51 @@ static inline int32_t aoo_sink_get_resend_maxnumframes(aoo_sink *sink, int32_t *
     return aoo_sink_get_option(sink, aoo_opt_resend_maxnumframes, AOO_ARG(*n));
 }
 
+static inline int32_t aoo_sink_set_loss_concealment(aoo_sink *sink, int32_t mode) {
+    return aoo_sink_set_option(sink, aoo_opt_loss_concealment, AOO_ARG(mode));
+}
+
+static inline int32_t aoo_sink_get_loss_concealment(aoo_sink *sink, int32_t *mode) {
+    return aoo_sink_get_option(sink, aoo_opt_loss_concealment, AOO_ARG(*mode));
+}
+
+static inline int32_t aoo_sink_set_nonblocking_process(aoo_sink *sink, int32_t b) {
+    return aoo_sink_set_option(sink, aoo_opt_nonblocking_process, AOO_ARG(b));
+}
+
+static inline int32_t aoo_sink_get_nonblocking_process(aoo_sink *sink, int32_t *b) {
+    return aoo_sink_get_option(sink, aoo_opt_nonblocking_process, AOO_ARG(*b));
+}
+
+static inline int32_t aoo_sink_set_event_notify(aoo_sink *sink, aoo_notifyfn fn, void *user) {
+    aoo_event_notify n = { fn, user };
+    return aoo_sink_set_option(sink, aoo_opt_event_notify, AOO_ARG(n));
+}
+
+static inline int32_t aoo_sink_set_adaptive_buffer(aoo_sink *sink, int32_t b) {
+    return aoo_sink_set_option(sink, aoo_opt_adaptive_buffer, AOO_ARG(b));
+}
+
+static inline int32_t aoo_sink_get_adaptive_buffer(aoo_sink *sink, int32_t *b) {
+    return aoo_sink_get_option(sink, aoo_opt_adaptive_buffer, AOO_ARG(*b));
+}
+
+static inline int32_t aoo_sink_set_adaptive_maxstretch(aoo_sink *sink, float f) {
+    return aoo_sink_set_option(sink, aoo_opt_adaptive_maxstretch, AOO_ARG(f));
+}
+
+static inline int32_t aoo_sink_get_adaptive_maxstretch(aoo_sink *sink, float *f) {
+    return aoo_sink_get_option(sink, aoo_opt_adaptive_maxstretch, AOO_ARG(*f));
+}
+
+static inline int32_t aoo_sink_set_resample_quality(aoo_sink *sink, int32_t q) {
+    return aoo_sink_set_option(sink, aoo_opt_resample_quality, AOO_ARG(q));
+}
+
+static inline int32_t aoo_sink_get_resample_quality(aoo_sink *sink, int32_t *q) {
+    return aoo_sink_get_option(sink, aoo_opt_resample_quality, AOO_ARG(*q));
+}
+
 static inline int32_t aoo_sink_reset_source(aoo_sink *sink, void *endpoint, int32_t id) {
     return aoo_sink_set_sourceoption(sink, endpoint, id, aoo_opt_reset, AOO_ARG_NULL);
 }
@@ -653,6 +931,14 @@ static inline int32_t aoo_sink_get_source_format(aoo_sink *sink, void *endpoint,
     return aoo_sink_get_sourceoption(sink, endpoint, id, aoo_opt_format, AOO_ARG(*f));
 }
 
+static inline int32_t aoo_sink_get_source_packet_counters(aoo_sink *sink, void *endpoint, int32_t id, aoo_packet_counters *c) {
+    return aoo_sink_get_sourceoption(sink, endpoint, id, aoo_opt_packet_counters, AOO_ARG(*c));
+}
+
+static inline int32_t aoo_sink_get_source_jitter_stats(aoo_sink *sink, void *endpoint, int32_t id, aoo_jitter_stats *s) {
+    return aoo_sink_get_sourceoption(sink, endpoint, id, aoo_opt_jitter_stats, AOO_ARG(*s));
+}
+
 /*//////////////////// Codec API //////////////////////////*/
 
 #define AOO_CODEC_MAXSETTINGSIZE 256
@@ -698,6 +984,11 @@ typedef int32_t (*aoo_codec_decode)(
 
 typedef int32_t (*aoo_codec_reset)(void *) ;
 
+typedef int32_t (*aoo_codec_copystate)(
+        void *,         // the destination instance
+        const void *    // the source instance (with the same format)
+);
+
 
 typedef struct aoo_codec
 {
@@ -719,6 +1010,12 @@ typedef struct aoo_codec
     aoo_codec_readformat decoder_readformat;
     aoo_codec_decode decoder_decode;
     aoo_codec_reset decoder_reset;
+    // optional (may be NULL): decode a lost block from the
+    // in-band FEC data of the block that follows it
+    aoo_codec_decode decoder_decode_fec;
+    // optional (may be NULL): copy the complete state of one encoder
+    // to another encoder with the same format
+    aoo_codec_copystate encoder_copystate;
 } aoo_codec;
 
 // register an external codec plugin
@@ -155,6 +155,35 @@ public:
         return get_option(aoo_opt_redundancy, AOO_ARG(n));
     }
 
+    int32_t set_parity(int32_t n){
+        return set_option(aoo_opt_parity, AOO_ARG(n));
+    }
+
+    int32_t get_parity(int32_t& n){
+        return get_option(aoo_opt_parity, AOO_ARG(n));
+    }
+
+    int32_t set_encode_group(int32_t n){
+        return set_option(aoo_opt_encode_group, AOO_ARG(n));
+    }
+
+    int32_t get_encode_group(int32_t& n){
+        return get_option(aoo_opt_encode_group, AOO_ARG(n));
+    }
+
+    int32_t set_event_notify(aoo_notifyfn fn, void *user){
+        aoo_event_notify n = { fn, user };
+        return set_option(aoo_opt_event_notify, AOO_ARG(n));
+    }
+
+    int32_t set_resample_quality(int32_t q){
+        return set_option(aoo_opt_resample_quality, AOO_ARG(q));
+    }
+
+    int32_t get_resample_quality(int32_t& q){
+        return get_option(aoo_opt_resample_quality, AOO_ARG(q));
+    }
+
     int32_t set_ping_interval(int32_t n){
         return set_option(aoo_opt_ping_interval, AOO_ARG(n));
     }
@@ -237,6 +266,10 @@ public:
     virtual int32_t handle_message(const char *data, int32_t n,
                                    void *endpoint, aoo_replyfn fn) = 0;
 
+    // handle a compact data message returned by aoo_sink_find_compact()
+    // (threadsafe, but not reentrant)
+    virtual int32_t handle_compact(const aoo_compact_data& msg) = 0;
+
     // send outgoing messages - will call the reply function (threadsafe, but not reentrant)
     virtual int32_t send() = 0;
 
@@ -321,6 +354,51 @@ public:
         return get_option(aoo_opt_resend_maxnumframes, AOO_ARG(n));
     }
 
+    int32_t set_loss_concealment(int32_t mode){
+        return set_option(aoo_opt_loss_concealment, AOO_ARG(mode));
+    }
+
+    int32_t get_loss_concealment(int32_t& mode){
+        return get_option(aoo_opt_loss_concealment, AOO_ARG(mode));
+    }
+
+    int32_t set_nonblocking_process(int32_t b){
+        return set_option(aoo_opt_nonblocking_process, AOO_ARG(b));
+    }
+
+    int32_t get_nonblocking_process(int32_t& b){
+        return get_option(aoo_opt_nonblocking_process, AOO_ARG(b));
+    }
+
+    int32_t set_event_notify(aoo_notifyfn fn, void *user){
+        aoo_event_notify n = { fn, user };
+        return set_option(aoo_opt_event_notify, AOO_ARG(n));
+    }
+
+    int32_t set_adaptive_buffer(int32_t b){
+        return set_option(aoo_opt_adaptive_buffer, AOO_ARG(b));
+    }
+
+    int32_t get_adaptive_buffer(int32_t& b){
+        return get_option(aoo_opt_adaptive_buffer, AOO_ARG(b));
+    }
+
+    int32_t set_adaptive_maxstretch(float f){
+        return set_option(aoo_opt_adaptive_maxstretch, AOO_ARG(f));
+    }
+
+    int32_t get_adaptive_maxstretch(float& f){
+        return get_option(aoo_opt_adaptive_maxstretch, AOO_ARG(f));
+    }
+
+    int32_t set_resample_quality(int32_t q){
+        return set_option(aoo_opt_resample_quality, AOO_ARG(q));
+    }
+
+    int32_t get_resample_quality(int32_t& q){
+        return get_option(aoo_opt_resample_quality, AOO_ARG(q));
+    }
+
     virtual int32_t set_option(int32_t opt, void *ptr, int32_t size) = 0;
     virtual int32_t get_option(int32_t opt, void *ptr, int32_t size) = 0;
 
@@ -335,6 +413,14 @@ public:
         return get_sourceoption(endpoint, id, aoo_opt_format, AOO_ARG(f));
     }
 
+    int32_t get_source_packet_counters(void *endpoint, int32_t id, aoo_packet_counters& c){
+        return get_sourceoption(endpoint, id, aoo_opt_packet_counters, AOO_ARG(c));
+    }
+
+    int32_t get_source_jitter_stats(void *endpoint, int32_t id, aoo_jitter_stats& s){
+        return get_sourceoption(endpoint, id, aoo_opt_jitter_stats, AOO_ARG(s));
+    }
+
     virtual int32_t request_source_codec_change(void *endpoint, int32_t id, aoo_format & f) = 0;
     
     virtual int32_t set_sourceoption(void *endpoint, int32_t id,
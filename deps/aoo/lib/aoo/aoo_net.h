@@ -77,6 +77,9 @@ extern "C"
 #define AOONET_MSG_LEAVE "/leave"
 #define AOONET_MSG_LEAVE_LEN 6
 
+#define AOONET_MSG_RELAY "/relay"
+#define AOONET_MSG_RELAY_LEN 6
+
 typedef enum aoonet_type
 {
     AOO_TYPE_SERVER = 1000,
@@ -88,6 +91,39 @@ typedef enum aoonet_type
 // returns 1 on success, 0 on fail
 AOO_API int32_t aoonet_parse_pattern(const char *msg, int32_t n, int32_t *type);
 
+/*///////////////////////// relay //////////////////////////////*/
+
+// If two peers can't reach each other directly (e.g. both are behind
+// symmetric NATs), the server can forward their UDP packets.
+// A relayed packet is the original packet prefixed by a compact binary header:
+//
+//   magic (4 bytes) | family (1 byte) | reserved (1 byte) | port (2 bytes) | address (4 or 16 bytes)
+//
+// 'family' is 4 for IPv4 or 6 for IPv6; port and address are in network byte order.
+// Packets sent to the server carry the public address of the destination peer,
+// packets forwarded by the server carry the public address of the source peer.
+// The magic starts with a zero byte, so it never clashes with OSC messages or bundles.
+//
+// The server only relays for clients which have registered their UDP endpoint:
+// after login, the client sends /aoo/server/relay <token> (the token comes with
+// the login reply) over UDP and the server binds the relay to the address the
+// message came from. It replies with /aoo/client/relay <result> <errmsg>.
+
+#define AOONET_RELAY_MAGIC "\0rly"
+#define AOONET_RELAY_MAGIC_LEN 4
+#define AOONET_RELAY_HEADER_SIZE_IPV4 12
+#define AOONET_RELAY_HEADER_SIZE_IPV6 24
+// max. header size, for reserving buffer space
+#define AOONET_RELAY_HEADER_SIZE AOONET_RELAY_HEADER_SIZE_IPV6
+
+// write a relay header for 'addr' (sockaddr *) to 'buf'.
+// returns the header size on success, 0 on fail
+AOO_API int32_t aoonet_relay_write_header(char *buf, int32_t size, const void *addr);
+
+// check if a packet is relayed. on success, returns the header size
+// and stores the address in 'addr' (which should be sockaddr_storage), otherwise returns 0
+AOO_API int32_t aoonet_relay_parse_header(const char *buf, int32_t size, void *addr, int32_t *len);
+
 /*///////////////////////// AOO events///////////////////////////*/
 
 typedef enum aoonet_event_type
@@ -134,6 +170,8 @@ typedef struct aoonet_server_user_event
 {
     int32_t type;
     const char *name;
+    // IP address of the user's connection (without port)
+    const char *address;
 } aoonet_server_user_event;
 
 typedef struct aoonet_server_group_event
@@ -158,11 +196,33 @@ typedef struct aoonet_client_peer_event
     const char *user;
     void *address;
     int32_t length;
+    // if not NULL, the peer can only be reached through the server relay:
+    // packets to the peer must be prefixed with a relay header and sent to this address.
+    void *relay_address;
+    int32_t relay_length;
 } aoonet_client_peer_event;
 
 
 /*///////////////////////// AOO server /////////////////////////*/
 
+typedef struct aoonet_server_stats
+{
+    int32_t num_clients; // open TCP connections
+    int32_t num_users; // logged in users
+    int32_t num_groups;
+    int64_t tcp_messages; // messages received from clients since startup
+    int64_t udp_messages;
+    int64_t send_queue_bytes; // bytes currently queued for all clients
+    int32_t max_send_queue; // largest queue of a single client since startup
+    int64_t send_blocked; // how often a client socket couldn't take more data
+    int64_t send_overflows; // clients disconnected because they couldn't keep up
+    int32_t relay_sessions; // active relay sessions (source -> destination pairs)
+    int64_t relay_packets; // packets forwarded since startup
+    int64_t relay_bytes;
+    int64_t relay_dropped; // packets dropped because of rate limits or unknown peers
+    int64_t rejected_clients; // connections closed because we ran out of file descriptors
+} aoonet_server_stats;
+
 #ifdef __cplusplus
 namespace aoo {
 namespace net {
@@ -194,6 +254,18 @@ AOO_API int32_t aoonet_server_events_available(aoonet_server *server);
 AOO_API int32_t aoonet_server_handle_events(aoonet_server *server,
                                             aoo_eventhandler fn, void *user);
 
+// get server statistics (always thread safe)
+AOO_API int32_t aoonet_server_get_stats(aoonet_server *server, aoonet_server_stats *stats);
+
+// enable/disable forwarding UDP packets between peers which can't reach each other
+// directly (always thread safe). 'maxrate' limits every relay session (bytes per second),
+// 0 means no limit. Clients learn whether the relay is available when they log in.
+AOO_API int32_t aoonet_server_set_relay(aoonet_server *server, int32_t enable, int32_t maxrate);
+
+// call 'fn' with 'user' whenever a new event has been queued,
+// so it doesn't have to be polled (set it before running the server)
+AOO_API int32_t aoonet_server_set_event_notify(aoonet_server *server, aoo_notifyfn fn, void *user);
+
 // LATER add methods to add/remove users and groups
 // and set/get server options, group options and user options
 
@@ -257,6 +329,10 @@ AOO_API int32_t aoonet_client_events_available(aoonet_client *client);
 AOO_API int32_t aoonet_client_handle_events(aoonet_client *client,
                                             aoo_eventhandler fn, void *user);
 
+// call 'fn' with 'user' whenever a new event has been queued,
+// so it doesn't have to be polled (set it before running the client)
+AOO_API int32_t aoonet_client_set_event_notify(aoonet_client *client, aoo_notifyfn fn, void *user);
+
 // LATER add API functions to set options and do additional peer communication (chat, OSC messages, etc.)
 
 #ifdef __cplusplus
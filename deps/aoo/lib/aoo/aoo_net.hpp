@@ -70,6 +70,15 @@ public:
     // get number of currently active users
     virtual int32_t get_user_count() const = 0;
 
+    // get server statistics (always thread safe)
+    virtual int32_t get_stats(aoonet_server_stats& stats) const = 0;
+
+    // enable/disable the UDP relay (always thread safe)
+    virtual int32_t set_relay(bool enable, int32_t maxrate) = 0;
+
+    // get notified about new events (set before run())
+    virtual int32_t set_event_notify(aoo_notifyfn fn, void *user) = 0;
+
 protected:
     ~iserver(){} // non-virtual!
 };
@@ -137,6 +146,9 @@ public:
     // will call the event handler function one or more times
     virtual int32_t handle_events(aoo_eventhandler fn, void *user) = 0;
 
+    // get notified about new events (set before run())
+    virtual int32_t set_event_notify(aoo_notifyfn fn, void *user) = 0;
+
     // LATER add API functions to set options and do additional peer communication (chat, OSC messages, etc.)
 protected:
     ~iclient(){} // non-virtual!
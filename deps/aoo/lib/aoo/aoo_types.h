@@ -72,6 +72,17 @@ typedef int32_t (*aoo_eventhandler)(
         int32_t n           // number of events
 );
 
+// event notification function
+typedef void (*aoo_notifyfn)(
+        void *              // user
+);
+
+typedef struct aoo_event_notify
+{
+    aoo_notifyfn fn;
+    void *user;
+} aoo_event_notify;
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
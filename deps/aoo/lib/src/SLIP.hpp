@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include <stdint.h>
 
 namespace aoo {
@@ -18,6 +19,12 @@ public:
     int32_t read_available() const { return balance_; }
     int32_t read_bytes(uint8_t *buffer, int32_t size);
 
+    // zero-copy reading: returns the readable bytes up to the end
+    // of the ring buffer; call read_commit() with the number of
+    // bytes actually consumed.
+    const uint8_t * read_data(int32_t& size) const;
+    void read_commit(int32_t size);
+
     int32_t write_available() const { return buffer_.size() - balance_; }
     int32_t write_bytes(const uint8_t *data, int32_t size);
 
@@ -66,6 +73,21 @@ inline int32_t SLIP::read_bytes(uint8_t *buffer, int32_t size){
     return size;
 }
 
+inline const uint8_t * SLIP::read_data(int32_t& size) const {
+    auto capacity = (int32_t)buffer_.size();
+    size = std::min<int32_t>(balance_, capacity - rdhead_);
+    return buffer_.data() + rdhead_;
+}
+
+inline void SLIP::read_commit(int32_t size){
+    auto capacity = (int32_t)buffer_.size();
+    rdhead_ += size;
+    if (rdhead_ >= capacity){
+        rdhead_ -= capacity;
+    }
+    balance_ -= size;
+}
+
 inline int32_t SLIP::write_bytes(const uint8_t *data, int32_t size){
     auto capacity = (int32_t)buffer_.size();
     auto space = capacity - balance_;
@@ -24,6 +24,9 @@
 #define AOONET_MSG_SERVER_REQUEST \
     AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_REQUEST
 
+#define AOONET_MSG_SERVER_RELAY \
+    AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_RELAY
+
 #define AOONET_MSG_SERVER_GROUP_JOIN \
     AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_GROUP AOONET_MSG_JOIN
 
@@ -148,6 +151,70 @@ int32_t aoonet_parse_pattern(const char *msg, int32_t n, int32_t *type)
     }
 }
 
+/*//////////////////// relay //////////////////////////*/
+
+int32_t aoonet_relay_write_header(char *buf, int32_t size, const void *addr)
+{
+    auto sa = static_cast<const struct sockaddr *>(addr);
+    if (!sa){
+        return 0;
+    }
+    // address and port are already in network byte order
+    if (sa->sa_family == AF_INET && size >= AOONET_RELAY_HEADER_SIZE_IPV4){
+        auto sin = static_cast<const struct sockaddr_in *>(addr);
+        memcpy(buf, AOONET_RELAY_MAGIC, AOONET_RELAY_MAGIC_LEN);
+        buf[4] = 4;
+        buf[5] = 0;
+        memcpy(buf + 6, &sin->sin_port, 2);
+        memcpy(buf + 8, &sin->sin_addr, 4);
+        return AOONET_RELAY_HEADER_SIZE_IPV4;
+    } else if (sa->sa_family == AF_INET6 && size >= AOONET_RELAY_HEADER_SIZE_IPV6){
+        auto sin6 = static_cast<const struct sockaddr_in6 *>(addr);
+        memcpy(buf, AOONET_RELAY_MAGIC, AOONET_RELAY_MAGIC_LEN);
+        buf[4] = 6;
+        buf[5] = 0;
+        memcpy(buf + 6, &sin6->sin6_port, 2);
+        memcpy(buf + 8, &sin6->sin6_addr, 16);
+        return AOONET_RELAY_HEADER_SIZE_IPV6;
+    } else {
+        return 0;
+    }
+}
+
+int32_t aoonet_relay_parse_header(const char *buf, int32_t size, void *addr, int32_t *len)
+{
+    if (size < AOONET_RELAY_HEADER_SIZE_IPV4
+        || memcmp(buf, AOONET_RELAY_MAGIC, AOONET_RELAY_MAGIC_LEN))
+    {
+        return 0;
+    }
+    if (buf[4] == 4){
+        struct sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        memcpy(&sa.sin_port, buf + 6, 2);
+        memcpy(&sa.sin_addr, buf + 8, 4);
+        memcpy(addr, &sa, sizeof(sa));
+        if (len){
+            *len = sizeof(sa);
+        }
+        return AOONET_RELAY_HEADER_SIZE_IPV4;
+    } else if (buf[4] == 6 && size >= AOONET_RELAY_HEADER_SIZE_IPV6){
+        struct sockaddr_in6 sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin6_family = AF_INET6;
+        memcpy(&sa.sin6_port, buf + 6, 2);
+        memcpy(&sa.sin6_addr, buf + 8, 16);
+        memcpy(addr, &sa, sizeof(sa));
+        if (len){
+            *len = sizeof(sa);
+        }
+        return AOONET_RELAY_HEADER_SIZE_IPV6;
+    } else {
+        return 0;
+    }
+}
+
 /*//////////////////// AoO client /////////////////////*/
 
 aoonet_client * aoonet_client_new(void *udpsocket, aoo_sendfn fn, int port) {
@@ -351,9 +418,30 @@ int32_t aoonet_client_handle_message(aoonet_client *client, const char *data,
 }
 
 int32_t aoo::net::client::handle_message(const char *data, int32_t n, void *addr){
-    if (static_cast<struct sockaddr *>(addr)->sa_family != AF_INET){
+    auto sa = static_cast<struct sockaddr *>(addr);
+    if (sa->sa_family != AF_INET && sa->sa_family != AF_INET6){
         return 0;
     }
+    ip_address address(sa, sa->sa_family == AF_INET6 ?
+                           sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+
+    // peer message forwarded by the server relay
+    bool relayed = false;
+    if (n >= AOONET_RELAY_MAGIC_LEN && !memcmp(data, AOONET_RELAY_MAGIC, AOONET_RELAY_MAGIC_LEN)){
+        int32_t len = 0;
+        int32_t onset = 0;
+        if (!(address == remote_addr_) ||
+            !(onset = aoonet_relay_parse_header(data, n, &address.address, &len)))
+        {
+            LOG_WARNING("aoo_client: bad relay packet");
+            return 0;
+        }
+        address.length = len;
+        data += onset;
+        n -= onset;
+        relayed = true;
+    }
+
     try {
         osc::ReceivedPacket packet(data, n);
         osc::ReceivedMessage msg(packet);
@@ -365,12 +453,10 @@ int32_t aoo::net::client::handle_message(const char *data, int32_t n, void *addr
             return 0;
         }
 
-        ip_address address((struct sockaddr *)addr, sizeof(sockaddr_in)); // FIXME
-
         LOG_DEBUG("aoo_client: handle UDP message " << msg.AddressPattern()
             << " from " << address.name() << ":" << address.port());
 
-        if (address == remote_addr_){
+        if (!relayed && address == remote_addr_){
             // server message
             if (type != AOO_TYPE_CLIENT){
                 LOG_WARNING("aoo_client: not a server message!");
@@ -401,9 +487,9 @@ int32_t aoo::net::client::handle_message(const char *data, int32_t n, void *addr
                         
                 for (auto& p : peers_){
                     if (p->match(address)){
-                        p->handle_message(msg, onset, address);
+                        p->handle_message(msg, onset, address, relayed);
                         success = true;
-                    } else if (!p->has_real_address() && token > 0 && p->match_token(token)) {
+                    } else if (!relayed && !p->has_real_address() && token > 0 && p->match_token(token)) {
                         // this message doesn't match one of the addresses given by the server for this peer
                         // but it DOES match the random token for the peer, which means we might be dealing
                         // with a symmetric NAT for that peer. so we will assign the address here as the *real* address
@@ -470,8 +556,21 @@ int32_t aoo::net::client::send(){
                 last_udp_ping_time_ = elapsed_time;
             }
         } else if (state == client_state::connected){
-            // send regular pings
-            if (delta >= ping_interval()){
+            auto relay_token = relay_token_.load();
+            if (relay_token && !relay_available_.load()){
+                // register for the relay, so that the server learns our
+                // actual UDP endpoint; repeat until it replies.
+                if (delta >= request_interval()){
+                    char buf[64];
+                    osc::OutboundPacketStream msg(buf, sizeof(buf));
+                    msg << osc::BeginMessage(AOONET_MSG_SERVER_RELAY)
+                        << (osc::int64)relay_token << osc::EndMessage;
+
+                    send_server_message_udp(msg.Data(), (int32_t) msg.Size());
+                    last_udp_ping_time_ = elapsed_time;
+                }
+            } else if (delta >= ping_interval()){
+                // send regular pings
                 char buf[64];
                 osc::OutboundPacketStream msg(buf, sizeof(buf));
                 msg << osc::BeginMessage(AOONET_MSG_SERVER_PING)
@@ -502,6 +601,16 @@ int32_t aoo::net::client::events_available(){
     return 1;
 }
 
+int32_t aoonet_client_set_event_notify(aoonet_client *client, aoo_notifyfn fn, void *user){
+    return client->set_event_notify(fn, user);
+}
+
+int32_t aoo::net::client::set_event_notify(aoo_notifyfn fn, void *user){
+    notify_.fn = fn;
+    notify_.user = user;
+    return 1;
+}
+
 int32_t aoonet_client_handle_events(aoonet_client *client, aoo_eventhandler fn, void *user){
     return client->handle_events(fn, user);
 }
@@ -574,6 +683,9 @@ void client::do_disconnect(command_reason reason, int error){
         peers_.clear();
     }
 
+    relay_available_ = false;
+    relay_token_ = 0;
+
     // event
     if (reason != command_reason::none){
         if (reason == command_reason::user){
@@ -714,11 +826,30 @@ void client::send_message_udp(const char *data, int32_t size, const ip_address&
     sendfn_(udpsocket_, data, size, (void *)&addr.address);
 }
 
+void client::send_relay_message_udp(const char *data, int32_t size, const ip_address& addr)
+{
+    char buf[AOO_MAXPACKETSIZE + AOONET_RELAY_HEADER_SIZE];
+    int32_t onset = 0;
+    if (size > AOO_MAXPACKETSIZE ||
+        !(onset = aoonet_relay_write_header(buf, sizeof(buf), &addr.address)))
+    {
+        LOG_ERROR("aoo_client: can't relay message to " << addr.name());
+        return;
+    }
+    memcpy(buf + onset, data, size);
+    sendfn_(udpsocket_, buf, size + onset, (void *)&remote_addr_.address);
+}
+
 void client::push_event(std::unique_ptr<ievent> e)
 {
-    scoped_lock<spinlock> lock(event_lock_);
-    if (events_.write_available()){
-        events_.write(std::move(e));
+    {
+        scoped_lock<spinlock> lock(event_lock_);
+        if (events_.write_available()){
+            events_.write(std::move(e));
+        }
+    }
+    if (notify_.fn){
+        notify_.fn(notify_.user);
     }
 }
 
@@ -1015,9 +1146,19 @@ void client::handle_login(const osc::ReceivedMessage& msg){
         auto it = msg.ArgumentsBegin();
         int32_t status = (it++)->AsInt32();
         if (status > 0){
+            // older servers don't send the relay token; we may only
+            // use the relay after registering for it (see send())
+            relay_available_ = false;
+            if (msg.ArgumentCount() > 2){
+                it++; // skip error message
+                relay_token_ = (it++)->AsInt64();
+            } else {
+                relay_token_ = 0;
+            }
             // connected!
             state_ = client_state::connected;
-            LOG_VERBOSE("aoo_client: successfully logged in");
+            LOG_VERBOSE("aoo_client: successfully logged in"
+                        << (relay_token_.load() ? " (relay available)" : ""));
             // event
             auto e = std::make_unique<event>(
                 AOONET_CLIENT_CONNECT_EVENT, 1);
@@ -1204,6 +1345,19 @@ void client::handle_server_message_udp(const osc::ReceivedMessage &msg, int onse
 
                 signal();
             }
+        } else if (!strcmp(pattern, AOONET_MSG_RELAY)){
+            auto it = msg.ArgumentsBegin();
+            int32_t result = (it++)->AsInt32();
+            if (result > 0){
+                if (!relay_available_.exchange(true)){
+                    LOG_VERBOSE("aoo_client: registered for the server relay");
+                }
+            } else {
+                std::string errmsg = (it++)->AsString();
+                LOG_WARNING("aoo_client: relay registration failed: " << errmsg);
+                // don't try again
+                relay_token_ = 0;
+            }
         } else {
             LOG_WARNING("aoo_client: received unknown UDP message "
                         << pattern << " from server");
@@ -1255,7 +1409,8 @@ client::group_event::~group_event()
 
 client::peer_event::peer_event(int32_t type,
                                const char *group, const char *user,
-                               const void *address, int32_t length)
+                               const void *address, int32_t length,
+                               const void *relay_address, int32_t relay_length)
 {
     peer_event_.type = type;
     peer_event_.result = 1;
@@ -1264,6 +1419,8 @@ client::peer_event::peer_event(int32_t type,
     peer_event_.user = copy_string(user);
     peer_event_.address = copy_sockaddr(address);
     peer_event_.length = length;
+    peer_event_.relay_address = relay_address ? copy_sockaddr(relay_address) : nullptr;
+    peer_event_.relay_length = relay_address ? relay_length : 0;
 }
 
 client::peer_event::~peer_event()
@@ -1273,6 +1430,9 @@ client::peer_event::~peer_event()
     if (peer_event_.address) {
         free_sockaddr(peer_event_.address);
     }
+    if (peer_event_.relay_address) {
+        free_sockaddr(peer_event_.relay_address);
+    }
 }
 
 /*///////////////////// peer //////////////////////////*/
@@ -1335,7 +1495,11 @@ void peer::send(time_tag now){
             osc::OutboundPacketStream msg(buf, sizeof(buf));
             msg << osc::BeginMessage(AOONET_MSG_PEER_PING) << osc::EndMessage;
 
-            client_->send_message_udp(msg.Data(), (int32_t) msg.Size(), *real_addr);
+            if (relay_.load()){
+                client_->send_relay_message_udp(msg.Data(), (int32_t) msg.Size(), *real_addr);
+            } else {
+                client_->send_message_udp(msg.Data(), (int32_t) msg.Size(), *real_addr);
+            }
             LOG_DEBUG("send regular ping to " << *this);
 
             last_pingtime_ = elapsed_time;
@@ -1343,11 +1507,32 @@ void peer::send(time_tag now){
     } else if (!timeout_) {
         // try to establish UDP connection with peer
         if (elapsed_time > client_->request_timeout()){
+            timeout_ = true;
+
+            if (client_->relay_available()){
+                // fall back to the server relay
+                LOG_WARNING("aoo_client: couldn't establish UDP connection to "
+                            << *this << "; using server relay");
+                relay_ = true;
+                address_.store(&public_address_);
+
+                auto& relay = client_->server_address();
+                auto e = std::make_unique<client::peer_event>(
+                            AOONET_CLIENT_PEER_JOIN_EVENT,
+                            group().c_str(), user().c_str(),
+                            &public_address_.address, public_address_.length,
+                            &relay.address, relay.length);
+                client_->push_event(std::move(e));
+
+                // ping them right away, so they know about us
+                last_pingtime_ = 0;
+                return;
+            }
+
             // couldn't establish peer connection!
             LOG_ERROR("aoo_client: couldn't establish UDP connection to "
                       << *this << "; timed out after "
                       << client_->request_timeout() << " seconds");
-            timeout_ = true;
 
 
             // this at least lets us present to the user that a particular user@group failed to establish
@@ -1376,14 +1561,18 @@ void peer::send(time_tag now){
 }
 
 void peer::handle_message(const osc::ReceivedMessage &msg, int onset,
-                          const ip_address& addr)
+                          const ip_address& addr, bool relayed)
 {
     auto pattern = msg.AddressPattern() + onset;
     try {
         if (!strcmp(pattern, AOONET_MSG_PING)){
             if (!address_.load()){
                 // this is the first ping!
-                if (addr == public_address_){
+                if (relayed){
+                    // the other side already gave up on a direct connection
+                    relay_ = true;
+                    address_.store(&public_address_);
+                } else if (addr == public_address_){
                     address_.store(&public_address_);
                 } else if (addr == local_address_){
                     address_.store(&local_address_);
@@ -1393,9 +1582,11 @@ void peer::handle_message(const osc::ReceivedMessage &msg, int onset,
                 }
 
                 // push event
+                auto& relay = client_->server_address();
                 auto e = std::make_unique<client::peer_event>(
                             AOONET_CLIENT_PEER_JOIN_EVENT,
-                            group().c_str(), user().c_str(), &addr.address, addr.length);
+                            group().c_str(), user().c_str(), &addr.address, addr.length,
+                            relayed ? &relay.address : nullptr, relayed ? relay.length : 0);
                 client_->push_event(std::move(e));
 
                 LOG_VERBOSE("aoo_client: successfully established connection with " << *this);
@@ -48,6 +48,9 @@ public:
         auto addr = address_.load();
         return addr != 0;
     }
+
+    // can only be reached through the server relay
+    bool relayed() const { return relay_.load(); }
     
     const ip_address& address() const {
         auto addr = address_.load();
@@ -61,7 +64,7 @@ public:
     void send(time_tag now);
 
     void handle_message(const osc::ReceivedMessage& msg, int onset,
-                        const ip_address& addr);
+                        const ip_address& addr, bool relayed = false);
 
     friend std::ostream& operator << (std::ostream& os, const peer& p);
 private:
@@ -72,6 +75,7 @@ private:
     ip_address local_address_;
     int64_t token_;
     std::atomic<ip_address *> address_{nullptr};
+    std::atomic<bool> relay_{false};
     time_tag start_time_;
     double last_pingtime_ = 0;
     bool timeout_ = false;
@@ -137,6 +141,8 @@ public:
 
     int32_t handle_events(aoo_eventhandler fn, void *user) override;
 
+    int32_t set_event_notify(aoo_notifyfn fn, void *user) override;
+
     void do_connect(const std::string& host, int port);
 
     int try_connect(const std::string& host, int port);
@@ -159,6 +165,13 @@ public:
 
     void send_message_udp(const char *data, int32_t size, const ip_address& addr);
 
+    // send a message to a peer through the server relay
+    void send_relay_message_udp(const char *data, int32_t size, const ip_address& addr);
+
+    bool relay_available() const { return relay_available_.load(); }
+
+    const ip_address& server_address() const { return remote_addr_; }
+
     void push_event(std::unique_ptr<ievent> e);
     
     int64_t get_token() const { return token_; }
@@ -188,6 +201,10 @@ private:
     double last_udp_ping_time_ = 0;
     double first_udp_ping_time_ = 0;
     int64_t token_ = 0;
+    // the server can relay peer messages (once we have registered
+    // our UDP endpoint with the relay token from the login reply)
+    std::atomic<bool> relay_available_{false};
+    std::atomic<int64_t> relay_token_{0};
     
     // commands
     lockfree::queue<std::unique_ptr<icommand>> commands_;
@@ -201,6 +218,7 @@ private:
     // events
     lockfree::queue<std::unique_ptr<ievent>> events_;
     spinlock event_lock_;
+    aoo_event_notify notify_{ nullptr, nullptr };
     // signal
     std::atomic<bool> quit_{false};
 #ifdef _WIN32
@@ -267,7 +285,8 @@ public:
     {
         peer_event(int32_t type,
                    const char *group, const char *user,
-                   const void *address, int32_t length);
+                   const void *address, int32_t length,
+                   const void *relay_address = nullptr, int32_t relay_length = 0);
         ~peer_event();
     };
 
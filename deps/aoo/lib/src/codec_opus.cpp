@@ -47,7 +47,8 @@ void print_settings(const aoo_format_opus& f){
                 << ", bitrate = " << f.bitrate
                 << ", complexity = " << f.complexity
                 << ", application = " << apptype
-                << ", signal type = " << type);
+                << ", signal type = " << type
+                << ", packet loss = " << f.packet_loss);
 }
 
 /*/////////////////////// codec base ////////////////////////*/
@@ -100,6 +101,12 @@ void validate_format(aoo_format_opus& f)
     if (f.application_type == 0) {
         f.application_type = OPUS_APPLICATION_AUDIO;
     }
+    // packet loss percentage
+    if (f.packet_loss < 0){
+        f.packet_loss = 0;
+    } else if (f.packet_loss > 100){
+        f.packet_loss = 100;
+    }
     // bitrate, complexity and signal type should be validated by opus
 }
 
@@ -195,6 +202,9 @@ int32_t encoder_setformat(void *enc, aoo_format *f){
         // signal type
         opus_multistream_encoder_ctl(c->state, OPUS_SET_SIGNAL(fmt->signal_type));
         opus_multistream_encoder_ctl(c->state, OPUS_GET_SIGNAL(&fmt->signal_type));
+        // in-band FEC (only has an effect in SILK/hybrid mode)
+        opus_multistream_encoder_ctl(c->state, OPUS_SET_INBAND_FEC(fmt->packet_loss > 0));
+        opus_multistream_encoder_ctl(c->state, OPUS_SET_PACKET_LOSS_PERC(fmt->packet_loss));
     } else {
         LOG_ERROR("Opus: opus_encoder_create() failed with error code " << error);
         return 0;
@@ -212,7 +222,7 @@ int32_t encoder_setformat(void *enc, aoo_format *f){
 
 int32_t encoder_writeformat(void *enc, aoo_format *fmt,
                             char *buf, int32_t size){
-    if (size >= 16){
+    if (size >= 20){
         // if encoder is null we assume the format passed in
         // is actually a reference to an aoo_format_opus,
         // and this call is used for serialization purposes
@@ -229,7 +239,8 @@ int32_t encoder_writeformat(void *enc, aoo_format *fmt,
         aoo::to_bytes<int32_t>(ofmt->complexity, buf + 4);
         aoo::to_bytes<int32_t>(ofmt->signal_type, buf + 8);
         aoo::to_bytes<int32_t>(ofmt->application_type, buf + 12);
-        return 16;
+        aoo::to_bytes<int32_t>(ofmt->packet_loss, buf + 16);
+        return 20;
     } else {
         LOG_WARNING("Opus: couldn't write settings");
         return -1;
@@ -257,6 +268,12 @@ int32_t encoder_readformat(void *enc, aoo_format *fmt,
         } else {
             f.application_type = OPUS_APPLICATION_AUDIO;
         }
+        if (size >= 20) {
+            f.packet_loss = aoo::from_bytes<int32_t>(buf + 16);
+            retsize = 20;
+        } else {
+            f.packet_loss = 0;
+        }
         
         if (encoder_setformat(c, reinterpret_cast<aoo_format *>(&f))){
             // it could have been modified during validation, need to re-write the base format of 
@@ -321,6 +338,26 @@ int32_t decoder_decode(void *dec,
     return 0;
 }
 
+int32_t decoder_decode_fec(void *dec,
+                           const char *buf, int32_t size,
+                           aoo_sample *s, int32_t n)
+{
+    // 'buf' is the block *after* the lost one
+    auto c = static_cast<decoder *>(dec);
+    if (c->state){
+        auto framesize = n / c->format.header.nchannels;
+        auto result = opus_multistream_decode_float(
+                    c->state, (const unsigned char *)buf, size, s, framesize, 1);
+        if (result > 0){
+            return result;
+        } else if (result < 0) {
+            LOG_VERBOSE("Opus: opus_decode_float() (FEC) failed with error code " << result);
+            return result;
+        }
+    }
+    return 0;
+}
+
 bool decoder_dosetformat(decoder *c, aoo_format_opus& f){
     if (c->state){
         opus_multistream_decoder_destroy(c->state);
@@ -407,6 +444,12 @@ int32_t decoder_readformat(void *dec, aoo_format *fmt,
         } else {
             f.application_type = OPUS_APPLICATION_AUDIO;
         }
+        if (size >= 20) {
+            f.packet_loss = aoo::from_bytes<int32_t>(buf + 16);
+            retsize = 20;
+        } else {
+            f.packet_loss = 0;
+        }
         
         if (decoder_dosetformat(c, f)){
             return retsize; // number of bytes
@@ -419,6 +462,22 @@ int32_t decoder_readformat(void *dec, aoo_format *fmt,
     }
 }
 
+// the multistream encoder is one block of memory without internal
+// pointers (except to static tables), so it can simply be copied.
+int32_t encoder_copystate(void *dst, const void *src){
+    auto d = static_cast<encoder *>(dst);
+    auto s = static_cast<const encoder *>(src);
+    if (d->state && s->state
+            && d->format.header.nchannels == s->format.header.nchannels
+            && d->format.header.samplerate == s->format.header.samplerate
+            && d->format.application_type == s->format.application_type){
+        auto size = opus_multistream_encoder_get_size(s->format.header.nchannels, 0);
+        memcpy(d->state, s->state, size);
+        return 1;
+    }
+    return 0;
+}
+
 int32_t decoder_reset(void *enc) {
     auto c = static_cast<decoder *>(enc);
     if (c->state){
@@ -445,7 +504,9 @@ aoo_codec codec_class = {
     decoder_getformat,
     decoder_readformat,
     decoder_decode,
-    decoder_reset
+    decoder_reset,
+    decoder_decode_fec,
+    encoder_copystate
 };
 
 } // namespace
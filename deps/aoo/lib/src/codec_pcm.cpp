@@ -8,6 +8,23 @@
 #include <cassert>
 #include <cstring>
 
+// SSE2 is always available on x86_64 (and on any x86 CPU from the last 20 years),
+// so there's no need for runtime dispatch. Other platforms use the generic
+// block loops, which the compiler can vectorize (e.g. with NEON).
+// Define AOO_PCM_SSE2=0 to get the generic loops anyway (e.g. for comparison).
+#ifndef AOO_PCM_SSE2
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) \
+    && (BYTE_ORDER == LITTLE_ENDIAN)
+ #define AOO_PCM_SSE2 1
+#else
+ #define AOO_PCM_SSE2 0
+#endif
+#endif
+
+#if AOO_PCM_SSE2
+ #include <emmintrin.h>
+#endif
+
 namespace {
 
 // conversion routines between aoo_sample and PCM data
@@ -37,11 +54,16 @@ int32_t bytes_per_sample(int32_t bd)
     }
 }
 
+// NOTE: clip *before* converting to integer, so that full scale
+// doesn't overflow (float can't represent INT32_MAX exactly).
+inline aoo_sample clip(aoo_sample in){
+    return (in > 1.f) ? 1.f : (in < -1.f) ? -1.f : in;
+}
+
 void sample_to_int16(aoo_sample in, char *out)
 {
     convert c;
-    int32_t temp = in * 0x7fff + 0.5f;
-    c.i16 = (temp > INT16_MAX) ? INT16_MAX : (temp < INT16_MIN) ? INT16_MIN : temp;
+    c.i16 = clip(in) * 32767.f + (in >= 0 ? 0.5f : -0.5f);
 #if BYTE_ORDER == BIG_ENDIAN
     memcpy(out, c.b, 2); // optimized away
 #else
@@ -52,19 +74,11 @@ void sample_to_int16(aoo_sample in, char *out)
 
 void sample_to_int24(aoo_sample in, char *out)
 {
-    convert c;
-    int32_t temp = in * 0x7fffffff + 0.5f;
-    c.i32 = (temp > INT32_MAX) ? INT32_MAX : (temp < INT32_MIN) ? INT32_MIN : temp;
-    // only copy the highest 3 bytes!
-#if BYTE_ORDER == BIG_ENDIAN
-    out[0] = c.b[0];
-    out[1] = c.b[1];
-    out[2] = c.b[2];
-#else
-    out[0] = c.b[3];
-    out[1] = c.b[2];
-    out[2] = c.b[1];
-#endif
+    // only the lower 3 bytes are used
+    int32_t temp = clip(in) * 8388607.f + (in >= 0 ? 0.5f : -0.5f);
+    out[0] = (temp >> 16) & 0xff;
+    out[1] = (temp >> 8) & 0xff;
+    out[2] = temp & 0xff;
 }
 
 void sample_to_float32(aoo_sample in, char *out)
@@ -90,20 +104,10 @@ aoo_sample int16_to_sample(const char *in){
 
 aoo_sample int24_to_sample(const char *in)
 {
-    convert c;
-    // copy to the highest 3 bytes!
-#if BYTE_ORDER == BIG_ENDIAN
-    c.b[0] = in[0];
-    c.b[1] = in[1];
-    c.b[2] = in[2];
-    c.b[3] = 0;
-#else
-    c.b[0] = 0;
-    c.b[1] = in[2];
-    c.b[2] = in[1];
-    c.b[3] = in[0];
-#endif
-    return (aoo_sample)c.i32 / 0x7fffffff;
+    // shift into the highest 3 bytes, then back to sign extend
+    auto b = (const uint8_t *)in;
+    int32_t temp = (int32_t)(((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8)) >> 8;
+    return (aoo_sample)temp / 8388608.f;
 }
 
 aoo_sample float32_to_sample(const char *in)
@@ -116,6 +120,191 @@ aoo_sample float64_to_sample(const char *in)
     return aoo::from_bytes<double>(in);
 }
 
+/*//////////////////// block conversion ///////////////////*/
+
+// convert whole blocks at once; each function returns the number
+// of samples it has handled, the caller does the rest one by one.
+
+#if AOO_PCM_SSE2
+
+inline __m128i swap_bytes16(__m128i x){
+    return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+inline __m128i swap_bytes32(__m128i x){
+    x = swap_bytes16(x); // swap bytes within each 16-bit word
+    return _mm_or_si128(_mm_slli_epi32(x, 16), _mm_srli_epi32(x, 16)); // swap words
+}
+
+// round to nearest int32
+inline __m128i float_to_int(__m128 x, __m128 scale){
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 minus_one = _mm_set1_ps(-1.f);
+    x = _mm_min_ps(_mm_max_ps(x, minus_one), one);
+    return _mm_cvtps_epi32(_mm_mul_ps(x, scale));
+}
+
+int32_t samples_to_int16(const aoo_sample *in, int32_t n, char *out){
+    const __m128 scale = _mm_set1_ps(32767.f);
+    int32_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        auto a = float_to_int(_mm_loadu_ps(in + i), scale);
+        auto b = float_to_int(_mm_loadu_ps(in + i + 4), scale);
+        auto x = swap_bytes16(_mm_packs_epi32(a, b));
+        _mm_storeu_si128((__m128i *)(out + i * 2), x);
+    }
+    return i;
+}
+
+int32_t int16_to_samples(const char *in, int32_t n, aoo_sample *out){
+    const __m128 scale = _mm_set1_ps(1.f / 32768.f);
+    int32_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        auto x = swap_bytes16(_mm_loadu_si128((const __m128i *)(in + i * 2)));
+        // sign extend to int32
+        auto a = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        auto b = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+    }
+    return i;
+}
+
+int32_t samples_to_int24(const aoo_sample *in, int32_t n, char *out){
+    // SSE2 has no byte shuffle, so we pack 4 samples into
+    // 3 words with plain integer ops and swap the words with SIMD.
+    const __m128 scale = _mm_set1_ps(8388607.f);
+    alignas(16) uint32_t temp[4];
+    int32_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        _mm_store_si128((__m128i *)temp, float_to_int(_mm_loadu_ps(in + i), scale));
+        auto x = _mm_setr_epi32((temp[0] << 8) | ((temp[1] >> 16) & 0xff),
+                                (temp[1] << 16) | ((temp[2] >> 8) & 0xffff),
+                                (temp[2] << 24) | (temp[3] & 0xffffff), 0);
+        x = swap_bytes32(x);
+        auto b = out + i * 3;
+        _mm_storel_epi64((__m128i *)b, x);
+        auto last = _mm_cvtsi128_si32(_mm_srli_si128(x, 8));
+        memcpy(b + 8, &last, 4);
+    }
+    return i;
+}
+
+int32_t int24_to_samples(const char *in, int32_t n, aoo_sample *out){
+    const __m128 scale = _mm_set1_ps(1.f / 8388608.f);
+    alignas(16) uint32_t temp[4];
+    int32_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        // unpack 3 words into the upper 3 bytes of 4 words
+        int32_t last;
+        memcpy(&last, in + i * 3 + 8, 4);
+        auto x = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(in + i * 3)),
+                                    _mm_cvtsi32_si128(last));
+        _mm_store_si128((__m128i *)temp, swap_bytes32(x));
+        x = _mm_setr_epi32(temp[0] & 0xffffff00,
+                           (temp[0] << 24) | ((temp[1] >> 8) & 0xffff00),
+                           (temp[1] << 16) | ((temp[2] >> 16) & 0xff00),
+                           temp[2] << 8);
+        // shift back to sign extend
+        x = _mm_srai_epi32(x, 8);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+    }
+    return i;
+}
+
+int32_t samples_to_float32(const aoo_sample *in, int32_t n, char *out){
+    int32_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        auto x = swap_bytes32(_mm_castps_si128(_mm_loadu_ps(in + i)));
+        _mm_storeu_si128((__m128i *)(out + i * 4), x);
+    }
+    return i;
+}
+
+int32_t float32_to_samples(const char *in, int32_t n, aoo_sample *out){
+    int32_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        auto x = swap_bytes32(_mm_loadu_si128((const __m128i *)(in + i * 4)));
+        _mm_storeu_ps(out + i, _mm_castsi128_ps(x));
+    }
+    return i;
+}
+
+#else
+
+// generic versions: convert a chunk into a temporary integer buffer
+// in a simple loop (which the compiler can vectorize), then serialize.
+
+#define AOO_PCM_CHUNKSIZE 64
+
+int32_t samples_to_int16(const aoo_sample *in, int32_t n, char *out){
+    int32_t temp[AOO_PCM_CHUNKSIZE];
+    int32_t i = 0;
+    for (; i + AOO_PCM_CHUNKSIZE <= n; i += AOO_PCM_CHUNKSIZE){
+        for (int k = 0; k < AOO_PCM_CHUNKSIZE; ++k){
+            auto x = clip(in[i + k]) * 32767.f;
+            temp[k] = x + (x >= 0 ? 0.5f : -0.5f);
+        }
+        auto b = (uint8_t *)(out + i * 2);
+        for (int k = 0; k < AOO_PCM_CHUNKSIZE; ++k, b += 2){
+            b[0] = (temp[k] >> 8) & 0xff;
+            b[1] = temp[k] & 0xff;
+        }
+    }
+    return i;
+}
+
+int32_t int16_to_samples(const char *in, int32_t n, aoo_sample *out){
+    auto b = (const uint8_t *)in;
+    for (int32_t i = 0; i < n; ++i, b += 2){
+        out[i] = (aoo_sample)(int16_t)((b[0] << 8) | b[1]) * (1.f / 32768.f);
+    }
+    return n;
+}
+
+int32_t samples_to_int24(const aoo_sample *in, int32_t n, char *out){
+    int32_t temp[AOO_PCM_CHUNKSIZE];
+    int32_t i = 0;
+    for (; i + AOO_PCM_CHUNKSIZE <= n; i += AOO_PCM_CHUNKSIZE){
+        for (int k = 0; k < AOO_PCM_CHUNKSIZE; ++k){
+            auto x = clip(in[i + k]) * 8388607.f;
+            temp[k] = x + (x >= 0 ? 0.5f : -0.5f);
+        }
+        auto b = (uint8_t *)(out + i * 3);
+        for (int k = 0; k < AOO_PCM_CHUNKSIZE; ++k, b += 3){
+            b[0] = (temp[k] >> 16) & 0xff;
+            b[1] = (temp[k] >> 8) & 0xff;
+            b[2] = temp[k] & 0xff;
+        }
+    }
+    return i;
+}
+
+int32_t int24_to_samples(const char *in, int32_t n, aoo_sample *out){
+    auto b = (const uint8_t *)in;
+    for (int32_t i = 0; i < n; ++i, b += 3){
+        int32_t temp = (int32_t)(((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8)) >> 8;
+        out[i] = (aoo_sample)temp * (1.f / 8388608.f);
+    }
+    return n;
+}
+
+int32_t samples_to_float32(const aoo_sample *in, int32_t n, char *out){
+    for (int32_t i = 0; i < n; ++i){
+        aoo::to_bytes<float>(in[i], out + i * 4);
+    }
+    return n;
+}
+
+int32_t float32_to_samples(const char *in, int32_t n, aoo_sample *out){
+    for (int32_t i = 0; i < n; ++i){
+        out[i] = aoo::from_bytes<float>(in + i * 4);
+    }
+    return n;
+}
+
+#endif
+
 void print_settings(const aoo_format_pcm& f)
 {
     LOG_VERBOSE("PCM settings: "
@@ -244,26 +433,30 @@ int32_t encoder_encode(void *enc,
         return 0;
     }
 
-    auto samples_to_blob = [&](auto fn){
-        auto b = buf;
-        for (int i = 0; i < n; ++i){
+    // 'blockfn' converts as many samples as possible at once,
+    // 'fn' does the remaining samples.
+    auto samples_to_blob = [&](auto blockfn, auto fn){
+        auto i = blockfn(s, n, buf);
+        auto b = buf + i * samplesize;
+        for (; i < n; ++i){
             fn(s[i], b);
             b += samplesize;
         }
     };
+    auto no_block = [](const aoo_sample *, int32_t, char *) { return 0; };
 
     switch (bitdepth){
     case AOO_PCM_INT16:
-        samples_to_blob(sample_to_int16);
+        samples_to_blob(samples_to_int16, sample_to_int16);
         break;
     case AOO_PCM_INT24:
-        samples_to_blob(sample_to_int24);
+        samples_to_blob(samples_to_int24, sample_to_int24);
         break;
     case AOO_PCM_FLOAT32:
-        samples_to_blob(sample_to_float32);
+        samples_to_blob(samples_to_float32, sample_to_float32);
         break;
     case AOO_PCM_FLOAT64:
-        samples_to_blob(sample_to_float64);
+        samples_to_blob(no_block, sample_to_float64);
         break;
     default:
         // unknown bitdepth
@@ -323,25 +516,27 @@ int32_t decoder_decode(void *dec,
         return 0;
     }
 
-    auto blob_to_samples = [&](auto convfn){
-        auto b = buf;
-        for (int i = 0; i < n; ++i, b += samplesize){
+    auto blob_to_samples = [&](auto blockfn, auto convfn){
+        auto i = blockfn(buf, n, s);
+        auto b = buf + i * samplesize;
+        for (; i < n; ++i, b += samplesize){
             s[i] = convfn(b);
         }
     };
+    auto no_block = [](const char *, int32_t, aoo_sample *) { return 0; };
 
     switch (c->format.bitdepth){
     case AOO_PCM_INT16:
-        blob_to_samples(int16_to_sample);
+        blob_to_samples(int16_to_samples, int16_to_sample);
         break;
     case AOO_PCM_INT24:
-        blob_to_samples(int24_to_sample);
+        blob_to_samples(int24_to_samples, int24_to_sample);
         break;
     case AOO_PCM_FLOAT32:
-        blob_to_samples(float32_to_sample);
+        blob_to_samples(float32_to_samples, float32_to_sample);
         break;
     case AOO_PCM_FLOAT64:
-        blob_to_samples(float64_to_sample);
+        blob_to_samples(no_block, float64_to_sample);
         break;
     default:
         // unknown bitdepth
@@ -375,6 +570,11 @@ int32_t decoder_readformat(void *dec, aoo_format *fmt,
     return -1;
 }
 
+// PCM encoders don't have any state
+int32_t encoder_copystate(void *, const void *){
+    return 1;
+}
+
 aoo_codec codec_class = {
     AOO_CODEC_PCM,
     encoder_new,
@@ -391,7 +591,9 @@ aoo_codec codec_class = {
     codec_getformat,
     decoder_readformat,
     decoder_decode,
-    codec_reset
+    codec_reset,
+    nullptr, // no FEC
+    encoder_copystate
 };
 
 } // namespace
@@ -13,6 +13,11 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 /*/////////////// version ////////////////////*/
 
@@ -204,6 +209,163 @@ std::unique_ptr<decoder> codec::create_decoder() const {
     }
 }
 
+/*////////////////////////// data messages /////////////////////////////*/
+
+#define AOO_DATA_TYPETAGS ",iiidiiiib\0" // 12 bytes
+#define AOO_COMPACT_DATA_TYPETAGS ",iib\0\0\0" // 8 bytes
+#define AOO_COMPACT_DATA_SR_TYPETAGS ",iidb\0\0" // 8 bytes
+
+// all arguments except for the blob data
+#define AOO_DATA_ARGSIZE 40
+
+void data_message_header::init(int32_t sink){
+    memset(data, 0, sizeof(data));
+    int len;
+    if (sink != AOO_ID_WILDCARD){
+        len = snprintf(data, 32, "%s%s/%d%s",
+                       AOO_MSG_DOMAIN, AOO_MSG_SINK, sink, AOO_MSG_DATA);
+    } else {
+        len = snprintf(data, 32, "%s", AOO_MSG_DOMAIN AOO_MSG_SINK AOO_MSG_WILDCARD AOO_MSG_DATA);
+    }
+    // including the terminating null character
+    size = (len + 4) & ~3;
+    memcpy(data + size, AOO_DATA_TYPETAGS, 12);
+    size += 12;
+}
+
+// write the blob and pad with zeros
+static char * write_blob(char *ptr, const char *data, int32_t n){
+    aoo::to_bytes<int32_t>(n, ptr);
+    ptr += 4;
+    if (n > 0){
+        memcpy(ptr, data, n);
+        ptr += n;
+    }
+    while (n & 3){
+        *ptr++ = 0;
+        n++;
+    }
+    return ptr;
+}
+
+int32_t write_data_message(char *buf, int32_t size, const data_message_header& header,
+                           int32_t src, int32_t salt, const data_packet& d){
+    auto total = header.size + AOO_DATA_ARGSIZE + ((d.size + 3) & ~3);
+    if (total > size){
+        return 0;
+    }
+    memcpy(buf, header.data, header.size);
+    auto ptr = buf + header.size;
+    aoo::to_bytes<int32_t>(src, ptr);
+    aoo::to_bytes<int32_t>(salt, ptr + 4);
+    aoo::to_bytes<int32_t>(d.sequence, ptr + 8);
+    aoo::to_bytes<double>(d.samplerate, ptr + 12);
+    aoo::to_bytes<int32_t>(d.channel, ptr + 20);
+    aoo::to_bytes<int32_t>(d.totalsize, ptr + 24);
+    aoo::to_bytes<int32_t>(d.nframes, ptr + 28);
+    aoo::to_bytes<int32_t>(d.framenum, ptr + 32);
+    ptr = write_blob(ptr + 36, d.data, d.size);
+    assert((ptr - buf) == total);
+    return total;
+}
+
+int32_t write_compact_data_message(char *buf, int32_t size, int32_t salt,
+                                   const data_packet& d, bool sendrate){
+    auto total = 4 + 8 + 12 + (sendrate ? 8 : 0) + ((d.size + 3) & ~3);
+    if (total > size){
+        return 0;
+    }
+    memcpy(buf, AOO_MSG_COMPACT_DATA "\0\0", 4);
+    auto ptr = buf + 4;
+    memcpy(ptr, sendrate ? AOO_COMPACT_DATA_SR_TYPETAGS : AOO_COMPACT_DATA_TYPETAGS, 8);
+    ptr += 8;
+    aoo::to_bytes<int32_t>(salt, ptr);
+    aoo::to_bytes<int32_t>(d.sequence, ptr + 4);
+    ptr += 8;
+    if (sendrate){
+        aoo::to_bytes<double>(d.samplerate, ptr);
+        ptr += 8;
+    }
+    ptr = write_blob(ptr, d.data, d.size);
+    assert((ptr - buf) == total);
+    return total;
+}
+
+// check and read the blob, it must be the last argument
+static bool read_blob(const char *ptr, const char *end, const char *& data, int32_t& n){
+    if ((end - ptr) < 4){
+        return false;
+    }
+    n = aoo::from_bytes<int32_t>(ptr);
+    if (n < 0 || n > (end - ptr - 4)){
+        return false;
+    }
+    data = ptr + 4;
+    return true;
+}
+
+bool parse_data_message(const char *msg, int32_t n, int32_t& src,
+                        int32_t& salt, data_packet& d){
+    // skip address pattern
+    auto term = (const char *)memchr(msg, 0, n);
+    if (!term){
+        return false;
+    }
+    auto onset = ((term - msg) + 4) & ~3;
+    if (onset + 12 + AOO_DATA_ARGSIZE > n
+            || memcmp(msg + onset, AOO_DATA_TYPETAGS, 12)){
+        return false;
+    }
+    auto ptr = msg + onset + 12;
+    src = aoo::from_bytes<int32_t>(ptr);
+    salt = aoo::from_bytes<int32_t>(ptr + 4);
+    d.sequence = aoo::from_bytes<int32_t>(ptr + 8);
+    d.samplerate = aoo::from_bytes<double>(ptr + 12);
+    d.channel = aoo::from_bytes<int32_t>(ptr + 20);
+    d.totalsize = aoo::from_bytes<int32_t>(ptr + 24);
+    d.nframes = aoo::from_bytes<int32_t>(ptr + 28);
+    d.framenum = aoo::from_bytes<int32_t>(ptr + 32);
+    return read_blob(ptr + 36, msg + n, d.data, d.size);
+}
+
+bool parse_compact_data_message(const char *msg, int32_t n,
+                                int32_t& salt, data_packet& d){
+    if (n < 4 + 8 + 12 || memcmp(msg, AOO_MSG_COMPACT_DATA "\0\0", 4)){
+        return false;
+    }
+    auto ptr = msg + 4;
+    bool hasrate;
+    if (!memcmp(ptr, AOO_COMPACT_DATA_TYPETAGS, 8)){
+        hasrate = false;
+    } else if (!memcmp(ptr, AOO_COMPACT_DATA_SR_TYPETAGS, 8)){
+        hasrate = true;
+    } else {
+        return false;
+    }
+    ptr += 8;
+    salt = aoo::from_bytes<int32_t>(ptr);
+    d.sequence = aoo::from_bytes<int32_t>(ptr + 4);
+    ptr += 8;
+    if (hasrate){
+        if ((msg + n - ptr) < 8){
+            return false;
+        }
+        d.samplerate = aoo::from_bytes<double>(ptr);
+        ptr += 8;
+    } else {
+        d.samplerate = 0; // marker to use last
+    }
+    if (!read_blob(ptr, msg + n, d.data, d.size)){
+        return false;
+    }
+    // reconstruct the rest from prior format
+    d.channel = 0;
+    d.nframes = 1;
+    d.framenum = 0;
+    d.totalsize = d.size;
+    return true;
+}
+
 /*////////////////////////// block /////////////////////////////*/
 
 void block::set(int32_t seq, double sr, int32_t chn,
@@ -682,164 +844,177 @@ void history_buffer::push(int32_t seq, double sr,
     }
 }
 
-/*////////////////////////// block_queue /////////////////////////////*/
-
-void block_queue::clear(){
-    size_ = 0;
-}
-
-void block_queue::resize(int32_t n){
-    blocks_.resize(n);
-    size_ = 0;
-}
+/*////////////////////////// jitter_buffer /////////////////////////////*/
 
-bool block_queue::empty() const {
-    return size_ == 0;
+void jitter_buffer::slot::add_frame(int32_t which, const char *data, int32_t n){
+    assert(data != nullptr);
+    assert(which >= 0 && which < numframes_);
+    if (which == numframes_ - 1){
+        LOG_DEBUG("copy last frame with " << n << " bytes");
+        std::copy(data, data + n, data_ + size_ - n);
+    } else {
+        LOG_DEBUG("copy frame " << which << " with " << n << " bytes");
+        std::copy(data, data + n, data_ + which * n);
+    }
+    auto& word = frames_[which / 64];
+    auto bit = (uint64_t)1 << (which % 64);
+    if (word & bit){
+        word &= ~bit;
+        missing_--;
+    }
 }
 
-bool block_queue::full() const {
-    return size_ == capacity();
+bool jitter_buffer::slot::has_frame(int32_t which) const {
+    assert(which < numframes_);
+    return ((frames_[which / 64] >> (which % 64)) & 1) == 0;
 }
 
-int32_t block_queue::size() const {
-    return size_;
+void jitter_buffer::clear(){
+    for (auto& s : slots_){
+        s.sequence = -1;
+    }
+    size_ = 0;
+    front_ = 0;
+    back_ = -1;
 }
 
-int32_t block_queue::capacity() const {
-    return blocks_.size();
+void jitter_buffer::resize(int32_t n, int32_t maxblocksize){
+    slots_.clear();
+    slots_.resize(n);
+    slotsize_ = 0;
+    slotwords_ = 0;
+    reserve(maxblocksize, 64);
+    clear();
 }
 
-block* block_queue::insert(int32_t seq, double sr, int32_t chn,
-              int32_t nbytes, int32_t nframes){
-    assert(capacity() > 0);
-    // find pos to insert
-    block * it;
-    // first try the end, as it is the most likely position
-    // (blocks usually arrive in sequential order)
-    if (empty() || seq > back().sequence){
-        it = end();
-    } else {
-    #if 0
-        // linear search
-        it = begin();
-        for (; it != end(); ++it){
-            assert(it->sequence != seq);
-            if (it->sequence > seq){
-                break;
-            }
-        }
-    #else
-        // binary search
-        it = std::lower_bound(begin(), end(), seq, [](auto& a, auto& b){
-            return a.sequence < b;
-        });
-        assert(!(it != end() && it->sequence == seq));
-    #endif
+// make sure every slot can hold the given block, only allocates if it doesn't fit.
+void jitter_buffer::reserve(int32_t nbytes, int32_t nframes){
+    auto nwords = (nframes + 63) / 64;
+    if (nbytes <= slotsize_ && nwords <= slotwords_){
+        return;
     }
-    // move items if needed
-    if (full()){
-        if (it > begin()){
-            LOG_DEBUG("insert block at pos " << (it - begin()) << " and pop old block");
-            // save first block
-            block temp = std::move(front());
-            // move blocks before 'it' to the left
-            std::move(begin() + 1, it, begin());
-            // adjust iterator and re-insert removed block
-            *(--it) = std::move(temp);
-        } else {
-            // simply replace first block
-            LOG_DEBUG("replace oldest block");
-        }
-    } else {
-        if (it != end()){
-            LOG_DEBUG("insert block at pos " << (it - begin()));
-            // save block past the end
-            block temp = std::move(*end());
-            // move blocks to the right
-            std::move_backward(it, end(), end() + 1);
-            // re-insert removed block at free slot (first moved item)
-            *it = std::move(temp);
-        } else {
-            // simply replace block past the end
-            LOG_DEBUG("append block");
+    auto newsize = std::max<int32_t>(slotsize_, nbytes);
+    auto newwords = std::max<int32_t>(slotwords_, nwords);
+    if (slotsize_ > 0){
+        LOG_VERBOSE("jitter buffer: grow slots to " << newsize << " bytes");
+    }
+    std::vector<char> slab(slots_.size() * newsize);
+    std::vector<uint64_t> bits(slots_.size() * newwords);
+    for (size_t i = 0; i < slots_.size(); ++i){
+        auto& s = slots_[i];
+        auto data = slab.data() + i * newsize;
+        auto frames = bits.data() + i * newwords;
+        // keep blocks which are currently buffered
+        if (s.sequence >= 0){
+            std::copy(s.data_, s.data_ + s.size_, data);
+            std::copy(s.frames_, s.frames_ + slotwords_, frames);
         }
-        size_++;
+        s.data_ = data;
+        s.frames_ = frames;
     }
-    // replace data
-    it->set(seq, sr, chn, nbytes, nframes);
-    return it;
+    slab_ = std::move(slab);
+    framebits_ = std::move(bits);
+    slotsize_ = newsize;
+    slotwords_ = newwords;
 }
 
-block* block_queue::find(int32_t seq){
-    // first try the end, as we most likely have to complete the most recent block
-    if (empty()){
+jitter_buffer::slot* jitter_buffer::insert(int32_t seq, double sr, int32_t chn,
+                                           int32_t nbytes, int32_t nframes){
+    assert(capacity() > 0);
+    assert(seq >= 0 && nbytes > 0 && nframes > 0);
+    if (!empty() && seq <= back_ - capacity()){
+        // too late, the slot belongs to a newer block
+        LOG_DEBUG("reject late block " << seq);
         return nullptr;
-    } else if (back().sequence == seq){
-        return &back();
     }
-#if 0
-    // linear search
-    for (int32_t i = 0; i < size_; ++i){
-        if (blocks_[i].sequence == seq){
-            return &blocks_[i];
-        }
+    if (full()){
+        LOG_DEBUG("replace oldest block");
+        pop_front();
     }
-#else
-    // binary search
-    auto result = std::lower_bound(begin(), end(), seq, [](auto& a, auto& b){
-        return a.sequence < b;
-    });
-    if (result != end() && result->sequence == seq){
-        return result;
+    auto& s = get(seq);
+    if (s.sequence >= 0){
+        // an outdated block is still sitting in our slot
+        assert(s.sequence != seq);
+        LOG_DEBUG("drop outdated block " << s.sequence);
+        remove(s);
     }
-#endif
-    return nullptr;
+    reserve(nbytes, nframes);
+    s.sequence = seq;
+    s.samplerate = sr;
+    s.channel = chn;
+    s.size_ = nbytes;
+    s.numframes_ = nframes;
+    s.missing_ = nframes;
+    // set missing frame bits to 1
+    std::fill(s.frames_, s.frames_ + slotwords_, 0);
+    for (int32_t i = 0; i < nframes; ++i){
+        s.frames_[i / 64] |= ((uint64_t)1 << (i % 64));
+    }
+    if (size_++ == 0){
+        front_ = back_ = seq;
+    } else if (seq < front_){
+        front_ = seq;
+    } else if (seq > back_){
+        back_ = seq;
+    }
+    return &s;
 }
 
-void block_queue::pop_front(){
-    assert(!empty());
-    if (size_ > 1){
-        // temporarily remove first block
-        block temp = std::move(front());
-        // move remaining blocks to the left
-        std::move(begin() + 1, end(), begin());
-        // re-insert removed block at free slot
-        back() = std::move(temp);
+jitter_buffer::slot* jitter_buffer::find(int32_t seq){
+    if (empty() || seq < front_ || seq > back_){
+        return nullptr;
+    }
+    auto& s = get(seq);
+    return s.sequence == seq ? &s : nullptr;
+}
+
+void jitter_buffer::remove(slot& s){
+    auto seq = s.sequence;
+    s.sequence = -1;
+    if (--size_ == 0){
+        front_ = 0;
+        back_ = -1;
+    } else if (seq == front_){
+        // advance to the next buffered block
+        do {
+            ++front_;
+        } while (get(front_).sequence != front_);
+    } else if (seq == back_){
+        do {
+            --back_;
+        } while (get(back_).sequence != back_);
     }
-    size_--;
 }
 
-void block_queue::pop_back(){
+void jitter_buffer::pop_front(){
     assert(!empty());
-    size_--;
+    remove(front());
 }
 
-block& block_queue::front(){
+jitter_buffer::slot& jitter_buffer::front(){
     assert(!empty());
-    return blocks_.front();
+    return get(front_);
 }
 
-block& block_queue::back(){
+jitter_buffer::slot& jitter_buffer::back(){
     assert(!empty());
-    return blocks_[size_ - 1];
+    return get(back_);
 }
 
-block* block_queue::begin(){
-    return blocks_.data();
+jitter_buffer::iterator jitter_buffer::begin(){
+    return empty() ? end() : iterator(this, front_);
 }
 
-block* block_queue::end(){
-    return blocks_.data() + size_;
+jitter_buffer::iterator jitter_buffer::end(){
+    return iterator(this, back_ + 1);
 }
 
-block& block_queue::operator[](int32_t i){
-    return blocks_[i];
-}
-
-std::ostream& operator<<(std::ostream& os, const block_queue& b){
-    os << "blockqueue (" << b.size() << " / " << b.capacity() << "): ";
-    for (int i = 0; i < b.size(); ++i){
-        os << b.blocks_[i].sequence << " ";
+std::ostream& operator<<(std::ostream& os, const jitter_buffer& b){
+    os << "jitterbuffer (" << b.size() << " / " << b.capacity() << "): ";
+    for (auto seq = b.front_; seq <= b.back_; ++seq){
+        if (b.slots_[seq % b.slots_.size()].sequence == seq){
+            os << seq << " ";
+        }
     }
     return os;
 }
@@ -848,8 +1023,20 @@ std::ostream& operator<<(std::ostream& os, const block_queue& b){
 
 #define AOO_RESAMPLER_SPACE 2.5 // was 3 // jlc was 8
 
-void dynamic_resampler::setup(int32_t nfrom, int32_t nto, int32_t srfrom, int32_t srto, int32_t nchannels){
+// number of sub-sample phases in the sinc table
+// (we interpolate linearly between adjacent phases)
+#define AOO_RESAMPLER_PHASES 256
+
+#define AOO_RESAMPLER_MAXTAPS 32
+
+void dynamic_resampler::setup(int32_t nfrom, int32_t nto, int32_t srfrom, int32_t srto,
+                              int32_t nchannels, int32_t quality){
     nchannels_ = nchannels;
+    srfrom_ = srfrom;
+    srto_ = srto;
+    quality_ = std::max<int32_t>(AOO_RESAMPLE_LINEAR,
+                                 std::min<int32_t>(AOO_RESAMPLE_SINC_LONG, quality));
+    ntaps_ = num_taps(quality_);
     auto blocksize = std::max<int32_t>(nfrom, nto);
 #if 0
     // this doesn't work as expected...
@@ -858,14 +1045,97 @@ void dynamic_resampler::setup(int32_t nfrom, int32_t nto, int32_t srfrom, int32_
 #else
     buffer_.resize(blocksize * nchannels_ * AOO_RESAMPLER_SPACE); // extra space for fluctuations
 #endif
+    // the filter needs some past samples, so we must not overwrite them.
+    // always keep enough for the longest filter, so that set_quality() can switch in place.
+    buffer_.resize(buffer_.size() + AOO_RESAMPLER_MAXTAPS * nchannels_);
+    scratch_.resize(AOO_RESAMPLER_MAXTAPS * nchannels_);
+    table_.reserve((AOO_RESAMPLER_PHASES + 1) * AOO_RESAMPLER_MAXTAPS);
+    make_sinc_table(quality_, srfrom, srto, table_);
     clear();
 }
 
+int32_t dynamic_resampler::num_taps(int32_t quality){
+    switch (quality){
+    case AOO_RESAMPLE_CUBIC:
+        return 4;
+    case AOO_RESAMPLE_SINC_SHORT:
+        return 8;
+    case AOO_RESAMPLE_SINC_LONG:
+        return AOO_RESAMPLER_MAXTAPS;
+    default:
+        return 2;
+    }
+}
+
+void dynamic_resampler::prepare_quality(int32_t quality, quality_change& q) const {
+    q.quality = std::max<int32_t>(AOO_RESAMPLE_LINEAR,
+                                  std::min<int32_t>(AOO_RESAMPLE_SINC_LONG, quality));
+    q.srfrom = srfrom_;
+    q.srto = srto_;
+    q.table.reserve((AOO_RESAMPLER_PHASES + 1) * AOO_RESAMPLER_MAXTAPS);
+    make_sinc_table(q.quality, q.srfrom, q.srto, q.table);
+}
+
+bool dynamic_resampler::set_quality(quality_change& q){
+    if (q.srfrom != srfrom_ || q.srto != srto_ || buffer_.empty()){
+        return false;
+    }
+    // NOTE: the delay changes with the number of taps, so the read position
+    // jumps by a few samples, but the stream goes on.
+    quality_ = q.quality;
+    ntaps_ = num_taps(quality_);
+    table_.swap(q.table); // both have the same capacity
+    return true;
+}
+
+// Blackman windowed sinc, one row of 'ntaps' coefficients per phase.
+// only the sinc presets use the table, otherwise it is left empty.
+void dynamic_resampler::make_sinc_table(int32_t quality, int32_t srfrom, int32_t srto,
+                                        std::vector<float>& table){
+    if (quality < AOO_RESAMPLE_SINC_SHORT){
+        table.clear();
+        return;
+    }
+    const int32_t ntaps = num_taps(quality);
+    // when downsampling, move the cutoff frequency below the new Nyquist frequency.
+    // the short filter has a wider transition band, so we leave more room.
+    double cutoff = (srfrom > 0 && srto < srfrom) ? (double)srto / (double)srfrom : 1.0;
+    cutoff *= (quality == AOO_RESAMPLE_SINC_LONG) ? 0.95 : 0.9;
+    // NOTE: there is one extra row so we can always interpolate between
+    // the current and the next phase.
+    const int32_t half = ntaps / 2;
+    table.resize((AOO_RESAMPLER_PHASES + 1) * ntaps);
+    for (int32_t p = 0; p <= AOO_RESAMPLER_PHASES; ++p){
+        auto row = &table[p * ntaps];
+        double fract = (double)p / (double)AOO_RESAMPLER_PHASES;
+        double sum = 0;
+        for (int32_t k = 0; k < ntaps; ++k){
+            // distance between the tap and the interpolation point
+            double x = (double)(k - half + 1) - fract;
+            double w = x / (double)half;
+            double win = (w <= -1.0 || w >= 1.0) ? 0.0 :
+                0.42 + 0.5 * cos(M_PI * w) + 0.08 * cos(2.0 * M_PI * w);
+            double sinc = (x == 0) ? cutoff : sin(M_PI * cutoff * x) / (M_PI * x);
+            double c = sinc * win;
+            row[k] = c;
+            sum += c;
+        }
+        // normalize for unity gain at DC
+        if (sum != 0){
+            for (int32_t k = 0; k < ntaps; ++k){
+                row[k] /= sum;
+            }
+        }
+    }
+}
+
 void dynamic_resampler::clear(){
     ratio_ = 1;
     rdpos_ = 0;
     wrpos_ = 0;
     balance_ = 0;
+    // the filter looks back, so don't let it see old data
+    std::fill(buffer_.begin(), buffer_.end(), 0);
 }
 
 void dynamic_resampler::update(double srfrom, double srto){
@@ -888,7 +1158,8 @@ void dynamic_resampler::update(double srfrom, double srto){
 }
 
 int32_t dynamic_resampler::write_available(){
-    return (double)buffer_.size() - balance_; // !
+    // keep the filter history
+    return (double)buffer_.size() - balance_ - AOO_RESAMPLER_MAXTAPS * nchannels_; // !
 }
 
 void dynamic_resampler::write(const aoo_sample *data, int32_t n){
@@ -913,6 +1184,139 @@ int32_t dynamic_resampler::read_available(){
     return balance_ * ratio_;
 }
 
+// get 'ntaps_' consecutive frames, starting at 'index'.
+// only copies if the frames wrap around the end of the buffer.
+const aoo_sample * dynamic_resampler::get_frames(int32_t index, aoo_sample *tmp) const {
+    auto limit = (int32_t)buffer_.size() / nchannels_;
+    if (index < 0){
+        index += limit;
+    }
+    if (index + ntaps_ <= limit){
+        return &buffer_[index * nchannels_];
+    }
+    for (int32_t k = 0; k < ntaps_; ++k){
+        auto src = &buffer_[index * nchannels_];
+        std::copy(src, src + nchannels_, tmp + k * nchannels_);
+        if (++index == limit){
+            index = 0;
+        }
+    }
+    return tmp;
+}
+
+void dynamic_resampler::read_linear(aoo_sample *data, int32_t n, double incr){
+    auto limit = (int32_t)buffer_.size() / nchannels_;
+    for (int i = 0; i < n; i += nchannels_){
+        int32_t index = (int32_t)rdpos_;
+        aoo_sample fract = rdpos_ - (double)index;
+        auto a = &buffer_[index * nchannels_];
+        auto b = (index + 1 < limit) ? a + nchannels_ : &buffer_[0];
+        for (int j = 0; j < nchannels_; ++j){
+            data[i + j] = a[j] + (b[j] - a[j]) * fract;
+        }
+        rdpos_ += incr;
+        if (rdpos_ >= limit){
+            rdpos_ -= limit;
+        }
+    }
+}
+
+void dynamic_resampler::read_cubic(aoo_sample *data, int32_t n, double incr){
+    auto limit = (int32_t)buffer_.size() / nchannels_;
+    for (int i = 0; i < n; i += nchannels_){
+        int32_t index = (int32_t)rdpos_;
+        aoo_sample t = rdpos_ - (double)index;
+        // 4-point Hermite between y1 and y2 (delayed by one sample)
+        auto y0 = get_frames(index - 2, scratch_.data());
+        auto y1 = y0 + nchannels_;
+        auto y2 = y1 + nchannels_;
+        auto y3 = y2 + nchannels_;
+        for (int j = 0; j < nchannels_; ++j){
+            aoo_sample c0 = y1[j];
+            aoo_sample c1 = 0.5f * (y2[j] - y0[j]);
+            aoo_sample c2 = y0[j] - 2.5f * y1[j] + 2.f * y2[j] - 0.5f * y3[j];
+            aoo_sample c3 = 0.5f * (y3[j] - y0[j]) + 1.5f * (y1[j] - y2[j]);
+            data[i + j] = ((c3 * t + c2) * t + c1) * t + c0;
+        }
+        rdpos_ += incr;
+        if (rdpos_ >= limit){
+            rdpos_ -= limit;
+        }
+    }
+}
+
+// apply the filter to N channels of interleaved frames. the taps are walked
+// in memory order (frame by frame) and the channels are accumulated side by
+// side, so there is no dependency between the lanes of the inner loop.
+template<int32_t N>
+static inline void sinc_channels(const float *coeffs, int32_t ntaps,
+                                 const aoo_sample *x, int32_t stride, aoo_sample *out){
+    float acc[N] = {};
+    for (int32_t k = 0; k < ntaps; ++k, x += stride){
+        const float c = coeffs[k];
+        for (int32_t j = 0; j < N; ++j){
+            acc[j] += c * x[j];
+        }
+    }
+    for (int32_t j = 0; j < N; ++j){
+        out[j] = acc[j];
+    }
+}
+
+// mono: a plain dot product, split into 4 partial sums which can run in parallel.
+// (ntaps is always a multiple of 4)
+static inline aoo_sample sinc_mono(const float *coeffs, int32_t ntaps, const aoo_sample *x){
+    float acc[4] = {};
+    for (int32_t k = 0; k < ntaps; k += 4){
+        for (int32_t j = 0; j < 4; ++j){
+            acc[j] += coeffs[k + j] * x[k + j];
+        }
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+void dynamic_resampler::read_sinc(aoo_sample *data, int32_t n, double incr){
+    auto limit = (int32_t)buffer_.size() / nchannels_;
+    const auto ntaps = ntaps_;
+    const auto nchannels = nchannels_;
+    alignas(16) float coeffs[AOO_RESAMPLER_MAXTAPS];
+    for (int i = 0; i < n; i += nchannels){
+        int32_t index = (int32_t)rdpos_;
+        double phase = (rdpos_ - (double)index) * AOO_RESAMPLER_PHASES;
+        int32_t p = (int32_t)phase;
+        float pfract = phase - (double)p;
+        // interpolate between adjacent table rows
+        auto c0 = &table_[p * ntaps];
+        auto c1 = c0 + ntaps;
+        for (int k = 0; k < ntaps; ++k){
+            coeffs[k] = c0[k] + (c1[k] - c0[k]) * pfract;
+        }
+        // the taps are [index - ntaps + 2, index + 1], i.e.
+        // we are delayed by (ntaps / 2 - 1) samples.
+        // they are always contiguous (copied if they wrap around).
+        auto x = get_frames(index - ntaps + 2, scratch_.data());
+        auto out = data + i;
+        if (nchannels == 1){
+            out[0] = sinc_mono(coeffs, ntaps, x);
+        } else if (nchannels == 2){
+            sinc_channels<2>(coeffs, ntaps, x, 2, out);
+        } else {
+            // groups of 4 channels, then the rest one by one
+            int32_t j = 0;
+            for (; j + 4 <= nchannels; j += 4){
+                sinc_channels<4>(coeffs, ntaps, x + j, nchannels, out + j);
+            }
+            for (; j < nchannels; ++j){
+                sinc_channels<1>(coeffs, ntaps, x + j, nchannels, out + j);
+            }
+        }
+        rdpos_ += incr;
+        if (rdpos_ >= limit){
+            rdpos_ -= limit;
+        }
+    }
+}
+
 void dynamic_resampler::read(aoo_sample *data, int32_t n){
     auto size = (int32_t)buffer_.size();
     auto limit = size / nchannels_;
@@ -921,22 +1325,27 @@ void dynamic_resampler::read(aoo_sample *data, int32_t n){
         // interpolating version
         double incr = 1. / ratio_;
         assert(incr > 0);
-        for (int i = 0; i < n; i += nchannels_){
-            int32_t index = (int32_t)rdpos_;
-            double fract = rdpos_ - (double)index;
-            for (int j = 0; j < nchannels_; ++j){
-                double a = buffer_[index * nchannels_ + j];
-                double b = buffer_[((index + 1) * nchannels_ + j) % size];
-                data[i + j] = a + (b - a) * fract;
-            }
-            rdpos_ += incr;
-            if (rdpos_ >= limit){
-                rdpos_ -= limit;
-            }
+        switch (quality_){
+        case AOO_RESAMPLE_CUBIC:
+            read_cubic(data, n, incr);
+            break;
+        case AOO_RESAMPLE_SINC_SHORT:
+        case AOO_RESAMPLE_SINC_LONG:
+            read_sinc(data, n, incr);
+            break;
+        default:
+            read_linear(data, n, incr);
+            break;
         }
         balance_ -= n * incr;
     } else {
         // non-interpolating (faster) version
+        // NOTE: apply the same delay as the interpolating version, so that
+        // we don't jump when switching between the two.
+        intpos -= latency();
+        if (intpos < 0){
+            intpos += limit;
+        }
         int32_t pos = intpos * nchannels_;
         int32_t end = pos + n;
         int n1, n2;
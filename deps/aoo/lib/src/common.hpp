@@ -23,16 +23,47 @@ uint32_t make_version(uint8_t protocolflags = 0);
 
 class dynamic_resampler {
 public:
-    void setup(int32_t nfrom, int32_t nto, int32_t srfrom, int32_t srto, int32_t nchannels);
+    void setup(int32_t nfrom, int32_t nto, int32_t srfrom, int32_t srto, int32_t nchannels,
+               int32_t quality = AOO_RESAMPLE_LINEAR);
     void clear();
     void update(double srfrom, double srto);
     int32_t write_available();
     void write(const aoo_sample* data, int32_t n);
     int32_t read_available();
     void read(aoo_sample* data, int32_t n);
+    int32_t quality() const { return quality_; }
+    // extra latency (in samples per channel) caused by the interpolation
+    int32_t latency() const { return ntaps_ / 2 - 1; }
+
+    // Changes the interpolation, but keeps the buffered audio.
+    // prepare_quality() allocates, so call it without holding a lock;
+    // set_quality() doesn't allocate. It returns false if the resampler
+    // has been set up again in between (which applies the quality anyway).
+    struct quality_change {
+        int32_t quality = AOO_RESAMPLE_LINEAR;
+        int32_t srfrom = 0;
+        int32_t srto = 0;
+        std::vector<float> table;
+    };
+    void prepare_quality(int32_t quality, quality_change& q) const;
+    bool set_quality(quality_change& q);
 private:
+    void read_linear(aoo_sample *data, int32_t n, double incr);
+    void read_cubic(aoo_sample *data, int32_t n, double incr);
+    void read_sinc(aoo_sample *data, int32_t n, double incr);
+    const aoo_sample * get_frames(int32_t index, aoo_sample *tmp) const;
+    static int32_t num_taps(int32_t quality);
+    static void make_sinc_table(int32_t quality, int32_t srfrom, int32_t srto,
+                                std::vector<float>& table);
+
     std::vector<aoo_sample> buffer_;
+    std::vector<float> table_; // polyphase sinc coefficients
+    std::vector<aoo_sample> scratch_; // for taps which wrap around
     int32_t nchannels_ = 0;
+    int32_t srfrom_ = 0;
+    int32_t srto_ = 0;
+    int32_t quality_ = AOO_RESAMPLE_LINEAR;
+    int32_t ntaps_ = 2;
     double rdpos_ = 0;
     int32_t wrpos_ = 0;
     double balance_ = 0;
@@ -82,6 +113,12 @@ public:
         return codec_->encoder_reset(obj_);
     }
 
+    bool can_copy_state() const {
+        return codec_->encoder_copystate != nullptr;
+    }
+    bool copy_state(const encoder& other){
+        return codec_->encoder_copystate(obj_, other.obj_) > 0;
+    }
 };
 
 class decoder : public base_codec {
@@ -99,6 +136,12 @@ public:
     int32_t decode(const char *buf, int32_t size, aoo_sample *s, int32_t n){
         return codec_->decoder_decode(obj_, buf, size, s, n);
     }
+    bool has_fec() const {
+        return codec_->decoder_decode_fec != nullptr;
+    }
+    int32_t decode_fec(const char *buf, int32_t size, aoo_sample *s, int32_t n){
+        return codec_->decoder_decode_fec(obj_, buf, size, s, n);
+    }
     int32_t reset() {
         return codec_->decoder_reset(obj_);
     }
@@ -138,6 +181,35 @@ struct data_packet {
     int32_t size;
 };
 
+// Data messages are by far the most frequent messages, so we
+// serialize and parse them by hand instead of going through oscpack.
+
+// address pattern + type tags of /data messages to a specific sink;
+// this only depends on the sink ID, so it can be built once per sink.
+struct data_message_header {
+    void init(int32_t sink);
+
+    char data[48];
+    int32_t size = 0;
+};
+
+// /aoo/sink/<id>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <numpackets> <packetnum> <data>
+// returns the message size or 0 if the buffer is too small
+int32_t write_data_message(char *buf, int32_t size, const data_message_header& header,
+                           int32_t src, int32_t salt, const data_packet& d);
+
+// /d <salt> <seq> [<srate>] <data>
+int32_t write_compact_data_message(char *buf, int32_t size, int32_t salt,
+                                   const data_packet& d, bool sendrate);
+
+// return false if the message doesn't have the expected layout,
+// the caller should fall back to oscpack.
+bool parse_data_message(const char *msg, int32_t n, int32_t& src,
+                        int32_t& salt, data_packet& d);
+
+bool parse_compact_data_message(const char *msg, int32_t n,
+                                int32_t& salt, data_packet& d);
+
 class block {
 public:
     // methods
@@ -165,30 +237,93 @@ protected:
     int32_t framesize_ = 0;
 };
 
-class block_queue {
+// Jitter buffer for incoming blocks.
+// Blocks are indexed by 'sequence % capacity' and their payload lives in
+// one fixed slab of memory, so insert, find and pop are O(1) and there is
+// no heap traffic per block. The slab only grows if a block is larger than
+// the expected maximum block size. Blocks can have any number of frames.
+// All blocks in the buffer must lie within 'capacity' sequence numbers,
+// so insert() rejects a block which is too old (returns nullptr).
+class jitter_buffer {
 public:
+    class slot {
+    public:
+        const char* data() const { return data_; }
+        int32_t size() const { return size_; }
+        bool complete() const { return missing_ == 0; }
+        void add_frame(int32_t which, const char *data, int32_t n);
+        bool has_frame(int32_t which) const;
+        int32_t num_frames() const { return numframes_; }
+        // data
+        int32_t sequence = -1; // -1: empty
+        double samplerate = 0;
+        int32_t channel = 0;
+    private:
+        friend class jitter_buffer;
+        char *data_ = nullptr;
+        uint64_t *frames_ = nullptr; // bitfield of missing frames
+        int32_t size_ = 0;
+        int32_t numframes_ = 0;
+        int32_t missing_ = 0;
+    };
+
+    class iterator {
+    public:
+        iterator(jitter_buffer *buf, int32_t seq)
+            : buf_(buf), seq_(seq){}
+        slot& operator*() const { return buf_->get(seq_); }
+        slot* operator->() const { return &buf_->get(seq_); }
+        iterator& operator++(){
+            // skip missing blocks
+            do {
+                ++seq_;
+            } while (seq_ <= buf_->back_ && buf_->get(seq_).sequence != seq_);
+            return *this;
+        }
+        iterator operator++(int){
+            auto old = *this;
+            ++(*this);
+            return old;
+        }
+        bool operator==(const iterator& other) const { return seq_ == other.seq_; }
+        bool operator!=(const iterator& other) const { return seq_ != other.seq_; }
+    private:
+        jitter_buffer *buf_;
+        int32_t seq_;
+    };
+
     void clear();
-    void resize(int32_t n);
-    bool empty() const;
-    bool full() const;
-    int32_t size() const;
-    int32_t capacity() const;
-    block* insert(int32_t seq, double sr, int32_t chn,
-                  int32_t nbytes, int32_t nframes);
-    block* find(int32_t seq);
+    void resize(int32_t n, int32_t maxblocksize);
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == capacity(); }
+    int32_t size() const { return size_; }
+    int32_t capacity() const { return slots_.size(); }
+    slot* insert(int32_t seq, double sr, int32_t chn,
+                 int32_t nbytes, int32_t nframes);
+    slot* find(int32_t seq);
     void pop_front();
-    void pop_back();
 
-    block& front();
-    block& back();
-    block *begin();
-    block *end();
-    block& operator[](int32_t i);
+    slot& front();
+    slot& back();
+    iterator begin();
+    iterator end();
 
-    friend std::ostream& operator<<(std::ostream& os, const block_queue& b);
+    friend std::ostream& operator<<(std::ostream& os, const jitter_buffer& b);
 private:
-    std::vector<block> blocks_;
+    slot& get(int32_t seq){
+        return slots_[seq % (int32_t)slots_.size()];
+    }
+    void remove(slot& s);
+    void reserve(int32_t nbytes, int32_t nframes);
+
+    std::vector<slot> slots_;
+    std::vector<char> slab_;
+    std::vector<uint64_t> framebits_;
+    int32_t slotsize_ = 0; // bytes per slot
+    int32_t slotwords_ = 0; // frame bitfield words per slot
     int32_t size_ = 0;
+    int32_t front_ = 0; // oldest sequence
+    int32_t back_ = -1; // newest sequence
 };
 
 class block_ack {
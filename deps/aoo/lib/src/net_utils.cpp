@@ -1,10 +1,67 @@
 #include "net_utils.hpp"
 
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#endif
+
 #include <stdio.h>
+#include <functional>
 
 namespace aoo {
 namespace net {
 
+ip_address::ip_address(const std::string& host, int port){
+    memset(&address, 0, sizeof(address));
+    if (host.find(':') != std::string::npos){
+        struct sockaddr_in6 sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin6_family = AF_INET6;
+        inet_pton(AF_INET6, host.c_str(), &sa.sin6_addr);
+        sa.sin6_port = htons(port);
+        memcpy(&address, &sa, sizeof(sa));
+        length = sizeof(sa);
+    } else {
+        struct sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = inet_addr(host.c_str());
+        sa.sin_port = htons(port);
+        memcpy(&address, &sa, sizeof(sa));
+        length = sizeof(sa);
+    }
+}
+
+std::string ip_address::name() const {
+    char buf[INET6_ADDRSTRLEN];
+    if (address.ss_family == AF_INET){
+        auto sa = reinterpret_cast<const struct sockaddr_in *>(&address);
+        if (inet_ntop(AF_INET, (void *)&sa->sin_addr, buf, sizeof(buf))){
+            return buf;
+        }
+    } else if (address.ss_family == AF_INET6){
+        auto sa = reinterpret_cast<const struct sockaddr_in6 *>(&address);
+        if (inet_ntop(AF_INET6, (void *)&sa->sin6_addr, buf, sizeof(buf))){
+            return buf;
+        }
+    }
+    return "";
+}
+
+size_t ip_address_hash::operator()(const ip_address& addr) const {
+    uint64_t h = addr.address.ss_family;
+    if (addr.address.ss_family == AF_INET){
+        auto sa = (const struct sockaddr_in *)&addr.address;
+        h = ((uint64_t)sa->sin_addr.s_addr << 16) | sa->sin_port;
+    } else if (addr.address.ss_family == AF_INET6){
+        auto sa = (const struct sockaddr_in6 *)&addr.address;
+        uint64_t a, b;
+        memcpy(&a, (const char *)&sa->sin6_addr, 8);
+        memcpy(&b, (const char *)&sa->sin6_addr + 8, 8);
+        h = (a * 31 + b) * 31 + sa->sin6_port;
+    }
+    return std::hash<uint64_t>()(h);
+}
+
 void socket_close(int sock){
 #ifdef _WIN32
     closesocket(sock);
@@ -44,15 +44,8 @@ struct ip_address {
         memcpy(&address, &sa, sizeof(sa));
         length = sizeof(sa);
     }
-    ip_address(const std::string& host, int port){
-        struct sockaddr_in sa;
-        memset(&sa, 0, sizeof(sa));
-        sa.sin_family = AF_INET;
-        sa.sin_addr.s_addr = inet_addr(host.c_str());
-        sa.sin_port = htons(port);
-        memcpy(&address, &sa, sizeof(sa));
-        length = sizeof(sa);
-    }
+    // numeric IPv4 or IPv6 address
+    ip_address(const std::string& host, int port);
 
     ip_address(const ip_address& other){
         memcpy(&address, &other.address, other.length);
@@ -72,8 +65,12 @@ struct ip_address {
                 auto b = (const struct sockaddr_in *)&other.address;
                 return (a->sin_addr.s_addr == b->sin_addr.s_addr)
                         && (a->sin_port == b->sin_port);
+            } else if (address.ss_family == AF_INET6){
+                auto a = (const struct sockaddr_in6 *)&address;
+                auto b = (const struct sockaddr_in6 *)&other.address;
+                return !memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr))
+                        && (a->sin6_port == b->sin6_port);
             } else  {
-                // IPv6 not supported yet
                 return false;
             }
         #else
@@ -85,17 +82,21 @@ struct ip_address {
         }
     }
 
-    std::string name() const {
-        if (address.ss_family == AF_INET){
-            return inet_ntoa(reinterpret_cast<const struct sockaddr_in *>(&address)->sin_addr);
-        } else {
-            return "";
-        }
+    bool operator!=(const ip_address& other) const {
+        return !(*this == other);
+    }
+
+    bool valid() const {
+        return address.ss_family == AF_INET || address.ss_family == AF_INET6;
     }
 
+    std::string name() const;
+
     int port() const {
         if (address.ss_family == AF_INET){
             return ntohs(reinterpret_cast<const struct sockaddr_in *>(&address)->sin_port);
+        } else if (address.ss_family == AF_INET6){
+            return ntohs(reinterpret_cast<const struct sockaddr_in6 *>(&address)->sin6_port);
         } else {
             return -1;
         }
@@ -105,6 +106,11 @@ struct ip_address {
     socklen_t length;
 };
 
+// for unordered containers; consistent with ip_address::operator==
+struct ip_address_hash {
+    size_t operator()(const ip_address& addr) const;
+};
+
 void socket_close(int sock);
 
 std::string socket_strerror(int err);
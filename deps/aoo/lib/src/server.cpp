@@ -17,6 +17,9 @@
 #define AOONET_MSG_CLIENT_REPLY \
     AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_REPLY
 
+#define AOONET_MSG_CLIENT_RELAY \
+    AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_RELAY
+
 #define AOONET_MSG_CLIENT_GROUP_PUBLIC \
     AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_GROUP AOONET_MSG_PUBLIC
 
@@ -48,12 +51,75 @@
 #define AOONET_MSG_GROUP_PUBLIC \
     AOONET_MSG_GROUP AOONET_MSG_PUBLIC
 
+// don't raise SIGPIPE if the client has closed the connection
+#ifdef MSG_NOSIGNAL
+#define AOO_NET_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define AOO_NET_SEND_FLAGS 0
+#endif
+
+#if AOO_NET_USE_EPOLL
+// reserved epoll ids, client ids start after these
+#define AOO_NET_EPOLL_TCP 0
+#define AOO_NET_EPOLL_UDP 1
+#define AOO_NET_EPOLL_WAIT 2
+#define AOO_NET_EPOLL_CLIENT 3
+#endif
+
 
 namespace aoo {
 namespace net {
 
 char * copy_string(const char * s);
 
+static bool share_group(user& a, user& b){
+    for (auto& grp : a.groups()){
+        for (auto& usr : grp->users()){
+            if (usr.get() == &b){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+#if AOO_NET_USE_MMSG
+// UDP packets are received into a fixed set of buffers. Relayed packets are
+// forwarded straight from these buffers, so the outgoing messages have to be
+// flushed before the next receive call.
+struct server::udp_batch {
+    udp_batch(){
+        memset(recv_msgs, 0, sizeof(recv_msgs));
+        memset(send_msgs, 0, sizeof(send_msgs));
+        for (int i = 0; i < AOO_NET_UDP_BATCH; ++i){
+            recv_iovecs[i].iov_base = buffers[i];
+            recv_iovecs[i].iov_len = sizeof(buffers[i]);
+            recv_msgs[i].msg_hdr.msg_iov = &recv_iovecs[i];
+            recv_msgs[i].msg_hdr.msg_iovlen = 1;
+            recv_msgs[i].msg_hdr.msg_name = &recv_addrs[i];
+            send_msgs[i].msg_hdr.msg_iov = &send_iovecs[i];
+            send_msgs[i].msg_hdr.msg_iovlen = 1;
+            send_msgs[i].msg_hdr.msg_name = &send_addrs[i];
+        }
+    }
+
+    void reset_names(){
+        for (int i = 0; i < AOO_NET_UDP_BATCH; ++i){
+            recv_msgs[i].msg_hdr.msg_namelen = sizeof(recv_addrs[i]);
+        }
+    }
+
+    char buffers[AOO_NET_UDP_BATCH][AOO_MAXPACKETSIZE + AOONET_RELAY_HEADER_SIZE];
+    struct sockaddr_storage recv_addrs[AOO_NET_UDP_BATCH];
+    struct iovec recv_iovecs[AOO_NET_UDP_BATCH];
+    struct mmsghdr recv_msgs[AOO_NET_UDP_BATCH];
+    struct sockaddr_storage send_addrs[AOO_NET_UDP_BATCH];
+    struct iovec send_iovecs[AOO_NET_UDP_BATCH];
+    struct mmsghdr send_msgs[AOO_NET_UDP_BATCH];
+    int num_send = 0;
+};
+#endif
+
 } // net
 } // aoo
 
@@ -146,8 +212,8 @@ aoonet_server * aoonet_server_new(int port, int32_t *err) {
         return nullptr;
     }
 
-    // listen
-    if (listen(tcpsocket, 32) < 0){
+    // listen (a rendezvous server might get lots of simultaneous connection attempts)
+    if (listen(tcpsocket, SOMAXCONN) < 0){
         *err = aoo::net::socket_errno();
         LOG_ERROR("aoo_server: listen() failed (" << *err << ")");
         aoo::net::socket_close(tcpsocket);
@@ -155,10 +221,23 @@ aoonet_server * aoonet_server_new(int port, int32_t *err) {
         return nullptr;
     }
 
-    return new aoo::net::server(tcpsocket, udpsocket);
+#if AOO_NET_USE_EPOLL
+    int epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd < 0){
+        *err = errno;
+        LOG_ERROR("aoo_server: epoll_create1() failed (" << *err << ")");
+        aoo::net::socket_close(tcpsocket);
+        aoo::net::socket_close(udpsocket);
+        return nullptr;
+    }
+#else
+    int epollfd = -1;
+#endif
+
+    return new aoo::net::server(tcpsocket, udpsocket, epollfd);
 }
 
-aoo::net::server::server(int tcpsocket, int udpsocket)
+aoo::net::server::server(int tcpsocket, int udpsocket, int epollfd)
     : tcpsocket_(tcpsocket), udpsocket_(udpsocket)
 {
 #ifdef _WIN32
@@ -171,6 +250,31 @@ aoo::net::server::server(int tcpsocket, int udpsocket)
     if (pipe(waitpipe_) != 0){
         // TODO handle error
     }
+    // see accept_clients()
+    reservefd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+#endif
+#if AOO_NET_USE_EPOLL
+    epollfd_ = epollfd;
+    // the sockets are always drained until they would block,
+    // so we can use edge-triggered notifications. the wait pipe
+    // stays level-triggered because we only read a single byte.
+    auto add = [this](int fd, uint64_t id, uint32_t flags){
+        struct epoll_event ev;
+        ev.events = flags;
+        ev.data.u64 = id;
+        if (epoll_ctl(epollfd_, EPOLL_CTL_ADD, fd, &ev) != 0){
+            LOG_ERROR("aoo_server: epoll_ctl() failed (" << errno << ")");
+        }
+    };
+    add(tcpsocket_, AOO_NET_EPOLL_TCP, EPOLLIN | EPOLLET);
+    add(udpsocket_, AOO_NET_EPOLL_UDP, EPOLLIN | EPOLLET);
+    add(waitpipe_[0], AOO_NET_EPOLL_WAIT, EPOLLIN);
+    next_client_id_ = AOO_NET_EPOLL_CLIENT;
+#else
+    (void)epollfd;
+#endif
+#if AOO_NET_USE_MMSG
+    udp_batch_ = std::make_unique<udp_batch>();
 #endif
     commands_.resize(256, 1);
     events_.resize(256, 1);
@@ -190,6 +294,14 @@ aoo::net::server::~server() {
 #else
     close(waitpipe_[0]);
     close(waitpipe_[1]);
+    if (reservefd_ >= 0){
+        close(reservefd_);
+    }
+#endif
+#if AOO_NET_USE_EPOLL
+    if (epollfd_ >= 0){
+        close(epollfd_);
+    }
 #endif
 
     socket_close(tcpsocket_);
@@ -205,6 +317,8 @@ int32_t aoo::net::server::run(){
         // wait for networking or other events
         wait_for_event();
 
+        update_stats();
+
         if (quit_.load()) {
             break;
         }
@@ -215,6 +329,11 @@ int32_t aoo::net::server::run(){
             commands_.read(cmd);
             cmd->perform(*this);
         }
+        // commands may send to clients, so close the ones that failed
+        // right away instead of after the next network event
+        if (close_failed_clients()){
+            update();
+        }
     }
 
     // need to close all the clients sockets without
@@ -245,6 +364,57 @@ int32_t aoo::net::server::events_available(){
     return 0;
 }
 
+int32_t aoonet_server_get_stats(aoonet_server *server, aoonet_server_stats *stats){
+    return server->get_stats(*stats);
+}
+
+int32_t aoo::net::server::get_stats(aoonet_server_stats& stats) const {
+    stats.num_clients = num_clients_.load(std::memory_order_relaxed);
+    stats.num_users = num_users_.load(std::memory_order_relaxed);
+    stats.num_groups = num_groups_.load(std::memory_order_relaxed);
+    stats.tcp_messages = tcp_messages_.load(std::memory_order_relaxed);
+    stats.udp_messages = udp_messages_.load(std::memory_order_relaxed);
+    stats.send_queue_bytes = send_queue_bytes_.load(std::memory_order_relaxed);
+    stats.max_send_queue = max_send_queue_.load(std::memory_order_relaxed);
+    stats.send_blocked = send_blocked_.load(std::memory_order_relaxed);
+    stats.send_overflows = send_overflows_.load(std::memory_order_relaxed);
+    stats.relay_sessions = num_relay_sessions_.load(std::memory_order_relaxed);
+    stats.relay_packets = relay_packets_.load(std::memory_order_relaxed);
+    stats.relay_bytes = relay_bytes_.load(std::memory_order_relaxed);
+    stats.relay_dropped = relay_dropped_.load(std::memory_order_relaxed);
+    stats.rejected_clients = rejected_clients_.load(std::memory_order_relaxed);
+    return 1;
+}
+
+void aoo::net::server::update_stats(){
+    num_clients_.store((int32_t)clients_.size(), std::memory_order_relaxed);
+    num_users_.store((int32_t)users_.size(), std::memory_order_relaxed);
+    num_groups_.store((int32_t)groups_.size(), std::memory_order_relaxed);
+    num_relay_sessions_.store((int32_t)relay_sessions_.size(), std::memory_order_relaxed);
+}
+
+int32_t aoonet_server_set_relay(aoonet_server *server, int32_t enable, int32_t maxrate){
+    return server->set_relay(enable != 0, maxrate);
+}
+
+int32_t aoo::net::server::set_relay(bool enable, int32_t maxrate){
+    relay_maxrate_.store(std::max<int32_t>(0, maxrate), std::memory_order_relaxed);
+    relay_enabled_.store(enable, std::memory_order_relaxed);
+    LOG_VERBOSE("aoo_server: relay " << (enable ? "enabled" : "disabled")
+                << " (max. rate: " << maxrate << " bytes/s)");
+    return 1;
+}
+
+int32_t aoonet_server_set_event_notify(aoonet_server *server, aoo_notifyfn fn, void *user){
+    return server->set_event_notify(fn, user);
+}
+
+int32_t aoo::net::server::set_event_notify(aoo_notifyfn fn, void *user){
+    notify_.fn = fn;
+    notify_.user = user;
+    return 1;
+}
+
 int32_t aoonet_server_handle_events(aoonet_server *server, aoo_eventhandler fn, void *user){
     return server->handle_events(fn, user);
 }
@@ -310,7 +480,7 @@ std::shared_ptr<user> server::get_user(const std::string& name,
         // create new user (LATER add option to disallow this)
         if (true){
             usr = std::make_shared<user>(name, pwd);
-            users_.push_back(usr);
+            users_.emplace(name, usr);
             e = error::none;
             return usr;
         } else {
@@ -322,10 +492,9 @@ std::shared_ptr<user> server::get_user(const std::string& name,
 
 std::shared_ptr<user> server::find_user(const std::string& name)
 {
-    for (auto& usr : users_){
-        if (usr->name == name){
-            return usr;
-        }
+    auto it = users_.find(name);
+    if (it != users_.end()){
+        return it->second;
     }
     return nullptr;
 }
@@ -353,7 +522,7 @@ std::shared_ptr<group> server::get_group(const std::string& name,
         // create new group (LATER add option to disallow this)
         if (true){
             grp = std::make_shared<group>(name, pwd, is_public);
-            groups_.push_back(grp);
+            groups_.emplace(name, grp);
             e = error::none;
             return grp;
         } else {
@@ -365,10 +534,9 @@ std::shared_ptr<group> server::get_group(const std::string& name,
 
 std::shared_ptr<group> server::find_group(const std::string& name)
 {
-    for (auto& grp : groups_){
-        if (grp->name == name){
-            return grp;
-        }
+    auto it = groups_.find(name);
+    if (it != groups_.end()){
+        return it->second;
     }
     return nullptr;
 }
@@ -384,14 +552,16 @@ int32_t server::get_user_count() const
 }
 
 void server::on_user_joined(user &usr){
+    auto address = usr.endpoint ? usr.endpoint->address().name() : "";
     auto e = std::make_unique<user_event>(AOONET_SERVER_USER_JOIN_EVENT,
-                                          usr.name.c_str());
+                                          usr.name.c_str(), address.c_str());
     push_event(std::move(e));
 }
 
 void server::on_user_left(user &usr){
+    auto address = usr.endpoint ? usr.endpoint->address().name() : "";
     auto e = std::make_unique<user_event>(AOONET_SERVER_USER_LEAVE_EVENT,
-                                          usr.name.c_str());
+                                          usr.name.c_str(), address.c_str());
     push_event(std::move(e));
 }
 
@@ -435,6 +605,12 @@ void server::on_user_joined_group(user& usr, group& grp){
 }
 
 void server::on_user_left_group(user& usr, group& grp){
+    // the user might not share a group with its relay partners anymore;
+    // sessions are checked again when they are recreated.
+    if (usr.endpoint){
+        remove_relay_sessions(*usr.endpoint);
+    }
+
     // notify group members
     for (auto& peer : grp.users()){
         if (peer.get() != &usr){
@@ -451,7 +627,9 @@ void server::on_user_left_group(user& usr, group& grp){
     if (grp.is_public) {
         on_public_group_modified(grp);
 
-        update(); // possibly prune empty
+        // possibly prune empty. NOTE: don't call update() because
+        // we might be called while iterating over the clients.
+        prune_groups();
     }
 
     auto e = std::make_unique<group_event>(AOONET_SERVER_GROUP_LEAVE_EVENT,
@@ -461,7 +639,8 @@ void server::on_user_left_group(user& usr, group& grp){
 
 void server::on_user_wants_public_groups(user& usr){
     // 1) send all existing public groups to the user
-    for (auto& grp : groups_){
+    for (auto& it : groups_){
+        auto& grp = it.second;
         if (!grp->is_public) continue;
 
         char buf[AOO_MAXPACKETSIZE];
@@ -487,7 +666,8 @@ void server::on_public_group_modified(group& grp)
     << osc::EndMessage;
 
     // notify all users who care
-    for (auto & peer : users_) {
+    for (auto & it : users_) {
+        auto & peer = it.second;
         if (peer->watch_public_groups) {
             peer->endpoint->send_message(msg.Data(), (int32_t) msg.Size());
         }
@@ -505,7 +685,8 @@ void server::on_public_group_removed(group& grp)
     << osc::EndMessage;
 
     // notify all users who care
-    for (auto & peer : users_) {
+    for (auto & it : users_) {
+        auto & peer = it.second;
         if (peer->watch_public_groups) {
             peer->endpoint->send_message(msg.Data(), (int32_t) msg.Size());
         }
@@ -572,6 +753,11 @@ void server::wait_for_event(){
             }
             WSAEnumNetworkEvents(clients_[i]->socket, clients_[i]->event, &ne);
 
+            if (ne.lNetworkEvents & FD_WRITE){
+                // socket is writable again
+                clients_[i]->flush();
+            }
+
             if (ne.lNetworkEvents & FD_READ){
                 // receive data from client
                 if (!clients_[i]->receive_data()){
@@ -585,8 +771,58 @@ void server::wait_for_event(){
 
                 clients_[i]->close();
                 didclose = true;
-            } else {
-                // ignore FD_WRITE
+            }
+        }
+    }
+#elif AOO_NET_USE_EPOLL
+    struct epoll_event events[AOO_NET_MAXEVENTS];
+    int result = epoll_wait(epollfd_, events, AOO_NET_MAXEVENTS, -1);
+    if (result < 0){
+        int err = errno;
+        if (err == EINTR){
+            // ?
+        } else {
+            LOG_ERROR("aoo_server: epoll_wait failed (" << err << ")");
+            // what to do?
+        }
+        return;
+    }
+
+    for (int i = 0; i < result; ++i){
+        if (events[i].data.u64 == AOO_NET_EPOLL_WAIT){
+            // clear pipe
+            char c;
+            read(waitpipe_[0], &c, 1);
+        }
+    }
+
+    if (quit_.load()) {
+        return;
+    }
+
+    for (int i = 0; i < result; ++i){
+        auto id = events[i].data.u64;
+        if (id == AOO_NET_EPOLL_TCP){
+            accept_clients();
+        } else if (id == AOO_NET_EPOLL_UDP){
+            receive_udp();
+        } else if (id >= AOO_NET_EPOLL_CLIENT){
+            // the client might have been removed while handling a previous event
+            auto it = client_index_.find(id);
+            if (it != client_index_.end() && it->second->is_active()){
+                auto client = it->second;
+                auto flags = events[i].events;
+                if (flags & EPOLLOUT){
+                    // socket is writable again
+                    client->flush();
+                }
+                // receive data from client; this also handles
+                // hangups and errors, because recv() would fail.
+                if ((flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    && !client->receive_data()){
+                    client->close();
+                    didclose = true;
+                }
             }
         }
     }
@@ -601,6 +837,9 @@ void server::wait_for_event(){
     int numclients = (int)clients_.size();
     for (int i = 0; i < numclients; ++i){
         fds[i].fd = clients_[i]->socket;
+        if (clients_[i]->wants_write()){
+            fds[i].events |= POLLOUT;
+        }
     }
     int tcpindex = numclients;
     int udpindex = numclients + 1;
@@ -633,22 +872,7 @@ void server::wait_for_event(){
     }
     
     if (fds[tcpindex].revents & POLLIN){
-        // accept new clients
-        while (true){
-            ip_address addr;
-            int sock = accept(tcpsocket_, (struct sockaddr *)&addr.address, &addr.length);
-            if (sock >= 0){
-                clients_.push_back(std::make_unique<client_endpoint>(*this, sock, addr));
-                LOG_VERBOSE("aoo_server: accepted client (IP: "
-                            << addr.name() << ", port: " << addr.port() << ")");
-            } else {
-                int err = socket_errno();
-                if (err != EWOULDBLOCK){
-                    LOG_ERROR("aoo_server: couldn't accept client (" << err << ")");
-                }
-                break;
-            }
-        }
+        accept_clients();
     }
 
     if (fds[udpindex].revents & POLLIN){
@@ -657,6 +881,10 @@ void server::wait_for_event(){
 
 
     for (int i = 0; i < numclients; ++i){
+        if (fds[i].revents & POLLOUT){
+            // socket is writable again
+            clients_[i]->flush();
+        }
         if (fds[i].revents & POLLIN){
             // receive data from client
             if (!clients_[i]->receive_data()){
@@ -667,31 +895,155 @@ void server::wait_for_event(){
     }
 #endif
 
+    if (close_failed_clients()){
+        didclose = true;
+    }
+
     if (didclose){
         update();
     }
 }
 
+bool server::close_failed_clients(){
+    bool didclose = false;
+    // closing a client notifies its peers, which might
+    // overflow another client's send queue.
+    while (failed_clients_ > 0){
+        failed_clients_ = 0;
+        for (auto& c : clients_){
+            if (c->is_active() && c->needs_close()){
+                c->close();
+                didclose = true;
+            }
+        }
+    }
+    return didclose;
+}
+
+void server::update_send_queue(int32_t delta, int32_t queued){
+    send_queue_bytes_.fetch_add(delta, std::memory_order_relaxed);
+    if (queued > max_send_queue_.load(std::memory_order_relaxed)){
+        max_send_queue_.store(queued, std::memory_order_relaxed);
+    }
+}
+
+void server::on_send_failed(bool overflow){
+    if (overflow){
+        send_overflows_.fetch_add(1, std::memory_order_relaxed);
+    }
+    failed_clients_++;
+}
+
+#ifndef _WIN32
+void server::accept_clients(){
+    // accept new clients
+    while (true){
+        ip_address addr;
+        int sock = accept(tcpsocket_, (struct sockaddr *)&addr.address, &addr.length);
+        if (sock >= 0){
+            auto client = std::make_unique<client_endpoint>(*this, sock, addr);
+        #if AOO_NET_USE_EPOLL
+            // register once, the socket stays in the epoll set until it is closed
+            if (client->is_active()){
+                struct epoll_event ev;
+                // edge-triggered EPOLLOUT only fires when the socket becomes
+                // writable again, so we can keep it registered all the time.
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                ev.data.u64 = client->id = next_client_id_++;
+                if (epoll_ctl(epollfd_, EPOLL_CTL_ADD, sock, &ev) == 0){
+                    client_index_.emplace(client->id, client.get());
+                } else {
+                    LOG_ERROR("aoo_server: epoll_ctl() failed (" << errno << ")");
+                    client->close(false);
+                }
+            }
+        #endif
+            clients_.push_back(std::move(client));
+            LOG_VERBOSE("aoo_server: accepted client (IP: "
+                        << addr.name() << ", port: " << addr.port() << ")");
+        } else {
+            int err = socket_errno();
+            if (err == EINTR || err == ECONNABORTED){
+                // interrupted or the connection was reset before we
+                // could accept it; there might be more connections
+                continue;
+            } else if (err == EMFILE || err == ENFILE){
+                // Out of file descriptors. The pending connection stays in the
+                // backlog, and with edge-triggered notifications we would never
+                // hear about it (or any later one) again; with poll() we would
+                // spin. Free the reserve descriptor, so that we can accept and
+                // close the connection, and take it again afterwards.
+                LOG_ERROR("aoo_server: too many open files, rejecting client");
+                if (reservefd_ >= 0){
+                    close(reservefd_);
+                    // NOTE: Linux reports EMFILE even if there is no pending
+                    // connection, in which case accept() fails with EWOULDBLOCK.
+                    int sock = accept(tcpsocket_, nullptr, nullptr);
+                    if (sock >= 0){
+                        socket_close(sock);
+                        rejected_clients_.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    reservefd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                    if (sock >= 0 && reservefd_ >= 0){
+                        continue; // try the next one
+                    }
+                }
+            } else if (err != EWOULDBLOCK){
+                LOG_ERROR("aoo_server: couldn't accept client (" << err << ")");
+            }
+            break;
+        }
+    }
+}
+#endif
+
 void server::update(){
+    // forget closed clients in the relay tables
+    for (auto& c : clients_){
+        if (!c->is_active()){
+            remove_relay_sessions(*c);
+            auto it = relay_clients_.find(c->relay_address);
+            if (it != relay_clients_.end() && it->second == c.get()){
+                relay_clients_.erase(it);
+            }
+            auto it2 = relay_tokens_.find(c->relay_token);
+            if (it2 != relay_tokens_.end() && it2->second == c.get()){
+                relay_tokens_.erase(it2);
+            }
+        }
+    }
     // remove closed clients
+#if AOO_NET_USE_EPOLL
+    // NOTE: the socket has already been closed, which also
+    // removes it from the epoll set.
+    for (auto& c : clients_){
+        if (!c->is_active()){
+            client_index_.erase(c->id);
+        }
+    }
+#endif
     auto result = std::remove_if(clients_.begin(), clients_.end(),
                                  [](auto& c){ return !c->is_active(); });
     clients_.erase(result, clients_.end());
     // automatically purge stale users
     // LATER add an option so that users will persist
     for (auto it = users_.begin(); it != users_.end(); ){
-        if (!(*it)->is_active()){
+        if (!it->second->is_active()){
             it = users_.erase(it);
         } else {
             ++it;
         }
     }
+    prune_groups();
+}
+
+void server::prune_groups(){
     // automatically purge empty groups
     // LATER add an option so that groups will persist
     for (auto it = groups_.begin(); it != groups_.end(); ){
-        if ((*it)->num_users() == 0){
-            if ((*it)->is_public) {
-                on_public_group_removed(*(*it));
+        if (it->second->num_users() == 0){
+            if (it->second->is_public) {
+                on_public_group_removed(*it->second);
             }
 
             it = groups_.erase(it);
@@ -705,35 +1057,50 @@ void server::receive_udp(){
     if (udpsocket_ < 0){
         return;
     }
+#if AOO_NET_USE_MMSG
+    // read as many packets as possible until recvmmsg() would block
+    auto& batch = *udp_batch_;
+    while (true){
+        batch.reset_names();
+        int count = recvmmsg(udpsocket_, batch.recv_msgs, AOO_NET_UDP_BATCH,
+                             MSG_DONTWAIT, nullptr);
+        if (count > 0){
+            for (int i = 0; i < count; ++i){
+                auto& hdr = batch.recv_msgs[i].msg_hdr;
+                ip_address addr((const struct sockaddr *)hdr.msg_name, hdr.msg_namelen);
+                handle_udp_packet(batch.buffers[i], batch.recv_msgs[i].msg_len, addr);
+            }
+            // the receive buffers are reused in the next iteration!
+            flush_relay_packets();
+        } else {
+            int err = socket_errno();
+            if (count < 0 && err == EINTR){
+                // we must drain the socket (edge-triggered), so try again
+                continue;
+            }
+            if (count < 0 && err != EWOULDBLOCK){
+                // TODO handle error
+                LOG_ERROR("aoo_server: recvmmsg() failed (" << err << ")");
+            }
+            return;
+        }
+    }
+#else
     // read as much data as possible until recv() would block
     while (true){
-        char buf[AOO_MAXPACKETSIZE];
+        char buf[AOO_MAXPACKETSIZE + AOONET_RELAY_HEADER_SIZE];
         ip_address addr;
         int32_t result = recvfrom(udpsocket_, buf, sizeof(buf), 0,
                                (struct sockaddr *)&addr.address, &addr.length);
         if (result > 0){
-            try {
-                osc::ReceivedPacket packet(buf, result);
-                osc::ReceivedMessage msg(packet);
-
-                int32_t type;
-                auto onset = aoonet_parse_pattern(buf, result, &type);
-                if (!onset){
-                    LOG_WARNING("aoo_server: not an AOO NET message!");
-                    return;
-                }
-
-                if (type != AOO_TYPE_SERVER){
-                    LOG_WARNING("aoo_server: not a client message!");
-                    return;
-                }
-
-                handle_udp_message(msg, onset, addr);
-            } catch (const osc::Exception& e){
-                LOG_ERROR("aoo_server: exception in receive_udp: " << e.what());
-            }
+            handle_udp_packet(buf, result, addr);
         } else if (result < 0){
             int err = socket_errno();
+        #ifndef _WIN32
+            if (err == EINTR){
+                continue;
+            }
+        #endif
         #ifdef _WIN32
             if (err == WSAEWOULDBLOCK)
         #else
@@ -752,6 +1119,251 @@ void server::receive_udp(){
             return;
         }
     }
+#endif
+}
+
+void server::handle_udp_packet(char *buf, int32_t size, const ip_address& addr){
+    if (size <= 0){
+        return;
+    }
+    // relay packets start with a zero byte, so they can't be confused with OSC
+    if (size >= AOONET_RELAY_MAGIC_LEN &&
+        !memcmp(buf, AOONET_RELAY_MAGIC, AOONET_RELAY_MAGIC_LEN))
+    {
+        handle_relay_packet(buf, size, addr);
+        return;
+    }
+
+    try {
+        osc::ReceivedPacket packet(buf, size);
+        osc::ReceivedMessage msg(packet);
+
+        int32_t type;
+        auto onset = aoonet_parse_pattern(buf, size, &type);
+        if (!onset){
+            LOG_WARNING("aoo_server: not an AOO NET message!");
+            return;
+        }
+
+        if (type != AOO_TYPE_SERVER){
+            LOG_WARNING("aoo_server: not a client message!");
+            return;
+        }
+
+        handle_udp_message(msg, onset, addr);
+    } catch (const osc::Exception& e){
+        LOG_ERROR("aoo_server: exception in receive_udp: " << e.what());
+    }
+}
+
+client_endpoint * server::find_relay_client(const ip_address& addr){
+    auto it = relay_clients_.find(addr);
+    if (it != relay_clients_.end()){
+        auto c = it->second;
+        if (c->is_active() && c->get_user()){
+            return c;
+        }
+    }
+    return nullptr;
+}
+
+void server::handle_relay_register(const osc::ReceivedMessage& msg, const ip_address& addr){
+    auto token = msg.ArgumentsBegin()->AsInt64();
+
+    auto it = relay_tokens_.find(token);
+    if (it == relay_tokens_.end() || !it->second->is_active()){
+        // don't reply to strangers
+        LOG_WARNING("aoo_server: relay registration with unknown token from "
+                    << addr.name() << ":" << addr.port());
+        relay_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto& c = *it->second;
+
+    int32_t result = 0;
+    std::string errmsg;
+    if (!relay_enabled()){
+        errmsg = "relay not enabled";
+    } else if (addr != c.public_address){
+        // the peers address the client by the public address it has
+        // sent with the login, so they must not differ.
+        errmsg = "UDP endpoint doesn't match the login";
+    } else {
+        auto it2 = relay_clients_.find(addr);
+        if (it2 != relay_clients_.end() && it2->second != &c){
+            errmsg = "UDP endpoint is already registered by another client";
+        } else {
+            if (it2 == relay_clients_.end()){
+                relay_clients_.emplace(addr, &c);
+                LOG_VERBOSE("aoo_server: relay: registered " << c.get_user()->name
+                            << " (" << addr.name() << ":" << addr.port() << ")");
+            }
+            c.relay_address = addr;
+            result = 1;
+        }
+    }
+    if (!result){
+        LOG_WARNING("aoo_server: relay registration of " << c.get_user()->name
+                    << " from " << addr.name() << ":" << addr.port() << " failed: " << errmsg);
+    }
+
+    // the client repeats the registration until it gets a reply
+    char buf[512];
+    osc::OutboundPacketStream reply(buf, sizeof(buf));
+    reply << osc::BeginMessage(AOONET_MSG_CLIENT_RELAY)
+          << result << errmsg.c_str() << osc::EndMessage;
+
+    send_udp_message(reply.Data(), (int32_t) reply.Size(), addr);
+}
+
+void server::handle_relay_packet(char *buf, int32_t size, const ip_address& addr){
+    ip_address dest;
+    int32_t len = 0;
+    int32_t onset = 0;
+    if (!relay_enabled() ||
+        !(onset = aoonet_relay_parse_header(buf, size, &dest.address, &len)) ||
+        (size - onset) > AOO_MAXPACKETSIZE)
+    {
+        relay_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    dest.length = len;
+    // only relay between logged in clients which share a group
+    auto src = find_relay_client(addr);
+    auto dst = find_relay_client(dest);
+    if (!src || !dst || src == dst){
+        LOG_DEBUG("aoo_server: drop relay packet from " << addr.name()
+                  << ":" << addr.port());
+        relay_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    auto now = clock::now();
+    auto maxrate = relay_maxrate_.load(std::memory_order_relaxed);
+    // always allow at least a single full packet
+    auto burst = std::max<double>(maxrate * AOO_NET_RELAY_BURST,
+                                  AOO_MAXPACKETSIZE + AOONET_RELAY_HEADER_SIZE);
+
+    relay_key key(src, dst);
+    auto it = relay_sessions_.find(key);
+    if (it == relay_sessions_.end()){
+        if (!share_group(*src->get_user(), *dst->get_user())){
+            LOG_DEBUG("aoo_server: relay: " << src->get_user()->name << " and "
+                      << dst->get_user()->name << " don't share a group");
+            relay_dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        relay_session session;
+        session.tokens = burst;
+        session.last_time = now;
+        it = relay_sessions_.emplace(key, session).first;
+        LOG_VERBOSE("aoo_server: new relay session " << src->get_user()->name
+                    << " -> " << dst->get_user()->name);
+    }
+
+    auto& session = it->second;
+    if (maxrate > 0){
+        // token bucket
+        auto elapsed = std::chrono::duration<double>(now - session.last_time).count();
+        session.last_time = now;
+        session.tokens = std::min<double>(session.tokens + elapsed * maxrate, burst);
+        if (session.tokens < size){
+            session.dropped++;
+            relay_dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        session.tokens -= size;
+    }
+    session.packets++;
+    session.bytes += size;
+    relay_packets_.fetch_add(1, std::memory_order_relaxed);
+    relay_bytes_.fetch_add(size, std::memory_order_relaxed);
+
+    // the receiver needs to know where the packet came from. NOTE: the header
+    // size differs if source and destination use different address families.
+    char header[AOONET_RELAY_HEADER_SIZE];
+    auto hsize = aoonet_relay_write_header(header, sizeof(header), &src->relay_address.address);
+    auto payload = size - onset;
+    char *start;
+    if (hsize <= onset){
+        start = buf + onset - hsize;
+    } else {
+        // the buffer has room for the max. header size in front of a max. size packet
+        memmove(buf + hsize, buf + onset, payload);
+        start = buf;
+    }
+    memcpy(start, header, hsize);
+    forward_relay_packet(start, hsize + payload, dst->relay_address);
+}
+
+void server::forward_relay_packet(const char *buf, int32_t size, const ip_address& addr){
+#if AOO_NET_USE_MMSG
+    auto& batch = *udp_batch_;
+    if (batch.num_send == AOO_NET_UDP_BATCH){
+        flush_relay_packets();
+    }
+    int i = batch.num_send++;
+    batch.send_iovecs[i].iov_base = (void *)buf;
+    batch.send_iovecs[i].iov_len = size;
+    memcpy(&batch.send_addrs[i], &addr.address, addr.length);
+    batch.send_msgs[i].msg_hdr.msg_namelen = addr.length;
+#else
+    send_udp_message(buf, size, addr);
+#endif
+}
+
+void server::flush_relay_packets(){
+#if AOO_NET_USE_MMSG
+    auto& batch = *udp_batch_;
+    int sent = 0;
+    while (sent < batch.num_send){
+        int result = sendmmsg(udpsocket_, batch.send_msgs + sent,
+                              batch.num_send - sent, 0);
+        if (result > 0){
+            sent += result;
+        } else {
+            int err = socket_errno();
+            if (err == EINTR){
+                continue;
+            } else if (err == EWOULDBLOCK){
+                // UDP is lossy anyway, drop the rest
+                relay_dropped_.fetch_add(batch.num_send - sent, std::memory_order_relaxed);
+                break;
+            } else {
+                // skip the offending packet
+                LOG_ERROR("aoo_server: sendmmsg() failed (" << err << ")");
+                relay_dropped_.fetch_add(1, std::memory_order_relaxed);
+                sent++;
+            }
+        }
+    }
+    batch.num_send = 0;
+#endif
+}
+
+void server::remove_relay_sessions(const client_endpoint& c){
+    for (auto it = relay_sessions_.begin(); it != relay_sessions_.end(); ){
+        if (it->first.first == &c || it->first.second == &c){
+            LOG_VERBOSE("aoo_server: relay session ended (" << it->second.packets
+                        << " packets, " << it->second.bytes << " bytes, "
+                        << it->second.dropped << " dropped)");
+            it = relay_sessions_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void server::on_client_login(client_endpoint& c){
+    // the token must not be guessable, otherwise anybody could hijack the
+    // relay for a client (which has not registered yet).
+    std::random_device rd;
+    int64_t token;
+    do {
+        token = ((int64_t)rd() << 32) | rd();
+    } while (token == 0 || relay_tokens_.count(token));
+    c.relay_token = token;
+    relay_tokens_.emplace(token, &c);
 }
 
 void server::send_udp_message(const char *msg, int32_t size,
@@ -781,6 +1393,8 @@ void server::handle_udp_message(const osc::ReceivedMessage &msg, int onset,
     auto pattern = msg.AddressPattern() + onset;
     LOG_DEBUG("aoo_server: handle client UDP message " << pattern);
 
+    udp_messages_.fetch_add(1, std::memory_order_relaxed);
+
     try {
         if (!strcmp(pattern, AOONET_MSG_PING)){
             // reply with /ping message
@@ -790,6 +1404,8 @@ void server::handle_udp_message(const osc::ReceivedMessage &msg, int onset,
                   << osc::EndMessage;
 
             send_udp_message(reply.Data(), (int32_t) reply.Size(), addr);
+        } else if (!strcmp(pattern, AOONET_MSG_RELAY)){
+            handle_relay_register(msg, addr);
         } else if (!strcmp(pattern, AOONET_MSG_REQUEST)){
             // reply with /reply message
             char buf[512];
@@ -953,7 +1569,7 @@ client_endpoint::client_endpoint(server &s, int sock, const ip_address &addr)
     }
 #endif
 
-    sendbuffer_.setup(65536);
+    sendbuffer_.setup(AOO_NET_CLIENT_SENDBUFSIZE);
     recvbuffer_.setup(65536);
 
     // generate random token
@@ -972,9 +1588,13 @@ client_endpoint::~client_endpoint(){
 
 void client_endpoint::close(bool notify){
     if (socket >= 0){
-        LOG_VERBOSE("aoo_server: close client endpoint");
+        LOG_VERBOSE("aoo_server: close client endpoint (max. queued: " << max_queued_
+                    << " bytes, blocked: " << num_blocked_ << " times)");
         socket_close(socket);
         socket = -1;
+        // discard unsent data
+        server_->update_send_queue(-sendbuffer_.read_available(), 0);
+        sendbuffer_.reset();
 
         if (user_ && notify){
             user_->on_close(*server_);
@@ -983,52 +1603,73 @@ void client_endpoint::close(bool notify){
 }
 
 void client_endpoint::send_message(const char *msg, int32_t size){
+    if (socket < 0 || close_pending_){
+        return;
+    }
+    auto queued = sendbuffer_.read_available();
     if (sendbuffer_.write_packet((const uint8_t *)msg, size)){
-        while (true){
-            uint8_t buf[1024];
-            int32_t total = 0;
-            // first try to send pending data
-            if (!pending_send_data_.empty()){
-                 std::copy(pending_send_data_.begin(), pending_send_data_.end(), buf);
-                 total = (int32_t) pending_send_data_.size();
-                 pending_send_data_.clear();
-            } else if (sendbuffer_.read_available()){
-                 total = sendbuffer_.read_bytes(buf, sizeof(buf));
-            } else {
-                break;
-            }
+        auto newqueued = sendbuffer_.read_available();
+        if (newqueued > max_queued_){
+            max_queued_ = newqueued;
+        }
+        server_->update_send_queue(newqueued - queued, newqueued);
+        LOG_DEBUG("aoo_server: queued " << msg << " for client");
+        // if the socket is full, the data is sent as soon as it becomes writable
+        if (!write_blocked_){
+            flush();
+        }
+    } else {
+        // the client can't keep up
+        LOG_ERROR("aoo_server: send queue overflow, couldn't send " << msg << " to client");
+        close_pending_ = true;
+        server_->on_send_failed(true);
+    }
+}
 
-            int32_t nbytes = 0;
-            while (nbytes < total){
-                auto res = ::send(socket, (char *)buf + nbytes, total - nbytes, 0);
-                if (res >= 0){
-                    nbytes += res;
-                #if 0
-                    LOG_VERBOSE("aoo_server: sent " << res << " bytes");
-                #endif
-                } else {
-                    auto err = socket_errno();
-                #ifdef _WIN32
-                    if (err != WSAEWOULDBLOCK)
-                #else
-                    if (err != EWOULDBLOCK)
-                #endif
-                    {
-                        // TODO handle error
-                        LOG_ERROR("aoo_server: send() failed (" << err << ")");
-                    } else {
-                        // store in pending buffer
-                        pending_send_data_.assign(buf + nbytes, buf + total);
-                        LOG_VERBOSE("aoo_server: send() would block");
-                    }
-                    return;
+void client_endpoint::flush(){
+    if (socket < 0 || close_pending_){
+        return;
+    }
+    // send directly from the queue until the socket would block
+    while (sendbuffer_.read_available() > 0){
+        int32_t size;
+        auto data = sendbuffer_.read_data(size);
+        auto res = ::send(socket, (const char *)data, size, AOO_NET_SEND_FLAGS);
+        if (res > 0){
+            sendbuffer_.read_commit((int32_t)res);
+            server_->update_send_queue(-(int32_t)res, 0);
+        #if 0
+            LOG_VERBOSE("aoo_server: sent " << res << " bytes");
+        #endif
+        } else {
+            auto err = socket_errno();
+        #ifndef _WIN32
+            if (res < 0 && err == EINTR){
+                continue;
+            }
+        #endif
+        #ifdef _WIN32
+            if (res == 0 || err == WSAEWOULDBLOCK)
+        #else
+            if (res == 0 || err == EWOULDBLOCK)
+        #endif
+            {
+                // wait until the socket is writable again
+                if (!write_blocked_){
+                    write_blocked_ = true;
+                    num_blocked_++;
+                    server_->add_send_blocked();
+                    LOG_VERBOSE("aoo_server: send() would block");
                 }
+            } else {
+                LOG_ERROR("aoo_server: send() failed (" << err << ")");
+                close_pending_ = true;
+                server_->on_send_failed(false);
             }
+            return;
         }
-        LOG_DEBUG("aoo_server: sent " << msg << " to client");
-    } else {
-        LOG_ERROR("aoo_server: couldn't send " << msg << " to client");
     }
+    write_blocked_ = false;
 }
 
 bool client_endpoint::receive_data(){
@@ -1042,6 +1683,11 @@ bool client_endpoint::receive_data(){
         }
         if (result < 0){
             int err = socket_errno();
+        #ifndef _WIN32
+            if (err == EINTR){
+                continue;
+            }
+        #endif
         #ifdef _WIN32
             if (err == WSAEWOULDBLOCK)
         #else
@@ -1124,6 +1770,8 @@ void client_endpoint::handle_message(const osc::ReceivedMessage &msg){
     auto pattern = msg.AddressPattern() + onset;
     LOG_DEBUG("aoo_server: got message " << pattern);
 
+    server_->add_tcp_message();
+
     try {
         if (!strcmp(pattern, AOONET_MSG_PING)){
             handle_ping(msg);
@@ -1187,6 +1835,7 @@ void client_endpoint::handle_login(const osc::ReceivedMessage& msg)
 
             result = 1;
 
+            server_->on_client_login(*this);
             server_->on_user_joined(*user_);
         } else {
             errmsg = server::error_to_string(err);
@@ -1198,8 +1847,12 @@ void client_endpoint::handle_login(const osc::ReceivedMessage& msg)
     // send reply
     char buf[AOO_MAXPACKETSIZE];
     osc::OutboundPacketStream reply(buf, sizeof(buf));
+    // the last argument is the token for registering with the relay
+    // (0 if the relay is not available)
     reply << osc::BeginMessage(AOONET_MSG_CLIENT_LOGIN)
-          << result << errmsg.c_str() << osc::EndMessage;
+          << result << errmsg.c_str()
+          << (osc::int64)((result && server_->relay_enabled()) ? relay_token : 0)
+          << osc::EndMessage;
 
     send_message(reply.Data(), (int32_t)reply.Size());
 }
@@ -1323,15 +1976,18 @@ server::event::~event()
     delete server_event_.errormsg;
 }
 
-server::user_event::user_event(int32_t type, const char *name)
+server::user_event::user_event(int32_t type, const char *name,
+                               const char *address)
 {
     user_event_.type = type;
     user_event_.name = copy_string(name);
+    user_event_.address = copy_string(address);
 }
 
 server::user_event::~user_event()
 {
     delete user_event_.name;
+    delete user_event_.address;
 }
 
 server::group_event::group_event(int32_t type,
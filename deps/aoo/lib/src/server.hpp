@@ -15,10 +15,64 @@
 #include "oscpack/osc/OscReceivedElements.h"
 
 #include <memory.h>
+#include <chrono>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <random>
 
+// use epoll (edge-triggered, persistent registrations) instead of
+// rebuilding a pollfd array for every client on every loop iteration.
+#ifndef AOO_NET_USE_EPOLL
+ #ifdef __linux__
+  #define AOO_NET_USE_EPOLL 1
+ #else
+  #define AOO_NET_USE_EPOLL 0
+ #endif
+#endif
+
+#if AOO_NET_USE_EPOLL
+ #include <sys/epoll.h>
+#endif
+
+// max. number of events handled per epoll_wait() call
+#ifndef AOO_NET_MAXEVENTS
+ #define AOO_NET_MAXEVENTS 64
+#endif
+
+// max. number of (SLIP encoded) bytes queued for a single client.
+// a client which can't keep up is disconnected, so that it can
+// reconnect and get a consistent state, instead of silently
+// missing notifications.
+#ifndef AOO_NET_CLIENT_SENDBUFSIZE
+ #define AOO_NET_CLIENT_SENDBUFSIZE 65536
+#endif
+
+// receive and forward UDP packets in batches with recvmmsg()/sendmmsg()
+#ifndef AOO_NET_USE_MMSG
+ #ifdef __linux__
+  #define AOO_NET_USE_MMSG 1
+ #else
+  #define AOO_NET_USE_MMSG 0
+ #endif
+#endif
+
+// max. number of UDP packets received/forwarded with a single system call
+#ifndef AOO_NET_UDP_BATCH
+ #define AOO_NET_UDP_BATCH 32
+#endif
+
+// default rate limit for a single relay session (bytes per second);
+// enough for several uncompressed audio channels.
+#ifndef AOO_NET_RELAY_MAXRATE
+ #define AOO_NET_RELAY_MAXRATE 1000000
+#endif
+
+// max. burst for a single relay session (seconds at the max. rate)
+#ifndef AOO_NET_RELAY_BURST
+ #define AOO_NET_RELAY_BURST 0.25
+#endif
+
 namespace aoo {
 namespace net {
 
@@ -30,6 +84,10 @@ using user_list = std::vector<std::shared_ptr<user>>;
 struct group;
 using group_list = std::vector<std::shared_ptr<group>>;
 
+// server side indices, looked up by name
+using user_map = std::unordered_map<std::string, std::shared_ptr<user>>;
+using group_map = std::unordered_map<std::string, std::shared_ptr<group>>;
+
 
 class client_endpoint {
     server *server_;
@@ -41,24 +99,53 @@ public:
 
     bool is_active() const { return socket >= 0; }
 
+    // queue a message and try to send it right away
     void send_message(const char *msg, int32_t);
 
+    // send as much of the queue as possible without blocking;
+    // called again when the socket becomes writable.
+    void flush();
+
     bool receive_data();
 
+    // waiting for the socket to become writable
+    bool wants_write() const { return write_blocked_; }
+
+    // the send queue overflowed or sending failed; the server
+    // closes the client once it has finished the current event.
+    bool needs_close() const { return close_pending_; }
+
+    // the logged in user (if any)
+    user * get_user() const { return user_.get(); }
+
+    // the address of the TCP connection
+    const ip_address& address() const { return addr_; }
+
     int socket = -1;
 #ifdef _WIN32
     HANDLE event;
+#elif AOO_NET_USE_EPOLL
+    uint64_t id = 0; // epoll registration
 #endif
     ip_address public_address;
     ip_address local_address;
     int64_t token;
+    // for registering with the relay (see server::handle_relay_register())
+    int64_t relay_token = 0;
+    // the registered UDP endpoint, invalid until then
+    ip_address relay_address;
 private:
     std::shared_ptr<user> user_;
     ip_address addr_;
     
     SLIP sendbuffer_;
     SLIP recvbuffer_;
-    std::vector<uint8_t> pending_send_data_;
+    bool write_blocked_ = false;
+    bool close_pending_ = false;
+    // send metrics
+    int32_t max_queued_ = 0; // max. number of queued bytes
+    int32_t num_blocked_ = 0; // number of times the socket buffer was full
+
 
     void handle_message(const osc::ReceivedMessage& msg);
 
@@ -145,7 +232,8 @@ public:
         };
     };
 
-    server(int tcpsocket, int udpsocket);
+    // takes ownership of the sockets and of 'epollfd' (AOO_NET_USE_EPOLL only)
+    server(int tcpsocket, int udpsocket, int epollfd);
     ~server();
 
     int32_t run() override;
@@ -168,6 +256,21 @@ public:
 
     int32_t get_group_count() const override;
     int32_t get_user_count() const override;
+
+    int32_t get_stats(aoonet_server_stats& stats) const override;
+
+    int32_t set_relay(bool enable, int32_t maxrate) override;
+
+    int32_t set_event_notify(aoo_notifyfn fn, void *user) override;
+
+    bool relay_enabled() const { return relay_enabled_.load(std::memory_order_relaxed); }
+
+    void add_tcp_message() { tcp_messages_.fetch_add(1, std::memory_order_relaxed); }
+
+    // send queue metrics, called by the clients
+    void update_send_queue(int32_t delta, int32_t queued);
+    void add_send_blocked() { send_blocked_.fetch_add(1, std::memory_order_relaxed); }
+    void on_send_failed(bool overflow);
     
     void on_user_joined(user& usr);
 
@@ -182,6 +285,9 @@ public:
     void on_public_group_modified(group& grp);
     void on_public_group_removed(group& grp);
 
+    // the client has logged in; gives it a token for registering with the relay
+    void on_client_login(client_endpoint& c);
+
 
 private:
     int tcpsocket_;
@@ -191,30 +297,105 @@ private:
     HANDLE udpevent_;
 #endif
     std::vector<std::unique_ptr<client_endpoint>> clients_;
-    user_list users_;
-    group_list groups_;
+#if AOO_NET_USE_EPOLL
+    int epollfd_ = -1;
+    // ids instead of pointers, so stale events of a client which
+    // has been removed in the meantime are simply ignored.
+    std::unordered_map<uint64_t, client_endpoint *> client_index_;
+    uint64_t next_client_id_;
+#endif
+    user_map users_;
+    group_map groups_;
     // queues
     lockfree::queue<std::unique_ptr<icommand>> commands_;
     lockfree::queue<std::unique_ptr<ievent>> events_;
+    aoo_event_notify notify_{ nullptr, nullptr };
     void push_event(std::unique_ptr<ievent> e){
         if (events_.write_available()){
             events_.write(std::move(e));
+            if (notify_.fn) notify_.fn(notify_.user);
         }
     }
+    // statistics, updated by the network thread
+    std::atomic<int32_t> num_clients_{0};
+    std::atomic<int32_t> num_users_{0};
+    std::atomic<int32_t> num_groups_{0};
+    std::atomic<int64_t> tcp_messages_{0};
+    std::atomic<int64_t> udp_messages_{0};
+    std::atomic<int64_t> send_queue_bytes_{0};
+    std::atomic<int32_t> max_send_queue_{0};
+    std::atomic<int64_t> send_blocked_{0};
+    std::atomic<int64_t> send_overflows_{0};
+    std::atomic<int64_t> rejected_clients_{0};
+    int32_t failed_clients_ = 0;
+    void update_stats();
+    // relay
+    using clock = std::chrono::steady_clock;
+    struct relay_session {
+        int64_t packets = 0;
+        int64_t bytes = 0;
+        int64_t dropped = 0;
+        double tokens = 0; // bytes which may still be sent (token bucket)
+        clock::time_point last_time;
+    };
+    using relay_key = std::pair<const client_endpoint *, const client_endpoint *>;
+    struct relay_key_hash {
+        size_t operator()(const relay_key& k) const {
+            return std::hash<const void *>()(k.first) * 31 + std::hash<const void *>()(k.second);
+        }
+    };
+    // by the UDP endpoint they have registered from
+    std::unordered_map<ip_address, client_endpoint *, ip_address_hash> relay_clients_;
+    std::unordered_map<int64_t, client_endpoint *> relay_tokens_;
+    std::unordered_map<relay_key, relay_session, relay_key_hash> relay_sessions_;
+    std::atomic<bool> relay_enabled_{false};
+    std::atomic<int32_t> relay_maxrate_{AOO_NET_RELAY_MAXRATE};
+    std::atomic<int32_t> num_relay_sessions_{0};
+    std::atomic<int64_t> relay_packets_{0};
+    std::atomic<int64_t> relay_bytes_{0};
+    std::atomic<int64_t> relay_dropped_{0};
+#if AOO_NET_USE_MMSG
+    struct udp_batch;
+    std::unique_ptr<udp_batch> udp_batch_;
+#endif
     // signal
     std::atomic<bool> quit_{false};
 #ifdef _WIN32
     HANDLE waitevent_ = 0;
 #else
     int waitpipe_[2];
+    // spare descriptor for rejecting clients when we run out (see accept_clients())
+    int reservefd_ = -1;
 #endif
 
     void wait_for_event();
 
+#ifndef _WIN32
+    void accept_clients();
+#endif
+
+    bool close_failed_clients();
+
     void update();
 
+    void prune_groups();
+
     void receive_udp();
 
+    void handle_udp_packet(char *buf, int32_t size, const ip_address& addr);
+
+    client_endpoint * find_relay_client(const ip_address& addr);
+
+    void handle_relay_register(const osc::ReceivedMessage& msg, const ip_address& addr);
+
+    void handle_relay_packet(char *buf, int32_t size, const ip_address& addr);
+
+    void forward_relay_packet(const char *buf, int32_t size, const ip_address& addr);
+
+    void flush_relay_packets();
+
+    void remove_relay_sessions(const client_endpoint& c);
+
     void send_udp_message(const char *msg, int32_t size,
                           const ip_address& addr);
 
@@ -234,7 +415,7 @@ private:
 
     struct user_event : ievent
     {
-        user_event(int32_t type, const char *name);
+        user_event(int32_t type, const char *name, const char *address);
         ~user_event();
     };
 
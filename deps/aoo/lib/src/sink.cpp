@@ -60,6 +60,7 @@ int32_t aoo::sink::invite_source(void *endpoint, int32_t id, aoo_replyfn fn){
         sources_.emplace_front(endpoint, fn, id, 0);
         src = &sources_.front();
         src->set_protocol_flags(protocol_flags_);
+        notify_events(); // "add" event
     }
     src->request_invite();
 
@@ -113,6 +114,33 @@ T& as(void *p){
     return *reinterpret_cast<T *>(p);
 }
 
+// /d <i:salt> <i:seq> <b:data>
+// /d <i:salt> <i:seq> <f:srate> <b:data>
+static void get_compact_data(const osc::ReceivedMessage& msg, int32_t& salt,
+                             aoo::data_packet& d)
+{
+    auto it = msg.ArgumentsBegin();
+
+    salt = (it++)->AsInt32();
+    d.sequence = (it++)->AsInt32();
+    if (msg.ArgumentCount() == 4) {
+        d.samplerate = (it++)->AsDouble();
+    }
+    else {
+        d.samplerate = 0; // marker to use last
+    }
+    const void *blobdata;
+    osc::osc_bundle_element_size_t blobsize;
+    (it++)->AsBlob(blobdata, blobsize);
+    // reconstruct the rest from prior format
+    d.channel = 0 ;
+    d.nframes = 1;
+    d.framenum = 0;
+    d.data = (const char *)blobdata;
+    d.size = blobsize;
+    d.totalsize = d.size;
+}
+
 } // aoo
 
 #define CHECKARG(type) assert(size == sizeof(type))
@@ -202,6 +230,46 @@ int32_t aoo::sink::set_option(int32_t opt, void *ptr, int32_t size)
         CHECKARG(int32_t);
         protocol_flags_ = as<int32_t>(ptr) & 0xff;
         break;
+    // loss concealment
+    case aoo_opt_loss_concealment:
+        CHECKARG(int32_t);
+        loss_concealment_ = std::max<int32_t>(AOO_LOSS_CONCEAL_NONE,
+                                std::min<int32_t>(AOO_LOSS_CONCEAL_FEC, as<int32_t>(ptr)));
+        break;
+    // non-blocking process
+    case aoo_opt_nonblocking_process:
+        CHECKARG(int32_t);
+        nonblocking_process_ = (as<int32_t>(ptr) != 0);
+        break;
+    // event notification
+    case aoo_opt_event_notify:
+        CHECKARG(aoo_event_notify);
+        notify_ = as<aoo_event_notify>(ptr);
+        break;
+    // adaptive buffer
+    case aoo_opt_adaptive_buffer:
+        CHECKARG(int32_t);
+        adaptive_buffer_ = (as<int32_t>(ptr) != 0);
+        break;
+    // adaptive buffer max. stretch
+    case aoo_opt_adaptive_maxstretch:
+        CHECKARG(float);
+        adaptive_maxstretch_ = std::max<float>(0.001, std::min<float>(0.1, as<float>(ptr)));
+        break;
+    // resample quality
+    case aoo_opt_resample_quality:
+    {
+        CHECKARG(int32_t);
+        auto q = std::max<int32_t>(AOO_RESAMPLE_LINEAR,
+                    std::min<int32_t>(AOO_RESAMPLE_SINC_LONG, as<int32_t>(ptr)));
+        if (resample_quality_.exchange(q) != q){
+            // only the interpolation changes, the streams go on
+            for (auto& src : sources_){
+                src.update_quality(q);
+            }
+        }
+        break;
+    }
     // unknown
     default:
         LOG_WARNING("aoo_sink: unsupported option " << opt);
@@ -256,6 +324,31 @@ int32_t aoo::sink::get_option(int32_t opt, void *ptr, int32_t size)
         CHECKARG(int32_t);
         as<int32_t>(ptr) = protocol_flags_;
         break;
+    // loss concealment
+    case aoo_opt_loss_concealment:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = loss_concealment_;
+        break;
+    // non-blocking process
+    case aoo_opt_nonblocking_process:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = nonblocking_process_;
+        break;
+    // adaptive buffer
+    case aoo_opt_adaptive_buffer:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = adaptive_buffer_;
+        break;
+    // adaptive buffer max. stretch
+    case aoo_opt_adaptive_maxstretch:
+        CHECKARG(float);
+        as<float>(ptr) = adaptive_maxstretch_;
+        break;
+    // resample quality
+    case aoo_opt_resample_quality:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = resample_quality_;
+        break;
     // unknown
     default:
         LOG_WARNING("aoo_sink: unsupported option " << opt);
@@ -310,6 +403,12 @@ int32_t aoo::sink::get_sourceoption(void *endpoint, int32_t id,
         case aoo_opt_buffer_fill_ratio:
             CHECKARG(float);
             return src->get_buffer_fill_ratio(as<float>(p));
+        case aoo_opt_packet_counters:
+            CHECKARG(aoo_packet_counters);
+            return src->get_packet_counters(as<aoo_packet_counters>(p));
+        case aoo_opt_jitter_stats:
+            CHECKARG(aoo_jitter_stats);
+            return src->get_jitter_stats(as<aoo_jitter_stats>(p));
         case aoo_opt_userformat:
             return src->get_userformat(static_cast<char*>(p), size);
         // unsupported
@@ -330,14 +429,20 @@ int32_t aoo_sink_handle_message(aoo_sink *sink, const char *data, int32_t n,
 
 int32_t aoo::sink::handle_message(const char *data, int32_t n,
                                   void *endpoint, aoo_replyfn fn) {
+    if (samplerate_ == 0){
+        return 0; // not setup yet
+    }
+
+    // fast path for data messages
+    int32_t result;
+    if (try_handle_data_message(data, n, endpoint, fn, result)){
+        return result;
+    }
+
     try {
         osc::ReceivedPacket packet(data, n);
         osc::ReceivedMessage msg(packet);
 
-        if (samplerate_ == 0){
-            return 0; // not setup yet
-        }
-
         int32_t type, sinkid;
         auto onset = aoo_parse_pattern(data, n, &type, &sinkid);
         if (!onset){
@@ -356,9 +461,10 @@ int32_t aoo::sink::handle_message(const char *data, int32_t n,
             auto it = msg.ArgumentsBegin();
             //auto id = (it++)->AsInt32();
             auto salt = (it++)->AsInt32();
-            auto src = find_source_by_salt(endpoint, salt);
-            if (src){
-                return handle_compact_data_message(endpoint, fn, msg);
+            const sink *owner = nullptr;
+            auto src = salt_index::instance().find(endpoint, salt, &owner);
+            if (src && owner == this){
+                return handle_compact_data_message(*src, msg);
             }
             else {
                 //LOG_WARNING("compact data doesn't match!");
@@ -377,6 +483,8 @@ int32_t aoo::sink::handle_message(const char *data, int32_t n,
             return handle_data_message(endpoint, fn, msg);
         } else if (!strcmp(pattern, AOO_MSG_PING)){
             return handle_ping_message(endpoint, fn, msg);
+        } else if (!strcmp(pattern, AOO_MSG_PARITY)){
+            return handle_parity_message(endpoint, fn, msg);
         } else {
             LOG_WARNING("unknown message " << pattern);
         }
@@ -386,6 +494,58 @@ int32_t aoo::sink::handle_message(const char *data, int32_t n,
     return 0;
 }
 
+aoo_sink * aoo_sink_find_compact(const char *data, int32_t n, void *endpoint,
+                                 aoo_compact_data *msg){
+    // /d <i:salt> ...
+    aoo::data_packet d;
+    int32_t salt;
+    if (!aoo::parse_compact_data_message(data, n, salt, d)){
+        try {
+            osc::ReceivedPacket packet(data, n);
+            osc::ReceivedMessage m(packet);
+            aoo::get_compact_data(m, salt, d);
+        } catch (const osc::Exception& e){
+            LOG_ERROR("aoo_sink_find_compact: " << e.what());
+            return nullptr;
+        }
+    }
+
+    const aoo::sink *owner = nullptr;
+    auto src = aoo::salt_index::instance().find(endpoint, salt, &owner);
+    if (src){
+        msg->source = src;
+        msg->salt = salt;
+        msg->sequence = d.sequence;
+        msg->samplerate = d.samplerate;
+        msg->data = d.data;
+        msg->size = d.size;
+        return const_cast<aoo::sink *>(owner);
+    }
+    return nullptr;
+}
+
+int32_t aoo_sink_handle_compact(aoo_sink *sink, const aoo_compact_data *msg){
+    return sink->handle_compact(*msg);
+}
+
+int32_t aoo::sink::handle_compact(const aoo_compact_data& msg){
+    if (samplerate_ == 0){
+        return 0; // not setup yet
+    }
+    // source was already looked up by salt. the source list only
+    // grows, so the pointer is valid as long as the sink exists.
+    aoo::data_packet d;
+    d.sequence = msg.sequence;
+    d.samplerate = msg.samplerate;
+    d.channel = 0;
+    d.nframes = 1;
+    d.framenum = 0;
+    d.data = msg.data;
+    d.size = msg.size;
+    d.totalsize = d.size;
+    return static_cast<source_desc *>(msg.source)->handle_data(*this, msg.salt, d);
+}
+
 int32_t aoo_sink_send(aoo_sink *sink){
     return sink->send();
 }
@@ -521,10 +681,47 @@ aoo::source_desc * sink::find_source(void *endpoint, int32_t id){
     return nullptr;
 }
 
-aoo::source_desc * sink::find_source_by_salt(void *endpoint, int32_t salt){
-    for (auto& src : sources_){
-        if ((src.endpoint() == endpoint) && (src.get_current_salt() == salt)){
-            return &src;
+/*////////////////////////// salt_index /////////////////////////////*/
+
+salt_index& salt_index::instance(){
+    static salt_index index;
+    return index;
+}
+
+void salt_index::update(const sink& s, source_desc& src, int32_t oldsalt, int32_t newsalt){
+    unique_lock lock(mutex_);
+    // remove old entry
+    auto range = map_.equal_range(oldsalt);
+    for (auto it = range.first; it != range.second; ++it){
+        if (it->second.src == &src){
+            map_.erase(it);
+            break;
+        }
+    }
+    map_.emplace(newsalt, entry { src.endpoint(), &s, &src });
+}
+
+void salt_index::remove(const sink& s){
+    unique_lock lock(mutex_);
+    for (auto it = map_.begin(); it != map_.end(); ){
+        if (it->second.owner == &s){
+            it = map_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+source_desc * salt_index::find(void *endpoint, int32_t salt, const sink **s){
+    shared_lock lock(mutex_);
+    // almost always a single entry, salts are random
+    auto range = map_.equal_range(salt);
+    for (auto it = range.first; it != range.second; ++it){
+        if (it->second.endpoint == endpoint){
+            if (s){
+                *s = it->second.owner;
+            }
+            return it->second.src;
         }
     }
     return nullptr;
@@ -580,6 +777,7 @@ int32_t sink::handle_format_message(void *endpoint, aoo_replyfn fn,
         sources_.emplace_front(endpoint, fn, id, salt);
         src = &sources_.front();
         src->set_protocol_flags(protocol_flags_);
+        notify_events(); // "add" event
     }
 
     return src->handle_format(*this, salt, f, (const char *)settings, size, version, (const char *) userfmt, ufsize);
@@ -605,6 +803,48 @@ int32_t sink::handle_data_message(void *endpoint, aoo_replyfn fn,
     d.data = (const char *)blobdata;
     d.size = blobsize;
 
+    return handle_data(endpoint, fn, id, salt, d);
+}
+
+// Data messages make up most of the traffic, so we try to parse them
+// directly from the buffer, without constructing osc::ReceivedMessage
+// and iterating over the arguments. Returns false if the message is
+// something else (or has an unexpected layout); in this case it must
+// go through the regular path.
+bool sink::try_handle_data_message(const char *data, int32_t n, void *endpoint,
+                                   aoo_replyfn fn, int32_t& result){
+    aoo::data_packet d;
+    int32_t salt;
+    if (parse_compact_data_message(data, n, salt, d)){
+        // the salt identifies both the source and the sink
+        const sink *owner = nullptr;
+        auto src = salt_index::instance().find(endpoint, salt, &owner);
+        if (src && owner == this){
+            result = src->handle_data(*this, salt, d);
+        } else {
+            result = 0;
+        }
+        return true;
+    }
+
+    int32_t type, sinkid;
+    auto onset = aoo_parse_pattern(data, n, &type, &sinkid);
+    if (onset > 0 && type == AOO_TYPE_SINK
+            && (sinkid == id() || sinkid == AOO_ID_WILDCARD)
+            && n > onset + AOO_MSG_DATA_LEN
+            && !memcmp(data + onset, AOO_MSG_DATA, AOO_MSG_DATA_LEN + 1)) // including null character
+    {
+        int32_t id;
+        if (parse_data_message(data, n, id, salt, d)){
+            result = handle_data(endpoint, fn, id, salt, d);
+            return true;
+        }
+    }
+    return false;
+}
+
+int32_t sink::handle_data(void *endpoint, aoo_replyfn fn, int32_t id,
+                          int32_t salt, const aoo::data_packet& d){
     if (id < 0){
         LOG_WARNING("bad ID for " << AOO_MSG_DATA << " message");
         return 0;
@@ -618,47 +858,21 @@ int32_t sink::handle_data_message(void *endpoint, aoo_replyfn fn,
         sources_.emplace_front(endpoint, fn, id, salt);
         src = &sources_.front();
         src->set_protocol_flags(protocol_flags_);
+        notify_events(); // "add" event
         src->request_format();
         return 0;
     }
 }
 
-int32_t sink::handle_compact_data_message(void *endpoint, aoo_replyfn fn,
+int32_t sink::handle_compact_data_message(source_desc& src,
                                           const osc::ReceivedMessage& msg)
 {
-    // /d <i:salt> <i:seq> <b:data>
-    // /d <i:salt> <i:seq> <f:srate> <b:data>
-    auto it = msg.ArgumentsBegin();
-
     aoo::data_packet d;
+    int32_t salt;
+    get_compact_data(msg, salt, d);
 
-    auto salt = (it++)->AsInt32();
-    d.sequence = (it++)->AsInt32();
-    if (msg.ArgumentCount() == 4) {
-        d.samplerate = (it++)->AsDouble();
-    }
-    else {
-        d.samplerate = 0; // marker to use last
-    }
-    const void *blobdata;
-    osc::osc_bundle_element_size_t blobsize;
-    (it++)->AsBlob(blobdata, blobsize);
-    // reconstruct the rest from prior format
-    d.channel = 0 ;
-    d.nframes = 1;
-    d.framenum = 0;
-    d.data = (const char *)blobdata;
-    d.size = blobsize;
-    d.totalsize = d.size;
-
-    // try to find existing source by salt
-    auto src = find_source_by_salt(endpoint, salt);
-    if (src){
-        return src->handle_data(*this, salt, d);
-    } else {
-        // discard data message
-        return 0;
-    }
+    // source was already looked up by salt
+    return src.handle_data(*this, salt, d);
 }
 
 int32_t sink::handle_ping_message(void *endpoint, aoo_replyfn fn,
@@ -683,6 +897,135 @@ int32_t sink::handle_ping_message(void *endpoint, aoo_replyfn fn,
     }
 }
 
+int32_t sink::handle_parity_message(void *endpoint, aoo_replyfn,
+                                    const osc::ReceivedMessage& msg)
+{
+    // /parity <src> <salt> <first> <count> <sizexor> <data>
+    auto it = msg.ArgumentsBegin();
+
+    auto id = (it++)->AsInt32();
+    auto salt = (it++)->AsInt32();
+    auto first = (it++)->AsInt32();
+    auto count = (it++)->AsInt32();
+    auto sizexor = (it++)->AsInt32();
+    const void *blobdata;
+    osc::osc_bundle_element_size_t blobsize;
+    (it++)->AsBlob(blobdata, blobsize);
+
+    if (id < 0){
+        LOG_WARNING("bad ID for " << AOO_MSG_PARITY << " message");
+        return 0;
+    }
+    if (count < 2 || count > AOO_PARITY_MAXBLOCKS){
+        LOG_WARNING("bad block count for " << AOO_MSG_PARITY << " message");
+        return 0;
+    }
+    // try to find existing source
+    auto src = find_source(endpoint, id);
+    if (src){
+        return src->handle_parity(*this, salt, first, count, sizexor,
+                                  (const char *)blobdata, blobsize);
+    } else {
+        return 0;
+    }
+}
+
+/*////////////////////////// jitter_stats /////////////////////////////*/
+
+// only the network thread writes, so plain load + store is enough;
+// readers might see a slightly inconsistent snapshot, which is fine.
+
+void jitter_stats::reset(){
+    for (auto& b : histogram_){
+        b.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+    max_interval_.store(0, std::memory_order_relaxed);
+    max_burst_.store(0, std::memory_order_relaxed);
+    max_reorder_.store(0, std::memory_order_relaxed);
+    max_lossrun_.store(0, std::memory_order_relaxed);
+    lossruns_.store(0, std::memory_order_relaxed);
+}
+
+void jitter_stats::add_lateness(double t){
+    auto ms = t * 1000.0;
+    auto bin = (int32_t)std::max<double>(0, std::min<double>(ms / AOO_JITTER_HISTOGRAM_BINWIDTH,
+                                                               AOO_JITTER_HISTOGRAM_SIZE - 1));
+    histogram_[bin].store(histogram_[bin].load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+    auto count = count_.load(std::memory_order_relaxed) + 1;
+    if (count > AOO_JITTER_HISTOGRAM_AGE){
+        // age out older measurements
+        count = 0;
+        for (auto& b : histogram_){
+            auto n = b.load(std::memory_order_relaxed) / 2;
+            b.store(n, std::memory_order_relaxed);
+            count += n;
+        }
+    }
+    count_.store(count, std::memory_order_relaxed);
+    if (ms > max_.load(std::memory_order_relaxed)){
+        max_.store(ms, std::memory_order_relaxed);
+    }
+}
+
+void jitter_stats::add_interval(double t, int32_t burst){
+    auto ms = t * 1000.0;
+    if (ms > max_interval_.load(std::memory_order_relaxed)){
+        max_interval_.store(ms, std::memory_order_relaxed);
+    }
+    if (burst > max_burst_.load(std::memory_order_relaxed)){
+        max_burst_.store(burst, std::memory_order_relaxed);
+    }
+}
+
+void jitter_stats::add_reorder(int32_t depth){
+    if (depth > max_reorder_.load(std::memory_order_relaxed)){
+        max_reorder_.store(depth, std::memory_order_relaxed);
+    }
+}
+
+void jitter_stats::add_lossrun(int32_t n){
+    lossruns_.store(lossruns_.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+    if (n > max_lossrun_.load(std::memory_order_relaxed)){
+        max_lossrun_.store(n, std::memory_order_relaxed);
+    }
+}
+
+void jitter_stats::get(aoo_jitter_stats &s) const {
+    int64_t total = 0;
+    for (int i = 0; i < AOO_JITTER_HISTOGRAM_SIZE; ++i){
+        s.histogram[i] = histogram_[i].load(std::memory_order_relaxed);
+        total += s.histogram[i];
+    }
+    // the upper edge of the bin which contains the given fraction of blocks.
+    // NOTE: blocks in the last bin are reported as the full histogram range.
+    auto percentile = [&](double p) -> float {
+        auto threshold = (int64_t)std::ceil(total * p);
+        int64_t sum = 0;
+        for (int i = 0; i < AOO_JITTER_HISTOGRAM_SIZE; ++i){
+            sum += s.histogram[i];
+            if (sum >= threshold){
+                return (i + 1) * AOO_JITTER_HISTOGRAM_BINWIDTH;
+            }
+        }
+        return AOO_JITTER_HISTOGRAM_SIZE * AOO_JITTER_HISTOGRAM_BINWIDTH;
+    };
+    s.binwidth = AOO_JITTER_HISTOGRAM_BINWIDTH;
+    s.count = total;
+    s.p50 = total > 0 ? percentile(0.5) : 0;
+    s.p95 = total > 0 ? percentile(0.95) : 0;
+    s.p99 = total > 0 ? percentile(0.99) : 0;
+    s.max = max_.load(std::memory_order_relaxed);
+    s.max_interval = max_interval_.load(std::memory_order_relaxed);
+    s.max_burst = max_burst_.load(std::memory_order_relaxed);
+    s.max_reorder = max_reorder_.load(std::memory_order_relaxed);
+    s.max_lossrun = max_lossrun_.load(std::memory_order_relaxed);
+    s.lossruns = lossruns_.load(std::memory_order_relaxed);
+}
+
 /*////////////////////////// source_desc /////////////////////////////*/
 
 source_desc::source_desc(void *endpoint, aoo_replyfn fn, int32_t id, int32_t salt)
@@ -699,6 +1042,16 @@ source_desc::source_desc(void *endpoint, aoo_replyfn fn, int32_t id, int32_t sal
     resendqueue_.resize(256, 1);
 }
 
+void source_desc::push_event(const sink& s, const event& e){
+    {
+        scoped_lock<spinlock> l(eventqueuelock_);
+        if (eventqueue_.write_available()){
+            eventqueue_.write(e);
+        }
+    }
+    s.notify_events();
+}
+
 int32_t source_desc::get_format(aoo_format_storage &format){
     // synchronize with handle_format() and update()!
     shared_lock lock(mutex_);
@@ -731,6 +1084,19 @@ int32_t source_desc::get_buffer_fill_ratio(float &ratio){
     return 1;
 }
 
+int32_t source_desc::get_packet_counters(aoo_packet_counters &c){
+    c.received = packets_received_.load(std::memory_order_relaxed);
+    c.fastpath = packets_fastpath_.load(std::memory_order_relaxed);
+    return 1;
+}
+
+int32_t source_desc::get_jitter_stats(aoo_jitter_stats &s){
+    stats_.get(s);
+    // the current peak lateness is tracked separately (see update_jitter())
+    s.jitter = jitter_.load(std::memory_order_relaxed) * 1000.0;
+    return 1;
+}
+
 int32_t source_desc::get_userformat(char *buf, int32_t size){
     shared_lock lock(mutex_);
     if (userformat_.empty()) return 0;
@@ -745,44 +1111,96 @@ int32_t source_desc::get_userformat(char *buf, int32_t size){
 
 
 void source_desc::update(const sink &s){
+    stream_buffers b; // the old buffers are freed after unlocking
+    for (;;){
+        {
+            shared_lock lock(mutex_);
+            if (!decoder_){
+                return;
+            }
+            prepare_buffers(s, *decoder_, b);
+        }
+        // take writer lock!
+        unique_lock lock(mutex_);
+        // the format might have changed in the meantime
+        if (decoder_ && decoder_->nchannels() == b.nchannels
+                && decoder_->blocksize() == b.blocksize
+                && decoder_->samplerate() == b.samplerate){
+            swap_buffers(s, b);
+            return;
+        }
+    }
+}
+
+void source_desc::update_quality(int32_t quality){
+    dynamic_resampler::quality_change change;
+    {
+        shared_lock lock(mutex_);
+        resampler_.prepare_quality(quality, change);
+    }
     // take writer lock!
     unique_lock lock(mutex_);
-    do_update(s);
+    resampler_.set_quality(change);
 }
 
-void source_desc::do_update(const sink &s){
-    // resize audio ring buffer
-    if (decoder_ && decoder_->blocksize() > 0 && decoder_->samplerate() > 0){
+// call without lock, only reads from the decoder and the sink
+void source_desc::prepare_buffers(const sink &s, const aoo::decoder& dec, stream_buffers& b){
+    b.nchannels = dec.nchannels();
+    b.blocksize = dec.blocksize();
+    b.samplerate = dec.samplerate();
+    b.nbuffers = 0;
+    if (b.blocksize > 0 && b.samplerate > 0){
         // recalculate buffersize from ms to samples
-        double bufsize = (double)s.buffersize() * decoder_->samplerate() * 0.001;
+        double bufsize = (double)s.buffersize() * b.samplerate * 0.001;
         bufsize = std::max(bufsize, (double)s.blocksize()); // needs to be at least one processing blocksize worth!
-        auto d = div(bufsize, decoder_->blocksize());
+        auto d = div(bufsize, b.blocksize);
         int32_t nbuffers = d.quot + (d.rem != 0); // round up
         nbuffers = std::max<int32_t>(1, nbuffers); // e.g. if buffersize_ is 0
-        // resize audio buffer and initially fill with zeros.
-        auto nsamples = decoder_->nchannels() * decoder_->blocksize();
-        audioqueue_.resize(nbuffers * nsamples, nsamples);
-        infoqueue_.resize(nbuffers, 1);
-        int count = 0;
-        while (audioqueue_.write_available() && infoqueue_.write_available()){
-            audioqueue_.write_commit();
+        // resize audio buffer and initially fill with zeros, but leave room
+        // for one block, so the first block can be decoded right away
+        // instead of waiting in the jitter buffer (see handle_data()).
+        auto nsamples = b.nchannels * b.blocksize;
+        b.audioqueue.resize(nbuffers * nsamples, nsamples);
+        b.infoqueue.resize(nbuffers, 1);
+        while (b.audioqueue.write_available() > 1 && b.infoqueue.write_available() > 1){
+            b.audioqueue.write_commit();
             // push nominal samplerate + default channel (0)
             block_info i;
-            i.sr = decoder_->samplerate();
+            i.sr = b.samplerate;
             i.channel = 0;
-            infoqueue_.write(i);
-            count++;
+            b.infoqueue.write(i);
         };
-        LOG_VERBOSE("reset source queues to " << nbuffers << " buffers");
+        // setup resampler
+        b.resampler.setup(b.blocksize, s.blocksize(),
+                          b.samplerate, s.samplerate(), b.nchannels,
+                          s.resample_quality());
+        // resize block queue
+        // (the slots are sized for uncompressed blocks, so they never have to grow in practice)
+        b.blockqueue.resize(nbuffers + 8, nsamples * sizeof(aoo_sample)); // (32) extra capacity for network jitter (allows lower buffersizes) (should be option?)
+        b.nbuffers = nbuffers;
+    }
+}
+
+// call with writer lock! should be quick, no allocations
+void source_desc::swap_buffers(const sink &s, stream_buffers& b){
+    if (b.decoder){
+        decoder_.swap(b.decoder);
+    }
+    if (decoder_ && b.nbuffers > 0){
+        std::swap(audioqueue_, b.audioqueue);
+        std::swap(infoqueue_, b.infoqueue);
+        std::swap(resampler_, b.resampler);
+        std::swap(blockqueue_, b.blockqueue);
+        LOG_VERBOSE("reset source queues to " << b.nbuffers << " buffers");
+        // restart jitter measurement
+        jitter_start_.clear();
+        fill_ = -1;
+        lossrun_ = 0;
+        stats_.reset();
     #if 0
         // don't touch the event queue once constructed
         eventqueue_.reset();
     #endif
-        // setup resampler
-        resampler_.setup(decoder_->blocksize(), s.blocksize(),
-                            decoder_->samplerate(), s.samplerate(), decoder_->nchannels());
-        // resize block queue
-        blockqueue_.resize(nbuffers + 8); // (32) extra capacity for network jitter (allows lower buffersizes) (should be option?)
         newest_ = 0;
         next_ = -1;
         nextneedsfadein_ = 0;
@@ -791,13 +1209,14 @@ void source_desc::do_update(const sink &s){
         streamstate_.reset();
         ack_list_.set_limit(s.resend_limit());
         ack_list_.clear();
+        recent_.resize(AOO_PARITY_MAXBLOCKS * 2); // only allocates the first time
 
         // start in a need recovery state so the buffer is re-filled when we get the first data
         streamstate_.request_recover();
 
         LOG_DEBUG("update source " << id_ << ": sr = " << decoder_->samplerate()
                     << ", blocksize = " << decoder_->blocksize() << ", nchannels = "
-                    << decoder_->nchannels() << ", bufsize = " << nbuffers * nsamples);
+                    << decoder_->nchannels() << ", bufsize = " << b.nbuffers * b.nchannels * b.blocksize);
     }
 }
 
@@ -806,45 +1225,87 @@ void source_desc::do_update(const sink &s){
 int32_t source_desc::handle_format(const sink& s, int32_t salt, const aoo_format& f,
                                    const char *settings, int32_t size, int32_t version,
                                    const char *userformat, int32_t ufsize){
-    // take writer lock!
-    unique_lock lock(mutex_);
-
-    salt_ = salt;
+    // codec name + format header + codec settings
+    std::vector<char> key;
+    int32_t header[3] = { f.nchannels, f.samplerate, f.blocksize };
+    key.insert(key.end(), f.codec, f.codec + strlen(f.codec) + 1);
+    key.insert(key.end(), (const char *)header, (const char *)header + sizeof(header));
+    if (settings && size > 0){
+        key.insert(key.end(), settings, settings + size);
+    }
+
+    // set up the buffers (and the decoder, if needed) without holding
+    // the lock, the audio thread might be waiting for it.
+    // NOTE: only the network thread changes the decoder, so it can't go away in between.
+    stream_buffers b;
+    bool samedecoder = false;
+    {
+        shared_lock lock(mutex_);
+        // e.g. the source just restarted its stream: keep the decoder
+        if (decoder_ && key == formatkey_){
+            prepare_buffers(s, *decoder_, b);
+            samedecoder = true;
+        }
+    }
 
-    // create/change decoder if needed
-    if (!decoder_ || strcmp(decoder_->name(), f.codec)){
+    if (!samedecoder){
         auto c = aoo::find_codec(f.codec);
         if (c){
-            decoder_ = c->create_decoder();
+            b.decoder = c->create_decoder();
         } else {
             LOG_ERROR("codec '" << f.codec << "' not supported!");
             return 0;
         }
-        if (!decoder_){
+        if (!b.decoder){
             LOG_ERROR("couldn't create decoder!");
             return 0;
         }
+
+        // read format
+        b.decoder->read_format(f, settings, size);
+
+        prepare_buffers(s, *b.decoder, b);
+    }
+
+    // user format
+    std::vector<char> uf;
+    if (userformat) {
+        uf.assign(userformat, userformat+ufsize);
     }
 
+    // take writer lock!
+    unique_lock lock(mutex_);
+
+    // (re)register so compact data with the new salt gets routed to us
+    salt_index::instance().update(s, *this, salt_, salt);
+
+    salt_ = salt;
+
     // see what protocol flags are in the LSB of the version
     protocol_flags_ = (0xFF & version);
-    
-    // read format
-    decoder_->read_format(f, settings, size);
 
-    // user format
     if (userformat) {
-        userformat_.assign(userformat, userformat+ufsize);
+        userformat_.swap(uf);
+    }
+
+    if (samedecoder){
+        // new stream, forget the old decoder state
+        decoder_->reset();
+    } else {
+        formatkey_.swap(key);
     }
 
-    do_update(s);
+    swap_buffers(s, b);
+
+    lock.unlock();
+    // the old decoder and buffers are freed without the lock
 
     // push event
     event e;
     e.type = AOO_SOURCE_FORMAT_EVENT;
     e.source.endpoint = endpoint_;
     e.source.id = id_;
-    push_event(e);
+    push_event(s, e);
 
     return 1;
 }
@@ -884,17 +1345,42 @@ int32_t source_desc::handle_data(const sink& s, int32_t salt, const aoo::data_pa
         return 0;
     }
 
-    // add data packet
-    if (!add_packet(d)){
-        return 0;
-    }
+    packets_received_.fetch_add(1, std::memory_order_relaxed);
 
-    // process blocks and send audio
-    process_blocks();
+    if (d.nframes == 1 && d.sequence == next_ && blockqueue_.empty()
+        && audioqueue_.write_available())
+    {
+        // fast path: the block we're waiting for arrived complete
+        // and nothing is queued before it, so we can decode it
+        // straight from the receive buffer.
+        block_info i;
+        i.sr = d.samplerate > 0 ? d.samplerate : samplerate_;
+        i.channel = d.channel >= 0 ? d.channel : channel_;
 
-#if 1
-    check_outdated_blocks();
-#endif
+        if (parity_active_ && d.size > 0){
+            recent_.push(d.sequence, i.sr, d.data, d.size, 1, d.size);
+        }
+        // it might have been requested for resending
+        ack_list_.remove(d.sequence);
+
+        write_block(s.loss_concealment(), d.sequence, d.data, d.size,
+                    i, d.sequence == nextneedsfadein_);
+        next_++;
+
+        packets_fastpath_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        // add data packet
+        if (!add_packet(d)){
+            return 0;
+        }
+
+        // process blocks and send audio
+        process_blocks(s);
+
+    #if 1
+        check_outdated_blocks();
+    #endif
+    }
 
     // check and resend missing blocks
     check_missing_blocks(s);
@@ -931,7 +1417,98 @@ int32_t source_desc::handle_ping(const sink &s, time_tag tt){
     e.ping.tt1 = tt.to_uint64();
     e.ping.tt2 = tt2.to_uint64();
     e.ping.tt3 = 0;
-    push_event(e);
+    push_event(s, e);
+
+    return 1;
+}
+
+// /aoo/sink/<id>/parity <src> <salt> <first> <count> <sizexor> <data>
+
+int32_t source_desc::handle_parity(const sink& s, int32_t salt, int32_t first, int32_t count,
+                                   int32_t sizexor, const char *data, int32_t size){
+    // synchronize with update()!
+    shared_lock lock(mutex_);
+
+    if (salt != salt_ || !decoder_){
+        return 0;
+    }
+
+    // from now on keep decoded blocks around
+    parity_active_ = true;
+
+    if (next_ < 0 || (first + count) <= next_){
+        return 1; // too late, nothing left to rebuild
+    }
+
+    // XOR all the other blocks of the group into the parity,
+    // which leaves us with the missing block (if exactly one is missing)
+    paritybuffer_.assign(data, data + size);
+    auto buf = paritybuffer_.data();
+    int32_t missing = -1;
+
+    for (int32_t seq = first; seq < first + count; ++seq){
+        // already decoded or still in the jitter buffer?
+        bool found = false, complete = false;
+        const char *bdata = nullptr;
+        int32_t bsize = 0;
+        if (seq < next_){
+            if (auto b = recent_.find(seq)){
+                found = true;
+                complete = b->complete();
+                bdata = b->data();
+                bsize = b->size();
+            }
+        } else if (auto b = blockqueue_.find(seq)){
+            found = true;
+            complete = b->complete();
+            bdata = b->data();
+            bsize = b->size();
+        }
+        if (found && complete){
+            if (bsize > size){
+                LOG_WARNING("parity smaller than block " << seq);
+                return 0;
+            }
+            for (int32_t i = 0; i < bsize; ++i){
+                buf[i] ^= bdata[i];
+            }
+            sizexor ^= bsize;
+        } else if (!found && seq >= next_ && missing < 0){
+            missing = seq;
+        } else {
+            // already concealed, partially received or more than one block missing
+            return 1;
+        }
+    }
+
+    if (missing < 0){
+        return 1; // nothing missing
+    }
+
+    if (sizexor <= 0 || sizexor > size){
+        LOG_WARNING("bad block size " << sizexor << " from parity");
+        return 0;
+    }
+
+    aoo::data_packet d;
+    d.sequence = missing;
+    d.samplerate = samplerate_;
+    d.channel = channel_;
+    d.totalsize = sizexor;
+    d.nframes = 1;
+    d.framenum = 0;
+    d.data = buf;
+    d.size = sizexor;
+
+    if (!add_packet(d)){
+        return 0;
+    }
+
+    LOG_VERBOSE("rebuilt block " << missing << " from parity");
+
+    process_blocks(s);
+
+    check_outdated_blocks();
 
     return 1;
 }
@@ -957,8 +1534,17 @@ bool source_desc::send(const sink& s){
 bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int32_t numsampleframes){
     // synchronize with handle_format() and update()!
     // the mutex should be uncontended most of the time.
-    // NOTE: We could use try_lock() and skip the block if we couldn't aquire the lock.
-    shared_lock lock(mutex_);
+    // Decoding happens in process_blocks() on the network thread and only takes
+    // a reader lock, so we can only be blocked by a format change or buffer resize.
+    shared_lock lock(mutex_, std::defer_lock);
+    if (s.nonblocking_process()){
+        if (!lock.try_lock()){
+            // don't wait, just skip this source for now
+            return false;
+        }
+    } else {
+        lock.lock();
+    }
 
     if (!decoder_){
         return false;
@@ -977,25 +1563,25 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
         // push packet loss event
         e.type = AOO_BLOCK_LOST_EVENT;
         e.block_loss.count = lost;
-        push_event(e);
+        push_event(s, e);
     }
     if (reordered > 0){
         // push packet reorder event
         e.type = AOO_BLOCK_REORDERED_EVENT;
         e.block_reorder.count = reordered;
-        push_event(e);
+        push_event(s, e);
     }
     if (resent > 0){
         // push packet resend event
         e.type = AOO_BLOCK_RESENT_EVENT;
         e.block_resend.count = resent;
-        push_event(e);
+        push_event(s, e);
     }
     if (gap > 0){
         // push packet gap event
         e.type = AOO_BLOCK_GAP_EVENT;
         e.block_gap.count = gap;
-        push_event(e);
+        push_event(s, e);
     }
 
     // don't process anything until the first few blocks are recv'd into the blockqueue
@@ -1035,7 +1621,12 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
 
     }
     // update resampler
-    resampler_.update(samplerate_, s.real_samplerate());
+    if (s.adaptive_buffer()){
+        // play slightly faster or slower to move towards the target fill level
+        resampler_.update(samplerate_ * adaptive_speed(s), s.real_samplerate());
+    } else {
+        resampler_.update(samplerate_, s.real_samplerate());
+    }
     // read samples from resampler
     
     //LOG_VERBOSE("s.blocksize: " << s.blocksize() << "  size: " << numsampleframes << "  stride: " << stride << " readsamp: " << readsamples << " ravail: " << resampler_.read_available() << " wavail: " << resampler_.write_available());
@@ -1068,7 +1659,7 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
             e.source_state.endpoint = endpoint_;
             e.source_state.id = id_;
             e.source_state.state = AOO_SOURCE_STATE_PLAY;
-            push_event(e);
+            push_event(s, e);
         }
 
         return true;
@@ -1080,7 +1671,7 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
             e.source_state.endpoint = endpoint_;
             e.source_state.id = id_;
             e.source_state.state = AOO_SOURCE_STATE_STOP;
-            push_event(e);
+            push_event(s, e);
 
             LOG_VERBOSE("UNDERRUN resampler avail " << resampler_.read_available() << "  readsamp: " << readsamples);
 
@@ -1139,16 +1730,29 @@ bool source_desc::check_packet(const data_packet &d){
         } else {
             LOG_VERBOSE("block " << d.sequence << " out of order!");
             streamstate_.add_reordered(1);
+            stats_.add_reorder(-diff);
+        }
+        if (!blockqueue_.find(d.sequence)){
+            // first packet of a late (reordered or resent) block;
+            // leaving these out would make the lateness look better than it is.
+            update_jitter(d.sequence);
         }
     } else {
         if (newest_ > 0 && diff > 1){
             LOG_VERBOSE("skipped " << (diff - 1) << " blocks");
         }
+        if (diff > 0 || newest_ == 0){
+            // first packet of a new block
+            update_jitter(d.sequence);
+        }
         // update newest sequence number
         newest_ = d.sequence;
     }
 
     if (large_gap || recover || dropped || underrun){
+        // the stream is interrupted, so the timing is meaningless
+        jitter_start_.clear();
+
         // record dropped blocks
         streamstate_.add_lost(blockqueue_.size());
         if (diff > 1){
@@ -1201,6 +1805,12 @@ bool source_desc::check_packet(const data_packet &d){
 bool source_desc::add_packet(const data_packet& d){
     auto block = blockqueue_.find(d.sequence);
     if (!block){
+        // a late block whose slot might already hold a newer one.
+        // check this first, we don't want to drop anything for it.
+        if (newest_ > 0 && d.sequence <= newest_ - blockqueue_.capacity()){
+            LOG_VERBOSE("discarded late block " << d.sequence);
+            return false;
+        }
         if (blockqueue_.full()){
             // if the queue is full, we have to drop a block;
             // in this case we send a block of zeros to the audio buffer.
@@ -1254,11 +1864,16 @@ bool source_desc::add_packet(const data_packet& d){
                 LOG_VERBOSE("dropped block " << old << " (queue full)");
             }
         }
+        // an outdated block might still occupy the slot of the new block
+        check_outdated_blocks();
         // add new block
         double srate = d.samplerate > 0 ? d.samplerate : samplerate_;
         int chan = d.channel >= 0 ? d.channel : channel_;
         block = blockqueue_.insert(d.sequence, srate,
                                    chan, d.totalsize, d.nframes);
+        if (!block){
+            return false;
+        }
     } else if (block->has_frame(d.framenum)){
         LOG_VERBOSE("frame " << d.framenum << " of block " << d.sequence << " already received!");
         return false;
@@ -1276,13 +1891,14 @@ bool source_desc::add_packet(const data_packet& d){
     return true;
 }
 
-void source_desc::process_blocks(){
+void source_desc::process_blocks(const sink& s){
     // Transfer all consecutive complete blocks as long as
     // no previous (expected) blocks are missing.
     if (blockqueue_.empty()){
         return;
     }
 
+    const auto lossmode = s.loss_concealment();
     auto b = blockqueue_.begin();
     int32_t next = next_;
     while (b != blockqueue_.end() && audioqueue_.write_available())
@@ -1300,6 +1916,11 @@ void source_desc::process_blocks(){
             i.sr = b->samplerate;
             i.channel = b->channel;
 
+            if (parity_active_ && size > 0){
+                // keep it around, it might be needed to rebuild a later block of its parity group
+                recent_.push(b->sequence, b->samplerate, data, size, 1, size);
+            }
+
             b++;
         } else if (!ack_list_.get(next).remaining()){
             // block won't be resent, just drop it
@@ -1319,42 +1940,14 @@ void source_desc::process_blocks(){
             break;
         }
 
-        next++;
-
         // decode data and push samples
-        auto ptr = audioqueue_.write_data();
-        auto nsamples = audioqueue_.blocksize();
-        // decode audio data
-        if (decoder_->decode(data, size, ptr, nsamples) < 0){
-            LOG_WARNING("aoo_sink: couldn't decode block!");
-            // decoder failed - fill with zeros
-            std::fill(ptr, ptr + nsamples, 0);
-        }
-        else if (dofadein) {
-            // fade the samples in
-            LOG_VERBOSE("fading in block");
-            auto nchannels = decoder_->nchannels();
-            const int sframes = nsamples/nchannels;
-            for (int i = 0; i < nchannels; ++i){
-                float gain = 0.0f;
-                const float gaindelta = 1.0f / sframes;
-                for (int j = 0; j < sframes; ++j){
-                    ptr[j*nchannels+i] *= gain;
-                    gain += gaindelta;
-                }
-            }                   
-            
-            nextneedsfadein_ = -1;
-        }
-        audioqueue_.write_commit();
+        write_block(lossmode, next, data, size, i, dofadein);
 
-        // push info
-        infoqueue_.write(i);
+        next++;
     }
     next_ = next;
     // pop blocks
-    auto count = b - blockqueue_.begin();
-    while (count--){
+    while (!blockqueue_.empty() && blockqueue_.front().sequence < next){
     #if 1
         // remove block from acklist
         ack_list_.remove(blockqueue_.front().sequence);
@@ -1366,6 +1959,75 @@ void source_desc::process_blocks(){
     LOG_DEBUG("next: " << next_);
 }
 
+// decode a block (or conceal a lost block if 'data' is NULL) into the audio queue.
+// the caller must make sure that the audio queue is not full!
+void source_desc::write_block(int32_t lossmode, int32_t seq, const char *data, int32_t size,
+                              const block_info& info, bool fadein){
+    auto ptr = audioqueue_.write_data();
+    auto nsamples = audioqueue_.blocksize();
+    // decode audio data (or conceal the lost block)
+    auto result = data ? decoder_->decode(data, size, ptr, nsamples)
+                       : decode_lost_block(lossmode, seq, ptr, nsamples);
+    // keep track of consecutive lost blocks
+    if (!data){
+        lossrun_++;
+    } else if (lossrun_ > 0){
+        stats_.add_lossrun(lossrun_);
+        lossrun_ = 0;
+    }
+    if (result < 0){
+        LOG_WARNING("aoo_sink: couldn't decode block!");
+        // decoder failed - fill with zeros
+        std::fill(ptr, ptr + nsamples, 0);
+    }
+    else if (fadein) {
+        // fade the samples in
+        LOG_VERBOSE("fading in block");
+        auto nchannels = decoder_->nchannels();
+        const int sframes = nsamples/nchannels;
+        for (int i = 0; i < nchannels; ++i){
+            float gain = 0.0f;
+            const float gaindelta = 1.0f / sframes;
+            for (int j = 0; j < sframes; ++j){
+                ptr[j*nchannels+i] *= gain;
+                gain += gaindelta;
+            }
+        }
+
+        nextneedsfadein_ = -1;
+    }
+    audioqueue_.write_commit();
+
+    // push info
+    infoqueue_.write(info);
+}
+
+int32_t source_desc::decode_lost_block(int32_t mode, int32_t seq,
+                                       aoo_sample *buf, int32_t nsamples){
+    if (mode == AOO_LOSS_CONCEAL_FEC && decoder_->has_fec()){
+        // the following block might already be here, and it can
+        // carry a (lower quality) copy of the lost block.
+        auto b = blockqueue_.find(seq + 1);
+        if (b && b->complete()){
+            auto result = decoder_->decode_fec(b->data(), b->size(), buf, nsamples);
+            if (result > 0){
+                LOG_VERBOSE("recovered block " << seq << " from FEC data");
+                return result;
+            }
+        }
+    }
+
+    if (mode == AOO_LOSS_CONCEAL_NONE){
+        // plain silence, fade in the next block
+        std::fill(buf, buf + nsamples, 0);
+        nextneedsfadein_ = seq + 1;
+        return nsamples;
+    }
+
+    // codec packet loss concealment
+    return decoder_->decode(nullptr, 0, buf, nsamples);
+}
+
 void source_desc::check_outdated_blocks(){
     // pop outdated blocks (shouldn't really happen...)
     while (!blockqueue_.empty() &&
@@ -1386,6 +2048,78 @@ void source_desc::check_outdated_blocks(){
     }
 }
 
+// the lowest arrival offset slowly moves up, so we can follow clock drift
+// and changes in the transmission delay (per block)
+#define AOO_JITTER_BASE_COEFF 0.0001
+// the time constant for the decay of the measured peak jitter in seconds
+#define AOO_JITTER_DECAY 10.0
+// blocks which arrive closer than this fraction of the block period
+// after the previous block count as a burst
+#define AOO_JITTER_BURST_THRESHOLD 0.25
+
+// measure how late blocks arrive compared to the earliest one,
+// taking their nominal send time into account.
+void source_desc::update_jitter(int32_t seq){
+    auto now = time_tag::now();
+    auto period = (double)decoder_->blocksize() / (double)decoder_->samplerate();
+    if (jitter_start_.empty() || seq < jitter_seq_){
+        jitter_start_ = now;
+        jitter_seq_ = seq;
+        jitter_base_ = 0;
+        jitter_peak_ = 0;
+        jitter_last_ = now;
+        burst_ = 1;
+        return;
+    }
+    // time since the previous block
+    auto interval = time_tag::duration(jitter_last_, now);
+    jitter_last_ = now;
+    if (interval < period * AOO_JITTER_BURST_THRESHOLD){
+        burst_++;
+    } else {
+        burst_ = 1;
+    }
+    stats_.add_interval(interval, burst_);
+    auto offset = time_tag::duration(jitter_start_, now) - (seq - jitter_seq_) * period;
+    if (offset < jitter_base_){
+        jitter_base_ = offset;
+    } else {
+        jitter_base_ += (offset - jitter_base_) * AOO_JITTER_BASE_COEFF;
+    }
+    auto lateness = offset - jitter_base_;
+    if (lateness > jitter_peak_){
+        jitter_peak_ = lateness; // instant attack
+    } else {
+        jitter_peak_ -= (jitter_peak_ - lateness) * (period / AOO_JITTER_DECAY);
+    }
+    jitter_.store(jitter_peak_, std::memory_order_relaxed);
+    stats_.add_lateness(lateness);
+}
+
+// the playback speed factor which moves the fill level towards the target.
+double source_desc::adaptive_speed(const sink& s){
+    auto nchannels = decoder_->nchannels();
+    auto sr = decoder_->samplerate();
+    // buffered samples per channel
+    double fill = (double)(audioqueue_.read_available() * audioqueue_.blocksize()
+                           + resampler_.read_available()) / nchannels;
+    // smooth out the sawtooth caused by block-wise reading and writing
+    if (fill_ < 0){
+        fill_ = fill;
+    } else {
+        fill_ += (fill - fill_) * 0.01;
+    }
+    // measured jitter + margin + one block on each side
+    double target = (jitter_.load(std::memory_order_relaxed) + AOO_ADAPTIVE_MARGIN * 0.001) * sr
+            + decoder_->blocksize() + s.blocksize();
+    target = std::min<double>(target, audioqueue_.capacity() / nchannels);
+    // the max. speed change is reached at 20% deviation
+    auto error = (fill_ - target) / target;
+    double maxstretch = s.adaptive_maxstretch();
+    auto speed = std::max<double>(-maxstretch, std::min<double>(maxstretch, error * maxstretch * 5.0));
+    return 1.0 + speed;
+}
+
 #define AOO_BLOCKQUEUE_CHECK_THRESHOLD 3
 
 // deal with "holes" in block queue
@@ -1410,7 +2144,8 @@ void source_desc::check_missing_blocks(const sink& s){
 
     // resend incomplete blocks except for the last block
     LOG_DEBUG("resend incomplete blocks");
-    for (auto it = blockqueue_.begin(); it != (blockqueue_.end() - 1); ++it){
+    auto last = blockqueue_.back().sequence;
+    for (auto it = blockqueue_.begin(); it->sequence != last; ++it){
         if (!it->complete() && resendqueue_.write_available()){
             // insert ack (if needed)
             auto& ack = ack_list_.get(it->sequence);
@@ -16,6 +16,8 @@
 #include "oscpack/osc/OscOutboundPacketStream.h"
 #include "oscpack/osc/OscReceivedElements.h"
 
+#include <unordered_map>
+
 namespace aoo {
 
 struct stream_state {
@@ -122,12 +124,65 @@ private:
     int32_t codecchange_datasize_ = 0;
 };
 
+// arrival statistics of a source. written by the network thread,
+// can be read from any thread (aoo_opt_jitter_stats).
+class jitter_stats {
+public:
+    jitter_stats() { reset(); }
+    jitter_stats(jitter_stats&& other) = delete;
+    jitter_stats& operator=(jitter_stats&& other) = delete;
+
+    void reset();
+
+    void add_lateness(double t);
+
+    void add_interval(double t, int32_t burst);
+
+    void add_reorder(int32_t depth);
+
+    void add_lossrun(int32_t n);
+
+    void get(aoo_jitter_stats& s) const;
+private:
+    std::atomic<int32_t> histogram_[AOO_JITTER_HISTOGRAM_SIZE];
+    std::atomic<int32_t> count_;
+    std::atomic<float> max_;
+    std::atomic<float> max_interval_;
+    std::atomic<int32_t> max_burst_;
+    std::atomic<int32_t> max_reorder_;
+    std::atomic<int32_t> max_lossrun_;
+    std::atomic<int32_t> lossruns_;
+};
+
 struct block_info {
     double sr;
     int32_t channel;
 };
 
 class sink;
+class source_desc;
+
+// process wide salt -> (sink, source) index, so that compact data messages
+// (which only carry the salt) can be routed without asking every sink.
+// updated whenever a source format is handled.
+class salt_index {
+public:
+    static salt_index& instance();
+
+    void update(const sink& s, source_desc& src, int32_t oldsalt, int32_t newsalt);
+
+    void remove(const sink& s);
+
+    source_desc * find(void *endpoint, int32_t salt, const sink **s = nullptr);
+private:
+    struct entry {
+        void *endpoint;
+        const sink *owner;
+        source_desc *src;
+    };
+    std::unordered_multimap<int32_t, entry> map_;
+    aoo::shared_mutex mutex_;
+};
 
 class source_desc {
 public:
@@ -158,6 +213,10 @@ public:
     
     int32_t get_buffer_fill_ratio(float &ratio);
 
+    int32_t get_packet_counters(aoo_packet_counters& c);
+
+    int32_t get_jitter_stats(aoo_jitter_stats& s);
+
     int32_t get_userformat(char * buf, int32_t size);
 
     int32_t get_current_salt() const { return salt_; }
@@ -167,6 +226,8 @@ public:
     // methods
     void update(const sink& s);
 
+    void update_quality(int32_t quality);
+
     int32_t handle_format(const sink& s, int32_t salt, const aoo_format& f,
                           const char *settings, int32_t size, int32_t version, const char *userformat=nullptr, int32_t ufsize=0);
 
@@ -175,6 +236,9 @@ public:
 
     int32_t handle_ping(const sink& s, time_tag tt);
 
+    int32_t handle_parity(const sink& s, int32_t salt, int32_t first, int32_t count,
+                          int32_t sizexor, const char *data, int32_t size);
+
     int32_t handle_events(aoo_eventhandler fn, void *user);
 
     bool send(const sink& s);
@@ -195,17 +259,43 @@ private:
         int32_t sequence;
         int32_t frame;
     };
-    void do_update(const sink& s);
+    // everything a format change or buffer resize has to rebuild.
+    // it is prepared without holding the lock and then swapped in,
+    // so that sink::process() never waits for allocations.
+    struct stream_buffers {
+        std::unique_ptr<aoo::decoder> decoder;
+        jitter_buffer blockqueue;
+        lockfree::queue<aoo_sample> audioqueue;
+        lockfree::queue<block_info> infoqueue;
+        dynamic_resampler resampler;
+        int32_t nbuffers = 0; // 0: no valid format
+        int32_t nchannels = 0;
+        int32_t blocksize = 0;
+        int32_t samplerate = 0;
+    };
+
+    static void prepare_buffers(const sink& s, const aoo::decoder& dec, stream_buffers& b);
+
+    void swap_buffers(const sink& s, stream_buffers& b);
     // handle messages
     bool check_packet(const data_packet& d);
 
     bool add_packet(const data_packet& d);
 
-    void process_blocks();
+    void process_blocks(const sink& s);
+
+    int32_t decode_lost_block(int32_t mode, int32_t seq, aoo_sample *buf, int32_t nsamples);
+
+    void write_block(int32_t lossmode, int32_t seq, const char *data, int32_t size,
+                     const block_info& info, bool fadein);
 
     void check_outdated_blocks();
 
     void check_missing_blocks(const sink& s);
+
+    void update_jitter(int32_t seq);
+
+    double adaptive_speed(const sink& s);
     // send messages
     bool send_format_request(const sink& s);
     bool send_codec_change_request(const sink& s);
@@ -224,6 +314,7 @@ private:
     int32_t salt_;
     // audio decoder
     std::unique_ptr<aoo::decoder> decoder_;
+    std::vector<char> formatkey_; // format the decoder was created with
     // state
     int32_t newest_ = 0; // sequence number of most recent incoming block
     int32_t next_ = 0; // next outgoing block
@@ -233,20 +324,34 @@ private:
     int32_t protocol_flags_ = 0; // protocol flags sent from the remote source
     stream_state streamstate_;
     std::vector<char> userformat_;
+    // packet counters
+    std::atomic<int64_t> packets_received_{0};
+    std::atomic<int64_t> packets_fastpath_{0};
+    // arrival jitter (network thread)
+    time_tag jitter_start_; // arrival time of the reference block
+    int32_t jitter_seq_ = 0; // sequence number of the reference block
+    double jitter_base_ = 0; // lowest arrival time offset
+    double jitter_peak_ = 0; // (decaying) max. lateness
+    std::atomic<float> jitter_{0}; // published for process()
+    time_tag jitter_last_; // arrival time of the previous block
+    int32_t burst_ = 0; // current number of blocks arriving at once
+    int32_t lossrun_ = 0; // current number of consecutive lost blocks
+    jitter_stats stats_;
+    // adaptive buffer (audio thread)
+    double fill_ = -1; // smoothed fill level in samples per channel
     // queues and buffers
-    block_queue blockqueue_;
+    jitter_buffer blockqueue_;
     block_ack_list ack_list_;
+    // recently decoded blocks, kept for parity FEC
+    history_buffer recent_;
+    std::vector<char> paritybuffer_;
+    bool parity_active_ = false;
     lockfree::queue<aoo_sample> audioqueue_;
     lockfree::queue<block_info> infoqueue_;
     lockfree::queue<data_request> resendqueue_;
     lockfree::queue<event> eventqueue_;
     spinlock eventqueuelock_;
-    void push_event(const event& e){
-        scoped_lock<spinlock> l(eventqueuelock_);
-        if (eventqueue_.write_available()){
-            eventqueue_.write(e);
-        }
-    }
+    void push_event(const sink& s, const event& e);
     dynamic_resampler resampler_;
     // thread synchronization
     aoo::shared_mutex mutex_; // LATER replace with a spinlock?
@@ -257,7 +362,9 @@ public:
     sink(int32_t id)
         : id_(id) {}
 
-    ~sink(){}
+    ~sink(){
+        salt_index::instance().remove(*this);
+    }
 
     int32_t setup(int32_t samplerate, int32_t blocksize, int32_t nchannels) override;
 
@@ -270,6 +377,8 @@ public:
     int32_t handle_message(const char *data, int32_t n,
                            void *endpoint, aoo_replyfn fn) override;
 
+    int32_t handle_compact(const aoo_compact_data& msg) override;
+
     int32_t send() override;
 
     int32_t process(aoo_sample **data, int32_t nsampframes, uint64_t t) override;
@@ -318,6 +427,20 @@ public:
 
     int32_t protocol_flags() const { return protocol_flags_; }
 
+    int32_t loss_concealment() const { return loss_concealment_; }
+
+    bool nonblocking_process() const { return nonblocking_process_.load(std::memory_order_relaxed); }
+
+    int32_t resample_quality() const { return resample_quality_; }
+
+    bool adaptive_buffer() const { return adaptive_buffer_.load(std::memory_order_relaxed); }
+
+    float adaptive_maxstretch() const { return adaptive_maxstretch_.load(std::memory_order_relaxed); }
+
+    void notify_events() const {
+        if (notify_.fn) notify_.fn(notify_.user);
+    }
+
 private:
     // settings
     std::atomic<int32_t> id_;
@@ -333,6 +456,12 @@ private:
     std::atomic<float> resend_interval_{ AOO_RESEND_INTERVAL * 0.001 };
     std::atomic<int32_t> resend_maxnumframes_{ AOO_RESEND_MAXNUMFRAMES };
     std::atomic<int32_t> protocol_flags_{ 0 };
+    std::atomic<int32_t> loss_concealment_{ AOO_LOSS_CONCEALMENT };
+    std::atomic<bool> nonblocking_process_{ false };
+    std::atomic<bool> adaptive_buffer_{ false };
+    std::atomic<float> adaptive_maxstretch_{ AOO_ADAPTIVE_MAXSTRETCH };
+    std::atomic<int32_t> resample_quality_{ AOO_RESAMPLE_QUALITY };
+    aoo_event_notify notify_{ nullptr, nullptr }; // set before use
     // the sources
     lockfree::list<source_desc> sources_;
     // timing
@@ -343,7 +472,6 @@ private:
     timer timer_;
     // helper methods
     source_desc *find_source(void *endpoint, int32_t id);
-    source_desc *find_source_by_salt(void *endpoint, int32_t salt);
 
     void update_sources();
 
@@ -353,11 +481,20 @@ private:
     int32_t handle_data_message(void *endpoint, aoo_replyfn fn,
                                 const osc::ReceivedMessage& msg);
 
-    int32_t handle_compact_data_message(void *endpoint, aoo_replyfn fn,
+    bool try_handle_data_message(const char *data, int32_t n, void *endpoint,
+                                 aoo_replyfn fn, int32_t& result);
+
+    int32_t handle_data(void *endpoint, aoo_replyfn fn, int32_t id,
+                        int32_t salt, const aoo::data_packet& d);
+
+    int32_t handle_compact_data_message(source_desc& src,
                                         const osc::ReceivedMessage& msg);
 
     int32_t handle_ping_message(void *endpoint, aoo_replyfn fn,
                                 const osc::ReceivedMessage& msg);
+
+    int32_t handle_parity_message(void *endpoint, aoo_replyfn fn,
+                                  const osc::ReceivedMessage& msg);
 };
 
 } // aoo
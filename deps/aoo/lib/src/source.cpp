@@ -9,6 +9,9 @@
 #include <algorithm>
 #include <random>
 #include <cmath>
+#include <map>
+#include <chrono>
+#include <thread>
 
 /*//////////////////// AoO source /////////////////////*/
 
@@ -17,6 +20,143 @@
 // typetag string: max. 12 bytes
 // args (without blob data): 36 bytes
 
+namespace aoo {
+
+std::shared_ptr<shared_encoder> shared_encoder::get(int32_t group, const encoder& enc,
+                                                    const std::vector<char>& formatkey){
+    static std::mutex mutex;
+    static std::map<std::pair<int32_t, std::vector<char>>, std::weak_ptr<shared_encoder>> encoders;
+
+    if (formatkey.empty() || !enc.can_copy_state()){
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto key = std::make_pair(group, formatkey);
+    auto it = encoders.find(key);
+    if (it != encoders.end()){
+        if (auto result = it->second.lock()){
+            return result;
+        }
+    }
+    // make a new encoder with the same format
+    aoo_format_storage fmt;
+    auto codec = aoo::find_codec(enc.name());
+    if (!codec || !enc.get_format(fmt)){
+        return nullptr;
+    }
+    auto newenc = codec->create_encoder();
+    if (!newenc || !newenc->set_format(fmt.header)){
+        return nullptr;
+    }
+    // forget encoders which aren't used anymore
+    for (auto e = encoders.begin(); e != encoders.end(); ){
+        if (e->second.expired()){
+            e = encoders.erase(e);
+        } else {
+            ++e;
+        }
+    }
+    auto result = std::make_shared<shared_encoder>(group, std::move(newenc));
+    encoders[key] = result;
+    return result;
+}
+
+// FNV-1a
+uint64_t shared_encoder::hash(const aoo_sample *data, int32_t n){
+    auto bytes = (const unsigned char *)data;
+    auto nbytes = n * sizeof(aoo_sample);
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < nbytes; ++i){
+        h = (h ^ bytes[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+bool shared_encoder::matches(const entry& e, int64_t gen, const aoo_sample *data,
+                             int32_t n, uint64_t hash) const {
+    return e.gen == gen && e.hash == hash && (int32_t)e.input.size() == n
+            && !memcmp(e.input.data(), data, n * sizeof(aoo_sample));
+}
+
+bool shared_encoder::join(const aoo_sample *data, int32_t n, uint64_t hash, int64_t& gen){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (members_ == 0){
+        // nobody else uses the encoder, start a new stream
+        encoder_->reset();
+        gen = latest_;
+        members_++;
+        return true;
+    }
+    // look for our first block in the recent history,
+    // it has probably been encoded by another member already.
+    for (int64_t g = latest_; g > 0 && g > latest_ - AOO_SHARED_ENCODER_HISTORY; --g){
+        if (matches(get_entry(g), g, data, n, hash)){
+            gen = g - 1;
+            members_++;
+            return true;
+        }
+    }
+    // we would disturb the other members
+    return false;
+}
+
+int32_t shared_encoder::encode(int64_t& gen, const aoo_sample *data, int32_t n,
+                               uint64_t hash, char *buf, int32_t size){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (gen == latest_){
+        // we are the first member to reach this block, so we encode it.
+        // save the encoder state before, for members which might
+        // leave at this block.
+        auto& e = get_entry(gen + 1);
+        if (!e.before){
+            aoo_format_storage fmt;
+            if (encoder_->get_format(fmt)){
+                e.before = aoo::find_codec(encoder_->name())->create_encoder();
+                if (e.before && !e.before->set_format(fmt.header)){
+                    e.before = nullptr;
+                }
+            }
+        }
+        e.hasbefore = e.before && e.before->copy_state(*encoder_);
+        auto result = encoder_->encode(data, n, buf, size);
+        // the vectors keep their capacity, so we don't allocate in the long run
+        e.gen = gen + 1;
+        e.hash = hash;
+        e.input.assign(data, data + n);
+        e.output.assign(buf, buf + std::max<int32_t>(result, 0));
+        gen = ++latest_;
+        return result;
+    }
+    // another member has already encoded it
+    auto& e = get_entry(gen + 1);
+    if (matches(e, gen + 1, data, n, hash) && (int32_t)e.output.size() <= size){
+        memcpy(buf, e.output.data(), e.output.size());
+        ++gen;
+        return (int32_t)e.output.size();
+    } else {
+        return -1;
+    }
+}
+
+bool shared_encoder::leave(int64_t gen, encoder *enc){
+    std::lock_guard<std::mutex> lock(mutex_);
+    members_--;
+    if (enc){
+        if (gen == latest_){
+            return enc->copy_state(*encoder_);
+        }
+        auto& e = get_entry(gen + 1);
+        if (e.gen == gen + 1 && e.hasbefore){
+            return enc->copy_state(*e.before);
+        }
+        return false;
+    }
+    return true;
+}
+
+} // aoo
+
 aoo_source * aoo_source_new(int32_t id) {
     return new aoo::source(id);
 }
@@ -37,7 +177,9 @@ void aoo_source_free(aoo_source *src){
     delete static_cast<aoo::source *>(src);
 }
 
-aoo::source::~source() {}
+aoo::source::~source() {
+    leave_shared_encoder(false);
+}
 
 template<typename T>
 T& as(void *p){
@@ -145,6 +287,39 @@ int32_t aoo::source::set_option(int32_t opt, void *ptr, int32_t size)
         // limit it somehow, 16 times is already very high
         redundancy_ = std::max<int32_t>(1, std::min<int32_t>(16, as<int32_t>(ptr)));
         break;
+    // parity FEC
+    case aoo_opt_parity:
+        CHECKARG(int32_t);
+        parity_ = std::max<int32_t>(0, std::min<int32_t>(AOO_PARITY_MAXBLOCKS, as<int32_t>(ptr)));
+        break;
+    // encode group
+    case aoo_opt_encode_group:
+        CHECKARG(int32_t);
+        encode_group_ = std::max<int32_t>(0, as<int32_t>(ptr));
+        break;
+    // event notification
+    case aoo_opt_event_notify:
+        CHECKARG(aoo_event_notify);
+        notify_ = as<aoo_event_notify>(ptr);
+        break;
+    // resample quality
+    case aoo_opt_resample_quality:
+    {
+        CHECKARG(int32_t);
+        auto q = std::max<int32_t>(AOO_RESAMPLE_LINEAR,
+                    std::min<int32_t>(AOO_RESAMPLE_SINC_LONG, as<int32_t>(ptr)));
+        if (resample_quality_.exchange(q) != q){
+            // only the interpolation changes, the stream goes on
+            dynamic_resampler::quality_change change;
+            {
+                shared_lock lock(update_mutex_);
+                resampler_.prepare_quality(q, change);
+            }
+            unique_lock lock(update_mutex_); // writer lock!
+            resampler_.set_quality(change);
+        }
+        break;
+    }
     case aoo_opt_respect_codec_change_requests:
         CHECKARG(int32_t);
         respect_codec_change_req_ = as<int32_t>(ptr);
@@ -213,6 +388,21 @@ int32_t aoo::source::get_option(int32_t opt, void *ptr, int32_t size)
         CHECKARG(int32_t);
         as<int32_t>(ptr) = redundancy_;
         break;
+    // parity FEC
+    case aoo_opt_parity:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = parity_;
+        break;
+    // encode group
+    case aoo_opt_encode_group:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = encode_group_;
+        break;
+    // resample quality
+    case aoo_opt_resample_quality:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = resample_quality_;
+        break;
     // unknown
     default:
         LOG_WARNING("aoo_source: unsupported option " << opt);
@@ -565,9 +755,22 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
     }
     
     
-    // the mutex should be uncontended most of the time.
-    // NOTE: We could use try_lock() and skip the block if we couldn't aquire the lock.
-    shared_lock lock(update_mutex_);
+    // the mutex should be uncontended most of the time, but never wait long for it,
+    // e.g. while update() is reallocating the buffers.
+    shared_lock lock(update_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()){
+        auto deadline = std::chrono::steady_clock::now()
+                + std::chrono::microseconds(AOO_SOURCE_LOCK_WAIT);
+        do {
+            std::this_thread::yield();
+        } while (!lock.try_lock() && std::chrono::steady_clock::now() < deadline);
+    }
+    if (!lock.owns_lock()){
+        // let send_data() repeat the previous block in place of this one.
+        // an empty block would make every sink reset its stream.
+        skipped_++;
+        return 0;
+    }
 
     if (!encoder_){
         return 0;
@@ -745,32 +948,28 @@ namespace aoo {
 
 void endpoint::send_data(int32_t src, int32_t salt, const aoo::data_packet& d) const{
     // call without lock!
+    data_message_header header;
+    header.init(id);
+    send_data(src, salt, d, header);
+}
 
-    char buf[AOO_MAXPACKETSIZE];
-    osc::OutboundPacketStream msg(buf, sizeof(buf));
-
-    if (id != AOO_ID_WILDCARD){
-        const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
-                + AOO_MSG_SINK_LEN + 16 + AOO_MSG_DATA_LEN;
-        char address[max_addr_size];
-        snprintf(address, sizeof(address), "%s%s/%d%s",
-                 AOO_MSG_DOMAIN, AOO_MSG_SINK, id, AOO_MSG_DATA);
+void endpoint::send_data(int32_t src, int32_t salt, const aoo::data_packet& d,
+                         const data_message_header& header) const{
+    // call without lock!
 
-        msg << osc::BeginMessage(address);
-    } else {
-        msg << osc::BeginMessage(AOO_MSG_DOMAIN AOO_MSG_SINK AOO_MSG_WILDCARD AOO_MSG_DATA);
+    char buf[AOO_MAXPACKETSIZE];
+    auto size = write_data_message(buf, sizeof(buf), header, src, salt, d);
+    if (!size){
+        LOG_ERROR("aoo_source: data message too large!");
+        return;
     }
 
-    msg << src << salt << d.sequence << d.samplerate << d.channel
-        << d.totalsize << d.nframes << d.framenum
-        << osc::Blob(d.data, d.size) << osc::EndMessage;
-
     LOG_DEBUG("send block: seq = " << d.sequence << ", sr = " << d.samplerate
               << ", chn = " << d.channel << ", totalsize = " << d.totalsize
-              << ", nframes = " << d.nframes << ", frame = " << d.framenum << ", size " << d.size << " msgsize: " << msg.Size() << "  overhead = " << (int) (100 * (1.0 - d.size/(double)msg.Size())) << "%");
+              << ", nframes = " << d.nframes << ", frame = " << d.framenum << ", size " << d.size << " msgsize: " << size << "  overhead = " << (int) (100 * (1.0 - d.size/(double)size)) << "%");
 
 
-    send(msg.Data(), (int32_t)msg.Size());
+    send(buf, size);
 }
 
 // /d <salt> <seq> <data>
@@ -779,28 +978,22 @@ void endpoint::send_data(int32_t src, int32_t salt, const aoo::data_packet& d) c
 void endpoint::send_data_compact(int32_t src, int32_t salt, const aoo::data_packet& d, bool sendrate) {
     // call without lock!
 
-    char buf[AOO_MAXPACKETSIZE];
-    osc::OutboundPacketStream msg(buf, sizeof(buf));
-    
-    msg << osc::BeginMessage(AOO_MSG_COMPACT_DATA);
-
     // the salt is how we identify both ourselves and our target
-    
-    msg << salt << d.sequence;
-    
+
     // only use the 4 argument version (with samplerate as double) if there is big enough divergence from prior samplerate
-    if (sendrate) {
-        msg << d.samplerate;
+    char buf[AOO_MAXPACKETSIZE];
+    auto size = write_compact_data_message(buf, sizeof(buf), salt, d, sendrate);
+    if (!size){
+        LOG_ERROR("aoo_source: data message too large!");
+        return;
     }
-    
-    msg << osc::Blob(d.data, d.size) << osc::EndMessage;
 
     LOG_DEBUG("send compact block: seq = " << d.sequence << ", sr = " << d.samplerate
               << ", chn = " << d.channel << ", totalsize = " << d.totalsize
-              << ", nframes = " << d.nframes << ", frame = " << d.framenum << ", size " << d.size << " msgsize: " << msg.Size() << "  overhead = " << (int) (100 * (1.0 - d.size/(double)msg.Size())) << "%");
+              << ", nframes = " << d.nframes << ", frame = " << d.framenum << ", size " << d.size << " msgsize: " << size << "  overhead = " << (int) (100 * (1.0 - d.size/(double)size)) << "%");
 
 
-    send(msg.Data(), (int32_t)msg.Size());
+    send(buf, size);
 }
 
 // /aoo/sink/<id>/format <src> <version> <salt> <numchannels> <samplerate> <blocksize> <codec> <options...> [<userformat..>]
@@ -863,6 +1056,35 @@ void endpoint::send_ping(int32_t src, time_tag t) const {
     send(msg.Data(), (int32_t)msg.Size());
 }
 
+// /aoo/sink/<id>/parity <src> <salt> <first> <count> <sizexor> <data>
+
+void endpoint::send_parity(int32_t src, int32_t salt, int32_t first, int32_t count,
+                           int32_t sizexor, const char *data, int32_t size) const {
+    // call without lock!
+
+    char buf[AOO_MAXPACKETSIZE];
+    osc::OutboundPacketStream msg(buf, sizeof(buf));
+
+    if (id != AOO_ID_WILDCARD){
+        const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
+                + AOO_MSG_SINK_LEN + 16 + AOO_MSG_PARITY_LEN;
+        char address[max_addr_size];
+        snprintf(address, sizeof(address), "%s%s/%d%s",
+                 AOO_MSG_DOMAIN, AOO_MSG_SINK, id, AOO_MSG_PARITY);
+
+        msg << osc::BeginMessage(address);
+    } else {
+        msg << osc::BeginMessage(AOO_MSG_DOMAIN AOO_MSG_SINK AOO_MSG_WILDCARD AOO_MSG_PARITY);
+    }
+
+    msg << src << salt << first << count << sizexor
+        << osc::Blob(data, size) << osc::EndMessage;
+
+    LOG_DEBUG("send parity: first = " << first << ", count = " << count << ", size = " << size);
+
+    send(msg.Data(), (int32_t)msg.Size());
+}
+
 /*///////////////////////// source ////////////////////////////////*/
 
 sink_desc * source::find_sink(void *endpoint, int32_t id){
@@ -924,6 +1146,10 @@ int32_t source::set_userformat(void * ptr, int32_t size){
 
 // always called with update_mutex_ locked!
 void source::update(){
+    // new stream, we may join a shared encoder again
+    leave_shared_encoder(false);
+    shared_joinable_ = true;
+
     if (!encoder_){
         return;
     }
@@ -945,7 +1171,8 @@ void source::update(){
         // resampler
        // if (blocksize_ != encoder_->blocksize() || samplerate_ != encoder_->samplerate()){
             resampler_.setup(blocksize_, encoder_->blocksize(),
-                             samplerate_, encoder_->samplerate(), nchannels_);
+                             samplerate_, encoder_->samplerate(), nchannels_,
+                             resample_quality_.load());
             resampler_.update(samplerate_, encoder_->samplerate());
         //} else {
         //    resampler_.clear();
@@ -953,7 +1180,9 @@ void source::update(){
 
         // history buffer
         update_historybuffer();
-        
+
+        update_formatkey();
+
         // reset encoder state to avoid old garbage
         encoder_->reset();
         
@@ -969,6 +1198,9 @@ void source::update(){
         salt_ = make_salt();
         sequence_ = 0;
         dropped_ = 0;
+        skipped_ = 0;
+        lastblock_.clear();
+        paritycount_ = 0;
         {
             shared_lock lock2(sink_mutex_);
             for (auto& sink : sinks_){
@@ -989,6 +1221,64 @@ void source::update_historybuffer(){
     }
 }
 
+// codec name + format header + codec settings, so that
+// encoders are only shared between sources with identical formats.
+void source::update_formatkey(){
+    aoo_format fmt;
+    char settings[AOO_CODEC_MAXSETTINGSIZE];
+    auto size = encoder_->write_format(fmt, settings, sizeof(settings));
+    formatkey_.clear();
+    if (size >= 0){
+        auto name = encoder_->name();
+        int32_t header[3] = { fmt.nchannels, fmt.samplerate, fmt.blocksize };
+        formatkey_.insert(formatkey_.end(), name, name + strlen(name) + 1);
+        formatkey_.insert(formatkey_.end(), (const char *)header, (const char *)header + sizeof(header));
+        formatkey_.insert(formatkey_.end(), settings, settings + size);
+    }
+}
+
+// call with update lock!
+int32_t source::encode(const aoo_sample *data, int32_t n, char *buf, int32_t size){
+    auto group = encode_group_.load();
+    if (shared_encoder_ && shared_encoder_->group() != group){
+        leave_shared_encoder(true);
+    }
+    // we can only join at the start of a stream
+    if (shared_joinable_){
+        shared_joinable_ = false;
+        if (group > 0){
+            shared_encoder_ = shared_encoder::get(group, *encoder_, formatkey_);
+            if (shared_encoder_ &&
+                !shared_encoder_->join(data, n, shared_encoder::hash(data, n), shared_gen_)){
+                shared_encoder_ = nullptr;
+            }
+        }
+    }
+    if (shared_encoder_){
+        auto result = shared_encoder_->encode(shared_gen_, data, n,
+                                              shared_encoder::hash(data, n), buf, size);
+        if (result >= 0){
+            return result;
+        }
+        // our audio differs from the rest of the group
+        leave_shared_encoder(true);
+    }
+    return encoder_->encode(data, n, buf, size);
+}
+
+// call with update lock!
+void source::leave_shared_encoder(bool keepstate){
+    if (shared_encoder_){
+        // continue seamlessly with our own encoder
+        if (!shared_encoder_->leave(shared_gen_, keepstate ? encoder_.get() : nullptr)
+                && keepstate){
+            LOG_VERBOSE("aoo_source: shared encoder state not available anymore");
+            encoder_->reset();
+        }
+        shared_encoder_ = nullptr;
+    }
+}
+
 bool source::send_format(){
     bool format_changed = format_changed_.exchange(false);
     bool format_requested = formatrequestqueue_.read_available();
@@ -1154,6 +1444,8 @@ bool source::send_data(){
         d.framenum = 0;
         d.data = nullptr;
         d.size = 0;
+        // empty blocks can't be part of a parity group
+        paritycount_ = 0;
         // now we can unlock
         updatelock.unlock();
 
@@ -1168,9 +1460,46 @@ bool source::send_data(){
 
         // send block to sinks
         for (int i = 0; i < numsinks; ++i){
-            sinks[i].send_data(id(), salt, d);            
+            sinks[i].send_data(id(), salt, d, sinks[i].data_header);
         }
         --dropped_;
+    } else if (skipped_ > 0){
+        // process() couldn't take the lock for a block, repeat the previous one.
+        // update() clears it, a new stream has nothing to repeat.
+        --skipped_;
+        if (lastblock_.empty()){
+            return 1;
+        }
+        d.sequence = sequence_++;
+        d.samplerate = lastsamplerate_;
+        d.totalsize = (int32_t) lastblock_.size();
+        sendbuffer_.assign(lastblock_.begin(), lastblock_.end());
+        auto maxpacketsize = packetsize_ - AOO_DATA_HEADERSIZE;
+        auto dv = div(d.totalsize, maxpacketsize);
+        d.nframes = dv.quot + (dv.rem != 0);
+        history_.push(d.sequence, d.samplerate, sendbuffer_.data(),
+                      d.totalsize, d.nframes, maxpacketsize);
+        // repeated blocks aren't part of a parity group
+        paritycount_ = 0;
+        updatelock.unlock();
+
+        shared_lock listlock(sink_mutex_);
+        int32_t numsinks = (int32_t) sinks_.size();
+        auto sinks = (sink_desc *)alloca((numsinks + 1) * sizeof(sink_desc)); // avoid alloca(0)
+        std::copy(sinks_.begin(), sinks_.end(), sinks);
+        listlock.unlock();
+
+        LOG_VERBOSE("aoo_source: repeat block " << d.sequence);
+        auto ptr = sendbuffer_.data();
+        for (int32_t j = 0; j < d.nframes; ++j, ptr += maxpacketsize){
+            d.framenum = j;
+            d.data = ptr;
+            d.size = (j < dv.quot) ? maxpacketsize : dv.rem;
+            for (int i = 0; i < numsinks; ++i){
+                d.channel = sinks[i].channel;
+                sinks[i].send_data(id(), salt, d, sinks[i].data_header);
+            }
+        }
     } else if (audioqueue_.read_available() && srqueue_.read_available()){
         // make local copy of sink descriptors
         shared_lock listlock(sink_mutex_);
@@ -1197,8 +1526,8 @@ bool source::send_data(){
             auto blocksize = encoder_->blocksize();
             sendbuffer_.resize(sizeof(double) * nchannels * blocksize); // overallocate
 
-            d.totalsize = encoder_->encode(audioqueue_.read_data(), audioqueue_.blocksize(),
-                                           sendbuffer_.data(), (int32_t) sendbuffer_.size());
+            d.totalsize = encode(audioqueue_.read_data(), audioqueue_.blocksize(),
+                                 sendbuffer_.data(), (int32_t) sendbuffer_.size());
             audioqueue_.read_commit();
 
             if (d.totalsize > 0){
@@ -1210,6 +1539,29 @@ bool source::send_data(){
                 // save block
                 history_.push(d.sequence, d.samplerate, sendbuffer_.data(),
                               d.totalsize, d.nframes, maxpacketsize);
+                // in case the next one has to be repeated
+                lastblock_.assign(sendbuffer_.data(), sendbuffer_.data() + d.totalsize);
+                lastsamplerate_ = d.samplerate;
+
+                // add to parity group (only single frame blocks)
+                auto paritysize = parity_.load();
+                bool sendparity = false;
+                int32_t parityfirst = 0, paritycount = 0, paritysizexor = 0;
+                if (paritysize > 1 && d.nframes == 1){
+                    sendparity = add_parity(d.sequence, sendbuffer_.data(), d.totalsize, paritysize);
+                } else {
+                    paritycount_ = 0;
+                }
+                if (sendparity){
+                    // take the completed group while we still hold the lock,
+                    // update() may reset the parity state as soon as we unlock.
+                    // paritysendbuffer_ is only touched by the send thread.
+                    std::swap(paritybuffer_, paritysendbuffer_);
+                    parityfirst = parityfirst_;
+                    paritycount = paritycount_;
+                    paritysizexor = paritysizexor_;
+                    paritycount_ = 0;
+                }
 
                 // unlock before sending!
                 updatelock.unlock();
@@ -1228,7 +1580,7 @@ bool source::send_data(){
                         if (d.nframes == 1 && d.channel == 0 && sinks[i].protocol_flags & AOO_PROTOCOL_FLAG_COMPACT_DATA) {
                             sinks[i].send_data_compact(id(), salt, d, sendrate);                
                         } else {
-                            sinks[i].send_data(id(), salt, d);
+                            sinks[i].send_data(id(), salt, d, sinks[i].data_header);
                         }
                     }
                 };
@@ -1245,6 +1597,14 @@ bool source::send_data(){
                         dosend(dv.quot, ptr, dv.rem);
                     }
                 }
+
+                if (sendparity){
+                    // send parity once, after the last block of the group
+                    for (int i = 0; i < numsinks; ++i){
+                        sinks[i].send_parity(id(), salt, parityfirst, paritycount, paritysizexor,
+                                             paritysendbuffer_.data(), (int32_t)paritysendbuffer_.size());
+                    }
+                }
             } else {
                 LOG_WARNING("aoo_source: couldn't encode audio data!");
             }
@@ -1267,11 +1627,37 @@ bool source::send_data(){
     if (d.sequence == INT32_MAX){
         unique_lock lock2(update_mutex_); // take writer lock
         salt_ = make_salt();
+        lastblock_.clear();
     }
 
     return 1;
 }
 
+// XOR the block into the current parity group,
+// returns true if the group is complete and should be sent
+bool source::add_parity(int32_t seq, const char *data, int32_t size, int32_t groupsize){
+    if (paritycount_ > 0 && seq != parityfirst_ + paritycount_){
+        // not consecutive, start over
+        paritycount_ = 0;
+    }
+    if (paritycount_ == 0){
+        parityfirst_ = seq;
+        paritysizexor_ = 0;
+        paritybuffer_.clear();
+    }
+    // shorter blocks are implicitly zero padded
+    if ((int32_t)paritybuffer_.size() < size){
+        paritybuffer_.resize(size, 0);
+    }
+    auto parity = paritybuffer_.data();
+    for (int32_t i = 0; i < size; ++i){
+        parity[i] ^= data[i];
+    }
+    paritysizexor_ ^= size;
+
+    return ++paritycount_ >= groupsize;
+}
+
 bool source::send_ping(){
     // if stream is stopped, the timer won't increment anyway
     auto elapsed = timer_.get_elapsed();
@@ -1382,6 +1768,7 @@ void source::handle_invite(void *endpoint, aoo_replyfn fn,
             e.sink.id = id;
             e.sink.flags = flags;
             eventqueue_.write(e);
+            notify_events();
         }
     } else {
         LOG_VERBOSE("ignoring '" << AOO_MSG_INVITE << "' message: sink already added");
@@ -1409,6 +1796,7 @@ void source::handle_uninvite(void *endpoint, aoo_replyfn fn,
             // Use 'id' because we want the individual sink! ('sink.id' might be a wildcard)
             e.sink.id = id;
             eventqueue_.write(e);
+            notify_events();
         }
     } else {
         LOG_VERBOSE("ignoring '" << AOO_MSG_UNINVITE << "' message: sink not found");
@@ -1448,6 +1836,7 @@ void source::handle_ping(void *endpoint, aoo_replyfn fn,
             e.ping.tt3 = aoo_osctime_get(); // use real system time
         #endif
             eventqueue_.write(e);
+            notify_events();
         }
     } else {
         LOG_VERBOSE("ignoring '" << AOO_MSG_PING << "' message: sink not found");
@@ -1526,6 +1915,7 @@ void source::handle_codec_change(void *endpoint, aoo_replyfn fn,
             // Use 'id' because we want the individual sink! ('sink.id' might be a wildcard)
             e.sink.id = id;
             eventqueue_.write(e);
+            notify_events();
         }
     } else {
         LOG_VERBOSE("ignoring '" << AOO_CHANGECODEC_EVENT << "' message: sink not found");
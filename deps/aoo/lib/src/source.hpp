@@ -29,6 +29,8 @@ struct endpoint {
     
     // methods
     void send_data(int32_t src, int32_t salt, const data_packet& data) const;
+    void send_data(int32_t src, int32_t salt, const data_packet& data,
+                   const data_message_header& header) const;
     void send_data_compact(int32_t src, int32_t salt, const data_packet& data, bool sendrate=false);
 
     void send_format(int32_t src, int32_t salt, const aoo_format& f,
@@ -36,6 +38,9 @@ struct endpoint {
 
     void send_ping(int32_t src, time_tag t) const;
 
+    void send_parity(int32_t src, int32_t salt, int32_t first, int32_t count,
+                     int32_t sizexor, const char *data, int32_t size) const;
+
     void send(const char *data, int32_t n) const {
         fn(user, data, n);
     }
@@ -68,12 +73,15 @@ struct invite_request : endpoint {
 
 struct sink_desc : endpoint {
     sink_desc(void *_user, aoo_replyfn _fn, int32_t _id)
-        : endpoint(_user, _fn, _id), channel(0), format_changed(true), protocol_flags(0) {}
+        : endpoint(_user, _fn, _id), channel(0), format_changed(true), protocol_flags(0) {
+        data_header.init(_id);
+    }
     sink_desc(const sink_desc& other)
         : endpoint(other.user, other.fn, other.id),
           channel(other.channel.load()),
           format_changed(other.format_changed.load()),
-          protocol_flags(other.protocol_flags.load()){}
+          protocol_flags(other.protocol_flags.load()),
+          data_header(other.data_header){}
     sink_desc& operator=(const sink_desc& other){
         user = other.user;
         fn = other.fn;
@@ -81,6 +89,7 @@ struct sink_desc : endpoint {
         channel = other.channel.load();
         format_changed = other.format_changed.load();
         protocol_flags = other.protocol_flags.load();
+        data_header = other.data_header;
         return *this;
     }
 
@@ -88,7 +97,65 @@ struct sink_desc : endpoint {
     std::atomic<int16_t> channel;
     std::atomic<bool> format_changed;
     std::atomic<int8_t> protocol_flags;
+    data_message_header data_header;
+
+};
+
+class source;
+
+// An encoder which is shared by all sources of the same encode group
+// with the same format. Every block is only encoded once, and every
+// member sends the output of one continuous encoder stream, so this also
+// works for stateful codecs. A member whose input differs from the rest
+// of the group leaves and continues with a copy of the shared encoder state.
+class shared_encoder {
+public:
+    // get the shared encoder for the group and format, or create a new one.
+    // returns nullptr if the codec doesn't support copying its state.
+    static std::shared_ptr<shared_encoder> get(int32_t group, const encoder& enc,
+                                               const std::vector<char>& formatkey);
+
+    shared_encoder(int32_t group, std::unique_ptr<encoder> enc)
+        : group_(group), encoder_(std::move(enc)) {}
+
+    int32_t group() const { return group_; }
+
+    // join at the start of a stream. 'gen' receives the generation
+    // we continue from. returns false if we can't join right now.
+    bool join(const aoo_sample *data, int32_t n, uint64_t hash, int64_t& gen);
+
+    // encode the block after 'gen' or copy it if another member has
+    // already encoded it. returns the number of bytes or -1 if our input
+    // differs from the group's.
+    int32_t encode(int64_t& gen, const aoo_sample *data, int32_t n, uint64_t hash,
+                   char *buf, int32_t size);
+
+    // leave the group. if 'enc' is not null, it receives the encoder state
+    // after block 'gen'; returns false if that state isn't available anymore.
+    bool leave(int64_t gen, encoder *enc);
+
+    static uint64_t hash(const aoo_sample *data, int32_t n);
+private:
+    struct entry {
+        int64_t gen = 0;
+        uint64_t hash = 0;
+        std::vector<aoo_sample> input;
+        std::vector<char> output;
+        std::unique_ptr<encoder> before; // encoder state before this block
+        bool hasbefore = false;
+    };
+    const int32_t group_;
+    std::unique_ptr<encoder> encoder_;
+    std::array<entry, AOO_SHARED_ENCODER_HISTORY> entries_;
+    int64_t latest_ = 0; // generation of the last encoded block
+    int32_t members_ = 0;
+    std::mutex mutex_;
 
+    entry& get_entry(int64_t gen) {
+        return entries_[gen % AOO_SHARED_ENCODER_HISTORY];
+    }
+    bool matches(const entry& e, int64_t gen, const aoo_sample *data,
+                 int32_t n, uint64_t hash) const;
 };
 
 class source final : public isource {
@@ -145,9 +212,16 @@ class source final : public isource {
     int32_t samplerate_ = 0;
     // audio encoder
     std::unique_ptr<encoder> encoder_;
+    std::vector<char> formatkey_; // for the shared encoder
+    std::shared_ptr<shared_encoder> shared_encoder_;
+    int64_t shared_gen_ = 0;
+    bool shared_joinable_ = true; // until the end of the stream
     // state
     int32_t sequence_ = 0;
     std::atomic<int32_t> dropped_{0};
+    std::atomic<int32_t> skipped_{0}; // blocks process() couldn't take the lock for
+    std::vector<char> lastblock_; // previous encoded block, for repeating skipped ones
+    double lastsamplerate_ = 0;
     std::atomic<float> lastpingtime_{0};
     std::atomic<bool> format_changed_{false};
     std::atomic<bool> play_{false};
@@ -163,6 +237,12 @@ class source final : public isource {
     lockfree::queue<endpoint> formatrequestqueue_;
     lockfree::queue<data_request> datarequestqueue_;
     history_buffer history_;
+    // parity FEC accumulator
+    std::vector<char> paritybuffer_;
+    std::vector<char> paritysendbuffer_; // completed group, owned by send_data()
+    int32_t parityfirst_ = 0;
+    int32_t paritycount_ = 0;
+    int32_t paritysizexor_ = 0;
     // sinks
     std::vector<sink_desc> sinks_;
     // thread synchronization
@@ -173,7 +253,11 @@ class source final : public isource {
     std::atomic<int32_t> packetsize_{ AOO_PACKETSIZE };
     std::atomic<int32_t> resend_buffersize_{ AOO_RESEND_BUFSIZE };
     std::atomic<int32_t> redundancy_{ AOO_SEND_REDUNDANCY };
+    std::atomic<int32_t> parity_{ AOO_SEND_PARITY };
+    std::atomic<int32_t> encode_group_{ 0 };
+    aoo_event_notify notify_{ nullptr, nullptr }; // set before use
     std::atomic<int32_t> dynamic_resampling_{ 1 };
+    std::atomic<int32_t> resample_quality_{ AOO_RESAMPLE_QUALITY };
     std::atomic<float> bandwidth_{ AOO_TIMEFILTER_BANDWIDTH };
     std::atomic<float> ping_interval_{ AOO_PING_INTERVAL * 0.001 };
     std::atomic<int32_t> protocol_flags_{ 0 };
@@ -194,14 +278,26 @@ class source final : public isource {
 
     int32_t make_salt();
 
+    void notify_events() const {
+        if (notify_.fn) notify_.fn(notify_.user);
+    }
+
     void update();
 
     void update_historybuffer();
 
+    void update_formatkey();
+
+    int32_t encode(const aoo_sample *data, int32_t n, char *buf, int32_t size);
+
+    void leave_shared_encoder(bool keepstate);
+
     bool send_format();
 
     bool send_data();
 
+    bool add_parity(int32_t seq, const char *data, int32_t size, int32_t groupsize);
+
     bool resend_data();
 
     bool send_ping();
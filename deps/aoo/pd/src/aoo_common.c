@@ -251,6 +251,7 @@ int aoo_format_parse(void *x, aoo_format_storage *f, int argc, t_atom *argv)
     else if (codec == gensym(AOO_CODEC_OPUS)){
         aoo_format_opus *fmt = (aoo_format_opus *)f;
         fmt->header.codec = AOO_CODEC_OPUS;
+        fmt->packet_loss = 0; // no in-band FEC
         // bitrate ("auto", "max" or float)
         if (argc > 3){
             if (argv[3].a_type == A_SYMBOL){
@@ -18,6 +18,11 @@ if ! cp ${BUILDDIR}/Standalone/sonobus  ${PREFIX}/bin/sonobus ; then
   exit 2
 fi
 
+if [ -f ../build/Source/server/sonobus-server ] ; then
+  cp ../build/Source/server/sonobus-server ${PREFIX}/bin/sonobus-server
+  echo "SonoBus connection server installed"
+fi
+
 mkdir -p ${PREFIX}/share/applications
 cp sonobus.desktop ${PREFIX}/share/applications/sonobus.desktop
 chmod +x ${PREFIX}/share/applications/sonobus.desktop
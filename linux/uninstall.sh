@@ -25,6 +25,8 @@ if [ -f ${PREFIX}/bin/sonobus ] ; then
   fi
 fi
 
+rm -f ${PREFIX}/bin/sonobus-server
+
 rm -f ${PREFIX}/share/applications/sonobus.desktop
 rm -f ${PREFIX}/pixmaps/sonobus.png
 